@@ -0,0 +1,208 @@
+/*
+ * Measures the rate at which connections can be handed from the server thread
+ * to a worker thread, comparing the per-connection pipe notification with the
+ * batched notification (eventfd where available) used by core.
+ */
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <cc_debug.h>
+#include <cc_event.h>
+#include <cc_option.h>
+#include <cc_ring_array.h>
+#include <channel/cc_pipe.h>
+#include <time/cc_timer.h>
+
+#define BATCH 64
+
+#define BENCHMARK_OPTION(ACTION)\
+    ACTION(nconn,   OPTION_TYPE_UINT, 1000000, "Total number of connections handed off")\
+    ACTION(burst,   OPTION_TYPE_UINT, 16,      "Connections accepted per burst")
+
+struct benchmark_options {
+    BENCHMARK_OPTION(OPTION_DECLARE)
+};
+
+enum handoff_mode {
+    HANDOFF_PIPE,    /* one pipe byte per connection, pop one at a time */
+    HANDOFF_BATCH,   /* one notification per burst, pop in batches */
+
+    MAX_HANDOFF_MODE
+};
+
+static const char *mode_names[MAX_HANDOFF_MODE] = {"pipe", "batch"};
+
+struct handoff {
+    enum handoff_mode mode;
+    uint64_t nconn;
+    uint64_t burst;
+    struct pipe_conn *pipe;
+    struct ring_array *arr;
+    uint64_t received; /* consumer only */
+};
+
+static void
+_consume_pipe(struct handoff *h)
+{
+    char buf[RING_ARRAY_DEFAULT_CAP];
+    uintptr_t c;
+    ssize_t i;
+
+    i = pipe_recv(h->pipe, buf, RING_ARRAY_DEFAULT_CAP);
+    for (; i > 0; --i) {
+        if (ring_array_pop(&c, h->arr) != CC_OK) {
+            break;
+        }
+        h->received++;
+    }
+}
+
+static void
+_consume_batch(struct handoff *h)
+{
+    uintptr_t c[BATCH];
+    uint32_t n;
+
+    pipe_drain(h->pipe);
+    while ((n = ring_array_pop_n(c, BATCH, h->arr)) > 0) {
+        h->received += n;
+    }
+}
+
+static void
+_consumer_event(void *arg, uint32_t events)
+{
+    struct handoff *h = arg;
+
+    if (events & EVENT_READ) {
+        if (h->mode == HANDOFF_PIPE) {
+            _consume_pipe(h);
+        } else {
+            _consume_batch(h);
+        }
+    }
+}
+
+static void *
+_consumer(void *arg)
+{
+    struct handoff *h = arg;
+    struct event_base *evb;
+
+    evb = event_base_create(1024, _consumer_event);
+    ASSERT(evb != NULL);
+    event_add_read(evb, pipe_read_id(h->pipe), h);
+
+    while (h->received < h->nconn) {
+        event_wait(evb, 10);
+    }
+
+    event_base_destroy(&evb);
+
+    return NULL;
+}
+
+static void
+_produce(struct handoff *h)
+{
+    uintptr_t c;
+    uint64_t i, j;
+
+    for (i = 0; i < h->nconn;) {
+        for (j = 0; j < h->burst && i < h->nconn; ++j) {
+            c = (uintptr_t)i + 1;
+            while (ring_array_push(&c, h->arr) != CC_OK) {
+                /* worker is backed up, wait for it to catch up */
+                if (h->mode == HANDOFF_BATCH) {
+                    pipe_notify(h->pipe);
+                }
+                sched_yield();
+            }
+            ++i;
+            if (h->mode == HANDOFF_PIPE) {
+                while (pipe_send(h->pipe, "", 1) != 1) {
+                    sched_yield();
+                }
+            }
+        }
+        if (h->mode == HANDOFF_BATCH) {
+            pipe_notify(h->pipe);
+        }
+    }
+}
+
+static struct duration
+benchmark_run(enum handoff_mode mode, uint64_t nconn, uint64_t burst)
+{
+    struct handoff h;
+    struct duration d;
+    pthread_t consumer;
+
+    h.mode = mode;
+    h.nconn = nconn;
+    h.burst = burst;
+    h.received = 0;
+    h.pipe = pipe_conn_create();
+    h.arr = ring_array_create(sizeof(uintptr_t), RING_ARRAY_DEFAULT_CAP);
+    ASSERT(h.pipe != NULL && h.arr != NULL);
+
+    if (mode == HANDOFF_PIPE) {
+        pipe_open(NULL, h.pipe);
+        pipe_set_nonblocking(h.pipe);
+    } else {
+        pipe_open_notify(NULL, h.pipe);
+    }
+
+    duration_start(&d);
+    pthread_create(&consumer, NULL, _consumer, &h);
+    _produce(&h);
+    pthread_join(consumer, NULL);
+    duration_stop(&d);
+
+    pipe_close(h.pipe);
+    pipe_conn_destroy(&h.pipe);
+    ring_array_destroy(&h.arr);
+
+    return d;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct benchmark_options opts = { BENCHMARK_OPTION(OPTION_INIT) };
+    unsigned nopts = OPTION_CARDINALITY(struct benchmark_options);
+    uint64_t nconn, burst;
+    struct duration d;
+    int mode;
+
+    option_load_default((struct option *)&opts, nopts);
+    if (argc > 1) {
+        FILE *fp = fopen(argv[1], "r");
+        if (fp == NULL) {
+            loga("failed to open the config file");
+            return -1;
+        }
+        option_load_file(fp, (struct option *)&opts, nopts);
+        fclose(fp);
+    }
+
+    nconn = option_uint(&opts.nconn);
+    burst = option_uint(&opts.burst);
+    if (nconn == 0 || burst == 0) {
+        loga("nconn and burst must be positive");
+        return -1;
+    }
+
+    for (mode = 0; mode < MAX_HANDOFF_MODE; ++mode) {
+        d = benchmark_run(mode, nconn, burst);
+        printf("%s handoff: %"PRIu64" conns in %f s, %f conns/sec\n",
+                mode_names[mode], nconn, duration_sec(&d),
+                nconn / duration_sec(&d));
+    }
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * Measures how long a file-backed slab pool takes to restart: the pool is
+ * filled, the slab module torn down and set up again, and the time until
+ * item_get finds a key is reported, once per number of recovery threads.
+ * With hash_datapool set, the hash index is kept in that data pool and is not
+ * rebuilt, so the number of recovery threads does not matter.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <storage/slab/item.h>
+#include <storage/slab/slab.h>
+#include <time/time.h>
+
+#include <cc_bstring.h>
+#include <cc_debug.h>
+#include <cc_option.h>
+#include <cc_print.h>
+#include <time/cc_timer.h>
+
+#define KEY_LEN 16
+
+#define BENCHMARK_OPTION(ACTION)\
+    ACTION(datapool,   OPTION_TYPE_STR,  "bench_restart.pool", "Path to the data pool file")\
+    ACTION(hash_datapool, OPTION_TYPE_STR, NULL,                "Path to the hash index data pool")\
+    ACTION(nentries,   OPTION_TYPE_UINT, 1000000,              "Number of items in the pool")\
+    ACTION(entry_size, OPTION_TYPE_UINT, 64,                   "Size of a value (byte)")\
+    ACTION(nthread,    OPTION_TYPE_UINT, 0,                    "Most recovery threads, 0: # CPUs")
+
+struct benchmark_options {
+    BENCHMARK_OPTION(OPTION_DECLARE)
+};
+
+static slab_options_st slab_opts = { SLAB_OPTION(OPTION_INIT) };
+static slab_metrics_st metrics = { SLAB_METRIC(METRIC_INIT) };
+
+static void
+_key(struct bstring *key, char *buf, uint64_t i)
+{
+    key->len = (uint32_t)cc_snprintf(buf, KEY_LEN + 1, "%0*"PRIu64, KEY_LEN,
+            i);
+    key->data = buf;
+}
+
+static void
+_fill(uint64_t nentries, uint64_t entry_size)
+{
+    char buf[KEY_LEN + 1];
+    struct bstring key, val;
+    struct item *it;
+    uint64_t i;
+
+    val.len = (uint32_t)entry_size;
+    val.data = malloc(entry_size);
+    ASSERT(val.data != NULL);
+    memset(val.data, 'v', entry_size);
+
+    for (i = 0; i < nentries; ++i) {
+        _key(&key, buf, i);
+        if (item_reserve(&it, &key, &val, val.len, 0, INT32_MAX) != ITEM_OK) {
+            loga("pool is full after %"PRIu64" items", i);
+            break;
+        }
+        item_insert(it, &key);
+    }
+
+    free(val.data);
+}
+
+static struct duration
+benchmark_run(uint32_t nthread, uint64_t nentries)
+{
+    char buf[KEY_LEN + 1];
+    struct bstring key;
+    struct duration d;
+
+    slab_teardown();
+    metric_reset((struct metric *)&metrics, METRIC_CARDINALITY(metrics));
+
+    slab_opts.slab_recovery_nthread.val.vuint = nthread;
+    _key(&key, buf, nentries / 2);
+
+    duration_start(&d);
+    slab_setup(&slab_opts, &metrics);
+    if (item_get(&key) == NULL) {
+        loga("key %.*s not found after restart", key.len, key.data);
+    }
+    duration_stop(&d);
+
+    return d;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct benchmark_options opts = { BENCHMARK_OPTION(OPTION_INIT) };
+    unsigned nopts = OPTION_CARDINALITY(struct benchmark_options);
+    uint64_t nentries, entry_size;
+    uint32_t nthread, n;
+    struct duration d;
+    char *path, *hash_path;
+
+    option_load_default((struct option *)&opts, nopts);
+    if (argc > 1) {
+        FILE *fp = fopen(argv[1], "r");
+        if (fp == NULL) {
+            loga("failed to open the config file");
+            return -1;
+        }
+        option_load_file(fp, (struct option *)&opts, nopts);
+        fclose(fp);
+    }
+
+    path = option_str(&opts.datapool);
+    hash_path = option_str(&opts.hash_datapool);
+    nentries = option_uint(&opts.nentries);
+    entry_size = option_uint(&opts.entry_size);
+    nthread = option_uint(&opts.nthread);
+    if (nthread == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthread = ncpu > 0 ? (uint32_t)ncpu : 1;
+    }
+    if (path == NULL || nentries == 0) {
+        loga("datapool and nentries must be set");
+        return -1;
+    }
+
+    option_load_default((struct option *)&slab_opts,
+            OPTION_CARDINALITY(slab_options_st));
+    slab_opts.slab_datapool.val.vstr = path;
+    slab_opts.slab_hash_datapool.val.vstr = hash_path;
+    slab_opts.slab_item_min.val.vuint =
+        ITEM_HDR_SIZE + ITEM_CAS_SIZE + KEY_LEN + entry_size;
+    slab_opts.slab_mem.val.vuint = CC_ALIGN(
+        slab_opts.slab_item_min.val.vuint * nentries * 5 / 4, SLAB_SIZE);
+
+    unlink(path);
+    if (hash_path != NULL) {
+        unlink(hash_path);
+        /* size the index for all items, so that it stays in its data pool */
+        slab_opts.slab_hash_power.val.vuint = 64 - __builtin_clzll(nentries * 2);
+    }
+    time_update();
+    slab_setup(&slab_opts, &metrics);
+    _fill(nentries, entry_size);
+
+    /* 1, 2, 4, ... threads, and nthread last */
+    for (n = 1;; n = MIN(n * 2, nthread)) {
+        d = benchmark_run(n, nentries);
+        printf("%"PRIu32" recovery thread(s): %"PRIu64" items served after "
+                "%f ms\n", n, (uint64_t)metrics.item_linked_curr.gauge,
+                duration_ms(&d));
+        if (n == nthread) {
+            break;
+        }
+    }
+
+    slab_teardown();
+    unlink(path);
+    if (hash_path != NULL) {
+        unlink(hash_path);
+    }
+
+    return 0;
+}
@@ -29,6 +29,7 @@ static __thread unsigned int rseed = 1234; /* XXX: make this an option */
     ACTION(pct_get,         OPTION_TYPE_UINT, 80,    "% of gets")\
     ACTION(pct_put,         OPTION_TYPE_UINT, 10,    "% of puts")\
     ACTION(pct_rem,         OPTION_TYPE_UINT, 10,    "% of removes")\
+    ACTION(pct_scan,        OPTION_TYPE_UINT, 0,     "% of gets for new keys (scan)")\
     ACTION(latency,         OPTION_TYPE_BOOL, true,  "Collect latency samples")
 
 #define O(b, opt) option_uint(&(b->options->benchmark.opt))
@@ -227,6 +228,58 @@ benchmark_run_operation(struct benchmark *b,
     return status;
 }
 
+/*
+ * Scan resistance: the cache is loaded with all entries, then gets are either
+ * for a random entry, or (pct_scan % of them) for a key never seen before, as
+ * in a scan. A get that misses is followed by a put of the same key, as a
+ * client filling the cache would do. Reports the hit rate of the entry gets.
+ */
+static struct duration
+benchmark_run_scan(struct benchmark *b)
+{
+    size_t nentries = O(b, nentries);
+    size_t nget = 0, nhit = 0;
+    benchmark_key_u scan_key = nentries;
+    struct benchmark_entry scan, *e;
+
+    bench_storage_init(b->options->engine, O(b, entry_max_size), nentries);
+
+    for (size_t i = 0; i < nentries; ++i) {
+        ASSERT(bench_storage_put(&b->entries[i]) == CC_OK);
+    }
+    scan = benchmark_entry_create(scan_key, O(b, entry_max_size));
+
+    struct duration d;
+    duration_start(&d);
+
+    for (size_t i = 0; i < O(b, nops); ++i) {
+        if (RRAND(0, 99) < O(b, pct_scan)) {
+            int ret = snprintf(scan.key, scan.key_size, "%zu", ++scan_key);
+            ASSERT(ret > 0 && (size_t)ret < scan.key_size);
+            e = &scan;
+        } else {
+            e = &b->entries[RRAND(0, nentries - 1)];
+            nget++;
+        }
+
+        if (benchmark_run_operation(b, e, BENCHMARK_GET) == CC_OK) {
+            nhit += (e != &scan);
+        } else if (benchmark_run_operation(b, e, BENCHMARK_PUT) != CC_OK) {
+            log_info("benchmark put() failed");
+        }
+    }
+
+    duration_stop(&d);
+
+    printf("hit rate of gets for loaded entries: %f\n",
+        nget > 0 ? (double)nhit / nget : 0.0);
+
+    benchmark_entry_destroy(&scan);
+    bench_storage_deinit();
+
+    return d;
+}
+
 static struct duration
 benchmark_run(struct benchmark *b)
 {
@@ -328,7 +381,8 @@ main(int argc, char *argv[])
 
     benchmark_entries_populate(&b);
 
-    struct duration d = benchmark_run(&b);
+    struct duration d = O((&b), pct_scan) > 0 ?
+        benchmark_run_scan(&b) : benchmark_run(&b);
 
     benchmark_print_summary(&b, &d);
 
@@ -50,6 +50,11 @@ bench_storage_put(struct benchmark_entry *e)
     bstring_set_cstr(&val, e->value);
     bstring_set_cstr(&key, e->key);
 
+    if (!item_admit(&key, val.len, 0)) {
+        item_delete(&key);
+        return CC_OK;
+    }
+
     item_rstatus_e status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
     if (status != ITEM_OK)
         return CC_ENOMEM;
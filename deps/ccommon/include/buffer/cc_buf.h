@@ -62,12 +62,35 @@ typedef struct {
     BUF_METRIC(METRIC_DECLARE)
 } buf_metrics_st;
 
+/*
+ * A buf can also hold references to memory it does not own, e.g. large values
+ * living in storage, which are sent in place (with writev) instead of being
+ * copied into the buffer. Each reference records how many buffered bytes
+ * precede it, so bytes and references go out in the order they were added.
+ *
+ * The owner must keep referenced memory valid until the reference is released
+ * with buf_ref_release (once sent) or buf_ref_reset (e.g. on error).
+ */
+#define BUF_NREF 16 /* max # of references held by a buf */
+
+struct buf_ref {
+    char              *data;    /* referenced data not yet sent */
+    void              *owner;   /* passed back to the release callback */
+    uint32_t          pre;      /* # buffered bytes sent before this ref */
+    uint32_t          len;      /* # referenced bytes not yet sent */
+};
+
+typedef void (*buf_ref_release_fn)(void *owner);
+
 struct buf {
     STAILQ_ENTRY(buf) next;     /* next buf in pool */
     char              *rpos;    /* read marker */
     char              *wpos;    /* write marker */
     char              *end;     /* end of buffer */
     bool              free;     /* is this buf free? */
+    uint8_t           nref;     /* # references held */
+    uint8_t           sref;     /* # references fully sent */
+    struct buf_ref    *ref;     /* allocated on first use */
     char              begin[1]; /* beginning of buffer */
 };
 
@@ -152,6 +175,7 @@ buf_reset(struct buf *buf)
     STAILQ_NEXT(buf, next) = NULL;
     buf->free = 0;
     buf->rpos = buf->wpos = buf->begin;
+    buf->nref = buf->sref = 0;
 }
 
 static inline uint32_t
@@ -214,6 +238,32 @@ buf_rshift(struct buf *buf)
     buf->wpos = buf->end;
 }
 
+/* # referenced bytes that have yet to be sent */
+static inline uint32_t
+buf_ref_rsize(const struct buf *buf)
+{
+    uint32_t i, len = 0;
+
+    for (i = buf->sref; i < buf->nref; ++i) {
+        len += buf->ref[i].len;
+    }
+
+    return len;
+}
+
+/* make room for one more reference, CC_ENOMEM if the buf cannot hold more */
+rstatus_i buf_ref_reserve(struct buf *buf);
+/* add a reference to len bytes at data after what has been written so far,
+ * room must have been reserved
+ */
+void buf_ref_append(struct buf *buf, char *data, uint32_t len, void *owner);
+/* mark count bytes as sent, consuming buffered and referenced data in order */
+void buf_ref_consume(struct buf *buf, uint32_t count);
+/* release references that have been fully sent */
+void buf_ref_release(struct buf *buf, buf_ref_release_fn release);
+/* release all references, sent or not */
+void buf_ref_reset(struct buf *buf, buf_ref_release_fn release);
+
 #ifdef __cplusplus
 }
 #endif
@@ -23,6 +23,7 @@ extern "C" {
 
 #include <cc_define.h>
 #include <cc_metric.h>
+#include <cc_option.h>
 
 #include <inttypes.h>
 
@@ -30,12 +31,26 @@ extern "C" {
 #define EVENT_WRITE 0x00ff00
 #define EVENT_ERR   0xff0000
 
+#define EVENT_IO_URING false
+
+/* io_uring is only available on linux, and if built with HAVE_IO_URING=ON;
+ * it replaces epoll for readiness only, recv/send are unchanged
+ */
+/*          name                type                default         description */
+#define EVENT_OPTION(ACTION)                                                              \
+    ACTION( event_io_uring,     OPTION_TYPE_BOOL,   EVENT_IO_URING, "use io_uring backend" )
+
+typedef struct {
+    EVENT_OPTION(OPTION_DECLARE)
+} event_options_st;
+
 /*          name                type            description */
 #define EVENT_METRIC(ACTION)                                            \
     ACTION( event_total,        METRIC_COUNTER, "# events returned"    )\
     ACTION( event_loop,         METRIC_COUNTER, "# event loop returns" )\
     ACTION( event_read,         METRIC_COUNTER, "# reads registered"   )\
-    ACTION( event_write,        METRIC_COUNTER, "# writes registered"  )
+    ACTION( event_write,        METRIC_COUNTER, "# writes registered"  )\
+    ACTION( event_uring,        METRIC_GAUGE,   "# event bases on io_uring")
 
 typedef struct {
     EVENT_METRIC(METRIC_DECLARE)
@@ -45,7 +60,7 @@ typedef void (*event_cb_fn)(void *, uint32_t);  /* event callback */
 
 struct event_base;
 
-void event_setup(event_metrics_st *metrics);
+void event_setup(event_options_st *options, event_metrics_st *metrics);
 void event_teardown(void);
 
 /* event base */
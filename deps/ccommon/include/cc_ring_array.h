@@ -22,6 +22,11 @@
  * thread does all of the popping. Given these conditions are met, the ring
  * array can guarantee that all pushes and pops will be valid and leave the
  * array in a valid state.
+ *
+ * Positions are published with release semantics and read with acquire
+ * semantics, so element contents are visible to the other side once the
+ * position update is. Read and write positions live on separate cache lines
+ * so the producer and the consumer do not falsely share them.
  */
 
 #pragma once
@@ -37,12 +42,15 @@ extern "C" {
 #include <stdint.h>
 
 #define RING_ARRAY_DEFAULT_CAP 1024
+#define RING_ARRAY_CACHE_LINE  64
 
 struct ring_array {
     size_t      elem_size;         /* element size */
     uint32_t    cap;               /* total capacity */
     uint32_t    rpos;              /* read offset */
+    uint8_t     _rpad[RING_ARRAY_CACHE_LINE];
     uint32_t    wpos;              /* write offset */
+    uint8_t     _wpad[RING_ARRAY_CACHE_LINE - sizeof(uint32_t)];
     union {
         size_t  pad;               /* using a size_t member to force alignment at
                                       native word boundary */
@@ -57,6 +65,10 @@ struct ring_array {
 /* push an element into the array */
 rstatus_i ring_array_push(const void *elem, struct ring_array *arr);
 
+/* push up to n elements stored contiguously at elems, returns # pushed */
+uint32_t ring_array_push_n(const void *elems, uint32_t n,
+        struct ring_array *arr);
+
 /* check if array is full */
 bool ring_array_full(const struct ring_array *arr);
 
@@ -68,6 +80,9 @@ bool ring_array_full(const struct ring_array *arr);
 /* pop an element from the array */
 rstatus_i ring_array_pop(void *elem, struct ring_array *arr);
 
+/* pop up to n elements into elems (discarded if NULL), returns # popped */
+uint32_t ring_array_pop_n(void *elems, uint32_t n, struct ring_array *arr);
+
 /* check if array is empty */
 bool ring_array_empty(const struct ring_array *arr);
 
@@ -125,6 +125,15 @@ static inline ch_id_i pipe_write_id(struct pipe_conn *c)
     return c->fd[1];
 }
 
+/* notification: any number of pipe_notify() calls made before the reader calls
+ * pipe_drain() result in a single read event. An eventfd is used if available,
+ * in which case pipe_read_id() and pipe_write_id() are the same descriptor;
+ * otherwise this falls back to a regular pipe. Both ends are nonblocking.
+ */
+bool pipe_open_notify(void *addr, struct pipe_conn *c);
+rstatus_i pipe_notify(struct pipe_conn *c);
+rstatus_i pipe_drain(struct pipe_conn *c);
+
 /* set pipe flags */
 void pipe_set_blocking(struct pipe_conn *c);
 void pipe_set_nonblocking(struct pipe_conn *c);
@@ -121,6 +121,7 @@ static inline ch_id_i tcp_write_id(struct tcp_conn *c)
 /* basic channel maintenance */
 bool tcp_connect(struct addrinfo *ai, struct tcp_conn *c);  /* channel_open_fn, client */
 bool tcp_listen(struct addrinfo *ai, struct tcp_conn *c);   /* channel_open_fn, server */
+bool tcp_listen_reuseport(struct addrinfo *ai, struct tcp_conn *c); /* channel_open_fn */
 void tcp_close(struct tcp_conn *c);                         /* channel_perm_fn */
 ssize_t tcp_recv(struct tcp_conn *c, void *buf, size_t nbyte); /* channel_recv_fn */
 ssize_t tcp_send(struct tcp_conn *c, void *buf, size_t nbyte); /* channel_send_fn */
@@ -135,6 +136,7 @@ void tcp_reject_all(struct tcp_conn *sc);                   /* channel_reject_fn
 int tcp_set_blocking(int sd);
 int tcp_set_nonblocking(int sd);
 int tcp_set_reuseaddr(int sd);
+int tcp_set_reuseport(int sd);
 int tcp_set_tcpnodelay(int sd);
 int tcp_set_keepalive(int sd);
 int tcp_set_linger(int sd, int timeout);
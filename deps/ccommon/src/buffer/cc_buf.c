@@ -138,6 +138,7 @@ buf_create(void)
     }
 
     buf->end = (char *)buf + buf_init_size;
+    buf->ref = NULL;
     buf_reset(buf);
     INCR(buf_metrics, buf_create);
     INCR(buf_metrics, buf_curr);
@@ -160,6 +161,8 @@ buf_destroy(struct buf **buf)
     cap = buf_size(*buf);
     log_verb("destroy buf %p size %"PRIu32, *buf, cap);
 
+    ASSERT((*buf)->nref == 0);
+    cc_free((*buf)->ref);
     cc_free(*buf);
     *buf = NULL;
     INCR(buf_metrics, buf_destroy);
@@ -167,6 +170,102 @@ buf_destroy(struct buf **buf)
     DECR_N(buf_metrics, buf_memory, cap);
 }
 
+rstatus_i
+buf_ref_reserve(struct buf *buf)
+{
+    if (buf->ref == NULL) {
+        buf->ref = cc_alloc(BUF_NREF * sizeof(struct buf_ref));
+        if (buf->ref == NULL) {
+            log_info("buf ref allocation failed due to OOM");
+            return CC_ENOMEM;
+        }
+    }
+
+    return buf->nref < BUF_NREF ? CC_OK : CC_ENOMEM;
+}
+
+void
+buf_ref_append(struct buf *buf, char *data, uint32_t len, void *owner)
+{
+    struct buf_ref *ref;
+    uint32_t i, pre = buf_rsize(buf);
+
+    ASSERT(buf->ref != NULL && buf->nref < BUF_NREF);
+    ASSERT(data != NULL && len > 0);
+
+    /* buffered bytes already placed before earlier (unsent) references */
+    for (i = buf->sref; i < buf->nref; ++i) {
+        pre -= buf->ref[i].pre;
+    }
+
+    ref = &buf->ref[buf->nref++];
+    ref->data = data;
+    ref->owner = owner;
+    ref->pre = pre;
+    ref->len = len;
+
+    log_verb("buf %p references %"PRIu32" bytes at %p after %"PRIu32" bytes",
+            buf, len, data, pre);
+}
+
+void
+buf_ref_consume(struct buf *buf, uint32_t count)
+{
+    struct buf_ref *ref;
+    uint32_t n;
+
+    while (count > 0 && buf->sref < buf->nref) {
+        ref = &buf->ref[buf->sref];
+
+        n = MIN(count, ref->pre);
+        buf->rpos += n;
+        ref->pre -= n;
+        count -= n;
+
+        n = MIN(count, ref->len);
+        ref->data += n;
+        ref->len -= n;
+        count -= n;
+
+        if (ref->len > 0) {
+            return;
+        }
+        buf->sref++;
+    }
+
+    ASSERT(count <= buf_rsize(buf));
+    buf->rpos += count;
+}
+
+void
+buf_ref_release(struct buf *buf, buf_ref_release_fn release)
+{
+    uint8_t i;
+
+    if (buf->sref == 0) {
+        return;
+    }
+
+    for (i = 0; i < buf->sref; ++i) {
+        release(buf->ref[i].owner);
+    }
+    buf->nref -= buf->sref;
+    cc_memmove(buf->ref, buf->ref + buf->sref,
+            buf->nref * sizeof(struct buf_ref));
+    buf->sref = 0;
+}
+
+void
+buf_ref_reset(struct buf *buf, buf_ref_release_fn release)
+{
+    uint8_t i;
+
+    for (i = 0; i < buf->nref; ++i) {
+        release(buf->ref[i].owner);
+    }
+    buf->nref = buf->sref = 0;
+}
+
 void
 buf_setup(buf_options_st *options, buf_metrics_st *metrics)
 {
@@ -30,7 +30,9 @@
  *
  * Each ring array should have exactly one reader and exactly one writer, as
  * far as threads are concerned (which can be the same). This allows the use of
- * atomic instructions to replace locks.
+ * atomic instructions to replace locks. Each side stores its own position with
+ * release order after touching the slots, and loads the other side's position
+ * with acquire order before touching the slots.
  *
  * We use an extra slot to differentiate full from empty.
  *
@@ -80,23 +82,70 @@ ring_array_nelem(uint32_t rpos, uint32_t wpos, uint32_t cap)
     }
 }
 
+static inline uint32_t
+ring_array_min(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
+/* copy n elements between buf and the slots starting at pos, with wrap-around */
+static inline void
+ring_array_copy_in(struct ring_array *arr, uint32_t pos, const uint8_t *buf,
+        uint32_t n)
+{
+    uint32_t n1 = ring_array_min(n, arr->cap + 1 - pos);
+
+    cc_memcpy(arr->data + arr->elem_size * pos, buf, arr->elem_size * n1);
+    if (n > n1) {
+        cc_memcpy(arr->data, buf + arr->elem_size * n1,
+                arr->elem_size * (n - n1));
+    }
+}
+
+static inline void
+ring_array_copy_out(const struct ring_array *arr, uint32_t pos, uint8_t *buf,
+        uint32_t n)
+{
+    uint32_t n1 = ring_array_min(n, arr->cap + 1 - pos);
+
+    cc_memcpy(buf, arr->data + arr->elem_size * pos, arr->elem_size * n1);
+    if (n > n1) {
+        cc_memcpy(buf + arr->elem_size * n1, arr->data,
+                arr->elem_size * (n - n1));
+    }
+}
+
 rstatus_i
 ring_array_push(const void *elem, struct ring_array *arr)
 {
-    uint32_t new_wpos;
-
-    if (ring_array_full(arr)) {
+    if (ring_array_push_n(elem, 1, arr) == 0) {
         log_debug("Could not push to ring array %p; array is full", arr);
         return CC_ERROR;
     }
 
-    cc_memcpy(arr->data + (arr->elem_size * arr->wpos), elem, arr->elem_size);
+    return CC_OK;
+}
 
-    /* update wpos atomically */
-    new_wpos = (arr->wpos + 1) % (arr->cap + 1);
-    __atomic_store_n(&(arr->wpos), new_wpos, __ATOMIC_RELAXED);
+uint32_t
+ring_array_push_n(const void *elems, uint32_t n, struct ring_array *arr)
+{
+    uint32_t rpos, nfree;
+
+    /* snapshot rpos, the consumer may be popping concurrently */
+    rpos = __atomic_load_n(&(arr->rpos), __ATOMIC_ACQUIRE);
+    nfree = arr->cap - ring_array_nelem(rpos, arr->wpos, arr->cap);
+    n = ring_array_min(n, nfree);
+    if (n == 0) {
+        return 0;
+    }
 
-    return CC_OK;
+    ring_array_copy_in(arr, arr->wpos, elems, n);
+
+    /* publish all n elements with one update of wpos */
+    __atomic_store_n(&(arr->wpos), (arr->wpos + n) % (arr->cap + 1),
+            __ATOMIC_RELEASE);
+
+    return n;
 }
 
 bool
@@ -108,44 +157,57 @@ ring_array_full(const struct ring_array *arr)
      * only pops and does not push; in other words, only one thread updates
      * either rpos or wpos.
      */
-    uint32_t rpos = __atomic_load_n(&(arr->rpos), __ATOMIC_RELAXED);
+    uint32_t rpos = __atomic_load_n(&(arr->rpos), __ATOMIC_ACQUIRE);
     return ring_array_nelem(rpos, arr->wpos, arr->cap) == arr->cap;
 }
 
 rstatus_i
 ring_array_pop(void *elem, struct ring_array *arr)
 {
-    uint32_t new_rpos;
-
-    if (ring_array_empty(arr)) {
+    if (ring_array_pop_n(elem, 1, arr) == 0) {
         log_debug("Could not pop from ring array %p; array is empty", arr);
         return CC_ERROR;
     }
 
-    if (elem != NULL) {
-        cc_memcpy(elem, arr->data + (arr->elem_size * arr->rpos), arr->elem_size);
+    return CC_OK;
+}
+
+uint32_t
+ring_array_pop_n(void *elems, uint32_t n, struct ring_array *arr)
+{
+    uint32_t wpos;
+
+    /* snapshot wpos, the producer may be pushing concurrently */
+    wpos = __atomic_load_n(&(arr->wpos), __ATOMIC_ACQUIRE);
+    n = ring_array_min(n, ring_array_nelem(arr->rpos, wpos, arr->cap));
+    if (n == 0) {
+        return 0;
     }
 
-    /* update rpos atomically */
-    new_rpos = (arr->rpos + 1) % (arr->cap + 1);
-    __atomic_store_n(&(arr->rpos), new_rpos, __ATOMIC_RELAXED);
+    if (elems != NULL) {
+        ring_array_copy_out(arr, arr->rpos, elems, n);
+    }
 
-    return CC_OK;
+    /* release all n slots to the producer with one update of rpos */
+    __atomic_store_n(&(arr->rpos), (arr->rpos + n) % (arr->cap + 1),
+            __ATOMIC_RELEASE);
+
+    return n;
 }
 
 bool
 ring_array_empty(const struct ring_array *arr)
 {
     /* take snapshot of wpos, since another thread might be pushing */
-    uint32_t wpos = __atomic_load_n(&(arr->wpos), __ATOMIC_RELAXED);
+    uint32_t wpos = __atomic_load_n(&(arr->wpos), __ATOMIC_ACQUIRE);
     return ring_array_nelem(arr->rpos, wpos, arr->cap) == 0;
 }
 
 void
 ring_array_flush(struct ring_array *arr)
 {
-    uint32_t wpos = __atomic_load_n(&(arr->wpos), __ATOMIC_RELAXED);
-    __atomic_store_n(&(arr->rpos), wpos, __ATOMIC_RELAXED);
+    uint32_t wpos = __atomic_load_n(&(arr->wpos), __ATOMIC_ACQUIRE);
+    __atomic_store_n(&(arr->rpos), wpos, __ATOMIC_RELEASE);
 }
 
 struct ring_array *
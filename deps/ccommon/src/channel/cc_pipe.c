@@ -25,6 +25,9 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -211,7 +214,7 @@ pipe_close(struct pipe_conn *c)
         close(c->fd[0]);
     }
 
-    if (c->fd[1] >= 0) {
+    if (c->fd[1] >= 0 && c->fd[1] != c->fd[0]) { /* not an eventfd */
         close(c->fd[1]);
     }
 
@@ -314,6 +317,112 @@ ssize_t pipe_send(struct pipe_conn *c, void *buf, size_t nbyte)
     return CC_ERROR;
 }
 
+bool
+pipe_open_notify(void *addr, struct pipe_conn *c)
+{
+    ASSERT(addr == NULL);
+    ASSERT(c != NULL);
+
+#ifdef HAVE_EVENTFD
+    int fd = eventfd(0, EFD_NONBLOCK);
+
+    if (fd < 0) {
+        log_error("eventfd() for conn %p failed: %s", c, strerror(errno));
+        c->err = errno;
+        INCR(pipe_metrics, pipe_open_ex);
+
+        return false;
+    }
+
+    c->fd[0] = c->fd[1] = fd;
+    c->state = CHANNEL_LISTEN;
+    INCR(pipe_metrics, pipe_open);
+#else
+    if (!pipe_open(NULL, c)) {
+        return false;
+    }
+    pipe_set_nonblocking(c);
+#endif
+
+    return true;
+}
+
+rstatus_i
+pipe_notify(struct pipe_conn *c)
+{
+#ifdef HAVE_EVENTFD
+    uint64_t val = 1;
+#else
+    uint8_t val = 0;
+#endif
+    ssize_t n;
+
+    ASSERT(c != NULL);
+
+    do {
+        n = write(c->fd[1], &val, sizeof(val));
+        INCR(pipe_metrics, pipe_send);
+    } while (n < 0 && errno == EINTR);
+
+    if (n == sizeof(val)) {
+        INCR_N(pipe_metrics, pipe_send_byte, n);
+        return CC_OK;
+    }
+
+    /* a full pipe (or counter) means the reader has a wakeup pending */
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return CC_OK;
+    }
+
+    INCR(pipe_metrics, pipe_send_ex);
+    c->err = errno;
+    log_error("notify on pipe fd %d failed: %s", c->fd[1], strerror(errno));
+
+    return CC_ERROR;
+}
+
+rstatus_i
+pipe_drain(struct pipe_conn *c)
+{
+    /* one read consumes the eventfd counter, a pipe may take several */
+#ifdef HAVE_EVENTFD
+    uint64_t buf[1];
+#else
+    uint8_t buf[64];
+#endif
+    ssize_t n;
+
+    ASSERT(c != NULL);
+
+    for (;;) {
+        n = read(c->fd[0], buf, sizeof(buf));
+        INCR(pipe_metrics, pipe_recv);
+
+        if (n > 0) {
+            INCR_N(pipe_metrics, pipe_recv_byte, n);
+#ifdef HAVE_EVENTFD
+            return CC_OK;
+#else
+            continue;
+#endif
+        }
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return CC_OK;
+        }
+
+        INCR(pipe_metrics, pipe_recv_ex);
+        c->err = (n == 0) ? 0 : errno;
+        log_error("drain on pipe fd %d failed: %s", c->fd[0],
+                n == 0 ? "eof" : strerror(errno));
+
+        return CC_ERROR;
+    }
+}
+
 static void
 _pipe_set_blocking(int fd)
 {
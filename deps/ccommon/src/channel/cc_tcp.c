@@ -244,8 +244,8 @@ error:
     return false;
 }
 
-bool
-tcp_listen(struct addrinfo *ai, struct tcp_conn *c)
+static bool
+_tcp_listen(struct addrinfo *ai, struct tcp_conn *c, bool reuseport)
 {
     int ret;
     int sd;
@@ -264,6 +264,14 @@ tcp_listen(struct addrinfo *ai, struct tcp_conn *c)
         goto error;
     }
 
+    if (reuseport) {
+        ret = tcp_set_reuseport(sd);
+        if (ret < 0) {
+            log_error("reuse port of sd %d failed: %s", sd, strerror(errno));
+            goto error;
+        }
+    }
+
     ret = bind(sd, ai->ai_addr, ai->ai_addrlen);
     if (ret < 0) {
         log_error("bind on sd %d failed: %s", sd, strerror(errno));
@@ -296,6 +304,21 @@ error:
     return false;
 }
 
+bool
+tcp_listen(struct addrinfo *ai, struct tcp_conn *c)
+{
+    return _tcp_listen(ai, c, false);
+}
+
+/* multiple sockets can listen on the same address, kernel balances incoming
+ * connections among them
+ */
+bool
+tcp_listen_reuseport(struct addrinfo *ai, struct tcp_conn *c)
+{
+    return _tcp_listen(ai, c, true);
+}
+
 void
 tcp_close(struct tcp_conn *c)
 {
@@ -518,6 +541,23 @@ tcp_set_reuseaddr(int sd)
     return setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &reuse, len);
 }
 
+int
+tcp_set_reuseport(int sd)
+{
+#ifdef SO_REUSEPORT
+    int reuse;
+    socklen_t len;
+
+    reuse = 1;
+    len = sizeof(reuse);
+
+    return setsockopt(sd, SOL_SOCKET, SO_REUSEPORT, &reuse, len);
+#else
+    errno = ENOPROTOOPT;
+    return -1;
+#endif
+}
+
 /*
  * Disable Nagle algorithm on TCP socket.
  *
@@ -859,7 +899,7 @@ tcp_sendv(struct tcp_conn *c, struct array *bufv, size_t nbyte)
 
     for (;;) {
         n = writev(c->sd, (const struct iovec *)bufv->data, bufv->nelem);
-        INCR(tcp_metrics, tcp_send_ex);
+        INCR(tcp_metrics, tcp_send);
 
         log_verb("writev on sd %d %zd of %zu in %"PRIu32" buffers",
                   c->sd, n, nbyte, bufv->nelem);
@@ -17,6 +17,19 @@
 
 /* need the following to use EPOLLRDHUP
  * #define _GNU_SOURCE */
+#include <config.h>
+
+#ifdef HAVE_IO_URING
+/* the event API is provided by cc_io_uring.c, see cc_shared.h */
+# define event_base         epoll_base
+# define event_base_create  epoll_base_create
+# define event_base_destroy epoll_base_destroy
+# define event_add_read     epoll_base_add_read
+# define event_add_write    epoll_base_add_write
+# define event_del          epoll_base_del
+# define event_wait         epoll_base_wait
+#endif
+
 #include <cc_event.h>
 
 #include <cc_debug.h>
@@ -0,0 +1,588 @@
+/*
+ * ccommon - a cache common library.
+ * Copyright (C) 2020 Twitter, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * io_uring event backend.
+ *
+ * Readiness is tracked with one multishot poll request per fd, which stays
+ * armed across events: the kernel posts a completion whenever the fd becomes
+ * ready, with no request to re-submit after each callback. Unlike epoll_ctl,
+ * arming and removing polls only queues entries on the submission ring, which
+ * are handed to the kernel together with the wait in a single io_uring_enter
+ * per event loop.
+ *
+ * Multishot polls are edge-triggered: data (or connections) left unread by a
+ * callback is not reported again until more arrives, so read handlers must
+ * drain the fd, i.e. read or accept until it would block. A poll the kernel
+ * ends (no IORING_CQE_F_MORE) is re-armed after the callback, and if that
+ * fails the callback is called again with EVENT_ERR, so the owner closes the
+ * connection rather than waiting on it forever.
+ *
+ * Only readiness goes through the ring: recv and send are still made by the
+ * stream layer, one syscall each. A completion-based data path (multishot
+ * recv, send and registered buffers) needs buffers owned by the ring while
+ * requests are in flight, which buf_sock does not allow, and is not part of
+ * this backend.
+ *
+ * The ring is driven through raw syscalls, so liburing is not required. If
+ * io_uring is not enabled (event_io_uring option), or the kernel lacks the
+ * required features, the event base falls back to epoll.
+ */
+
+#include <cc_event.h>
+
+#include <cc_debug.h>
+#include <cc_define.h>
+#include <cc_mm.h>
+
+#include <endian.h>
+#include <inttypes.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cc_shared.h"
+
+#define URING_NFD        1024       /* initial size of the fd table */
+#define URING_REMOVE     UINT64_MAX /* user_data of poll removals, ignored */
+
+/* per fd state, the fd table is indexed by fd */
+struct uring_fd {
+    void                *data;      /* callback data */
+    uint32_t            gen;        /* generation, bumped on every delete */
+    uint32_t            poll;       /* POLLIN or POLLOUT, 0 if not added */
+    bool                armed;      /* a multishot poll is in flight */
+};
+
+struct event_base {
+    struct epoll_base   *ep;        /* fallback, NULL if io_uring is used */
+
+    int                 ring;       /* io_uring descriptor */
+    void                *rmap;      /* shared sq/cq ring mapping */
+    size_t              rmap_size;
+    struct io_uring_sqe *sqe;       /* sqe[] - submission queue entries */
+    size_t              sqe_size;
+
+    /* submission queue */
+    unsigned            *sq_head;
+    unsigned            *sq_tail;
+    unsigned            *sq_mask;
+    unsigned            *sq_array;
+    unsigned            sq_entries;
+
+    /* completion queue */
+    unsigned            *cq_head;
+    unsigned            *cq_tail;
+    unsigned            *cq_mask;
+    struct io_uring_cqe *cqe;
+
+    struct uring_fd     *fd;        /* fd[] - per fd state */
+    int                 nfd;        /* # fd table entries */
+
+    int                 nevent;     /* max # events per wait */
+    event_cb_fn         cb;         /* event callback */
+};
+
+static inline int
+_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int
+_uring_enter(int ring, unsigned to_submit, unsigned min_complete,
+        unsigned flags, void *arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, ring, to_submit, min_complete,
+            flags, arg, argsz);
+}
+
+static rstatus_i
+_uring_init(struct event_base *evb, int nevent)
+{
+    struct io_uring_params p;
+    uint8_t *rmap;
+
+    memset(&p, 0, sizeof(p));
+    evb->ring = _uring_setup((unsigned)nevent, &p);
+    if (evb->ring < 0) {
+        log_warn("io_uring setup failed: %s", strerror(errno));
+        return CC_ERROR;
+    }
+
+    /* single mmap for both rings and waiting with timeout (5.11+) */
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) ||
+            !(p.features & IORING_FEAT_EXT_ARG)) {
+        log_warn("io_uring on this kernel lacks required features");
+        goto error;
+    }
+
+    evb->rmap_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    if (evb->rmap_size < p.cq_off.cqes + p.cq_entries *
+            sizeof(struct io_uring_cqe)) {
+        evb->rmap_size = p.cq_off.cqes + p.cq_entries *
+            sizeof(struct io_uring_cqe);
+    }
+    evb->rmap = mmap(NULL, evb->rmap_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, evb->ring, IORING_OFF_SQ_RING);
+    if (evb->rmap == MAP_FAILED) {
+        log_warn("io_uring ring mmap failed: %s", strerror(errno));
+        evb->rmap = NULL;
+        goto error;
+    }
+
+    evb->sqe_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    evb->sqe = mmap(NULL, evb->sqe_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, evb->ring, IORING_OFF_SQES);
+    if (evb->sqe == MAP_FAILED) {
+        log_warn("io_uring sqe mmap failed: %s", strerror(errno));
+        evb->sqe = NULL;
+        goto error;
+    }
+
+    rmap = evb->rmap;
+    evb->sq_head = (unsigned *)(rmap + p.sq_off.head);
+    evb->sq_tail = (unsigned *)(rmap + p.sq_off.tail);
+    evb->sq_mask = (unsigned *)(rmap + p.sq_off.ring_mask);
+    evb->sq_array = (unsigned *)(rmap + p.sq_off.array);
+    evb->sq_entries = p.sq_entries;
+    evb->cq_head = (unsigned *)(rmap + p.cq_off.head);
+    evb->cq_tail = (unsigned *)(rmap + p.cq_off.tail);
+    evb->cq_mask = (unsigned *)(rmap + p.cq_off.ring_mask);
+    evb->cqe = (struct io_uring_cqe *)(rmap + p.cq_off.cqes);
+
+    evb->fd = cc_zalloc(URING_NFD * sizeof(struct uring_fd));
+    if (evb->fd == NULL) {
+        goto error;
+    }
+    evb->nfd = URING_NFD;
+
+    return CC_OK;
+
+error:
+    if (evb->sqe != NULL) {
+        munmap(evb->sqe, evb->sqe_size);
+        evb->sqe = NULL;
+    }
+    if (evb->rmap != NULL) {
+        munmap(evb->rmap, evb->rmap_size);
+        evb->rmap = NULL;
+    }
+    close(evb->ring);
+    evb->ring = -1;
+
+    return CC_ERROR;
+}
+
+struct event_base *
+event_base_create(int nevent, event_cb_fn cb)
+{
+    struct event_base *evb;
+
+    ASSERT(nevent > 0);
+
+    evb = (struct event_base *)cc_zalloc(sizeof(*evb));
+    if (evb == NULL) {
+        return NULL;
+    }
+
+    evb->ring = -1;
+    evb->nevent = nevent;
+    evb->cb = cb;
+
+    if (event_io_uring && _uring_init(evb, nevent) == CC_OK) {
+        INCR(event_metrics, event_uring);
+        log_info("io_uring fd %d with nevent %d", evb->ring, evb->nevent);
+
+        return evb;
+    }
+
+    if (event_io_uring) {
+        log_warn("io_uring unavailable, falling back to epoll");
+    }
+    evb->ep = epoll_base_create(nevent, cb);
+    if (evb->ep == NULL) {
+        cc_free(evb);
+        return NULL;
+    }
+
+    return evb;
+}
+
+void
+event_base_destroy(struct event_base **evb)
+{
+    struct event_base *e = *evb;
+
+    if (e == NULL) {
+        return;
+    }
+
+    if (e->ep != NULL) {
+        epoll_base_destroy(&e->ep);
+    } else {
+        DECR(event_metrics, event_uring);
+        cc_free(e->fd);
+        munmap(e->sqe, e->sqe_size);
+        munmap(e->rmap, e->rmap_size);
+        if (close(e->ring) < 0) {
+            log_warn("close io_uring fd %d failed, ignored: %s", e->ring,
+                    strerror(errno));
+        }
+    }
+
+    cc_free(e);
+
+    *evb = NULL;
+}
+
+/* submit queued entries, and wait for completions unless timeout is 0 */
+static int
+_uring_submit(struct event_base *evb, int timeout)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned nsubmit, flags = 0, wait = 0;
+    int status;
+
+    nsubmit = *evb->sq_tail - __atomic_load_n(evb->sq_head, __ATOMIC_ACQUIRE);
+    if (timeout != 0) {
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        if (timeout > 0) {
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * 1000000LL;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+        }
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        wait = 1;
+    } else if (nsubmit == 0) {
+        return 0;
+    }
+
+    status = _uring_enter(evb->ring, nsubmit, wait, flags, &arg, sizeof(arg));
+    if (status < 0 && errno != EINTR && errno != ETIME && errno != EAGAIN &&
+            errno != EBUSY) {
+        log_error("enter io_uring fd %d failed: %s", evb->ring,
+                strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static struct io_uring_sqe *
+_uring_get_sqe(struct event_base *evb)
+{
+    struct io_uring_sqe *sqe;
+    unsigned tail = *evb->sq_tail, idx;
+
+    if (tail - __atomic_load_n(evb->sq_head, __ATOMIC_ACQUIRE) ==
+            evb->sq_entries) {
+        /* submission queue is full, hand it to the kernel */
+        _uring_submit(evb, 0);
+        if (tail - __atomic_load_n(evb->sq_head, __ATOMIC_ACQUIRE) ==
+                evb->sq_entries) {
+            log_error("io_uring fd %d submission queue full", evb->ring);
+            return NULL;
+        }
+    }
+
+    idx = tail & *evb->sq_mask;
+    sqe = &evb->sqe[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    evb->sq_array[idx] = idx;
+
+    return sqe;
+}
+
+static inline void
+_uring_put_sqe(struct event_base *evb)
+{
+    __atomic_store_n(evb->sq_tail, *evb->sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t
+_uring_user_data(int fd, uint32_t gen)
+{
+    return ((uint64_t)gen << 32) | (uint32_t)fd;
+}
+
+static int
+_uring_arm(struct event_base *evb, int fd)
+{
+    struct uring_fd *f = &evb->fd[fd];
+    struct io_uring_sqe *sqe;
+    uint32_t poll = f->poll;
+
+    sqe = _uring_get_sqe(evb);
+    if (sqe == NULL) {
+        errno = EBUSY;
+        return -1;
+    }
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+    poll = (poll << 16) | (poll >> 16);
+#endif
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = poll;
+    sqe->user_data = _uring_user_data(fd, f->gen);
+    _uring_put_sqe(evb);
+
+    f->armed = true;
+
+    return 0;
+}
+
+static int
+_uring_add(struct event_base *evb, int fd, uint32_t poll, void *data)
+{
+    struct uring_fd *f;
+
+    if (fd >= evb->nfd) { /* grow fd table */
+        int nfd = evb->nfd;
+
+        while (nfd <= fd) {
+            nfd *= 2;
+        }
+        f = cc_realloc(evb->fd, nfd * sizeof(struct uring_fd));
+        if (f == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        memset(f + evb->nfd, 0, (nfd - evb->nfd) * sizeof(struct uring_fd));
+        evb->fd = f;
+        evb->nfd = nfd;
+    }
+
+    f = &evb->fd[fd];
+    if (f->poll != 0) {
+        errno = EEXIST;
+        return -1;
+    }
+
+    f->data = data;
+    f->poll = poll;
+    if (_uring_arm(evb, fd) < 0) {
+        f->data = NULL;
+        f->poll = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+event_add_read(struct event_base *evb, int fd, void *data)
+{
+    int status;
+
+    ASSERT(evb != NULL);
+    ASSERT(fd >= 0);
+
+    if (evb->ep != NULL) {
+        return epoll_base_add_read(evb->ep, fd, data);
+    }
+
+    status = _uring_add(evb, fd, POLLIN, data);
+    if (status < 0 && errno != EEXIST) {
+        log_error("add read w/ io_uring fd %d on fd %d failed: %s", evb->ring,
+                fd, strerror(errno));
+    }
+
+    INCR(event_metrics, event_read);
+    log_verb("add read event to io_uring fd %d on fd %d", evb->ring, fd);
+
+    return status;
+}
+
+int
+event_add_write(struct event_base *evb, int fd, void *data)
+{
+    int status;
+
+    ASSERT(evb != NULL);
+    ASSERT(fd >= 0);
+
+    if (evb->ep != NULL) {
+        return epoll_base_add_write(evb->ep, fd, data);
+    }
+
+    status = _uring_add(evb, fd, POLLOUT, data);
+    if (status < 0 && errno != EEXIST) {
+        log_error("add write w/ io_uring fd %d on fd %d failed: %s", evb->ring,
+                fd, strerror(errno));
+    }
+
+    INCR(event_metrics, event_write);
+    log_verb("add write event to io_uring fd %d on fd %d", evb->ring, fd);
+
+    return status;
+}
+
+int
+event_del(struct event_base *evb, int fd)
+{
+    struct io_uring_sqe *sqe;
+    struct uring_fd *f;
+
+    ASSERT(evb != NULL);
+    ASSERT(fd >= 0);
+
+    if (evb->ep != NULL) {
+        return epoll_base_del(evb->ep, fd);
+    }
+
+    if (fd >= evb->nfd || evb->fd[fd].poll == 0) {
+        log_error("del w/ io_uring fd %d on fd %d failed: %s", evb->ring, fd,
+                strerror(ENOENT));
+        errno = ENOENT;
+        return -1;
+    }
+
+    f = &evb->fd[fd];
+    if (f->armed) {
+        /* completions of the cancelled poll carry a stale generation */
+        sqe = _uring_get_sqe(evb);
+        if (sqe != NULL) {
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = _uring_user_data(fd, f->gen);
+            sqe->user_data = URING_REMOVE;
+            _uring_put_sqe(evb);
+        }
+    }
+
+    f->gen++;
+    f->poll = 0;
+    f->armed = false;
+    f->data = NULL;
+
+    log_verb("del fd %d from io_uring fd %d", fd, evb->ring);
+
+    return 0;
+}
+
+/*
+ * create a timed event with event base function and timeout (in millisecond)
+ */
+int
+event_wait(struct event_base *evb, int timeout)
+{
+    struct io_uring_cqe *cqe;
+    struct uring_fd *f;
+    unsigned head, tail;
+    uint64_t user_data;
+    int nreturned, fd, res;
+    uint32_t events, cqe_flags;
+    void *data;
+
+    ASSERT(evb != NULL);
+
+    if (evb->ep != NULL) {
+        return epoll_base_wait(evb->ep, timeout);
+    }
+
+    for (;;) {
+        head = *evb->cq_head;
+        tail = __atomic_load_n(evb->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) { /* submit pending polls and wait */
+            if (_uring_submit(evb, timeout) < 0) {
+                return -1;
+            }
+            INCR(event_metrics, event_loop);
+            tail = __atomic_load_n(evb->cq_tail, __ATOMIC_ACQUIRE);
+        }
+
+        for (nreturned = 0; head != tail && nreturned < evb->nevent; head++) {
+            cqe = &evb->cqe[head & *evb->cq_mask];
+            user_data = cqe->user_data;
+            res = cqe->res;
+            cqe_flags = cqe->flags;
+            __atomic_store_n(evb->cq_head, head + 1, __ATOMIC_RELEASE);
+
+            if (user_data == URING_REMOVE) {
+                continue;
+            }
+
+            fd = (int)(uint32_t)user_data;
+            if (fd >= evb->nfd) {
+                continue;
+            }
+            f = &evb->fd[fd];
+            if (f->poll == 0 || f->gen != (uint32_t)(user_data >> 32)) {
+                continue; /* deleted since the poll was armed */
+            }
+            if (!(cqe_flags & IORING_CQE_F_MORE)) {
+                f->armed = false; /* the kernel ended the multishot poll */
+            }
+
+            events = 0;
+            if (res < 0 || (res & (POLLERR | POLLHUP))) {
+                events |= EVENT_ERR;
+            }
+            if (res > 0 && (res & (POLLIN | POLLRDHUP))) {
+                events |= EVENT_READ;
+            }
+            if (res > 0 && (res & POLLOUT)) {
+                events |= EVENT_WRITE;
+            }
+
+            log_verb("io_uring %04"PRIX32" against data %p", events, f->data);
+
+            data = f->data;
+            nreturned++;
+            if (evb->cb != NULL) {
+                evb->cb(data, events);
+            }
+
+            /* re-arm, unless the callback deleted (and maybe re-added) fd */
+            f = &evb->fd[fd];
+            if (f->poll != 0 && !f->armed && _uring_arm(evb, fd) < 0) {
+                log_error("re-arm poll w/ io_uring fd %d on fd %d failed: %s",
+                        evb->ring, fd, strerror(errno));
+                if (evb->cb != NULL) {
+                    evb->cb(f->data, EVENT_ERR);
+                }
+            }
+        }
+
+        if (nreturned > 0) {
+            INCR_N(event_metrics, event_total, nreturned);
+            log_verb("returned %d events from io_uring fd %d", nreturned,
+                    evb->ring);
+
+            return nreturned;
+        }
+
+        if (timeout != -1 && head == tail) {
+            log_vverb("wait on io_uring fd %d with nevent %d timeout %d "
+                    "returned no events", evb->ring, evb->nevent, timeout);
+            return 0;
+        }
+    }
+
+    NOT_REACHED();
+}
@@ -21,14 +21,26 @@
 
 static bool event_init = false;
 event_metrics_st *event_metrics = NULL;
+bool event_io_uring = EVENT_IO_URING;
 
 void
-event_setup(event_metrics_st *metrics)
+event_setup(event_options_st *options, event_metrics_st *metrics)
 {
     log_info("set up the %s module", EVENT_MODULE_NAME);
 
     event_metrics = metrics;
 
+    event_io_uring = EVENT_IO_URING;
+    if (options != NULL) {
+        event_io_uring = option_bool(&options->event_io_uring);
+    }
+#ifndef HAVE_IO_URING
+    if (event_io_uring) {
+        log_warn("io_uring backend not built, using the default backend");
+        event_io_uring = false;
+    }
+#endif
+
     if (event_init) {
         log_warn("%s has already been setup, overwrite", EVENT_MODULE_NAME);
     }
@@ -29,6 +29,21 @@ extern "C" {
 #define EVENT_MODULE_NAME "ccommon::event"
 
 extern event_metrics_st *event_metrics;
+extern bool event_io_uring;
+
+#if defined(HAVE_IO_URING) && !defined(event_base)
+/* with io_uring built in, cc_io_uring.c provides the event API and uses the
+ * epoll backend, renamed as below, when io_uring is disabled or unavailable
+ * (cc_epoll.c itself gets these through the renamed cc_event.h)
+ */
+struct epoll_base;
+struct epoll_base *epoll_base_create(int nevent, event_cb_fn cb);
+void epoll_base_destroy(struct epoll_base **evb);
+int epoll_base_add_read(struct epoll_base *evb, int fd, void *data);
+int epoll_base_add_write(struct epoll_base *evb, int fd, void *data);
+int epoll_base_del(struct epoll_base *evb, int fd);
+int epoll_base_wait(struct epoll_base *evb, int timeout);
+#endif
 
 #ifdef __cplusplus
 }
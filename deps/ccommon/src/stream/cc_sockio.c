@@ -19,6 +19,7 @@
 
 #include <buffer/cc_buf.h>
 #include <buffer/cc_dbuf.h>
+#include <cc_array.h>
 #include <cc_debug.h>
 #include <cc_define.h>
 #include <cc_mm.h>
@@ -27,6 +28,7 @@
 #include <channel/cc_tcp.h>
 
 #include <limits.h>
+#include <pthread.h>
 #include <sys/uio.h>
 
 /*
@@ -44,6 +46,8 @@ struct buf_sock_pool bsp;
 
 static bool sockio_init = false;
 static bool bsp_init = false;
+/* threads accepting connections on their own share the pool */
+static pthread_mutex_t bsp_lock = PTHREAD_MUTEX_INITIALIZER;
 static sockio_metrics_st *sockio_metrics = NULL;
 
 rstatus_i
@@ -93,6 +97,39 @@ buf_tcp_read(struct buf_sock *s)
     return status;
 }
 
+/* send buffered data interleaved with the references it holds */
+static ssize_t
+_buf_tcp_writev(struct tcp_conn *c, struct buf *buf, size_t cap)
+{
+    struct iovec iov[BUF_NREF * 2 + 1];
+    struct array bufv = {
+        .nalloc = BUF_NREF * 2 + 1,
+        .size = sizeof(struct iovec),
+        .nelem = 0,
+        .data = (uint8_t *)iov,
+    };
+    struct buf_ref *ref;
+    char *p = buf->rpos;
+    uint8_t i;
+
+    for (i = buf->sref; i < buf->nref; ++i) {
+        ref = &buf->ref[i];
+        if (ref->pre > 0) {
+            iov[bufv.nelem].iov_base = p;
+            iov[bufv.nelem++].iov_len = ref->pre;
+            p += ref->pre;
+        }
+        iov[bufv.nelem].iov_base = ref->data;
+        iov[bufv.nelem++].iov_len = ref->len;
+    }
+    if (p < buf->wpos) {
+        iov[bufv.nelem].iov_base = p;
+        iov[bufv.nelem++].iov_len = (size_t)(buf->wpos - p);
+    }
+
+    return tcp_sendv(c, &bufv, cap);
+}
+
 rstatus_i
 buf_tcp_write(struct buf_sock *s)
 {
@@ -108,7 +145,7 @@ buf_tcp_write(struct buf_sock *s)
     ASSERT(c != NULL && h != NULL && buf != NULL);
     ASSERT(h->send != NULL);
 
-    cap = buf_rsize(buf);
+    cap = buf_rsize(buf) + buf_ref_rsize(buf);
 
     if (cap == 0) {
         log_verb("no data to send in buf at %p ", buf);
@@ -116,7 +153,11 @@ buf_tcp_write(struct buf_sock *s)
         return CC_EEMPTY;
     }
 
-    n = h->send(c, buf->rpos, cap);
+    if (buf->sref < buf->nref) {
+        n = _buf_tcp_writev(c, buf, cap);
+    } else {
+        n = h->send(c, buf->rpos, cap);
+    }
     if (n < 0) {
         if (n == CC_EAGAIN) {
             log_verb("send on conn returns rescuable error: EAGAIN", c);
@@ -134,7 +175,7 @@ buf_tcp_write(struct buf_sock *s)
     }
 
     if (n > 0) {
-        buf->rpos += n;
+        buf_ref_consume(buf, (uint32_t)n);
         log_verb("send %zd bytes on conn %p", n, c);
     }
 
@@ -338,7 +379,9 @@ buf_sock_borrow(void)
 {
     struct buf_sock *s;
 
+    pthread_mutex_lock(&bsp_lock);
     FREEPOOL_BORROW(s, &bsp, next, buf_sock_create);
+    pthread_mutex_unlock(&bsp_lock);
     if (s == NULL) {
         log_debug("borrow buffered socket failed: OOM or over limit");
         INCR(sockio_metrics, buf_sock_borrow_ex);
@@ -364,7 +407,9 @@ buf_sock_return(struct buf_sock **s)
     log_verb("return buffered socket %p", *s);
 
     (*s)->free = true;
+    pthread_mutex_lock(&bsp_lock);
     FREEPOOL_RETURN(*s, &bsp, next);
+    pthread_mutex_unlock(&bsp_lock);
 
     *s = NULL;
     INCR(sockio_metrics, buf_sock_return);
@@ -245,6 +245,83 @@ START_TEST(test_rshift)
 }
 END_TEST
 
+static int nreleased;
+
+static void
+_release(void *owner)
+{
+    ck_assert_ptr_ne(owner, NULL);
+    nreleased++;
+}
+
+START_TEST(test_ref)
+{
+#define HDR "VALUE "
+#define VAL "referenced"
+#define END "\r\n"
+    struct buf *buf = NULL;
+    char val[] = VAL;
+
+    test_reset();
+    nreleased = 0;
+
+    buf = buf_create();
+    ck_assert_ptr_ne(buf, NULL);
+    ck_assert_uint_eq(buf_ref_rsize(buf), 0);
+    ck_assert_int_eq(buf_ref_reserve(buf), CC_OK);
+
+    /* "VALUE " <ref> "\r\n" <ref> "\r\n" */
+    buf_write(buf, HDR, sizeof(HDR) - 1);
+    buf_ref_append(buf, val, sizeof(VAL) - 1, val);
+    buf_write(buf, END, sizeof(END) - 1);
+    ck_assert_int_eq(buf_ref_reserve(buf), CC_OK);
+    buf_ref_append(buf, val, sizeof(VAL) - 1, val);
+    buf_write(buf, END, sizeof(END) - 1);
+    ck_assert_uint_eq(buf->nref, 2);
+    ck_assert_uint_eq(buf->ref[0].pre, sizeof(HDR) - 1);
+    ck_assert_uint_eq(buf->ref[1].pre, sizeof(END) - 1);
+    ck_assert_uint_eq(buf_ref_rsize(buf), 2 * (sizeof(VAL) - 1));
+
+    /* consume into the middle of the first reference */
+    buf_ref_consume(buf, sizeof(HDR) + 1);
+    ck_assert_uint_eq(buf->sref, 0);
+    ck_assert_ptr_eq(buf->ref[0].data, val + 2);
+    ck_assert_uint_eq(buf->ref[0].pre, 0);
+    ck_assert_uint_eq(buf_rsize(buf), 2 * (sizeof(END) - 1));
+
+    /* references survive moving buffered data */
+    buf_lshift(buf);
+    buf_ref_consume(buf, sizeof(VAL) - 3 + sizeof(END) - 1);
+    ck_assert_uint_eq(buf->sref, 1);
+    buf_ref_release(buf, _release);
+    ck_assert_int_eq(nreleased, 1);
+    ck_assert_uint_eq(buf->nref, 1);
+    ck_assert_uint_eq(buf->sref, 0);
+    ck_assert_uint_eq(buf->ref[0].pre, 0);
+
+    /* drain the rest */
+    buf_ref_consume(buf, sizeof(VAL) - 1 + sizeof(END) - 1);
+    ck_assert_uint_eq(buf_rsize(buf), 0);
+    ck_assert_uint_eq(buf_ref_rsize(buf), 0);
+    buf_ref_release(buf, _release);
+    ck_assert_int_eq(nreleased, 2);
+    ck_assert_uint_eq(buf->nref, 0);
+
+    /* unsent references are released on reset */
+    while (buf_ref_reserve(buf) == CC_OK) {
+        buf_ref_append(buf, val, sizeof(VAL) - 1, val);
+    }
+    buf_ref_reset(buf, _release);
+    ck_assert_int_eq(nreleased, 2 + BUF_NREF);
+    ck_assert_uint_eq(buf_ref_rsize(buf), 0);
+
+    buf_destroy(&buf);
+#undef HDR
+#undef VAL
+#undef END
+}
+END_TEST
+
 START_TEST(test_dbuf_double_basic)
 {
 #define EXPECTED_BUF_SIZE                (TEST_BUF_SIZE * 2)
@@ -395,6 +472,7 @@ buf_suite(void)
     tcase_add_test(tc_buf, test_create_write_read_destroy_long);
     tcase_add_test(tc_buf, test_lshift);
     tcase_add_test(tc_buf, test_rshift);
+    tcase_add_test(tc_buf, test_ref);
 
     TCase *tc_dbuf = tcase_create("dbuf test");
     suite_add_tcase(s, tc_dbuf);
@@ -3,6 +3,7 @@
 
 #include <check.h>
 
+#include <poll.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -156,6 +157,41 @@ START_TEST(test_read_nonblocking)
 }
 END_TEST
 
+static bool
+readable(struct pipe_conn *pipe)
+{
+    struct pollfd pfd = { .fd = pipe_read_id(pipe), .events = POLLIN };
+
+    return poll(&pfd, 1, 0) == 1;
+}
+
+START_TEST(test_notify_drain)
+{
+    struct pipe_conn *pipe;
+    int i;
+
+    test_reset();
+
+    pipe = pipe_conn_create();
+    ck_assert_ptr_ne(pipe, NULL);
+
+    ck_assert_int_eq(pipe_open_notify(NULL, pipe), true);
+    ck_assert(!readable(pipe));
+    ck_assert_int_eq(pipe_drain(pipe), CC_OK);
+
+    /* many notifications, one drain */
+    for (i = 0; i < 10; i++) {
+        ck_assert_int_eq(pipe_notify(pipe), CC_OK);
+    }
+    ck_assert(readable(pipe));
+    ck_assert_int_eq(pipe_drain(pipe), CC_OK);
+    ck_assert(!readable(pipe));
+
+    pipe_close(pipe);
+    pipe_conn_destroy(&pipe);
+}
+END_TEST
+
 /*
  * test suite
  */
@@ -168,6 +204,7 @@ pipe_suite(void)
     tcase_add_test(tc_pipe, test_send_recv);
     tcase_add_test(tc_pipe, test_read_blocking);
     tcase_add_test(tc_pipe, test_read_nonblocking);
+    tcase_add_test(tc_pipe, test_notify_drain);
     suite_add_tcase(s, tc_pipe);
 
     return s;
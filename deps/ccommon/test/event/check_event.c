@@ -28,7 +28,7 @@ static void
 test_setup(void)
 {
     event_log_count = 0;
-    event_setup(NULL);
+    event_setup(NULL, NULL);
 }
 
 static void
@@ -142,6 +142,72 @@ START_TEST(test_write)
 }
 END_TEST
 
+#ifdef HAVE_IO_URING
+/* same as above with the io_uring backend, plus switching event types */
+START_TEST(test_io_uring)
+{
+#define DATA "foo bar baz"
+    event_options_st options = { EVENT_OPTION(OPTION_INIT) };
+    event_metrics_st metrics = { EVENT_METRIC(METRIC_INIT) };
+    struct event_base *event_base;
+    int random_pointer[1] = {1};
+    struct pipe_conn *pipe;
+
+    test_reset();
+    option_load_default((struct option *)&options,
+            OPTION_CARDINALITY(event_options_st));
+    options.event_io_uring.val.vbool = true;
+    event_teardown();
+    event_setup(&options, &metrics);
+
+    event_base = event_base_create(1024, log_event);
+    ck_assert_ptr_ne(event_base, NULL);
+    /* io_uring was set up, rather than falling back to epoll */
+    ck_assert_int_eq(metrics.event_uring.gauge, 1);
+
+    pipe = pipe_conn_create();
+    ck_assert_int_eq(pipe_open(NULL, pipe), true);
+
+    event_add_read(event_base, pipe_read_id(pipe), random_pointer);
+    ck_assert_int_eq(event_add_read(event_base, pipe_read_id(pipe),
+                random_pointer), -1);
+    event_wait(event_base, 100);
+    ck_assert_int_eq(event_log_count, 0);
+
+    ck_assert_int_eq(pipe_send(pipe, DATA, sizeof(DATA)), sizeof(DATA));
+    event_wait(event_base, -1);
+    ck_assert_int_eq(event_log_count, 1);
+    ck_assert_ptr_eq(event_log[0].arg, random_pointer);
+    ck_assert_int_eq(event_log[0].events, EVENT_READ);
+
+    /* edge-triggered: unread data is only reported again with more data */
+    event_wait(event_base, 100);
+    ck_assert_int_eq(event_log_count, 1);
+    ck_assert_int_eq(pipe_send(pipe, DATA, sizeof(DATA)), sizeof(DATA));
+    event_wait(event_base, -1);
+    ck_assert_int_eq(event_log_count, 2);
+    ck_assert_int_eq(event_log[1].events, EVENT_READ);
+
+    ck_assert_int_eq(event_del(event_base, pipe_read_id(pipe)), 0);
+    ck_assert_int_eq(event_del(event_base, pipe_read_id(pipe)), -1);
+    event_wait(event_base, 100);
+    ck_assert_int_eq(event_log_count, 2);
+
+    event_add_write(event_base, pipe_write_id(pipe), random_pointer);
+    event_wait(event_base, -1);
+    ck_assert_int_eq(event_log_count, 3);
+    ck_assert_int_eq(event_log[2].events, EVENT_WRITE);
+
+    ck_assert_int_eq(event_del(event_base, pipe_write_id(pipe)), 0);
+    event_base_destroy(&event_base);
+    ck_assert_int_eq(metrics.event_uring.gauge, 0);
+    pipe_close(pipe);
+    pipe_conn_destroy(&pipe);
+#undef DATA
+}
+END_TEST
+#endif
+
 /*
  * test suite
  */
@@ -157,6 +223,9 @@ event_suite(void)
     tcase_add_test(tc_event, test_read);
     tcase_add_test(tc_event, test_cannot_read);
     tcase_add_test(tc_event, test_write);
+#ifdef HAVE_IO_URING
+    tcase_add_test(tc_event, test_io_uring);
+#endif
 
     return s;
 }
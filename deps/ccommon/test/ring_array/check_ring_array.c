@@ -156,6 +156,48 @@ START_TEST(test_flush)
 }
 END_TEST
 
+START_TEST(test_push_pop_n)
+{
+#define ELEM_SIZE sizeof(uint8_t)
+#define CAP 10
+    struct ring_array *arr;
+    uint8_t in[CAP + 1], out[CAP + 1];
+    uint8_t i;
+
+    for (i = 0; i < CAP + 1; i++) {
+        in[i] = i;
+    }
+
+    arr = ring_array_create(ELEM_SIZE, CAP);
+
+    /* partial push when there isn't enough room */
+    ck_assert_int_eq(ring_array_push_n(in, CAP + 1, arr), CAP);
+    ck_assert(ring_array_full(arr));
+    ck_assert_int_eq(ring_array_push_n(in, 1, arr), 0);
+
+    ck_assert_int_eq(ring_array_pop_n(out, 7, arr), 7);
+    for (i = 0; i < 7; i++) {
+        ck_assert_int_eq(out[i], i);
+    }
+
+    /* push and pop across the end of the underlying array */
+    ck_assert_int_eq(ring_array_push_n(in, 7, arr), 7);
+    ck_assert_int_eq(ring_array_pop_n(out, CAP + 1, arr), CAP);
+    for (i = 0; i < 3; i++) {
+        ck_assert_int_eq(out[i], 7 + i);
+    }
+    for (i = 3; i < CAP; i++) {
+        ck_assert_int_eq(out[i], i - 3);
+    }
+    ck_assert(ring_array_empty(arr));
+    ck_assert_int_eq(ring_array_pop_n(out, 1, arr), 0);
+
+    ring_array_destroy(&arr);
+#undef ELEM_SIZE
+#undef CAP
+}
+END_TEST
+
 /*
  * Threading test
  */
@@ -179,6 +221,23 @@ test_produce(void *arg)
     return NULL;
 }
 
+#define BATCH 7
+static void *
+test_produce_n(void *arg)
+{
+    uint32_t i, j, n = ((struct test_ring_array_arg *)arg)->n;
+    struct ring_array *arr = ((struct test_ring_array_arg *)arg)->arr;
+    uint32_t batch[BATCH];
+
+    for (i = 0; i < n;) {
+        for (j = 0; j < BATCH; j++) {
+            batch[j] = i + j;
+        }
+        i += ring_array_push_n(batch, n - i < BATCH ? n - i : BATCH, arr);
+    }
+    return NULL;
+}
+
 START_TEST(test_thread)
 {
 #define ELEM_SIZE sizeof(uint32_t)
@@ -215,6 +274,40 @@ START_TEST(test_thread)
 }
 END_TEST
 
+START_TEST(test_thread_n)
+{
+#define ELEM_SIZE sizeof(uint32_t)
+#define CAP 100
+#define NUM_REPS 50000
+    struct ring_array *arr = NULL;
+    pthread_t producer;
+    struct test_ring_array_arg arg;
+    uint32_t i, j, n, batch[BATCH + 1];
+
+    arr = ring_array_create(ELEM_SIZE, CAP);
+    ck_assert_ptr_ne(arr, NULL);
+
+    arg.n = NUM_REPS;
+    arg.arr = arr;
+
+    ck_assert_int_eq(pthread_create(&producer, NULL, &test_produce_n, &arg), 0);
+
+    for (i = 0; i < NUM_REPS;) {
+        n = ring_array_pop_n(batch, BATCH + 1, arr);
+        for (j = 0; j < n; j++) {
+            ck_assert_int_eq(batch[j], i++);
+        }
+    }
+
+    pthread_join(producer, NULL);
+    ring_array_destroy(&arr);
+#undef ELEM_SIZE
+#undef CAP
+#undef NUM_REPS
+}
+END_TEST
+#undef BATCH
+
 /*
  * test suite
  */
@@ -233,7 +326,9 @@ ring_array_suite(void)
     tcase_add_test(tc_ring_array, test_push_full);
     tcase_add_test(tc_ring_array, test_push_pop_many);
     tcase_add_test(tc_ring_array, test_flush);
+    tcase_add_test(tc_ring_array, test_push_pop_n);
     tcase_add_test(tc_ring_array, test_thread);
+    tcase_add_test(tc_ring_array, test_thread_n);
 
     return s;
 }
@@ -3,6 +3,7 @@
 #include "core/context.h"
 
 #include "protocol/admin/admin_include.h"
+#include "util/affinity.h"
 #include "util/util.h"
 
 #include <buffer/cc_buf.h>
@@ -14,11 +15,13 @@
 #include <time/cc_timer.h>
 #include <time/cc_wheel.h>
 
+#include <fcntl.h>
 #include <netdb.h>
 #include <stdbool.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sysexits.h>
+#include <unistd.h>
 
 #define ADMIN_MODULE_NAME "core::admin"
 
@@ -32,6 +35,8 @@ static channel_handler_st *hdl = &handlers;
 
 static struct addrinfo *admin_ai;
 static struct buf_sock *admin_sock;
+static struct affinity_list cpus; /* admin runs on these, if any */
+static int inherit_sd = -1; /* listening socket taken over, if any */
 
 static struct request req;
 static struct response rsp;
@@ -44,7 +49,8 @@ _admin_close(struct buf_sock *s)
     buf_sock_destroy(&s);
 }
 
-static inline void
+/* returns true if a connection is present, false if no more pending */
+static inline bool
 _tcp_accept(struct buf_sock *ss)
 {
     struct buf_sock *s;
@@ -55,17 +61,20 @@ _tcp_accept(struct buf_sock *ss)
         log_error("establish connection failed: cannot allocate buf_sock, "
                 "reject connection request");
         ss->hdl->reject(sc); /* server rejects connection by closing it */
-        return;
+        return false;
     }
 
     if (!ss->hdl->accept(sc, s->ch)) {
-        return;
+        buf_sock_destroy(&s);
+        return false;
     }
 
     s->owner = ctx;
     s->hdl = hdl;
 
     event_add_read(ctx->evb, hdl->rid(s->ch), s);
+
+    return true;
 }
 
 static inline rstatus_i
@@ -175,7 +184,8 @@ _admin_event_read(struct buf_sock *s)
     struct tcp_conn *c = s->ch;
 
     if (c->level == CHANNEL_META) {
-        _tcp_accept(s);
+        /* accept all pending connections, read events may be edge-triggered */
+        while (_tcp_accept(s));
     } else if (c->level == CHANNEL_BASE) {
         _admin_read(s);
         _admin_post_read(s);
@@ -230,6 +240,7 @@ core_admin_setup(admin_options_st *options)
         core_admin_teardown();
     }
 
+    cpus.n = 0;
     if (options != NULL) {
         host = option_str(&options->admin_host);
         port = option_str(&options->admin_port);
@@ -238,6 +249,12 @@ core_admin_setup(admin_options_st *options)
         tick_ms = option_uint(&options->admin_tw_tick);
         cap = option_uint(&options->admin_tw_cap);
         ntick = option_uint(&options->admin_tw_ntick);
+        if (option_str(&options->admin_cpus) != NULL &&
+                affinity_parse(&cpus, option_str(&options->admin_cpus))
+                != CC_OK) {
+            log_crit("failed to setup admin thread; invalid cpu list");
+            goto error;
+        }
     }
 
     ctx->timeout = timeout;
@@ -270,7 +287,12 @@ core_admin_setup(admin_options_st *options)
         goto error;
     }
     c = admin_sock->ch;
-    if (!hdl->open(admin_ai, c)) {
+    if (inherit_sd >= 0) {
+        c->sd = inherit_sd;
+        c->state = CHANNEL_LISTEN;
+        inherit_sd = -1;
+        log_info("admin listening on inherited socket descriptor %d", c->sd);
+    } else if (!hdl->open(admin_ai, c)) {
         log_crit("admin connection setup failed");
         goto error;
     }
@@ -311,6 +333,25 @@ core_admin_teardown(void)
     admin_init = false;
 }
 
+int
+core_admin_fd(void)
+{
+    if (!admin_init) {
+        return -1;
+    }
+
+    return fcntl(admin_sock->ch->sd, F_DUPFD_CLOEXEC, 0);
+}
+
+void
+core_admin_inherit(int sd)
+{
+    if (inherit_sd >= 0) {
+        close(inherit_sd);
+    }
+    inherit_sd = sd;
+}
+
 struct timeout_event *
 core_admin_register(uint64_t intvl_ms, timeout_cb_fn cb, void *arg)
 {
@@ -344,6 +385,10 @@ _admin_evwait(void)
 void
 core_admin_evloop(void)
 {
+    if (cpus.n > 0 && affinity_pin(&cpus) == CC_OK) {
+        log_info("admin pinned to %"PRIu32" cpu(s)", cpus.n);
+    }
+
     for(;;) {
         if (_admin_evwait() != CC_OK) {
             log_crit("admin loop exited due to failure");
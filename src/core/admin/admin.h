@@ -18,6 +18,7 @@
 #define ADMIN_TW_TICK   10      /* in ms */
 #define ADMIN_TW_CAP    1000    /* 1000 ticks in timing wheel */
 #define ADMIN_TW_NTICK  100     /* 1 second's worth of timeout events */
+#define ADMIN_CPUS      NULL    /* not pinned */
 
 /*          name            type                default         description */
 #define ADMIN_OPTION(ACTION)                                                                    \
@@ -27,7 +28,8 @@
     ACTION( admin_nevent,   OPTION_TYPE_UINT,   ADMIN_NEVENT,   "evwait max nevent returned"   )\
     ACTION( admin_tw_tick,  OPTION_TYPE_UINT,   ADMIN_TW_TICK,  "timing wheel tick size (ms)"  )\
     ACTION( admin_tw_cap,   OPTION_TYPE_UINT,   ADMIN_TW_CAP,   "# ticks in timing wheel"      )\
-    ACTION( admin_tw_ntick, OPTION_TYPE_UINT,   ADMIN_TW_NTICK, "max # ticks processed at once")
+    ACTION( admin_tw_ntick, OPTION_TYPE_UINT,   ADMIN_TW_NTICK, "max # ticks processed at once")\
+    ACTION( admin_cpus,     OPTION_TYPE_STR,    ADMIN_CPUS,     "CPUs admin is pinned to"      )
 
 typedef struct {
     ADMIN_OPTION(OPTION_DECLARE)
@@ -36,6 +38,11 @@ typedef struct {
 void core_admin_setup(admin_options_st *options);
 void core_admin_teardown(void);
 
+/* a duplicate of the admin listening socket, or -1 */
+int core_admin_fd(void);
+/* listen on sd instead of binding on the next core_admin_setup */
+void core_admin_inherit(int sd);
+
 /* add a periodic action to be executed on the admin thread, which uses timing wheel */
 struct timeout_event *
 core_admin_register(uint64_t intvl_ms, timeout_cb_fn cb, void *arg);
@@ -3,16 +3,18 @@
 #include "context.h"
 
 #include <cc_debug.h>
+#include <cc_mm.h>
 
 #include <errno.h>
 #include <pthread.h>
 #include <string.h>
 #include <sysexits.h>
 
-pthread_t worker, server;
+pthread_t *worker, server;
 void
 core_run(void *arg_worker, void *arg_server)
 {
+    uint32_t i;
     int ret;
 
     if (!admin_init || !server_init || !worker_init) {
@@ -20,12 +22,21 @@ core_run(void *arg_worker, void *arg_server)
         return;
     }
 
-    ret = pthread_create(&worker, NULL, core_worker_evloop, arg_worker);
-    if (ret != 0) {
-        log_crit("pthread create failed for worker thread: %s", strerror(ret));
+    worker = cc_alloc(sizeof(pthread_t) * nworker);
+    if (worker == NULL) {
+        log_crit("could not allocate %"PRIu32" worker threads", nworker);
         goto error;
     }
 
+    for (i = 0; i < nworker; ++i) {
+        ret = pthread_create(&worker[i], NULL, core_worker_evloop, arg_worker);
+        if (ret != 0) {
+            log_crit("pthread create failed for worker thread: %s",
+                    strerror(ret));
+            goto error;
+        }
+    }
+
     ret = pthread_create(&server, NULL, core_server_evloop, arg_server);
     if (ret != 0) {
         log_crit("pthread create failed for server thread: %s", strerror(ret));
@@ -40,6 +51,7 @@ error:
 
 void core_destroy(void)
 {
+    uint32_t i;
     int ret;
 
     if (!server_init || !worker_init) {
@@ -53,9 +65,12 @@ void core_destroy(void)
         exit(EX_OSERR);
     }
 
-    ret = pthread_join(worker, NULL);
-    if (ret != 0) {
-        log_crit("pthread join failed for server thread: %s", strerror(ret));
-        exit(EX_OSERR);
+    for (i = 0; i < nworker; ++i) {
+        ret = pthread_join(worker[i], NULL);
+        if (ret != 0) {
+            log_crit("pthread join failed for server thread: %s", strerror(ret));
+            exit(EX_OSERR);
+        }
     }
+    cc_free(worker);
 }
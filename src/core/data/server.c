@@ -3,10 +3,12 @@
 #include "core/context.h"
 #include "shared.h"
 
+#include "util/affinity.h"
 #include "util/util.h"
 
 #include <cc_debug.h>
 #include <cc_event.h>
+#include <cc_mm.h>
 #include <cc_ring_array.h>
 #include <channel/cc_channel.h>
 #include <channel/cc_pipe.h>
@@ -14,16 +16,13 @@
 #include <stream/cc_sockio.h>
 
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <sysexits.h>
+#include <unistd.h>
 
 #define SERVER_MODULE_NAME "core::server"
 
-struct pipe_conn *pipe_new = NULL;   /* server(w) -> worker(r) */
-struct pipe_conn *pipe_term = NULL;  /* worker(w) -> server(r) */
-struct ring_array *conn_new = NULL;  /* server(w) -> worker(r) */
-struct ring_array *conn_term = NULL; /* worker(w) -> server(r) */
-
 static server_metrics_st *server_metrics = NULL;
 
 static struct context context;
@@ -34,12 +33,17 @@ static channel_handler_st *hdl = &handlers;
 
 static struct addrinfo *server_ai;
 static struct buf_sock *server_sock; /* server buf_sock */
+static struct buf_sock **worker_sock = NULL; /* worker_sock[nworker] */
+static bool reuseport = SERVER_REUSEPORT;
+static struct affinity_list cpus; /* server runs on these, if any */
+static int inherit_sd = -1; /* listening socket taken over, if any */
+
+static uint32_t next_worker = 0; /* worker to receive the next connection */
+static bool *new_pending = NULL; /* new_pending[nworker], worker to notify */
 
-/* Note: server thread currently owns the stream (buf_sock) pool. Other threads
- * either need to get the connection from server (the case for worker thread) or
- * have to directly create their own, instead of borrowing (the case for admin
- * thread), to avoid concurrency issues around pooling operations, which are not
- * thread-safe.
+/* Note: server thread and workers accepting on their own sockets (reuseport)
+ * borrow from and return to the stream (buf_sock) pool, which is locked and
+ * bounded by buf_sock_poolsize. The admin thread directly creates its own.
  */
 
 static inline void
@@ -53,51 +57,47 @@ _server_close(struct buf_sock *s)
     buf_sock_return(&s);
 }
 
+/* one notification per worker covers all connections accepted in a burst */
 static inline void
-_server_pipe_write(void)
+_server_notify(void)
 {
-    ASSERT(pipe_new != NULL);
+    uint32_t i;
 
-    ssize_t status = pipe_send(pipe_new, "", 1);
+    for (i = 0; i < nworker; ++i) {
+        if (!new_pending[i]) {
+            continue;
+        }
 
-    if (status == 0 || status == CC_EAGAIN) {
-        /* retry write */
-        log_verb("server core: retry send on pipe");
-        event_add_write(ctx->evb, pipe_write_id(pipe_new), NULL);
-    } else if (status == CC_ERROR) {
-        log_error("could not write to pipe - %s", strerror(pipe_new->err));
+        new_pending[i] = false;
+        if (pipe_notify(handoff[i].pipe_new) != CC_OK) {
+            log_error("could not notify worker %"PRIu32" - %s", i,
+                    strerror(handoff[i].pipe_new->err));
+        }
     }
 }
 
-/* pipe_read recycles returned streams from worker thread */
-static inline void
-_server_pipe_read(void)
+/* pipe_read recycles returned streams from a worker thread */
+static void
+_server_pipe_read(struct conn_handoff *h)
 {
-    struct buf_sock *s;
-    char buf[RING_ARRAY_DEFAULT_CAP]; /* buffer for discarding pipe data */
-    int i;
-    rstatus_i status;
+    struct buf_sock *s[CONN_HANDOFF_BATCH];
+    uint32_t i, n;
 
-    ASSERT(pipe_term != NULL);
+    ASSERT(h->pipe_term != NULL);
 
-    i = pipe_recv(pipe_term, buf, RING_ARRAY_DEFAULT_CAP);
-    if (i < 0) { /* errors, do not read from ring array */
+    /* drain first, connections returned after this come with a notification */
+    if (pipe_drain(h->pipe_term) != CC_OK) {
         log_warn("not reclaiming connections due to pipe error");
         return;
     }
 
-    /* each byte in the pipe corresponds to a connection in the array */
-    for (; i > 0; --i) {
-        status = ring_array_pop(&s, conn_term);
-        if (status != CC_OK) {
-            log_warn("event number does not match conn queue: missing %d conns",
-                    i);
-            return;
+    while ((n = ring_array_pop_n(s, CONN_HANDOFF_BATCH, h->conn_term)) > 0) {
+        for (i = 0; i < n; ++i) {
+            log_verb("Recycling buf_sock %p from worker thread", s[i]);
+            hdl->term(s[i]->ch);
+            buf_sock_reset(s[i]);
+            buf_sock_return(&s[i]);
         }
-        log_verb("Recycling buf_sock %p from worker thread", s);
-        hdl->term(s->ch);
-        buf_sock_reset(s);
-        buf_sock_return(&s);
     }
 }
 
@@ -107,6 +107,7 @@ _tcp_accept(struct buf_sock *ss)
 {
     struct buf_sock *s;
     struct tcp_conn *sc = ss->ch;
+    uint32_t i, id = 0;
 
     s = buf_sock_borrow();
     if (s == NULL) {
@@ -146,6 +147,7 @@ _tcp_accept(struct buf_sock *ss)
          */
         log_error("establish connection failed: cannot allocate buf_sock, "
                 "reject connection request");
+        INCR(server_metrics, server_accept_ex);
         ss->hdl->reject(sc); /* server rejects connection by closing it */
         return false;
     }
@@ -155,17 +157,29 @@ _tcp_accept(struct buf_sock *ss)
         buf_sock_return(&s);
         return false;
     }
+    INCR(server_metrics, server_accept);
 
-    /* push buf_sock to queue */
-    if (ring_array_push(&s, conn_new) != CC_OK) { /* close if can't enqueue */
+    /* push buf_sock to the queue of the next worker in round-robin order,
+     * skipping workers whose queue is full
+     */
+    for (i = 0; i < nworker; ++i) {
+        id = next_worker;
+        next_worker = (next_worker + 1) % nworker;
+        if (ring_array_push(&s, handoff[id].conn_new) == CC_OK) {
+            break;
+        }
+    }
+    if (i == nworker) { /* close if can't enqueue */
         log_error("new connetion queue is full, closing connection");
+        INCR(server_metrics, server_accept_ex);
+        hdl->term(s->ch);
         buf_sock_reset(s);
         buf_sock_return(&s);
         return false;
     }
 
-    /* notify worker, note this may fail and will be retried via write event */
-    _server_pipe_write();
+    /* worker is notified once the current burst of accepts is over */
+    new_pending[id] = true;
 
     return true;
 }
@@ -178,6 +192,7 @@ _server_event_read(struct buf_sock *s)
     ASSERT(c->level == CHANNEL_META);
 
     while (_tcp_accept(s));
+    _server_notify();
 }
 
 static void
@@ -186,16 +201,13 @@ _server_event(void *arg, uint32_t events)
     struct buf_sock *s = arg;
     log_verb("server event %06"PRIX32" with data %p", events, s);
 
-    if (s == NULL) { /* event on pipe */
+    if (arg != server_sock) { /* event on pipe, arg is the worker handoff */
+        struct conn_handoff *h = arg;
+
         if (events & EVENT_READ) { /* terminating connection from worker */
             log_verb("processing server read event on pipe");
             INCR(server_metrics, server_event_read);
-            _server_pipe_read();
-        }
-        if (events & EVENT_WRITE) { /* retrying worker notification */
-            log_verb("processing server write event on pipe");
-            INCR(server_metrics, server_event_write);
-            _server_pipe_write();
+            _server_pipe_read(h);
         }
         if (events & EVENT_ERR) {
             log_debug("processing server error event on pipe");
@@ -215,6 +227,40 @@ _server_event(void *arg, uint32_t events)
     }
 }
 
+/* each worker gets a listening socket bound to the same address */
+static rstatus_i
+_server_setup_reuseport(void)
+{
+    struct buf_sock *s;
+    uint32_t i;
+
+    worker_sock = cc_zalloc(sizeof(struct buf_sock *) * nworker);
+    if (worker_sock == NULL) {
+        log_error("could not allocate worker listening sockets");
+        return CC_ENOMEM;
+    }
+
+    for (i = 0; i < nworker; ++i) {
+        s = buf_sock_borrow();
+        if (s == NULL) {
+            log_error("could not get buf_sock for worker %"PRIu32, i);
+            return CC_ENOMEM;
+        }
+        worker_sock[i] = s;
+        s->hdl = hdl;
+        if (!hdl->open(server_ai, s->ch)) {
+            log_error("listening setup failed for worker %"PRIu32, i);
+            return CC_ERROR;
+        }
+        s->ch->level = CHANNEL_META;
+        core_worker_listen(i, s);
+    }
+
+    log_info("%"PRIu32" workers listening with SO_REUSEPORT", nworker);
+
+    return CC_OK;
+}
+
 void
 core_server_setup(server_options_st *options, server_metrics_st *metrics)
 {
@@ -223,9 +269,15 @@ core_server_setup(server_options_st *options, server_metrics_st *metrics)
     char *port = SERVER_PORT;
     int timeout = SERVER_TIMEOUT;
     int nevent = SERVER_NEVENT;
+    uint32_t i;
 
     log_info("set up the %s module", SERVER_MODULE_NAME);
 
+    if (!worker_init) {
+        log_crit("failed to setup server core; worker has to be setup first");
+        goto error;
+    }
+
     if (server_init) {
         log_warn("server has already been setup, re-creating");
         core_server_teardown();
@@ -233,43 +285,20 @@ core_server_setup(server_options_st *options, server_metrics_st *metrics)
 
     server_metrics = metrics;
 
+    reuseport = SERVER_REUSEPORT;
+    cpus.n = 0;
     if (options != NULL) {
         host = option_str(&options->server_host);
         port = option_str(&options->server_port);
         timeout = option_uint(&options->server_timeout);
         nevent = option_uint(&options->server_nevent);
-    }
-
-    /* setup shared data structures between server and worker */
-    pipe_new = pipe_conn_create();
-    pipe_term = pipe_conn_create();
-    if (pipe_new == NULL || pipe_term == NULL) {
-        log_error("Could not create connection for pipe, abort");
-        goto error;
-    }
-
-    if (!pipe_open(NULL, pipe_new)) {
-        log_error("Could not open pipe for new connection: %s",
-                strerror(pipe_new->err));
-        goto error;
-    }
-    if (!pipe_open(NULL, pipe_term)) {
-        log_error("Could not open pipe for terminated connection: %s",
-                strerror(pipe_term->err));
-        goto error;
-    }
-
-
-    pipe_set_nonblocking(pipe_new);
-    pipe_set_nonblocking(pipe_term);
-
-    conn_new = ring_array_create(sizeof(struct buf_sock *),
-            RING_ARRAY_DEFAULT_CAP);
-    conn_term = ring_array_create(sizeof(struct buf_sock *),
-            RING_ARRAY_DEFAULT_CAP);
-    if (conn_new == NULL || conn_term == NULL) {
-        log_error("core setup failed: could not allocate conn array(s)");
-        goto error;
+        reuseport = option_bool(&options->server_reuseport);
+        if (option_str(&options->server_cpus) != NULL &&
+                affinity_parse(&cpus, option_str(&options->server_cpus))
+                != CC_OK) {
+            log_crit("failed to setup server core; invalid cpu list");
+            goto error;
+        }
     }
 
     ctx->timeout = timeout;
@@ -281,7 +310,8 @@ core_server_setup(server_options_st *options, server_metrics_st *metrics)
 
     hdl->accept = (channel_accept_fn)tcp_accept;
     hdl->reject = (channel_reject_fn)tcp_reject_all;
-    hdl->open = (channel_open_fn)tcp_listen;
+    hdl->open = reuseport ? (channel_open_fn)tcp_listen_reuseport :
+        (channel_open_fn)tcp_listen;
     hdl->term = (channel_term_fn)tcp_close;
     hdl->recv = (channel_recv_fn)tcp_recv;
     hdl->send = (channel_send_fn)tcp_send;
@@ -296,6 +326,28 @@ core_server_setup(server_options_st *options, server_metrics_st *metrics)
      * one that contains a type field and a pointer to the actual struct, or
      * define common fields, like how posix sockaddr structs are used.
      */
+    if (CC_OK != getaddr(&server_ai, host, port)) {
+        log_crit("failed to resolve address for admin host & port");
+        goto error;
+    }
+
+    if (reuseport && inherit_sd >= 0) {
+        log_warn("inherited listening socket is not used with reuseport");
+        close(inherit_sd);
+        inherit_sd = -1;
+    }
+
+    if (reuseport) {
+        if (_server_setup_reuseport() != CC_OK) {
+            log_crit("failed to setup server core; could not setup worker "
+                    "listening sockets");
+            goto error;
+        }
+        server_init = true;
+
+        return;
+    }
+
     server_sock = buf_sock_borrow();
     if (server_sock == NULL) {
         log_crit("failed to setup server core; could not get buf_sock");
@@ -303,20 +355,31 @@ core_server_setup(server_options_st *options, server_metrics_st *metrics)
     }
 
     server_sock->hdl = hdl;
-    if (CC_OK != getaddr(&server_ai, host, port)) {
-        log_crit("failed to resolve address for admin host & port");
-        goto error;
-    }
 
     c = server_sock->ch;
-    if (!hdl->open(server_ai, c)) {
+    if (inherit_sd >= 0) {
+        c->sd = inherit_sd;
+        c->state = CHANNEL_LISTEN;
+        inherit_sd = -1;
+        log_info("server listening on inherited socket descriptor %d", c->sd);
+    } else if (!hdl->open(server_ai, c)) {
         log_crit("server connection setup failed");
         goto error;
     }
     c->level = CHANNEL_META;
 
+    new_pending = cc_zalloc(sizeof(bool) * nworker);
+    if (new_pending == NULL) {
+        log_crit("failed to setup server core; could not allocate flags");
+        goto error;
+    }
+
     event_add_read(ctx->evb, hdl->rid(c), server_sock);
-    event_add_read(ctx->evb, pipe_read_id(pipe_term), NULL);
+    for (i = 0; i < nworker; ++i) {
+        event_add_read(ctx->evb, pipe_read_id(handoff[i].pipe_term),
+                &handoff[i]);
+    }
+    next_worker = 0;
 
     server_init = true;
 
@@ -329,6 +392,8 @@ error:
 void
 core_server_teardown(void)
 {
+    uint32_t i;
+
     log_info("tear down the %s module", SERVER_MODULE_NAME);
 
     if (!server_init) {
@@ -336,16 +401,40 @@ core_server_teardown(void)
     } else {
         event_base_destroy(&(ctx->evb));
         freeaddrinfo(server_ai);
-        buf_sock_return(&server_sock);
+        if (reuseport) {
+            for (i = 0; i < nworker; ++i) {
+                hdl->term(worker_sock[i]->ch);
+                buf_sock_return(&worker_sock[i]);
+            }
+            cc_free(worker_sock);
+        } else {
+            buf_sock_return(&server_sock);
+            cc_free(new_pending);
+        }
     }
-    ring_array_destroy(&conn_term);
-    ring_array_destroy(&conn_new);
-    pipe_conn_destroy(&pipe_term);
-    pipe_conn_destroy(&pipe_new);
     server_metrics = NULL;
     server_init = false;
 }
 
+int
+core_server_fd(void)
+{
+    if (!server_init || reuseport) {
+        return -1;
+    }
+
+    return fcntl(server_sock->ch->sd, F_DUPFD_CLOEXEC, 0);
+}
+
+void
+core_server_inherit(int sd)
+{
+    if (inherit_sd >= 0) {
+        close(inherit_sd);
+    }
+    inherit_sd = sd;
+}
+
 static rstatus_i
 _server_evwait(void)
 {
@@ -367,6 +456,10 @@ core_server_evloop(void *arg)
 {
     bool *running = arg;
 
+    if (cpus.n > 0 && affinity_pin(&cpus) == CC_OK) {
+        log_info("server pinned to %"PRIu32" cpu(s)", cpus.n);
+    }
+
     while (__atomic_load_n(running, __ATOMIC_ACQUIRE)) {
         if (_server_evwait() != CC_OK) {
             log_crit("server core event loop exited due to failure");
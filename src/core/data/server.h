@@ -4,17 +4,21 @@
 #include <cc_metric.h>
 #include <cc_option.h>
 
-#define SERVER_HOST     NULL
-#define SERVER_PORT     "12321"
-#define SERVER_TIMEOUT  100     /* in ms */
-#define SERVER_NEVENT   1024
-
-/*          name            type                default         description */
-#define SERVER_OPTION(ACTION)                                                                   \
-    ACTION( server_host,    OPTION_TYPE_STR,    SERVER_HOST,    "interfaces listening on"      )\
-    ACTION( server_port,    OPTION_TYPE_STR,    SERVER_PORT,    "port listening on"            )\
-    ACTION( server_timeout, OPTION_TYPE_UINT,   SERVER_TIMEOUT, "evwait timeout"               )\
-    ACTION( server_nevent,  OPTION_TYPE_UINT,   SERVER_NEVENT,  "evwait max nevent returned"   )
+#define SERVER_HOST      NULL
+#define SERVER_PORT      "12321"
+#define SERVER_TIMEOUT   100    /* in ms */
+#define SERVER_NEVENT    1024
+#define SERVER_REUSEPORT false
+#define SERVER_CPUS      NULL   /* not pinned */
+
+/*          name                type                default             description */
+#define SERVER_OPTION(ACTION)                                                                           \
+    ACTION( server_host,        OPTION_TYPE_STR,    SERVER_HOST,        "interfaces listening on"      )\
+    ACTION( server_port,        OPTION_TYPE_STR,    SERVER_PORT,        "port listening on"            )\
+    ACTION( server_timeout,     OPTION_TYPE_UINT,   SERVER_TIMEOUT,     "evwait timeout"               )\
+    ACTION( server_nevent,      OPTION_TYPE_UINT,   SERVER_NEVENT,      "evwait max nevent returned"   )\
+    ACTION( server_reuseport,   OPTION_TYPE_BOOL,   SERVER_REUSEPORT,   "per-worker SO_REUSEPORT accept")\
+    ACTION( server_cpus,        OPTION_TYPE_STR,    SERVER_CPUS,        "CPUs server is pinned to"     )
 
 typedef struct {
     SERVER_OPTION(OPTION_DECLARE)
@@ -26,7 +30,9 @@ typedef struct {
     ACTION( server_event_loop,      METRIC_COUNTER, "# server event loops returned" )\
     ACTION( server_event_read,      METRIC_COUNTER, "# server core_read events"     )\
     ACTION( server_event_write,     METRIC_COUNTER, "# server core_write events"    )\
-    ACTION( server_event_error,     METRIC_COUNTER, "# server core_error events"    )
+    ACTION( server_event_error,     METRIC_COUNTER, "# server core_error events"    )\
+    ACTION( server_accept,          METRIC_COUNTER, "# server connections accepted" )\
+    ACTION( server_accept_ex,       METRIC_COUNTER, "# server accept exceptions"    )
 
 typedef struct {
     CORE_SERVER_METRIC(METRIC_DECLARE)
@@ -34,6 +40,20 @@ typedef struct {
 
 struct addrinfo;
 
+/*
+ * By default the server thread accepts all connections and hands them off to
+ * worker threads. With server_reuseport set, each worker instead gets its own
+ * listening socket bound to the same address with SO_REUSEPORT, and accepts
+ * connections directly in its event loop; the server thread stays idle.
+ */
 void core_server_setup(server_options_st *options, server_metrics_st *metrics);
 void core_server_teardown(void);
+
+/* The listening socket can be handed to a process replacing this one, so that
+ * connections pending on it are not refused in between.
+ */
+/* a duplicate of the listening socket, or -1 (e.g. with server_reuseport) */
+int core_server_fd(void);
+/* listen on sd instead of binding on the next core_server_setup */
+void core_server_inherit(int sd);
 void *core_server_evloop(void *arg); /* arg is ignored, signature for pthread_create compatibility */
@@ -1,12 +1,34 @@
 #pragma once
 
+#include <stdint.h>
+
+struct buf_sock;
 struct pipe_conn;
 struct ring_array;
 
-/* pipe for server/worker thread communication */
-extern struct pipe_conn *pipe_new;
-extern struct pipe_conn *pipe_term;
+#define CONN_HANDOFF_BATCH 64 /* max # of connections taken per pop */
+
+/* each worker thread has its own set of pipes and arrays to receive new
+ * connections from server and return terminated connections back to server
+ *
+ * The producer pushes connections onto the array, and notifies the consumer
+ * once per burst rather than once per connection. The consumer drains the
+ * notification before popping, so that it never misses a later push.
+ */
+struct conn_handoff {
+    /* notification for server/worker thread communication, see pipe_notify */
+    struct pipe_conn    *pipe_new;  /* server(w) -> worker(r) */
+    struct pipe_conn    *pipe_term; /* worker(w) -> server(r) */
+
+    /* array holding accepted connections */
+    struct ring_array   *conn_new;  /* server(w) -> worker(r) */
+    struct ring_array   *conn_term; /* worker(w) -> server(r) */
+};
+
+extern struct conn_handoff *handoff; /* handoff[nworker], owned by worker */
+extern uint32_t nworker;
 
-/* array holding accepted connections */
-extern struct ring_array *conn_new;
-extern struct ring_array *conn_term;
+/* hand a listening socket to worker `id', which then accepts connections on it
+ * directly instead of receiving them from server (server_reuseport mode)
+ */
+void core_worker_listen(uint32_t id, struct buf_sock *s);
@@ -4,6 +4,7 @@
 #include "shared.h"
 
 #include "time/time.h"
+#include "util/affinity.h"
 
 #include <buffer/cc_buf.h>
 #include <buffer/cc_dbuf.h>
@@ -16,14 +17,31 @@
 
 #include <stream/cc_sockio.h>
 
+#include <cc_mm.h>
+
 #include <sysexits.h>
 
 #define WORKER_MODULE_NAME "core::worker"
 
 worker_metrics_st *worker_metrics = NULL;
 
-static struct context context;
-static struct context *ctx = &context;
+struct conn_handoff *handoff = NULL;    /* handoff[nworker] */
+uint32_t nworker = WORKER_THREADS;
+
+static struct context *contexts = NULL; /* contexts[nworker] */
+static uint32_t nstarted = 0;           /* # worker contexts claimed */
+
+/* listening buf_socks, owned by server, of workers that accept connections
+ * directly, see core_worker_listen
+ */
+static struct buf_sock **listeners = NULL; /* listeners[nworker] */
+static struct affinity_list cpus; /* worker i runs on the i-th, if any */
+
+/* context, handoff & listener of the worker owning the calling thread */
+static __thread struct context *ctx = NULL;
+static __thread struct conn_handoff *ho = NULL;
+static __thread struct buf_sock *wl = NULL;
+static __thread bool term_pending = false; /* server yet to be notified */
 
 static channel_handler_st handlers;
 static channel_handler_st *hdl = &handlers;
@@ -72,77 +90,99 @@ _worker_event_write(struct buf_sock *s)
 static inline void
 _worker_event_read(struct buf_sock *s)
 {
+    rstatus_i status;
+
     ASSERT(s != NULL);
 
     log_verb("reading on buf_sock %p", s);
-    /* TODO(kyang): consider refactoring dbuf_tcp_read and buf_tcp_read to have no return status
-       at all, since the return status is already given by the connection state */
-    buf_tcp_read(s);
-    if (processor->read(&s->rbuf, &s->wbuf, &s->data) < 0) {
-        log_debug("handler signals channel termination");
-        s->ch->state = CHANNEL_TERM;
-        return;
-    }
-    if (buf_rsize(s->wbuf) > 0) {
-        log_verb("attempt to write");
-        _worker_event_write(s);
-    }
+    /* read until the socket is drained, not just until rbuf is full: read
+     * events may be edge-triggered (io_uring), and won't come again for data
+     * left behind. A write that backs up switches to write events, the read
+     * event re-added after it reports whatever is still unread.
+     */
+    do {
+        status = buf_tcp_read(s);
+        if (processor->read(&s->rbuf, &s->wbuf, &s->data) < 0) {
+            log_debug("handler signals channel termination");
+            s->ch->state = CHANNEL_TERM;
+            return;
+        }
+        if (buf_rsize(s->wbuf) > 0 || buf_ref_rsize(s->wbuf) > 0) {
+            log_verb("attempt to write");
+            if (_worker_event_write(s) != CC_OK) {
+                return;
+            }
+        }
+    } while (status == CC_ERETRY);
 }
 
 static void
 worker_add_stream(void)
 {
-    struct buf_sock *s;
-    char buf[RING_ARRAY_DEFAULT_CAP]; /* buffer for discarding pipe data */
-    int i;
-    rstatus_i status;
+    struct buf_sock *s[CONN_HANDOFF_BATCH];
+    uint32_t i, n;
 
-    /* server pushes connection on to the ring array before writing to the pipe,
-     * therefore, we should read from the pipe first and take the connections
-     * off the ring array to match the number of bytes received.
-     *
-     * Once we move server to its own thread, it is possible that there are more
-     * connections added to the queue when we are processing, it is OK to wait
-     * for the next read event in that case.
+    /* drain the notification before taking connections off the ring array,
+     * any connection pushed after this point comes with a new notification
      */
-
-    i = pipe_recv(pipe_new, buf, RING_ARRAY_DEFAULT_CAP);
-    if (i < 0) { /* errors, do not read from ring array */
+    if (pipe_drain(ho->pipe_new) != CC_OK) {
         log_warn("not adding new connections due to pipe error");
         return;
     }
 
-    /* each byte in the pipe corresponds to a new connection, which we will
-     * now get from the ring array
-     */
-    for (; i > 0; --i) {
-        status = ring_array_pop(&s, conn_new);
-        if (status != CC_OK) {
-            log_warn("event number does not match conn queue: missing %d conns",
-                    i);
-            return;
+    while ((n = ring_array_pop_n(s, CONN_HANDOFF_BATCH, ho->conn_new)) > 0) {
+        for (i = 0; i < n; ++i) {
+            INCR(worker_metrics, worker_add_stream);
+            log_verb("Adding new buf_sock %p to worker thread", s[i]);
+            s[i]->owner = ctx;
+            s[i]->hdl = hdl;
+            event_add_read(ctx->evb, hdl->rid(s[i]->ch), s[i]);
         }
-        INCR(worker_metrics, worker_add_stream);
-        log_verb("Adding new buf_sock %p to worker thread", s);
-        s->owner = ctx;
-        s->hdl = hdl;
-        event_add_read(ctx->evb, hdl->rid(s->ch), s); /* event activated */
     }
 }
 
-static inline void
-_worker_pipe_write(void)
+/* returns true if a connection is present, false if no more pending */
+static inline bool
+_worker_tcp_accept(struct buf_sock *ss)
 {
-    ASSERT(pipe_term != NULL);
+    struct buf_sock *s;
+    struct tcp_conn *sc = ss->ch;
+
+    s = buf_sock_borrow();
+    if (s == NULL) {
+        log_error("establish connection failed: cannot allocate buf_sock, "
+                "reject connection request");
+        INCR(worker_metrics, worker_accept_ex);
+        ss->hdl->reject(sc);
+        return false;
+    }
 
-    ssize_t status = pipe_send(pipe_term, "", 1);
+    if (!ss->hdl->accept(sc, s->ch)) {
+        buf_sock_reset(s);
+        buf_sock_return(&s);
+        return false;
+    }
 
-    if (status == 0 || status == CC_EAGAIN) {
-        /* retry write */
-        log_verb("server core: retry send on pipe");
-        event_add_write(ctx->evb, pipe_write_id(pipe_term), NULL);
-    } else if (status == CC_ERROR) {
-        log_error("could not write to pipe - %s", strerror(pipe_term->err));
+    INCR(worker_metrics, worker_accept);
+    log_verb("Accepted new buf_sock %p on worker thread", s);
+    s->owner = ctx;
+    s->hdl = hdl;
+    event_add_read(ctx->evb, hdl->rid(s->ch), s);
+
+    return true;
+}
+
+/* one notification covers all connections returned in the last event loop */
+static inline void
+_worker_notify(void)
+{
+    if (!term_pending) {
+        return;
+    }
+
+    term_pending = false;
+    if (pipe_notify(ho->pipe_term) != CC_OK) {
+        log_error("could not notify server - %s", strerror(ho->pipe_term->err));
     }
 }
 
@@ -157,9 +197,17 @@ worker_ret_stream(struct buf_sock *s)
     processor->error(&s->rbuf, &s->wbuf, &s->data);
     event_del(ctx->evb, hdl->rid(s->ch));
 
-    /* push buf_sock to queue */
     INCR(worker_metrics, worker_ret_stream);
-    if (ring_array_push(&s, conn_term) != CC_OK) {
+    if (wl != NULL) { /* accepted by this worker, return it directly */
+        hdl->term(s->ch);
+        buf_sock_reset(s);
+        buf_sock_return(&s);
+
+        return;
+    }
+
+    /* push buf_sock to queue */
+    if (ring_array_push(&s, ho->conn_term) != CC_OK) {
         /* here we have no choice but to clean up the stream to avoid leak */
         log_error("term connetion queue is full");
         hdl->term(s->ch);
@@ -168,8 +216,7 @@ worker_ret_stream(struct buf_sock *s)
 
         return;
     }
-    /* conn_term */
-    _worker_pipe_write();
+    term_pending = true; /* see _worker_notify */
 }
 
 static void
@@ -183,14 +230,22 @@ _worker_event(void *arg, uint32_t events)
             INCR(worker_metrics, worker_event_read);
             worker_add_stream();
         }
-        if (events & EVENT_WRITE) { /* retry return notification */
-            INCR(worker_metrics, worker_event_write);
-            _worker_pipe_write();
-        }
         if (events & EVENT_ERR) {
             INCR(worker_metrics, worker_event_error);
             log_error("error event received on pipe");
         }
+    } else if (s->ch->level == CHANNEL_META) { /* event on listening socket */
+        if (events & EVENT_READ) {
+            log_verb("processing worker read event on listening buf_sock %p",
+                    s);
+            INCR(worker_metrics, worker_event_read);
+            while (_worker_tcp_accept(s));
+        }
+        if (events & EVENT_ERR) { /* effectively refusing new conn */
+            log_error("error event received on listening socket");
+            INCR(worker_metrics, worker_event_error);
+            event_del(ctx->evb, hdl->rid(s->ch));
+        }
     } else {
         /* event on one of the connections */
 
@@ -229,11 +284,59 @@ _worker_event(void *arg, uint32_t events)
     }
 }
 
+static rstatus_i
+_worker_handoff_create(struct conn_handoff *h)
+{
+    h->pipe_new = pipe_conn_create();
+    h->pipe_term = pipe_conn_create();
+    if (h->pipe_new == NULL || h->pipe_term == NULL) {
+        log_error("Could not create connection for pipe");
+        return CC_ENOMEM;
+    }
+
+    if (!pipe_open_notify(NULL, h->pipe_new)) {
+        log_error("Could not open pipe for new connection: %s",
+                strerror(h->pipe_new->err));
+        return CC_ERROR;
+    }
+    if (!pipe_open_notify(NULL, h->pipe_term)) {
+        log_error("Could not open pipe for terminated connection: %s",
+                strerror(h->pipe_term->err));
+        return CC_ERROR;
+    }
+
+    h->conn_new = ring_array_create(sizeof(struct buf_sock *),
+            RING_ARRAY_DEFAULT_CAP);
+    h->conn_term = ring_array_create(sizeof(struct buf_sock *),
+            RING_ARRAY_DEFAULT_CAP);
+    if (h->conn_new == NULL || h->conn_term == NULL) {
+        log_error("could not allocate conn array(s)");
+        return CC_ENOMEM;
+    }
+
+    return CC_OK;
+}
+
+static void
+_worker_handoff_destroy(struct conn_handoff *h)
+{
+    if (h->conn_term != NULL) {
+        ring_array_destroy(&h->conn_term);
+    }
+    if (h->conn_new != NULL) {
+        ring_array_destroy(&h->conn_new);
+    }
+    pipe_conn_destroy(&h->pipe_term);
+    pipe_conn_destroy(&h->pipe_new);
+}
+
 void
-core_worker_setup(worker_options_st *options, worker_metrics_st *metrics)
+core_worker_setup(worker_options_st *options, worker_metrics_st *metrics,
+        struct data_processor *p)
 {
     int timeout = WORKER_TIMEOUT;
     int nevent = WORKER_NEVENT;
+    uint32_t i;
 
     log_info("set up the %s module", WORKER_MODULE_NAME);
 
@@ -244,18 +347,62 @@ core_worker_setup(worker_options_st *options, worker_metrics_st *metrics)
 
     worker_metrics = metrics;
 
+    nworker = WORKER_THREADS;
+    cpus.n = 0;
     if (options != NULL) {
         timeout = option_uint(&options->worker_timeout);
         nevent = option_uint(&options->worker_nevent);
+        nworker = option_uint(&options->worker_threads);
+        if (option_str(&options->worker_cpus) != NULL &&
+                affinity_parse(&cpus, option_str(&options->worker_cpus))
+                != CC_OK) {
+            log_crit("failed to setup worker thread core; invalid cpu list");
+            exit(EX_CONFIG);
+        }
     }
 
-    ctx->timeout = timeout;
-    ctx->evb = event_base_create(nevent, _worker_event);
-    if (ctx->evb == NULL) {
-        log_crit("failed to setup worker thread core; could not create event_base");
+    if (nworker == 0 || nworker > WORKER_MAX_NTHREAD) {
+        log_crit("failed to setup worker thread core; invalid # of worker "
+                "threads: %"PRIu32, nworker);
+        exit(EX_CONFIG);
+    }
+    if (nworker > 1 && !p->concurrent) {
+        log_crit("failed to setup worker thread core; %"PRIu32" worker "
+                "threads need a thread-safe data processor, see worker.h",
+                nworker);
         exit(EX_CONFIG);
     }
 
+    /* setup shared data structures between server and workers */
+    handoff = cc_zalloc(sizeof(struct conn_handoff) * nworker);
+    contexts = cc_zalloc(sizeof(struct context) * nworker);
+    listeners = cc_zalloc(sizeof(struct buf_sock *) * nworker);
+    if (handoff == NULL || contexts == NULL || listeners == NULL) {
+        log_crit("failed to setup worker thread core; could not allocate "
+                "worker contexts");
+        goto error;
+    }
+
+    for (i = 0; i < nworker; ++i) {
+        if (_worker_handoff_create(&handoff[i]) != CC_OK) {
+            log_crit("failed to setup worker thread core; could not create "
+                    "handoff for worker %"PRIu32, i);
+            goto error;
+        }
+
+        contexts[i].timeout = timeout;
+        contexts[i].evb = event_base_create(nevent, _worker_event);
+        if (contexts[i].evb == NULL) {
+            log_crit("failed to setup worker thread core; could not create "
+                    "event_base");
+            goto error;
+        }
+
+        event_add_read(contexts[i].evb, pipe_read_id(handoff[i].pipe_new),
+                NULL);
+    }
+    nstarted = 0;
+
     /* worker thread does not handle accept/reject/open/term directly */
     hdl->accept = NULL;
     hdl->reject = NULL;
@@ -266,20 +413,43 @@ core_worker_setup(worker_options_st *options, worker_metrics_st *metrics)
     hdl->rid = (channel_id_fn)tcp_read_id;
     hdl->wid = (channel_id_fn)tcp_write_id;
 
-    event_add_read(ctx->evb, pipe_read_id(pipe_new), NULL);
+    log_info("%"PRIu32" worker thread(s) configured", nworker);
 
     worker_init = true;
+
+    return;
+
+error:
+    exit(EX_CONFIG);
+}
+
+void
+core_worker_listen(uint32_t id, struct buf_sock *s)
+{
+    ASSERT(worker_init && id < nworker);
+    ASSERT(s->ch->level == CHANNEL_META);
+
+    listeners[id] = s;
+    event_add_read(contexts[id].evb, s->hdl->rid(s->ch), s);
 }
 
 void
 core_worker_teardown(void)
 {
+    uint32_t i;
+
     log_info("tear down the %s module", WORKER_MODULE_NAME);
 
     if (!worker_init) {
         log_warn("%s has never been setup", WORKER_MODULE_NAME);
     } else {
-        event_base_destroy(&(ctx->evb));
+        for (i = 0; i < nworker; ++i) {
+            event_base_destroy(&(contexts[i].evb));
+            _worker_handoff_destroy(&handoff[i]);
+        }
+        cc_free(listeners);
+        cc_free(contexts);
+        cc_free(handoff);
     }
     worker_metrics = NULL;
     worker_init = false;
@@ -297,6 +467,7 @@ _worker_evwait(void)
 
     INCR(worker_metrics, worker_event_loop);
     INCR_N(worker_metrics, worker_event_total, n);
+    _worker_notify();
     time_update();
 
     return CC_OK;
@@ -305,13 +476,35 @@ _worker_evwait(void)
 void *
 core_worker_evloop(void *arg)
 {
+    uint32_t id;
+
     processor = arg;
 
+    id = __atomic_fetch_add(&nstarted, 1, __ATOMIC_RELAXED);
+    if (id >= nworker) {
+        log_crit("worker core event loop started more than %"PRIu32" times",
+                nworker);
+        exit(1);
+    }
+    ctx = &contexts[id];
+    ho = &handoff[id];
+    wl = listeners[id];
+
+    if (cpus.n > 0 && affinity_pin_nth(&cpus, id) == CC_OK) {
+        log_info("worker %"PRIu32" pinned to cpu %"PRIu16, id,
+                cpus.id[id % cpus.n]);
+    }
+
+    log_info("worker %"PRIu32" entering event loop", id);
+
     while (__atomic_load_n(&processor->running, __ATOMIC_ACQUIRE)) {
         if (_worker_evwait() != CC_OK) {
             log_crit("worker core event loop exited due to failure");
             exit(1);
         }
+        if (id == 0 && processor->tick != NULL) {
+            processor->tick();
+        }
     }
 
     return NULL;
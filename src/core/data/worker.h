@@ -6,11 +6,16 @@
 
 #define WORKER_TIMEOUT   100     /* in ms */
 #define WORKER_NEVENT    1024
+#define WORKER_THREADS   1
+#define WORKER_MAX_NTHREAD 256
+#define WORKER_CPUS      NULL    /* not pinned */
 
 /*          name            type                default         description */
 #define WORKER_OPTION(ACTION)                                                                   \
     ACTION( worker_timeout, OPTION_TYPE_UINT,   WORKER_TIMEOUT, "evwait timeout"               )\
-    ACTION( worker_nevent,  OPTION_TYPE_UINT,   WORKER_NEVENT,  "evwait max nevent returned"   )
+    ACTION( worker_nevent,  OPTION_TYPE_UINT,   WORKER_NEVENT,  "evwait max nevent returned"   )\
+    ACTION( worker_threads, OPTION_TYPE_UINT,   WORKER_THREADS, "# worker threads, see below"  )\
+    ACTION( worker_cpus,    OPTION_TYPE_STR,    WORKER_CPUS,    "CPUs workers are pinned to"   )
 
 typedef struct {
     WORKER_OPTION(OPTION_DECLARE)
@@ -24,7 +29,9 @@ typedef struct {
     ACTION( worker_event_write,     METRIC_COUNTER, "# worker core_write events"    )\
     ACTION( worker_event_error,     METRIC_COUNTER, "# worker core_error events"    )\
     ACTION( worker_add_stream,      METRIC_COUNTER, "# worker adding a stream"      )\
-    ACTION( worker_ret_stream,      METRIC_COUNTER, "# worker returning a stream"   )
+    ACTION( worker_ret_stream,      METRIC_COUNTER, "# worker returning a stream"   )\
+    ACTION( worker_accept,          METRIC_COUNTER, "# worker connections accepted" )\
+    ACTION( worker_accept_ex,       METRIC_COUNTER, "# worker accept exceptions"    )
 
 typedef struct {
     CORE_WORKER_METRIC(METRIC_DECLARE)
@@ -37,16 +44,39 @@ typedef struct {
  *
  * Applications should set and pass their instance of processor as argument
  * to core_worker_evloop().
+ *
+ * Only a processor that sets concurrent, i.e. whose read/write/error (and
+ * the storage behind them) can be called from several threads at once, runs
+ * on more than one worker thread. For any other processor, setup fails with
+ * worker_threads > 1, since serializing all storage access behind one lock
+ * would not scale past a single core anyway. Currently, these scale across
+ * workers:
+ *   - pelikan_pingserver, which keeps no data;
+ *   - pelikan_slimcache with cuckoo_concurrent, a lock-striped cuckoo table.
+ * twemcache, rds, slimrds and cdb run a single worker thread.
+ *
+ * An optional tick is called by the first worker each time its event loop
+ * wakes up, i.e. at least once every worker_timeout ms, for housekeeping that
+ * should not wait for a request, e.g. proactive expiration. It may run
+ * alongside processing on other workers if the processor is concurrent, and
+ * should cap its own work per call.
  */
 struct buf;
 typedef int (*data_fn)(struct buf **, struct buf **, void **);
+typedef void (*tick_fn)(void);
 struct data_processor {
     data_fn read;
     data_fn write;
     data_fn error;
+    tick_fn tick;
     bool running;
+    bool concurrent; /* read/write/error need no serialization */
 };
 
-void core_worker_setup(worker_options_st *options, worker_metrics_st *metrics);
+/* p is the processor to be run, see above for how it limits worker threads */
+void core_worker_setup(worker_options_st *options, worker_metrics_st *metrics,
+        struct data_processor *p);
+
 void core_worker_teardown(void);
+/* each thread running the loop claims the next unused worker context */
 void *core_worker_evloop(void *arg);
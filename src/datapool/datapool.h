@@ -1,14 +1,46 @@
 #pragma once
 
+#include <cc_define.h>
+
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 struct datapool;
 
+/* called by the last prefault thread to finish, with the time taken in ms */
+typedef void (*datapool_prefault_fn)(uint64_t ms);
+
+/* page_size only applies to pools in memory, see hugepage.h */
 struct datapool *datapool_open(const char *path, const char *user_signature,
-    size_t size, int *fresh, bool prefault);
+    size_t size, int *fresh, bool prefault, size_t page_size);
 void datapool_close(struct datapool *pool);
 
+/*
+ * A pool in memory can also be backed by a memfd, so that another process can
+ * open it with the same contents, e.g. after receiving the fd over a unix
+ * socket. fd is -1 to create a new memfd. The pool owns fd, and its contents
+ * are kept for the next open only if it was closed with datapool_close; a
+ * pool not closed cleanly is opened as fresh.
+ */
+struct datapool *datapool_open_fd(int fd, const char *user_signature,
+    size_t size, int *fresh, bool prefault);
+/* the memfd backing the pool, or -1 */
+int datapool_fd(struct datapool *pool);
+
 void *datapool_addr(struct datapool *pool);
 size_t datapool_size(struct datapool *pool);
+/* size of the pages backing the pool */
+size_t datapool_page_size(struct datapool *pool);
+/*
+ * Touch every page of the pool with nthread threads (0 for one per online
+ * CPU), each over a disjoint range. Returns once all pages are touched, or
+ * right away if background is set; the pool can be used meanwhile and
+ * datapool_close waits for prefault to finish. done may be NULL.
+ *
+ * datapool_open(..., prefault = true, ...) is the same as prefaulting in the
+ * foreground with one thread per CPU.
+ */
+rstatus_i datapool_prefault(struct datapool *pool, uint32_t nthread,
+    bool background, datapool_prefault_fn done);
 void datapool_set_user_data(const struct datapool *pool, const void *user_data, size_t user_size);
 void datapool_get_user_data(const struct datapool *pool, void *user_data, size_t user_size);
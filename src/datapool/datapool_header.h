@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Header at the beginning of a pool file or memfd, shared by both datapool
+ * implementations, so that either can open a pool the other has written.
+ * It's verified every time the pool is opened.
+ */
+
+#define DATAPOOL_SIGNATURE ("PELIKAN") /* 8 bytes */
+#define DATAPOOL_SIGNATURE_LEN (sizeof(DATAPOOL_SIGNATURE))
+
+/*
+ * Size of the data pool header.
+ * Big enough to fit all necessary metadata, but most of this size is left
+ * unused for future expansion. A page, so that the data that follows is page
+ * aligned.
+ */
+
+#define DATAPOOL_INTERNAL_HEADER_LEN 2048
+#define DATAPOOL_USER_LAYOUT_LEN       48
+#define DATAPOOL_USER_HEADER_LEN     2048
+#define DATAPOOL_HEADER_LEN (DATAPOOL_INTERNAL_HEADER_LEN + DATAPOOL_USER_HEADER_LEN)
+
+/*
+ * Bumped whenever the layout of what a pool holds changes, e.g. struct item of
+ * the slab module, so that pools written by an older binary start fresh.
+ */
+#define DATAPOOL_VERSION 2
+
+#define DATAPOOL_FLAG_DIRTY (1 << 0)
+#define DATAPOOL_VALID_FLAGS (DATAPOOL_FLAG_DIRTY)
+
+struct datapool_header {
+    uint8_t signature[DATAPOOL_SIGNATURE_LEN];
+    uint64_t version;
+    uint64_t size;
+    uint64_t flags;
+    uint8_t unused[DATAPOOL_INTERNAL_HEADER_LEN - 32];
+
+    uint8_t user_signature[DATAPOOL_USER_LAYOUT_LEN];
+    uint8_t user_data[DATAPOOL_USER_HEADER_LEN - DATAPOOL_USER_LAYOUT_LEN];
+};
@@ -4,6 +4,9 @@
  *
  */
 #include "datapool.h"
+#include "datapool_header.h"
+#include "hugepage.h"
+#include "prefault.h"
 
 #include <cc_mm.h>
 #include <cc_debug.h>
@@ -11,50 +14,25 @@
 #include <inttypes.h>
 #include <libpmem.h>
 #include <errno.h>
-
-#define DATAPOOL_SIGNATURE ("PELIKAN") /* 8 bytes */
-#define DATAPOOL_SIGNATURE_LEN (sizeof(DATAPOOL_SIGNATURE))
-
-/*
- * Size of the data pool header.
- * Big enough to fit all necessary metadata, but most of this size is left
- * unused for future expansion.
- */
-
-#define DATAPOOL_INTERNAL_HEADER_LEN 2048
-#define DATAPOOL_USER_LAYOUT_LEN       48
-#define DATAPOOL_USER_HEADER_LEN     2048
-#define DATAPOOL_HEADER_LEN (DATAPOOL_INTERNAL_HEADER_LEN + DATAPOOL_USER_HEADER_LEN)
-#define DATAPOOL_VERSION 1
-
-#define DATAPOOL_FLAG_DIRTY (1 << 0)
-#define DATAPOOL_VALID_FLAGS (DATAPOOL_FLAG_DIRTY)
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define PAGE_SIZE 4096
 
-/*
- * Header at the beginning of the file, it's verified every time the pool is
- * opened.
- */
-struct datapool_header {
-    uint8_t signature[DATAPOOL_SIGNATURE_LEN];
-    uint64_t version;
-    uint64_t size;
-    uint64_t flags;
-    uint8_t unused[DATAPOOL_INTERNAL_HEADER_LEN - 32];
-
-    uint8_t user_signature[DATAPOOL_USER_LAYOUT_LEN];
-    uint8_t user_data[DATAPOOL_USER_HEADER_LEN - DATAPOOL_USER_LAYOUT_LEN];
-};
-
 struct datapool {
     void *addr;
+    size_t page_size;
+    size_t page_used;
+    struct prefault prefault;
 
     struct datapool_header *hdr;
     void *user_addr;
     size_t mapped_len;
     int is_pmem;
     int file_backed;
+    int fd;             /* of a memfd pool, or -1 */
 };
 
 static void
@@ -155,17 +133,60 @@ datapool_flag_clear(struct datapool *pool, uint64_t flag)
     datapool_sync_hdr(pool);
 }
 
+/* validate the header of a freshly mapped pool, initializing it if invalid */
+static rstatus_i
+datapool_attach(struct datapool *pool, const char *user_signature, int *fresh)
+{
+    pool->hdr = pool->addr;
+    pool->user_addr = (uint8_t *)pool->addr + sizeof(struct datapool_header);
+
+    if (fresh) {
+        *fresh = 0;
+    }
+
+    if (!datapool_valid(pool)) {
+        if (fresh) {
+            *fresh = 1;
+        }
+
+        datapool_initialize(pool, user_signature);
+    } else if (!datapool_valid_user_signature(pool, user_signature)) {
+        log_error("wrong user signature (%s) used for pool", user_signature);
+        return CC_ERROR;
+    }
+
+    datapool_flag_set(pool, DATAPOOL_FLAG_DIRTY);
+
+    return CC_OK;
+}
+
+static void
+datapool_unmap(struct datapool *pool)
+{
+    if (pool->fd >= 0) {
+        int ret = munmap(pool->addr, pool->mapped_len);
+        ASSERT(ret == 0);
+        close(pool->fd);
+    } else if (pool->file_backed) {
+        int ret = pmem_unmap(pool->addr, pool->mapped_len);
+        ASSERT(ret == 0);
+    } else {
+        hugepage_unmap(pool->addr, pool->mapped_len, pool->page_size);
+    }
+}
+
 /*
  * Opens, and if necessary initializes, a datapool that resides in the given
- * file. If no file is provided, the pool is allocated through cc_zalloc.
+ * file. If no file is provided, the pool is mapped in memory, on huge pages
+ * of page_size bytes if requested.
  *
  * The the datapool to retain its contents, the datapool_close() call must
  * finish successfully.
  */
 struct datapool *
-datapool_open(const char *path, const char *user_signature, size_t size, int *fresh, bool prefault)
+datapool_open(const char *path, const char *user_signature, size_t size, int *fresh, bool prefault, size_t page_size)
 {
-    struct datapool *pool = cc_alloc(sizeof(*pool));
+    struct datapool *pool = cc_zalloc(sizeof(*pool));
     if (pool == NULL) {
         log_error("unable to create allocate memory for pmem mapping");
         goto err_alloc;
@@ -183,8 +204,11 @@ datapool_open(const char *path, const char *user_signature, size_t size, int *fr
 
     size_t map_size = size + sizeof(struct datapool_header);
 
+    pool->fd = -1;
+    pool->page_size = path == NULL ? page_size : HUGEPAGE_NONE;
+    pool->page_used = PAGE_SIZE;
     if (path == NULL) { /* fallback to DRAM if pmem is not configured */
-        pool->addr = cc_zalloc(map_size);
+        pool->addr = hugepage_map(map_size, page_size, &pool->page_used);
         pool->mapped_len = map_size;
         pool->is_pmem = 0;
         pool->file_backed = 0;
@@ -201,67 +225,122 @@ datapool_open(const char *path, const char *user_signature, size_t size, int *fr
 
     if (prefault) {
         log_info("prefault datapool");
-        volatile char *cur_addr = pool->addr;
-        char *addr_end = (char *)cur_addr + map_size;
-        for (; cur_addr < addr_end; cur_addr += PAGE_SIZE) {
-            *cur_addr = *cur_addr;
-        }
+        datapool_prefault(pool, 0, false, NULL);
     }
 
     log_info("mapped datapool %s with size %llu, is_pmem: %d",
         path, pool->mapped_len, pool->is_pmem);
 
-    pool->hdr = pool->addr;
-    pool->user_addr = (uint8_t *)pool->addr + sizeof(struct datapool_header);
+    if (datapool_attach(pool, user_signature, fresh) != CC_OK) {
+        goto err_map_adr;
+    }
 
-    if (fresh) {
-        *fresh = 0;
+    return pool;
+
+err_map_adr:
+    datapool_unmap(pool);
+err_map:
+    cc_free(pool);
+err_alloc:
+    return NULL;
+}
+
+/*
+ * Opens a datapool kept in the memfd fd, or a new one if fd is -1. The pool
+ * takes ownership of fd (closing it on error). The memory is mapped shared, so
+ * it outlives this process if fd is passed on to another one.
+ */
+struct datapool *
+datapool_open_fd(int fd, const char *user_signature, size_t size, int *fresh,
+    bool prefault)
+{
+    size_t map_size = size + sizeof(struct datapool_header);
+    struct datapool *pool;
+    struct stat st;
+
+    if (user_signature == NULL ||
+        cc_strnlen(user_signature, DATAPOOL_USER_LAYOUT_LEN) == DATAPOOL_USER_LAYOUT_LEN) {
+        log_error("invalid user signature");
+        goto err_alloc;
     }
 
-    if (!datapool_valid(pool)) {
-        if (fresh) {
-            *fresh = 1;
+    if (fd < 0) {
+#ifdef MFD_CLOEXEC
+        fd = memfd_create(user_signature, MFD_CLOEXEC);
+#else
+        errno = ENOSYS;
+#endif
+        if (fd < 0) {
+            log_error("memfd for datapool failed: %s", strerror(errno));
+            return NULL;
         }
+    }
 
-        datapool_initialize(pool, user_signature);
-    } else if (!datapool_valid_user_signature(pool, user_signature)) {
-        log_error("wrong user signature (%s) used for pool", user_signature);
-        goto err_map_adr;
+    pool = cc_zalloc(sizeof(*pool));
+    if (pool == NULL) {
+        log_error("unable to create allocate memory for memfd mapping");
+        goto err_alloc;
     }
 
-    datapool_flag_set(pool, DATAPOOL_FLAG_DIRTY);
+    /* a pool of another size is reinitialized */
+    if (fstat(fd, &st) < 0 || ((size_t)st.st_size != map_size &&
+        (ftruncate(fd, 0) < 0 || ftruncate(fd, map_size) < 0))) {
+        log_error("sizing memfd datapool failed: %s", strerror(errno));
+        goto err_map;
+    }
 
-    return pool;
+    pool->addr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (pool->addr == MAP_FAILED) {
+        log_error("mapping memfd datapool failed: %s", strerror(errno));
+        goto err_map;
+    }
+    pool->mapped_len = map_size;
+    pool->page_size = HUGEPAGE_NONE;
+    pool->page_used = PAGE_SIZE;
+    pool->file_backed = 1;
+    pool->fd = fd;
 
-err_map_adr:
-    if (pool->file_backed) {
-        int ret = pmem_unmap(pool->addr, pool->mapped_len);
-        ASSERT(ret == 0);
-    } else {
-        cc_free(pool->addr);
+    if (prefault) {
+        log_info("prefault datapool");
+        datapool_prefault(pool, 0, false, NULL);
     }
+
+    log_info("mapped memfd datapool %d with size %zu", fd, map_size);
+
+    if (datapool_attach(pool, user_signature, fresh) != CC_OK) {
+        munmap(pool->addr, pool->mapped_len);
+        goto err_map;
+    }
+
+    return pool;
+
 err_map:
     cc_free(pool);
 err_alloc:
+    if (fd >= 0) {
+        close(fd);
+    }
     return NULL;
 }
 
 void
 datapool_close(struct datapool *pool)
 {
+    prefault_wait(&pool->prefault);
     datapool_sync(pool);
     datapool_flag_clear(pool, DATAPOOL_FLAG_DIRTY);
 
-    if (pool->file_backed) {
-        int ret = pmem_unmap(pool->addr, pool->mapped_len);
-        ASSERT(ret == 0);
-    } else {
-        cc_free(pool->addr);
-    }
+    datapool_unmap(pool);
 
     cc_free(pool);
 }
 
+int
+datapool_fd(struct datapool *pool)
+{
+    return pool->fd;
+}
+
 void *
 datapool_addr(struct datapool *pool)
 {
@@ -274,6 +353,28 @@ datapool_size(struct datapool *pool)
     return pool->mapped_len - sizeof(struct datapool_header);
 }
 
+size_t
+datapool_page_size(struct datapool *pool)
+{
+    return pool->page_used;
+}
+
+rstatus_i
+datapool_prefault(struct datapool *pool, uint32_t nthread, bool background,
+    datapool_prefault_fn done)
+{
+    rstatus_i status;
+
+    prefault_wait(&pool->prefault);
+    status = prefault_start(&pool->prefault, pool->addr, pool->mapped_len,
+        nthread, done);
+    if (status == CC_OK && !background) {
+        prefault_wait(&pool->prefault);
+    }
+
+    return status;
+}
+
 void
 datapool_set_user_data(const struct datapool *pool, const void *user_data, size_t user_size)
 {
@@ -1,59 +1,260 @@
 /*
  * Anonymous shared memory backed datapool.
- * Loses all its contents after closing.
+ * Loses all its contents after closing, unless backed by a memfd that is
+ * opened again, by this or another process.
  */
 #include "datapool.h"
+#include "datapool_header.h"
+#include "hugepage.h"
+#include "prefault.h"
 
 #include <cc_debug.h>
 #include <cc_mm.h>
 
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct datapool {
+    void   *addr;
+    size_t size;
+    size_t page_size;   /* requested page size, or HUGEPAGE_NONE */
+    size_t page_used;   /* size of the pages actually mapped */
+    struct prefault prefault;
+    int    fd;          /* memfd, or -1 */
+    struct datapool_header *hdr; /* start of the memfd mapping */
+};
+
 struct datapool *
-datapool_open(const char *path, const char *user_signature, size_t size, int *fresh, bool prefault)
+datapool_open(const char *path, const char *user_signature, size_t size, int *fresh, bool prefault, size_t page_size)
 {
+    struct datapool *pool;
+
     if (path != NULL) {
         log_warn("attempted to open a file-based data pool without"
             "pmem features enabled");
         return NULL;
     }
 
+    pool = cc_zalloc(sizeof(*pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    pool->size = size;
+    pool->page_size = page_size;
+    pool->fd = -1;
+    /* mapped memory is zeroed as it is faulted in, not all upfront */
+    pool->addr = hugepage_map(size, page_size, &pool->page_used);
+    if (pool->addr == NULL) {
+        cc_free(pool);
+        return NULL;
+    }
+
     if (fresh) {
         *fresh = 1;
     }
 
-    return cc_zalloc(size);
+    if (prefault) {
+        datapool_prefault(pool, 0, false, NULL);
+    }
+
+    return pool;
+}
+
+/* a header left by datapool_close for a pool of the same size and user */
+static bool
+_datapool_fd_valid(int fd, const char *user_signature, size_t size)
+{
+    struct datapool_header hdr;
+    struct stat st;
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size != DATAPOOL_HEADER_LEN + size ||
+            pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+        return false;
+    }
+
+    if (cc_memcmp(hdr.signature, DATAPOOL_SIGNATURE,
+            DATAPOOL_SIGNATURE_LEN) != 0 || hdr.version != DATAPOOL_VERSION ||
+            hdr.size != size) {
+        log_info("no datapool of %zu bytes found in fd %d", size, fd);
+        return false;
+    }
+
+    if (hdr.flags & DATAPOOL_FLAG_DIRTY) {
+        log_info("datapool in fd %d has a valid header but is dirty", fd);
+        return false;
+    }
+
+    if (cc_strncmp(hdr.user_signature, user_signature,
+            DATAPOOL_USER_LAYOUT_LEN) != 0) {
+        log_warn("datapool in fd %d is not a %s", fd, user_signature);
+        return false;
+    }
+
+    return true;
+}
+
+struct datapool *
+datapool_open_fd(int fd, const char *user_signature, size_t size, int *fresh,
+    bool prefault)
+{
+    struct datapool *pool;
+    bool valid = false;
+
+    if (user_signature == NULL ||
+            cc_strnlen(user_signature, DATAPOOL_USER_LAYOUT_LEN) ==
+            DATAPOOL_USER_LAYOUT_LEN) {
+        log_error("invalid user signature for datapool");
+        goto error;
+    }
+
+    pool = cc_zalloc(sizeof(*pool));
+    if (pool == NULL) {
+        goto error;
+    }
+
+    if (fd < 0) {
+#ifdef MFD_CLOEXEC
+        fd = memfd_create(user_signature, MFD_CLOEXEC);
+#else
+        errno = ENOSYS;
+#endif
+        if (fd < 0) {
+            log_error("memfd for datapool failed: %s", strerror(errno));
+            goto error_free;
+        }
+    } else {
+        valid = _datapool_fd_valid(fd, user_signature, size);
+    }
+
+    /* resizing to 0 drops the pages, so that a fresh pool is zeroed */
+    if (!valid && (ftruncate(fd, 0) < 0 ||
+            ftruncate(fd, DATAPOOL_HEADER_LEN + size) < 0)) {
+        log_error("sizing datapool in fd %d failed: %s", fd, strerror(errno));
+        goto error_free;
+    }
+
+    pool->hdr = mmap(NULL, DATAPOOL_HEADER_LEN + size, PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    if (pool->hdr == MAP_FAILED) {
+        log_error("mapping datapool in fd %d failed: %s", fd, strerror(errno));
+        goto error_free;
+    }
+
+    pool->addr = (uint8_t *)pool->hdr + DATAPOOL_HEADER_LEN;
+    pool->size = size;
+    pool->page_size = HUGEPAGE_NONE;
+    pool->page_used = (size_t)sysconf(_SC_PAGESIZE);
+    pool->fd = fd;
+
+    if (!valid) {
+        log_info("initializing fresh datapool in fd %d", fd);
+        cc_memcpy(pool->hdr->signature, DATAPOOL_SIGNATURE,
+                DATAPOOL_SIGNATURE_LEN);
+        pool->hdr->version = DATAPOOL_VERSION;
+        pool->hdr->size = size;
+        cc_memcpy(pool->hdr->user_signature, user_signature,
+                cc_strlen(user_signature));
+    }
+    pool->hdr->flags |= DATAPOOL_FLAG_DIRTY;
+
+    if (fresh) {
+        *fresh = !valid;
+    }
+
+    if (prefault) {
+        datapool_prefault(pool, 0, false, NULL);
+    }
+
+    return pool;
+
+error_free:
+    cc_free(pool);
+error:
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return NULL;
 }
 
 void
 datapool_close(struct datapool *pool)
 {
+    prefault_wait(&pool->prefault);
+    if (pool->fd >= 0) {
+        pool->hdr->flags &= ~DATAPOOL_FLAG_DIRTY;
+        munmap(pool->hdr, DATAPOOL_HEADER_LEN + pool->size);
+        close(pool->fd);
+    } else {
+        hugepage_unmap(pool->addr, pool->size, pool->page_size);
+    }
     cc_free(pool);
 }
 
 void *
 datapool_addr(struct datapool *pool)
 {
-    return pool;
+    return pool->addr;
 }
 
 size_t
 datapool_size(struct datapool *pool)
 {
-    return cc_alloc_usable_size(pool);
+    return pool->size;
+}
+
+size_t
+datapool_page_size(struct datapool *pool)
+{
+    return pool->page_used;
+}
+
+int
+datapool_fd(struct datapool *pool)
+{
+    return pool->fd;
+}
+
+rstatus_i
+datapool_prefault(struct datapool *pool, uint32_t nthread, bool background,
+    datapool_prefault_fn done)
+{
+    rstatus_i status;
+
+    prefault_wait(&pool->prefault);
+    status = prefault_start(&pool->prefault, pool->addr, pool->size, nthread,
+        done);
+    if (status == CC_OK && !background) {
+        prefault_wait(&pool->prefault);
+    }
+
+    return status;
 }
 
 /*
  * NOTE: Abstraction in datapool required defining functions below
- *       datapool_get_user_data is currently used only in in pmem implementation
+ *       datapool_get_user_data is only used with pools that keep their
+ *       contents, i.e. with pmem or backed by a memfd
  *       datapool_set_user_data is called during teardown e.g. slab
  */
 void
 datapool_set_user_data(const struct datapool *pool, const void *user_data, size_t user_size)
 {
-
+    if (pool->fd >= 0) {
+        ASSERT(user_size <= sizeof(pool->hdr->user_data));
+        cc_memcpy(pool->hdr->user_data, user_data, user_size);
+    }
 }
 
 void
 datapool_get_user_data(const struct datapool *pool, void *user_data, size_t user_size)
 {
-    NOT_REACHED();
+    ASSERT(pool->fd >= 0);
+    ASSERT(user_size <= sizeof(pool->hdr->user_data));
+
+    cc_memcpy(user_data, pool->hdr->user_data, user_size);
 }
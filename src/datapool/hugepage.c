@@ -0,0 +1,145 @@
+#include "hugepage.h"
+
+#include <cc_debug.h>
+#include <cc_define.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+static size_t
+_base_page_size(void)
+{
+    long sz = sysconf(_SC_PAGESIZE);
+
+    return sz > 0 ? (size_t)sz : 4096;
+}
+
+static size_t
+_map_len(size_t size, size_t page_size)
+{
+    size_t base = _base_page_size();
+    size_t align = page_size > base ? page_size : base;
+
+    return (size + align - 1) / align * align;
+}
+
+#ifdef MAP_HUGETLB
+static void *
+_map_hugetlb(size_t len, size_t page_size)
+{
+    int shift = __builtin_ctzll((unsigned long long)page_size);
+    void *p;
+
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+            (shift << MAP_HUGE_SHIFT), -1, 0);
+
+    return p == MAP_FAILED ? NULL : p;
+}
+#endif
+
+/* over-map by a huge page and trim, so that huge pages can line up */
+static void *
+_map_aligned(size_t len, size_t align)
+{
+    uint8_t *p, *start;
+    size_t head, tail;
+
+    p = mmap(NULL, len + align, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+
+    start = (uint8_t *)(((uintptr_t)p + align - 1) & ~((uintptr_t)align - 1));
+    head = start - p;
+    tail = align - head;
+    if (head > 0) {
+        munmap(p, head);
+    }
+    if (tail > 0) {
+        munmap(start + len, tail);
+    }
+
+    return start;
+}
+
+void *
+hugepage_map(size_t size, size_t page_size, size_t *page_used)
+{
+    size_t base = _base_page_size();
+    size_t len = _map_len(size, page_size);
+    void *p = NULL;
+
+    ASSERT(size > 0);
+
+    if (page_size <= base) {
+        p = _map_aligned(len, base);
+        if (p == NULL) {
+            log_error("mapping %zu bytes failed: %s", len, strerror(errno));
+            return NULL;
+        }
+        if (page_used != NULL) {
+            *page_used = base;
+        }
+        return p;
+    }
+
+    if ((page_size & (page_size - 1)) != 0) {
+        log_warn("huge page size %zu is not a power of 2", page_size);
+    } else {
+#ifdef MAP_HUGETLB
+        p = _map_hugetlb(len, page_size);
+#else
+        errno = ENOTSUP;
+#endif
+    }
+
+    if (p != NULL) {
+        log_info("mapped %zu bytes on %zu huge pages of %zu bytes", len,
+                len / page_size, page_size);
+        if (page_used != NULL) {
+            *page_used = page_size;
+        }
+        return p;
+    }
+
+    log_warn("no huge pages of %zu bytes for %zu bytes (%s), falling back to "
+            "transparent huge pages", page_size, len, strerror(errno));
+
+    p = _map_aligned(len, page_size);
+    if (p == NULL) {
+        log_error("mapping %zu bytes failed: %s", len, strerror(errno));
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    if (madvise(p, len, MADV_HUGEPAGE) < 0) {
+        log_warn("transparent huge pages not available: %s", strerror(errno));
+    }
+#endif
+    if (page_used != NULL) {
+        *page_used = base;
+    }
+
+    return p;
+}
+
+void
+hugepage_unmap(void *addr, size_t size, size_t page_size)
+{
+    if (addr == NULL) {
+        return;
+    }
+
+    if (munmap(addr, _map_len(size, page_size)) < 0) {
+        log_error("unmapping %p failed: %s", addr, strerror(errno));
+    }
+}
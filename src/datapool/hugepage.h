@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Large heaps and tables can be mapped on huge pages, so that far fewer TLB
+ * entries cover them and random accesses miss the TLB less often. Explicit
+ * (hugetlb) pages of the requested size are tried first, which only works if
+ * enough of them are reserved, e.g. through /proc/sys/vm/nr_hugepages or
+ * /sys/kernel/mm/hugepages/. If that fails, regular pages are mapped and
+ * transparent huge pages are requested for them with madvise.
+ *
+ * Either way the mapping is zeroed and its length is rounded up to a multiple
+ * of the requested page size.
+ */
+
+#define HUGEPAGE_NONE 0 /* regular pages, no huge page requested */
+
+/* map size bytes on pages of page_size bytes, returns NULL on failure;
+ * page_used, if not NULL, is set to the size of the pages actually mapped,
+ * which is the base page size if explicit huge pages were not available
+ */
+void *hugepage_map(size_t size, size_t page_size, size_t *page_used);
+/* unmap what was mapped by hugepage_map with the same size and page_size */
+void hugepage_unmap(void *addr, size_t size, size_t page_size);
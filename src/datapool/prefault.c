@@ -0,0 +1,134 @@
+#include "prefault.h"
+
+#include <cc_debug.h>
+#include <cc_mm.h>
+
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__linux__) && !defined(MADV_POPULATE_WRITE)
+#define MADV_POPULATE_WRITE 23
+#endif
+
+struct prefault_range {
+    struct prefault *pf;
+    uint8_t         *start;
+    uint8_t         *end;
+};
+
+static uint64_t
+_elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)(now.tv_sec - start->tv_sec) * 1000 +
+        (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/*
+ * Pages are faulted in with MADV_POPULATE_WRITE where the kernel has it
+ * (5.14+), which never writes to the memory. Otherwise each page is touched
+ * with an atomic add of 0, which is also safe while the pool is in use.
+ */
+static void
+_touch(uint8_t *start, uint8_t *end)
+{
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uint8_t *p;
+
+#ifdef MADV_POPULATE_WRITE
+    uint8_t *aligned = (uint8_t *)((uintptr_t)start & ~(page - 1));
+
+    if (madvise(aligned, end - aligned, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+#endif
+
+    for (p = start; p < end; p += page) {
+        __atomic_fetch_add(p, 0, __ATOMIC_RELAXED);
+    }
+}
+
+static void *
+_prefault(void *arg)
+{
+    struct prefault_range *r = arg;
+    struct prefault *pf = r->pf;
+    uint64_t ms;
+
+    _touch(r->start, r->end);
+
+    if (__atomic_add_fetch(&pf->ndone, 1, __ATOMIC_ACQ_REL) == pf->nthread) {
+        ms = _elapsed_ms(&pf->start);
+        log_info("prefaulted %zu bytes with %"PRIu32" thread(s) in %"PRIu64
+                " ms", pf->len, pf->nthread, ms);
+        if (pf->done != NULL) {
+            pf->done(ms);
+        }
+    }
+
+    return NULL;
+}
+
+rstatus_i
+prefault_start(struct prefault *pf, void *addr, size_t len, uint32_t nthread,
+        datapool_prefault_fn done)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t npage = (len + page - 1) / page, chunk;
+    struct prefault_range *range;
+    uint32_t i;
+
+    ASSERT(pf->range == NULL);
+
+    if (len == 0) {
+        return CC_OK;
+    }
+
+    if (nthread == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthread = ncpu > 0 ? (uint32_t)ncpu : 1;
+    }
+    nthread = MIN(nthread, npage);
+    chunk = (npage + nthread - 1) / nthread * page;
+
+    range = cc_alloc(sizeof(struct prefault_range) * nthread);
+    if (range == NULL) {
+        return CC_ENOMEM;
+    }
+
+    pf->addr = addr;
+    pf->len = len;
+    pf->nthread = nthread;
+    pf->ndone = 0;
+    pf->done = done;
+    pf->range = range;
+    clock_gettime(CLOCK_MONOTONIC, &pf->start);
+
+    for (i = 0; i < nthread; i++) {
+        range[i].pf = pf;
+        range[i].start = pf->addr + MIN(i * chunk, len);
+        range[i].end = pf->addr + MIN((i + 1) * chunk, len);
+    }
+
+    log_info("prefaulting %zu bytes with %"PRIu32" thread(s)", len, nthread);
+
+    run_parallel_start(&pf->threads, _prefault, range, sizeof(*range), nthread);
+
+    return CC_OK;
+}
+
+void
+prefault_wait(struct prefault *pf)
+{
+    if (pf->range == NULL) {
+        return;
+    }
+
+    run_parallel_wait(&pf->threads);
+    cc_free(pf->range);
+    pf->range = NULL;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "datapool.h"
+
+#include "util/util.h"
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Prefaulting a pool with several threads, each touching a disjoint range.
+ * Used by both datapool implementations; the pool keeps one of these.
+ */
+
+struct prefault_range;
+
+struct prefault {
+    uint8_t             *addr;
+    size_t              len;
+    uint32_t            nthread;
+    uint32_t            ndone;      /* # threads finished */
+    struct parallel     threads;
+    struct prefault_range *range;   /* range[nthread], NULL if none started */
+    struct timespec     start;
+    datapool_prefault_fn done;
+};
+
+/* start prefaulting [addr, addr + len), see datapool_prefault */
+rstatus_i prefault_start(struct prefault *pf, void *addr, size_t len,
+        uint32_t nthread, datapool_prefault_fn done);
+/* wait for all prefault threads to finish, if any were started */
+void prefault_wait(struct prefault *pf);
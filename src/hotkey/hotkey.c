@@ -7,11 +7,15 @@
 #include <cc_bstring.h>
 #include <cc_debug.h>
 
+#include <pthread.h>
+
 #define HOTKEY_MODULE_NAME "hotkey::hotkey"
 
 bool hotkey_enabled = false;
 
 static uint64_t hotkey_counter;
+/* the window and counter table are shared by workers processing concurrently */
+static pthread_mutex_t hotkey_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static bool hotkey_init = false;
 static uint32_t hotkey_window_size = HOTKEY_WINDOW_SIZE;
@@ -58,10 +62,13 @@ hotkey_teardown(void)
 bool
 hotkey_sample(const struct bstring *key)
 {
-    if (++hotkey_counter % hotkey_rate == 0) {
+    if (__atomic_add_fetch(&hotkey_counter, 1, __ATOMIC_RELAXED) % hotkey_rate
+            == 0) {
         /* sample this key */
         uint32_t freq;
 
+        pthread_mutex_lock(&hotkey_lock);
+
         if (key_window_len() == hotkey_window_size) {
             char buf[MAX_KEY_LEN];
             struct bstring popped;
@@ -75,6 +82,7 @@ hotkey_sample(const struct bstring *key)
 
         key_window_push(key);
         freq = kc_map_incr(key);
+        pthread_mutex_unlock(&hotkey_lock);
 
         return freq >= hotkey_threshold;
     }
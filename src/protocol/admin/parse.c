@@ -57,6 +57,11 @@ _get_req_type(struct request *req, struct bstring *type)
             break;
         }
 
+        if (str8cmp(type->data, 's', 'n', 'a', 'p', 's', 'h', 'o', 't')) {
+            req->type = REQ_SNAPSHOT;
+            break;
+        }
+
         break;
     }
 
@@ -26,7 +26,8 @@
     ACTION( REQ_STATS,         "stats"     )\
     ACTION( REQ_VERSION,       "version"   )\
     ACTION( REQ_QUIT,          "quit"      )\
-    ACTION( REQ_SHUTDOWN,      "shutdown"  )
+    ACTION( REQ_SHUTDOWN,      "shutdown"  )\
+    ACTION( REQ_SNAPSHOT,      "snapshot"  )
 
 #define GET_TYPE(_name, _str) _name,
 typedef enum request_type {
@@ -305,8 +305,16 @@ compose_rsp(struct buf **buf, struct response *rsp)
             vlen = rsp->vstr.len;
         }
 
+        /* a referenced value is not copied, unless the buf is out of refs.
+         * vref is cleared whenever the value does not end up referenced.
+         */
+        if (rsp->vref != NULL && buf_ref_reserve(*buf) != CC_OK) {
+            rsp->vref = NULL;
+        }
         if (_check_buf_size(buf, str->len + rsp->key.len + CC_UINT32_MAXLEN * 2
-                    + cas_len + vlen + CRLF_LEN * 2) != COMPOSE_OK) {
+                    + cas_len + (rsp->vref == NULL ? vlen : 0) + CRLF_LEN * 2)
+                != COMPOSE_OK) {
+            rsp->vref = NULL;
             goto error;
         }
         n += _write_bstring(buf, str);
@@ -322,6 +330,9 @@ compose_rsp(struct buf **buf, struct response *rsp)
         n += _crlf(buf);
         if (rsp->num) {
             n += _write_uint64(buf, rsp->vint);
+        } else if (rsp->vref != NULL) {
+            buf_ref_append(*buf, rsp->vstr.data, rsp->vstr.len, rsp->vref);
+            n += rsp->vstr.len;
         } else {
             n += _write_bstring(buf, &rsp->vstr);
         }
@@ -12,6 +12,7 @@
 #include <time/cc_wheel.h>
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <sysexits.h>
 #include <time.h>
@@ -29,6 +30,8 @@
 
 static struct logger *klogger;
 static uint64_t klog_cmds;
+/* the logger has a single producer, workers may log concurrently */
+static pthread_mutex_t klog_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static char backup_path[PATH_MAX + 1];
 static char *klog_backup = NULL;
@@ -147,6 +150,18 @@ _get_val_rsp_len(struct response *rsp, struct bstring *key)
         + (rsp->num ? digits(rsp->vint) : rsp->vstr.len) + CRLF_LEN;
 }
 
+static inline bool
+_klog_log(char *buf, int len)
+{
+    bool ok;
+
+    pthread_mutex_lock(&klog_lock);
+    ok = log_write(klogger, buf, len);
+    pthread_mutex_unlock(&klog_lock);
+
+    return ok;
+}
+
 static inline void
 _klog_write_get(struct request *req, struct response *rsp, char *buf, int len)
 {
@@ -173,7 +188,7 @@ _klog_write_get(struct request *req, struct response *rsp, char *buf, int len)
 
         ASSERT(len + suffix_len <= KLOG_MAX_LEN);
 
-        if (log_write(klogger, buf, len + suffix_len)) {
+        if (_klog_log(buf, len + suffix_len)) {
             INCR(klog_metrics, klog_logged);
         } else {
             INCR(klog_metrics, klog_discard);
@@ -249,14 +264,13 @@ _klog_write(struct request *req, struct response *rsp)
     int len, time_len, errno_save;
     char buf[KLOG_MAX_LEN], *peer = "-";
     time_t t;
+    struct tm tm;
 
     if (klogger == NULL) {
         return;
     }
 
-    ++klog_cmds;
-
-    if (klog_cmds % klog_sample != 0) {
+    if (__atomic_add_fetch(&klog_cmds, 1, __ATOMIC_RELAXED) % klog_sample != 0) {
         INCR(klog_metrics, klog_skip);
         return;
     }
@@ -265,7 +279,8 @@ _klog_write(struct request *req, struct response *rsp)
 
     t = time_unix_sec();
     len = cc_scnprintf(buf, KLOG_MAX_LEN, "%s - ", peer);
-    time_len = strftime(buf + len, KLOG_MAX_LEN - len, KLOG_TIME_FMT, localtime(&t));
+    time_len = strftime(buf + len, KLOG_MAX_LEN - len, KLOG_TIME_FMT,
+            localtime_r(&t, &tm));
     if (time_len == 0) {
         log_error("strftime failed: %s", strerror(errno));
         goto done;
@@ -301,7 +316,7 @@ _klog_write(struct request *req, struct response *rsp)
 
     ASSERT(len <= KLOG_MAX_LEN);
 
-    if (log_write(klogger, buf, len)) {
+    if (_klog_log(buf, len)) {
         INCR(klog_metrics, klog_logged);
     } else {
         INCR(klog_metrics, klog_discard);
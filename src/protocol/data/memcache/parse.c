@@ -13,12 +13,102 @@
 
 #include <ctype.h>
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define PARSE_SIMD 1
+#endif
+
 #define PARSE_MODULE_NAME "protocol::memcache::parse"
 
 static bool parse_init = false;
 static parse_req_metrics_st *parse_req_metrics = NULL;
 static parse_rsp_metrics_st *parse_rsp_metrics = NULL;
 
+/*
+ * A key ends at the first ' ' or CR (which may start CRLF), so the bulk of
+ * tokenizing keys, e.g. for get/gets with many keys, is a search for either
+ * byte. On x86-64 this is done 32 (AVX2) or 16 (SSE4.2) bytes at a time, the
+ * best version supported by the CPU is picked in parse_setup.
+ */
+typedef char *(*find_delim_fn)(char *p, char *end);
+
+/* return the first ' ' or CR in [p, end), or end if there is none */
+static char *
+_find_delim_scalar(char *p, char *end)
+{
+    while (p < end && *p != ' ' && *p != CR) {
+        p++;
+    }
+
+    return p;
+}
+
+#ifdef PARSE_SIMD
+__attribute__((target("sse4.2")))
+static char *
+_find_delim_sse42(char *p, char *end)
+{
+    const __m128i delim = _mm_setr_epi8(' ', CR, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0);
+    int i;
+
+    for (; p + 16 <= end; p += 16) {
+        i = _mm_cmpestri(delim, 2, _mm_loadu_si128((const __m128i *)p), 16,
+                _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY |
+                _SIDD_LEAST_SIGNIFICANT);
+        if (i < 16) {
+            return p + i;
+        }
+    }
+
+    return _find_delim_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static char *
+_find_delim_avx2(char *p, char *end)
+{
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i cr = _mm256_set1_epi8(CR);
+    __m256i v;
+    uint32_t mask;
+
+    for (; p + 32 <= end; p += 32) {
+        v = _mm256_loadu_si256((const __m256i *)p);
+        mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+                    _mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, cr)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+
+    /* any CPU with AVX2 also has SSE4.2 */
+    return _find_delim_sse42(p, end);
+}
+#endif
+
+static find_delim_fn _find_delim = _find_delim_scalar;
+
+static void
+_find_delim_setup(void)
+{
+    const char *name = "scalar";
+
+    _find_delim = _find_delim_scalar;
+#ifdef PARSE_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        _find_delim = _find_delim_avx2;
+        name = "avx2";
+    } else if (__builtin_cpu_supports("sse4.2")) {
+        _find_delim = _find_delim_sse42;
+        name = "sse4.2";
+    }
+#endif
+
+    log_info("tokenizing keys with the %s scanner", name);
+}
+
 void
 parse_setup(parse_req_metrics_st *req, parse_rsp_metrics_st *rsp)
 {
@@ -30,6 +120,7 @@ parse_setup(parse_req_metrics_st *req, parse_rsp_metrics_st *rsp)
 
     parse_req_metrics = req;
     parse_rsp_metrics = rsp;
+    _find_delim_setup();
 
     parse_init = true;
 }
@@ -44,6 +135,7 @@ parse_teardown(void)
     }
     parse_req_metrics = NULL;
     parse_rsp_metrics = NULL;
+    _find_delim = _find_delim_scalar;
     parse_init = false;
 }
 
@@ -151,54 +243,44 @@ _chase_crlf(struct buf *buf)
     return PARSE_EUNFIN;
 }
 
-static inline parse_rstatus_e
-_check_key(struct buf *buf, bool *end, struct bstring *t, char *p)
+static parse_rstatus_e
+_chase_key(struct buf *buf, bool *end, struct bstring *t)
 {
-    bool complete;
+    char *p, *q;
+    /* the key is oversized if it has not ended by this point */
+    char *limit = MIN(buf->wpos, buf->rpos + MAX_TOKEN_LEN + 1);
 
-    if (*p == ' ' && t->len == 0) { /* pre-key spaces */
-        return PARSE_EUNFIN;
+    for (p = buf->rpos; p < limit && *p == ' '; p++) { /* pre-key spaces */
     }
 
-    complete = _token_end(end, buf, p);
-    if (complete) {
-        _forward_rpos(buf, *end, p);
-
-        if (t->len == 0) {
-            return PARSE_EEMPTY;
-        } else {
-            return PARSE_OK;
+    for (q = p;; q++) {
+        q = _find_delim(q, limit);
+        if (q == limit) {
+            return (limit < buf->wpos) ? PARSE_EOVERSIZE : PARSE_EUNFIN;
+        }
+        if (*q == ' ') {
+            *end = false;
+            break;
+        }
+        if (q + 1 == buf->wpos) { /* the next byte hasn't been received */
+            return PARSE_EUNFIN;
         }
+        if (*(q + 1) == LF) {
+            *end = true;
+            break;
+        }
+        /* a CR not followed by LF is part of the key */
     }
 
-    /* the current character is part of the key */
-    if (t->len == 0) {
-        _token_begin(t, p);
-    } else {
-        t->len++;
+    _forward_rpos(buf, *end, q);
+    if (q == p) {
+        return PARSE_EEMPTY;
     }
 
-    return PARSE_EUNFIN;
-}
-
-static parse_rstatus_e
-_chase_key(struct buf *buf, bool *end, struct bstring *t)
-{
-    char *p;
-    parse_rstatus_e status;
-
-    for (p = buf->rpos; p < buf->wpos; p++) {
-        if (_token_oversize(buf, p)) {
-            return PARSE_EOVERSIZE;
-        }
-
-        status = _check_key(buf, end, t, p);
-        if (status != PARSE_EUNFIN) {
-            return status;
-        }
-    }
+    t->data = p;
+    t->len = (uint32_t)(q - p);
 
-    return PARSE_EUNFIN;
+    return PARSE_OK;
 }
 
 static inline parse_rstatus_e
@@ -3,6 +3,8 @@
 #include <cc_debug.h>
 #include <cc_pool.h>
 
+#include <pthread.h>
+
 #define REQUEST_MODULE_NAME "protocol::memcache::request"
 
 static bool request_init = false;
@@ -17,6 +19,8 @@ struct bstring req_strings[] = {
 FREEPOOL(req_pool, reqq, request);
 static struct req_pool reqp;
 static bool reqp_init = false;
+/* workers processing concurrently share the pool */
+static pthread_mutex_t reqp_lock = PTHREAD_MUTEX_INITIALIZER;
 
 void
 request_reset(struct request *req)
@@ -129,7 +133,9 @@ request_borrow(void)
 {
     struct request *req;
 
+    pthread_mutex_lock(&reqp_lock);
     FREEPOOL_BORROW(req, &reqp, next, request_create);
+    pthread_mutex_unlock(&reqp_lock);
     if (req == NULL) {
         log_debug("borrow req failed: OOM %d");
 
@@ -158,7 +164,9 @@ request_return(struct request **request)
     log_vverb("return req %p", req);
 
     req->free = true;
+    pthread_mutex_lock(&reqp_lock);
     FREEPOOL_RETURN(req, &reqp, next);
+    pthread_mutex_unlock(&reqp_lock);
 
     *request = NULL;
 }
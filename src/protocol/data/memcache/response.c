@@ -4,6 +4,8 @@
 #include <cc_mm.h>
 #include <cc_pool.h>
 
+#include <pthread.h>
+
 #define RESPONSE_MODULE_NAME "protocol::memcache::response"
 
 static bool response_init = false;
@@ -18,6 +20,8 @@ struct bstring rsp_strings[] = {
 FREEPOOL(rsp_pool, rspq, response);
 static struct rsp_pool rspp;
 static bool rspp_init = false;
+/* workers processing concurrently share the pool */
+static pthread_mutex_t rspp_lock = PTHREAD_MUTEX_INITIALIZER;
 
 void
 response_reset(struct response *rsp)
@@ -32,6 +36,7 @@ response_reset(struct response *rsp)
 
     bstring_init(&rsp->key);
     bstring_init(&rsp->vstr);
+    rsp->vref = NULL;
     rsp->vint = 0;
     rsp->vcas = 0;
     rsp->met = NULL;
@@ -114,7 +119,9 @@ response_borrow(void)
 {
     struct response *rsp;
 
+    pthread_mutex_lock(&rspp_lock);
     FREEPOOL_BORROW(rsp, &rspp, next, response_create);
+    pthread_mutex_unlock(&rspp_lock);
     if (rsp == NULL) {
         log_debug("borrow rsp failed: OOM %d");
 
@@ -148,7 +155,9 @@ response_return(struct response **response)
     log_vverb("return rsp %p", rsp);
 
     rsp->free = true;
+    pthread_mutex_lock(&rspp_lock);
     FREEPOOL_RETURN(rsp, &rspp, next);
+    pthread_mutex_unlock(&rspp_lock);
 
     *response = NULL;
 }
@@ -81,6 +81,9 @@ struct response {
 
     struct bstring          key;        /* key string */
     struct bstring          vstr;       /* value string */
+    void                    *vref;      /* if set, vstr is sent by reference
+                                         * and vref is its owner, see cc_buf.h
+                                         */
 
     uint64_t                vint;       /* return value for incr/decr, or integer get value */
     uint64_t                vcas;       /* value for cas */
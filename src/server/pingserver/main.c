@@ -17,7 +17,8 @@ struct data_processor worker_processor = {
     pingserver_process_read,
     pingserver_process_write,
     pingserver_process_error,
-    .running = true
+    .running = true,
+    .concurrent = true /* no storage, every request is answered on its own */
 };
 
 static void
@@ -106,7 +107,7 @@ setup(void)
     /* setup library modules */
     buf_setup(&setting.buf, &stats.buf);
     dbuf_setup(&setting.dbuf, &stats.dbuf);
-    event_setup(&stats.event);
+    event_setup(&setting.event, &stats.event);
     sockio_setup(&setting.sockio, &stats.sockio);
     tcp_setup(&setting.tcp, &stats.tcp);
     timing_wheel_setup(&stats.timing_wheel);
@@ -118,8 +119,8 @@ setup(void)
     compose_setup(NULL, &stats.compose_rsp);
     admin_process_setup();
     core_admin_setup(&setting.admin);
+    core_worker_setup(&setting.worker, &stats.worker, &worker_processor);
     core_server_setup(&setting.server, &stats.server);
-    core_worker_setup(&setting.worker, &stats.worker);
 
     /* adding recurring events to maintenance/admin thread */
     intvl = option_uint(&setting.pingserver.dlog_intvl);
@@ -143,9 +143,13 @@ _realloc_list_item(struct item **it, ziplist_p *zl, const struct bstring *key,
             return istatus;
         }
 
+        istatus = item_insert(nit, key);
+        if (istatus != ITEM_OK) {
+            return istatus;
+        }
+
         *it = nit;
         *zl = (ziplist_p)item_data(nit);
-        item_insert(nit, key);
     }
 
     ASSERT(item_will_fit(*it, delta));
@@ -227,7 +231,11 @@ cmd_list_create(struct response *rsp, const struct request *req, const struct
     it->vlen = ZIPLIST_HEADER_SIZE;
 
     /* link into index */
-    item_insert(it, key);
+    if (item_insert(it, key) != ITEM_OK) {
+        _rsp_storage_err(rsp, reply, cmd, key);
+        INCR(process_metrics, list_create_ex);
+        return;
+    }
 
     _rsp_ok(rsp, reply, cmd, key);
 }
@@ -111,7 +111,12 @@ cmd_sarray_create(struct response *rsp, const struct request *req,
         _set_watermark((uint32_t *)item_optional(it), low, high);
     }
 
-    item_insert(it, key);
+    if (item_insert(it, key) != ITEM_OK) {
+        compose_rsp_storage_err(rsp, reply, cmd, key);
+        INCR(process_metrics, sarray_create_ex);
+
+        return;
+    }
 
     compose_rsp_ok(rsp, reply, cmd, key);
     INCR(process_metrics, sarray_create_ok);
@@ -419,8 +424,13 @@ cmd_sarray_insert(struct response *rsp, const struct request *req, const struct
         /* NOTE(yao): we are double copying the key portion here */
         cc_memcpy(nit->end, it->end, item_npayload(it));
         nit->vlen = it->vlen;
+        if (item_insert(nit, key) != ITEM_OK) {
+            compose_rsp_storage_err(rsp, reply, cmd, key);
+            INCR(process_metrics, sarray_insert_ex);
+
+            return;
+        }
         it = nit;
-        item_insert(nit, key);
     }
 
     sa = (sarray_p)item_data(it); /* item might have changed */
@@ -105,7 +105,7 @@ setup(void)
     /* setup library modules */
     buf_setup(&setting.buf, &stats.buf);
     dbuf_setup(&setting.dbuf, &stats.dbuf);
-    event_setup(&stats.event);
+    event_setup(&setting.event, &stats.event);
     sockio_setup(&setting.sockio, &stats.sockio);
     tcp_setup(&setting.tcp, &stats.tcp);
     timing_wheel_setup(&stats.timing_wheel);
@@ -121,8 +121,8 @@ setup(void)
     process_setup(&setting.process, &stats.process);
     admin_process_setup();
     core_admin_setup(&setting.admin);
+    core_worker_setup(&setting.worker, &stats.worker, &worker_processor);
     core_server_setup(&setting.server, &stats.server);
-    core_worker_setup(&setting.worker, &stats.worker);
 
     /* adding recurring events to maintenance/admin thread */
     intvl = option_uint(&setting.rds.dlog_intvl);
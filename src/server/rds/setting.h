@@ -45,6 +45,7 @@ struct setting {
     buf_options_st      buf;
     dbuf_options_st     dbuf;
     debug_options_st    debug;
+    event_options_st    event;
     sockio_options_st   sockio;
     tcp_options_st      tcp;
 };
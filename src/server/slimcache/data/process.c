@@ -6,6 +6,7 @@
 
 #include <cc_array.h>
 #include <cc_debug.h>
+#include <cc_mm.h>
 #include <cc_print.h>
 
 #define SLIMCACHE_PROCESS_MODULE_NAME "slimcache::process"
@@ -18,6 +19,75 @@ static bool process_init = false;
 static process_metrics_st *process_metrics = NULL;
 static bool allow_flush = ALLOW_FLUSH;
 
+/*
+ * With a concurrent table, items found are copied out, as other workers may
+ * move or change them before the response is composed. Each worker thread
+ * has room for the items of one request, allocated on its first get.
+ */
+static __thread struct item *scratch;
+
+static struct item *
+_scratch(uint32_t n)
+{
+    if (!cuckoo_concurrent) {
+        return NULL;
+    }
+
+    if (scratch == NULL) {
+        scratch = cc_alloc(cuckoo_item_size() * MAX_BATCH_SIZE);
+        if (scratch == NULL) {
+            return NULL;
+        }
+    }
+
+    return (struct item *)((char *)scratch + cuckoo_item_size() * n);
+}
+
+/*
+ * A value in the overflow arena is not part of the item copied, and may be
+ * freed by another worker once the copy is made. Such items are read again
+ * with the key locked, and their values copied to room kept per thread for
+ * each value of a request, which only grows.
+ */
+static __thread struct bstring vscratch[MAX_BATCH_SIZE];
+
+static struct item *
+_get_overflowed(struct val *val, struct bstring *key, struct item *buf,
+        uint32_t n)
+{
+    struct bstring *v = &vscratch[n];
+    struct item *it;
+    char *data;
+
+    cuckoo_lock(key);
+    it = cuckoo_get(key);
+    if (it != NULL) {
+        cc_memcpy(buf, it, cuckoo_item_size());
+        item_val(val, it);
+        it = buf;
+    }
+    if (it != NULL && val->type == VAL_TYPE_STR) {
+        if (v->len < val->vstr.len) {
+            data = cc_realloc(v->data, val->vstr.len);
+            if (data != NULL) {
+                v->data = data;
+                v->len = val->vstr.len;
+            }
+        }
+        if (v->len < val->vstr.len) {
+            log_error("cannot copy value of key %.*s: OOM", key->len,
+                    key->data);
+            it = NULL;
+        } else {
+            cc_memcpy(v->data, val->vstr.data, val->vstr.len);
+            val->vstr.data = v->data;
+        }
+    }
+    cuckoo_unlock();
+
+    return it;
+}
+
 void
 process_setup(process_options_st *options, process_metrics_st *metrics)
 {
@@ -51,18 +121,27 @@ process_teardown(void)
 
 
 static bool
-_get_key(struct response *rsp, struct bstring *key)
+_get_key(struct response *rsp, struct bstring *key, uint32_t n)
 {
-    struct item *it;
+    struct item *it, *buf = _scratch(n);
     struct val val;
 
-    it = cuckoo_get(key);
+    if (cuckoo_concurrent && buf == NULL) {
+        log_error("cannot copy item of key %.*s: OOM", key->len, key->data);
+        return false;
+    }
+
+    it = cuckoo_read(key, buf);
+    if (it != NULL && cuckoo_concurrent && item_overflowed(it)) {
+        it = _get_overflowed(&val, key, buf, n);
+    } else if (it != NULL) {
+        item_val(&val, it);
+    }
     if (it != NULL) {
         rsp->type = RSP_VALUE;
         rsp->key = *key;
         rsp->flag = item_flag(it);
         rsp->vcas = item_cas(it);
-        item_val(&val, it);
         if (val.type == VAL_TYPE_INT) {
             rsp->num = 1;
             rsp->vint = val.vint;
@@ -94,7 +173,7 @@ _process_get(struct response *rsp, struct request *req)
     for (i = 0; i < array_nelem(req->keys); ++i) {
         INCR(process_metrics, get_key);
         key = array_get(req->keys, i);
-        if (_get_key(r, key)) {
+        if (_get_key(r, key, req->nfound)) {
             r->cas = false;
             r = STAILQ_NEXT(r, next);
             if (r == NULL) {
@@ -125,7 +204,7 @@ _process_gets(struct response *rsp, struct request *req)
     for (i = 0; i < array_nelem(req->keys); ++i) {
         INCR(process_metrics, gets_key);
         key = array_get(req->keys, i);
-        if (_get_key(r, key)) {
+        if (_get_key(r, key, req->nfound)) {
             r->cas = true;
             r = STAILQ_NEXT(r, next);
             if (r == NULL) {
@@ -147,6 +226,7 @@ static void
 _process_delete(struct response *rsp, struct request *req)
 {
     INCR(process_metrics, delete);
+    cuckoo_lock(array_first(req->keys));
     if (cuckoo_delete(array_first(req->keys))) {
         rsp->type = RSP_DELETED;
         INCR(process_metrics, delete_deleted);
@@ -154,6 +234,7 @@ _process_delete(struct response *rsp, struct request *req)
         rsp->type = RSP_NOT_FOUND;
         INCR(process_metrics, delete_notfound);
     }
+    cuckoo_unlock();
 
     log_verb("delete req %p processed, rsp type %d", req, rsp->type);
 }
@@ -196,12 +277,14 @@ _process_set(struct response *rsp, struct request *req)
     expire = time_convert_proc_sec((time_i)req->expiry);
     _get_value(&val, &req->vstr);
 
+    cuckoo_lock(key);
     it = cuckoo_get(key);
     if (it != NULL) {
         status = cuckoo_update(it, &val, expire);
     } else {
         it = cuckoo_insert(key, &val, expire);
     }
+    cuckoo_unlock();
 
     if (it != NULL && status == CC_OK) {
         rsp->type = RSP_STORED;
@@ -223,6 +306,7 @@ _process_add(struct response *rsp, struct request *req)
 
     INCR(process_metrics, add);
     key = array_first(req->keys);
+    cuckoo_lock(key);
     it = cuckoo_get(key);
     if (it != NULL) {
         rsp->type = RSP_NOT_STORED;
@@ -238,6 +322,7 @@ _process_add(struct response *rsp, struct request *req)
             INCR(process_metrics, add_ex);
         }
     }
+    cuckoo_unlock();
 
     log_verb("add req %p processed, rsp type %d", req, rsp->type);
 }
@@ -251,6 +336,7 @@ _process_replace(struct response *rsp, struct request *req)
 
     INCR(process_metrics, replace);
     key = array_first(req->keys);
+    cuckoo_lock(key);
     it = cuckoo_get(key);
     if (it != NULL) {
         _get_value(&val, &req->vstr);
@@ -266,6 +352,7 @@ _process_replace(struct response *rsp, struct request *req)
         rsp->type = RSP_NOT_STORED;
         INCR(process_metrics, replace_notstored);
     }
+    cuckoo_unlock();
 
     log_verb("replace req %p processed, rsp type %d", req, rsp->type);
 }
@@ -279,6 +366,7 @@ _process_cas(struct response *rsp, struct request *req)
 
     INCR(process_metrics, cas);
     key = array_first(req->keys);
+    cuckoo_lock(key);
     it = cuckoo_get(key);
     if (it != NULL) {
 
@@ -300,6 +388,7 @@ _process_cas(struct response *rsp, struct request *req)
         rsp->type = RSP_NOT_FOUND;
         INCR(process_metrics, cas_notfound);
     }
+    cuckoo_unlock();
 
     log_verb("cas req %p processed, rsp type %d", req, rsp->type);
 }
@@ -307,20 +396,23 @@ _process_cas(struct response *rsp, struct request *req)
 static void
 _process_incr(struct response *rsp, struct request *req)
 {
-    struct bstring *key;
+    struct bstring *key, vstr;
     struct item *it;
     struct val nval;
 
     INCR(process_metrics, incr);
     key = array_first(req->keys);
+    cuckoo_lock(key);
     it = cuckoo_get(key);
     if (NULL != it) {
         if (item_vtype(it) != VAL_TYPE_INT) {
             _error_rsp(rsp, DELTA_ERR_MSG);
             INCR(process_metrics, incr_ex);
             /* TODO(yao): binary key */
+            item_value_str(&vstr, it);
             log_warn("value not int, cannot apply incr on key %.*s val %.*s",
-                    key->len, key->data, it->vlen, ITEM_VAL_POS(it));
+                    key->len, key->data, vstr.len, vstr.data);
+            cuckoo_unlock();
             return;
         }
 
@@ -334,6 +426,7 @@ _process_incr(struct response *rsp, struct request *req)
         rsp->type = RSP_NOT_FOUND;
         INCR(process_metrics, incr_notfound);
     }
+    cuckoo_unlock();
 
     log_verb("incr req %p processed, rsp type %d", req, rsp->type);
 }
@@ -341,21 +434,24 @@ _process_incr(struct response *rsp, struct request *req)
 static void
 _process_decr(struct response *rsp, struct request *req)
 {
-    struct bstring *key;
+    struct bstring *key, vstr;
     struct item *it;
     uint64_t v;
     struct val nval;
 
     INCR(process_metrics, decr);
     key = array_first(req->keys);
+    cuckoo_lock(key);
     it = cuckoo_get(key);
     if (NULL != it) {
         if (item_vtype(it) != VAL_TYPE_INT) {
             _error_rsp(rsp, DELTA_ERR_MSG);
             INCR(process_metrics, decr_ex);
             /* TODO(yao): binary key */
+            item_value_str(&vstr, it);
             log_warn("value not int, cannot apply decr on key %.*s val %.*s",
-                    key->len, key->data, it->vlen, ITEM_VAL_POS(it));
+                    key->len, key->data, vstr.len, vstr.data);
+            cuckoo_unlock();
             return;
         }
 
@@ -374,6 +470,7 @@ _process_decr(struct response *rsp, struct request *req)
         rsp->type = RSP_NOT_FOUND;
         INCR(process_metrics, decr_notfound);
     }
+    cuckoo_unlock();
 
     log_verb("incr req %p processed, rsp type %d", req, rsp->type);
 }
@@ -137,7 +137,7 @@ setup(void)
     /* setup library modules */
     buf_setup(&setting.buf, &stats.buf);
     dbuf_setup(&setting.dbuf, &stats.dbuf);
-    event_setup(&stats.event);
+    event_setup(&setting.event, &stats.event);
     sockio_setup(&setting.sockio, &stats.sockio);
     tcp_setup(&setting.tcp, &stats.tcp);
     timing_wheel_setup(&stats.timing_wheel);
@@ -152,11 +152,12 @@ setup(void)
     klog_setup(&setting.klog, &stats.klog);
     hotkey_setup(&setting.hotkey);
     cuckoo_setup(&setting.cuckoo, &stats.cuckoo);
+    worker_processor.concurrent = cuckoo_concurrent;
     process_setup(&setting.process, &stats.process);
     admin_process_setup();
     core_admin_setup(&setting.admin);
+    core_worker_setup(&setting.worker, &stats.worker, &worker_processor);
     core_server_setup(&setting.server, &stats.server);
-    core_worker_setup(&setting.worker, &stats.worker);
 
     /* adding recurring events to maintenance/admin thread */
     intvl = option_uint(&setting.slimcache.dlog_intvl);
@@ -16,6 +16,7 @@ struct setting setting = {
     { BUF_OPTION(OPTION_INIT)       },
     { DBUF_OPTION(OPTION_INIT)      },
     { DEBUG_OPTION(OPTION_INIT)     },
+    { EVENT_OPTION(OPTION_INIT)     },
     { SOCKIO_OPTION(OPTION_INIT)    },
     { TCP_OPTION(OPTION_INIT)       },
 };
@@ -1,7 +1,9 @@
 #include "process.h"
 
 #include "protocol/admin/admin_include.h"
+#ifndef TWEMCACHE_SEG
 #include "storage/slab/slab.h"
+#endif
 #include "util/procinfo.h"
 
 #include <cc_mm.h>
@@ -15,7 +17,9 @@
 
 extern struct stats stats;
 extern unsigned int nmetric;
+#ifndef TWEMCACHE_SEG
 static unsigned int nmetric_perslab = METRIC_CARDINALITY(perslab_metrics_st);
+#endif
 
 static bool admin_init = false;
 static char *buf = NULL;
@@ -30,10 +34,14 @@ admin_process_setup(void)
                  TWEMCACHE_ADMIN_MODULE_NAME);
     }
 
+#ifdef TWEMCACHE_SEG
+    cap = nmetric * METRIC_PRINT_LEN + METRIC_END_LEN;
+#else
     nmetric_perslab = METRIC_CARDINALITY(perslab[0]);
     /* perslab metric size <(32 + 20)B, prefix/suffix 12B, total < 64 */
     cap = MAX(nmetric, nmetric_perslab * SLABCLASS_MAX_ID) * METRIC_PRINT_LEN +
         METRIC_END_LEN;
+#endif
     buf = cc_alloc(cap);
     /* TODO: check return status of cc_alloc */
 
@@ -51,6 +59,7 @@ admin_process_teardown(void)
     admin_init = false;
 }
 
+#ifndef TWEMCACHE_SEG
 /* TODO(yao): refactor slab stats reporting somewhere else?
  * this is duplicated between twemcache and rds
  */
@@ -76,6 +85,7 @@ _admin_stats_slab(struct response *rsp, struct request *req)
     rsp->data.data = buf;
     rsp->data.len = offset;
 }
+#endif
 
 static void
 _admin_stats_default(struct response *rsp, struct request *req)
@@ -92,11 +102,13 @@ _admin_stats(struct response *rsp, struct request *req)
         _admin_stats_default(rsp, req);
         return;
     }
+#ifndef TWEMCACHE_SEG
     if (req->arg.len == 5 && str5cmp(req->arg.data, ' ', 's', 'l', 'a', 'b')) {
         _admin_stats_slab(rsp, req);
-    } else {
-        rsp->type = RSP_INVALID;
+        return;
     }
+#endif
+    rsp->type = RSP_INVALID;
 }
 
 void
@@ -111,6 +123,12 @@ admin_process_request(struct response *rsp, struct request *req)
     case REQ_VERSION:
         rsp->data = str2bstr(VERSION_PRINTED);
         break;
+#ifndef TWEMCACHE_SEG
+    case REQ_SNAPSHOT:
+        /* written by the worker, a few items at a time */
+        rsp->type = slab_snapshot_request() == CC_OK ? RSP_OK : RSP_INVALID;
+        break;
+#endif
     default:
         rsp->type = RSP_INVALID;
         break;
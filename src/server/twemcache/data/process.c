@@ -2,7 +2,11 @@
 
 #include "hotkey/hotkey.h"
 #include "protocol/data/memcache_include.h"
+#ifdef TWEMCACHE_SEG
+#include "storage/seg/seg.h"
+#else
 #include "storage/slab/slab.h"
+#endif
 
 #include <cc_array.h>
 #include <cc_debug.h>
@@ -32,8 +36,9 @@ static uint32_t prefill_ksize;
 static char prefill_kbuf[UINT8_MAX]; /* slab implementation has klen as unint8_t */
 static uint32_t prefill_vsize;
 /* val_buf size is arbitrary , update if want to warm up with larger objects */
-static char prefill_vbuf[ITEM_SIZE_MAX];
+static char prefill_vbuf[MiB];
 static uint64_t prefill_nkey;
+static uint32_t zcopy_vsize = ZCOPY_VSIZE;
 
 static void
 _prefill_slab(void)
@@ -59,7 +64,8 @@ _prefill_slab(void)
         istatus = item_reserve(&it, &key, &val, val.len, DATAFLAG_SIZE,
                 time_convert_proc_sec((time_i)INT32_MAX));
         ASSERT(istatus == ITEM_OK);
-        item_insert(it, &key);
+        istatus = item_insert(it, &key);
+        ASSERT(istatus == ITEM_OK);
     }
     duration_stop(&d);
 
@@ -86,6 +92,7 @@ process_setup(process_options_st *options, process_metrics_st *metrics)
         prefill_ksize = (uint32_t)option_uint(&options->prefill_ksize);
         prefill_vsize = (uint32_t)option_uint(&options->prefill_vsize);
         prefill_nkey = (uint64_t)option_uint(&options->prefill_nkey);
+        zcopy_vsize = (uint32_t)option_uint(&options->zcopy_vsize);
     }
 
     if (prefill) {
@@ -133,6 +140,9 @@ _get_key(struct response *rsp, struct bstring *key)
         rsp->vcas = item_get_cas(it);
         rsp->vstr.len = it->vlen;
         rsp->vstr.data = item_data(it);
+        if (zcopy_vsize > 0 && it->vlen >= zcopy_vsize) {
+            rsp->vref = it; /* pinned when composed, see _compose_rsp */
+        }
 
         if (hotkey_enabled && hotkey_sample(key)) {
             log_debug("hotkey detected: %.*s", key->len, key->data);
@@ -306,6 +316,22 @@ _process_set(struct response *rsp, struct request *req)
     struct item *it;
     struct bstring key;
 
+#ifndef TWEMCACHE_SEG
+    /* a set rejected by the admission filter is done as far as the client is
+     * concerned, as if the new item had been evicted right away; keys that
+     * are stored already are always admitted, so nothing is left behind
+     */
+    if (req->first && !req->partial && !item_admit(array_first(req->keys),
+                req->vlen, DATAFLAG_SIZE)) {
+        INCR(process_metrics, set);
+        rsp->type = RSP_STORED;
+        INCR(process_metrics, set_stored);
+        INCR(process_metrics, set_reject);
+
+        return;
+    }
+#endif
+
     status = _put(&istatus, req);
     if (status == PUT_PARTIAL) {
         return;
@@ -321,7 +347,13 @@ _process_set(struct response *rsp, struct request *req)
     INCR(process_metrics, set);
     it = (struct item *)req->reserved;
     key = (struct bstring){it->klen, item_key(it)};
-    item_insert(it, &key);
+    istatus = item_insert(it, &key);
+    if (istatus != ITEM_OK) {
+        _error_rsp(rsp, istatus);
+        INCR(process_metrics, set_ex);
+
+        return;
+    }
     rsp->type = RSP_STORED;
     INCR(process_metrics, set_stored);
 
@@ -356,7 +388,13 @@ _process_add(struct response *rsp, struct request *req)
         rsp->type = RSP_NOT_STORED;
         INCR(process_metrics, add_notstored);
     } else {
-        item_insert(it, &key);
+        istatus = item_insert(it, &key);
+        if (istatus != ITEM_OK) {
+            _error_rsp(rsp, istatus);
+            INCR(process_metrics, add_ex);
+
+            return;
+        }
         rsp->type = RSP_STORED;
         INCR(process_metrics, add_stored);
     }
@@ -388,7 +426,13 @@ _process_replace(struct response *rsp, struct request *req)
     it = (struct item *)req->reserved;
     key = (struct bstring){it->klen, item_key(it)};
     if (item_get(&key) != NULL) {
-        item_insert(it, &key);
+        istatus = item_insert(it, &key);
+        if (istatus != ITEM_OK) {
+            _error_rsp(rsp, istatus);
+            INCR(process_metrics, replace_ex);
+
+            return;
+        }
         rsp->type = RSP_STORED;
         INCR(process_metrics, replace_stored);
     } else {
@@ -433,7 +477,13 @@ _process_cas(struct response *rsp, struct request *req)
             rsp->type = RSP_EXISTS;
             INCR(process_metrics, cas_exists);
         } else {
-            item_insert(it, &key);
+            istatus = item_insert(it, &key);
+            if (istatus != ITEM_OK) {
+                _error_rsp(rsp, istatus);
+                INCR(process_metrics, cas_ex);
+
+                return;
+            }
             rsp->type = RSP_STORED;
             INCR(process_metrics, cas_stored);
         }
@@ -473,7 +523,7 @@ _process_delta(struct response *rsp, struct item *it, struct request *req,
     rsp->vint = vint;
     nval.len = cc_print_uint64_unsafe(buf, vint);
     nval.data = buf;
-    if (item_slabid(it->klen, nval.len, it->olen) == it->id) {
+    if (item_fits(it, nval.len)) {
         item_update(it, &nval);
         return ITEM_OK;
     }
@@ -483,7 +533,7 @@ _process_delta(struct response *rsp, struct item *it, struct request *req,
             it->expire_at);
     if (status == ITEM_OK) {
         _set_dataflag(it, dataflag);
-        item_insert(it, key);
+        status = item_insert(it, key);
     }
 
     return status;
@@ -694,6 +744,36 @@ _cleanup(struct request *req, struct response *rsp)
     req->rsp = rsp;
 }
 
+static void
+_unpin(void *owner)
+{
+    item_unpin(owner);
+}
+
+/* compose a response, pinning the item if its value is sent by reference */
+static int
+_compose_rsp(struct buf **wbuf, struct response *rsp)
+{
+    struct item *it = rsp->vref;
+    int n;
+
+    if (it != NULL && !item_pin(it)) {
+        rsp->vref = it = NULL;
+    }
+
+    n = compose_rsp(wbuf, rsp);
+
+    if (it != NULL) {
+        if (rsp->vref == NULL) { /* copied after all */
+            item_unpin(it);
+        } else {
+            INCR(process_metrics, get_key_zcopy);
+        }
+    }
+
+    return n;
+}
+
 int
 twemcache_process_read(struct buf **rbuf, struct buf **wbuf, void **data)
 {
@@ -797,7 +877,7 @@ twemcache_process_read(struct buf **rbuf, struct buf **wbuf, void **data)
                 card = req->nfound + 1;
             }
             for (i = 0; i < card; nr = STAILQ_NEXT(nr, next), ++i) {
-                if (compose_rsp(wbuf, nr) < 0) {
+                if (_compose_rsp(wbuf, nr) < 0) {
                     log_error("composing rsp erred");
                     INCR(process_metrics, process_ex);
                     _cleanup(req, rsp);
@@ -820,6 +900,7 @@ twemcache_process_write(struct buf **rbuf, struct buf **wbuf, void **data)
 {
     log_verb("post-write processing");
 
+    buf_ref_release(*wbuf, _unpin);
     buf_lshift(*rbuf);
     dbuf_shrink(rbuf);
     buf_lshift(*wbuf);
@@ -840,6 +921,7 @@ twemcache_process_error(struct buf **rbuf, struct buf **wbuf, void **data)
     /* normalize buffer size */
     buf_reset(*rbuf);
     dbuf_shrink(rbuf);
+    buf_ref_reset(*wbuf, _unpin);
     buf_reset(*wbuf);
     dbuf_shrink(wbuf);
 
@@ -857,3 +939,13 @@ twemcache_process_error(struct buf **rbuf, struct buf **wbuf, void **data)
 
     return 0;
 }
+
+#ifndef TWEMCACHE_SEG
+void
+twemcache_process_tick(void)
+{
+    slab_expire_tick();
+    slab_automove_tick();
+    slab_snapshot_tick();
+}
+#endif
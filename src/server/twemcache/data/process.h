@@ -10,6 +10,7 @@
 #define PREFILL_KSIZE 32
 #define PREFILL_VSIZE 32
 #define PREFILL_NKEY 400000000 /* 40M keys roughly fills up a 4GB heap with default slab & data sizes */
+#define ZCOPY_VSIZE (8 * KiB)
 
 /*          name           type              default        description */
 #define PROCESS_OPTION(ACTION)                                                         \
@@ -17,7 +18,8 @@
     ACTION( prefill,       OPTION_TYPE_BOOL, PREFILL,       "prefill slabs with data" )\
     ACTION( prefill_ksize, OPTION_TYPE_UINT, PREFILL_KSIZE, "prefill key size"        )\
     ACTION( prefill_vsize, OPTION_TYPE_UINT, PREFILL_VSIZE, "prefill val size"        )\
-    ACTION( prefill_nkey,  OPTION_TYPE_UINT, PREFILL_NKEY,  "prefill keys inserted"   )
+    ACTION( prefill_nkey,  OPTION_TYPE_UINT, PREFILL_NKEY,  "prefill keys inserted"   )\
+    ACTION( zcopy_vsize,   OPTION_TYPE_UINT, ZCOPY_VSIZE,   "zero-copy min val size"  )
 /* prefilling can potentially follow a fairly complex config wrt key/value size
  * distribution and schema. However, basic performance testing around IO and
  * heap size can be greatly sped up without lengthy client-drive warm-up if we
@@ -31,6 +33,12 @@
  * and eviction are therefore possible) depending on how slab_mem is configured.
  */
 
+/* values of at least zcopy_vsize bytes are sent by get/gets straight from item
+ * memory (with writev) instead of being copied into the write buffer. Such
+ * items are pinned until the response has been sent, which also keeps their
+ * slab from being evicted. Setting zcopy_vsize to 0 disables this.
+ */
+
 typedef struct {
     PROCESS_OPTION(OPTION_DECLARE)
 } process_options_st;
@@ -45,6 +53,7 @@ typedef struct {
     ACTION( get_key_hit,       METRIC_COUNTER, "# key hits by get"     )\
     ACTION( get_key_miss,      METRIC_COUNTER, "# key misses by get"   )\
     ACTION( get_ex,            METRIC_COUNTER, "# get errors"          )\
+    ACTION( get_key_zcopy,     METRIC_COUNTER, "# zero-copy values"    )\
     ACTION( gets,              METRIC_COUNTER, "# gets requests"       )\
     ACTION( gets_key,          METRIC_COUNTER, "# keys by gets"        )\
     ACTION( gets_key_hit,      METRIC_COUNTER, "# key hits by gets"    )\
@@ -56,6 +65,7 @@ typedef struct {
     ACTION( set,               METRIC_COUNTER, "# set requests"        )\
     ACTION( set_stored,        METRIC_COUNTER, "# set successes"       )\
     ACTION( set_ex,            METRIC_COUNTER, "# set errors"          )\
+    ACTION( set_reject,        METRIC_COUNTER, "# sets not admitted"   )\
     ACTION( add,               METRIC_COUNTER, "# add requests"        )\
     ACTION( add_stored,        METRIC_COUNTER, "# add successes"       )\
     ACTION( add_notstored,     METRIC_COUNTER, "# add failures"        )\
@@ -97,3 +107,7 @@ void process_teardown(void);
 int twemcache_process_read(struct buf **rbuf, struct buf **wbuf, void **data);
 int twemcache_process_write(struct buf **rbuf, struct buf **wbuf, void **data);
 int twemcache_process_error(struct buf **rbuf, struct buf **wbuf, void **data);
+#ifndef TWEMCACHE_SEG
+/* slab housekeeping: proactive expiration and slab automove */
+void twemcache_process_tick(void);
+#endif
@@ -3,6 +3,7 @@
 #include "stats.h"
 
 #include "time/time.h"
+#include "util/upgrade.h"
 #include "util/util.h"
 
 #include <cc_debug.h>
@@ -12,20 +13,39 @@
 #include <pthread.h>
 #include <sys/socket.h>
 #include <sysexits.h>
+#include <unistd.h>
+
+#define UPGRADE_INTVL 100 /* ms between checks for a process taking over */
 
 enum twemcache_timeout_event_type {
     DLOG_TIMEOUT_EV,
     KLOG_TIMEOUT_EV,
     STATS_TIMEOUT_EV,
+    UPGRADE_TIMEOUT_EV,
     MAX_TIMEOUT_EV
 };
 
+/* descriptors handed to a process taking over, in this order */
+enum twemcache_upgrade_fd {
+    UPGRADE_HEAP_FD,
+    UPGRADE_SERVER_FD,
+    UPGRADE_ADMIN_FD,
+    MAX_UPGRADE_FD
+};
+
 static struct timeout_event *twemcache_tev[MAX_TIMEOUT_EV];
 
+static int upgrade_sd = -1;     /* listening for a process taking over */
+static int upgrade_peer = -1;   /* the process taking over */
+static int upgrade_fd[MAX_UPGRADE_FD] = { -1, -1, -1 };
+
 struct data_processor worker_processor = {
     twemcache_process_read,
     twemcache_process_write,
     twemcache_process_error,
+#ifndef TWEMCACHE_SEG
+    .tick = twemcache_process_tick,
+#endif
     .running = true
 };
 
@@ -39,7 +59,11 @@ show_usage(void)
     log_stdout(
             "Description:" CRLF
             "  pelikan_twemcache is one of the unified cache backends. " CRLF
+#ifdef TWEMCACHE_SEG
+            "  It uses a segment-based storage to cache key/val pairs. " CRLF
+#else
             "  It uses a slab-based storage to cache key/val pairs. " CRLF
+#endif
             "  It speaks the memcached ASCII protocol and supports almost " CRLF
             "  all ASCII memcached commands." CRLF
             );
@@ -65,7 +89,20 @@ teardown(void)
     core_admin_teardown();
     admin_process_teardown();
     process_teardown();
+#ifdef TWEMCACHE_SEG
+    seg_teardown();
+#else
     slab_teardown();
+#endif
+    /* the heap is only handed over once no longer written to */
+    if (upgrade_peer >= 0) {
+        upgrade_send(upgrade_peer, upgrade_fd, MAX_UPGRADE_FD);
+        upgrade_peer = -1;
+    }
+    if (upgrade_sd >= 0) {
+        close(upgrade_sd);
+        upgrade_sd = -1;
+    }
     klog_teardown();
     hotkey_teardown();
     compose_teardown();
@@ -94,15 +131,75 @@ _shutdown(int signo)
     __atomic_store_n(&worker_processor.running, false, __ATOMIC_RELEASE);
     core_destroy();
     for (int i = DLOG_TIMEOUT_EV; i < MAX_TIMEOUT_EV; ++i) {
-        core_admin_unregister(twemcache_tev[i]);
+        if (twemcache_tev[i] != NULL) {
+            core_admin_unregister(twemcache_tev[i]);
+        }
     }
     exit(EX_OK);
 }
 
+/*
+ * Runs on the admin thread. Once a new process connects, the server and worker
+ * threads are stopped and the process exits; teardown then hands over the
+ * heap and listening sockets, and the new process starts serving on them.
+ */
+static void
+_upgrade_check(void *arg)
+{
+    int sd;
+
+    sd = upgrade_accept(upgrade_sd);
+    if (sd < 0) {
+        return;
+    }
+
+    log_info("handing over to a new process");
+#ifndef TWEMCACHE_SEG
+    upgrade_fd[UPGRADE_HEAP_FD] = slab_heap_fd();
+#endif
+    upgrade_fd[UPGRADE_SERVER_FD] = core_server_fd();
+    upgrade_fd[UPGRADE_ADMIN_FD] = core_admin_fd();
+    upgrade_peer = sd;
+
+    __atomic_store_n(&worker_processor.running, false, __ATOMIC_RELEASE);
+    core_destroy();
+    exit(EX_OK);
+}
+
+/* take over the heap and listening sockets of a running process, if any;
+ * CC_ERROR if it is still serving on the ports we would have to bind
+ */
+static rstatus_i
+_upgrade_setup(const char *path, uint32_t timeout)
+{
+    int fd[MAX_UPGRADE_FD];
+    rstatus_i status;
+
+    status = upgrade_recv(path, fd, MAX_UPGRADE_FD, timeout);
+    if (status == CC_EAGAIN) {
+        return CC_ERROR;
+    }
+    if (status != CC_OK) { /* nothing to take over, start fresh */
+        return CC_OK;
+    }
+
+#ifndef TWEMCACHE_SEG
+    slab_heap_inherit(fd[UPGRADE_HEAP_FD]);
+#else
+    if (fd[UPGRADE_HEAP_FD] >= 0) {
+        close(fd[UPGRADE_HEAP_FD]);
+    }
+#endif
+    core_server_inherit(fd[UPGRADE_SERVER_FD]);
+    core_admin_inherit(fd[UPGRADE_ADMIN_FD]);
+
+    return CC_OK;
+}
+
 static void
 setup(void)
 {
-    char *fname = NULL;
+    char *fname = NULL, *upath;
     uint64_t intvl;
 
     if (atexit(teardown) != 0) {
@@ -132,11 +229,18 @@ setup(void)
         create_pidfile(fname);
     }
 
+    upath = option_str(&setting.twemcache.upgrade_path);
+    if (upath != NULL && _upgrade_setup(upath,
+                option_uint(&setting.twemcache.upgrade_timeout)) != CC_OK) {
+        log_error("the running process did not hand over, not starting");
+        goto error;
+    }
+
     /* setup library modules */
     stats_log_setup(&setting.stats_log);
     buf_setup(&setting.buf, &stats.buf);
     dbuf_setup(&setting.dbuf, &stats.dbuf);
-    event_setup(&stats.event);
+    event_setup(&setting.event, &stats.event);
     sockio_setup(&setting.sockio, &stats.sockio);
     tcp_setup(&setting.tcp, &stats.tcp);
     timing_wheel_setup(&stats.timing_wheel);
@@ -150,12 +254,16 @@ setup(void)
     compose_setup(NULL, &stats.compose_rsp);
     klog_setup(&setting.klog, &stats.klog);
     hotkey_setup(&setting.hotkey);
+#ifdef TWEMCACHE_SEG
+    seg_setup(&setting.seg, &stats.seg);
+#else
     slab_setup(&setting.slab, &stats.slab);
+#endif
     process_setup(&setting.process, &stats.process);
     admin_process_setup();
     core_admin_setup(&setting.admin);
+    core_worker_setup(&setting.worker, &stats.worker, &worker_processor);
     core_server_setup(&setting.server, &stats.server);
-    core_worker_setup(&setting.worker, &stats.worker);
 
     /* adding recurring events to maintenance/admin thread */
     intvl = option_uint(&setting.twemcache.dlog_intvl);
@@ -176,6 +284,17 @@ setup(void)
         goto error;
     }
 
+    if (upath != NULL) {
+        if ((upgrade_sd = upgrade_listen(upath)) < 0) {
+            log_error("Could not listen for upgrades on %s", upath);
+            goto error;
+        }
+        if ((twemcache_tev[UPGRADE_TIMEOUT_EV] = core_admin_register(UPGRADE_INTVL, _upgrade_check, NULL)) == NULL) {
+            log_error("Could not register timed event to check for upgrades");
+            goto error;
+        }
+    }
+
     return;
 
 error:
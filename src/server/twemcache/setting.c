@@ -10,12 +10,17 @@ struct setting setting = {
     { HOTKEY_OPTION(OPTION_INIT)    },
     { REQUEST_OPTION(OPTION_INIT)   },
     { RESPONSE_OPTION(OPTION_INIT)  },
+#ifdef TWEMCACHE_SEG
+    { SEG_OPTION(OPTION_INIT)       },
+#else
     { SLAB_OPTION(OPTION_INIT)      },
+#endif
     { TIME_OPTION(OPTION_INIT)      },
     { ARRAY_OPTION(OPTION_INIT)     },
     { BUF_OPTION(OPTION_INIT)       },
     { DBUF_OPTION(OPTION_INIT)      },
     { DEBUG_OPTION(OPTION_INIT)     },
+    { EVENT_OPTION(OPTION_INIT)     },
     { STATS_LOG_OPTION(OPTION_INIT) },
     { SOCKIO_OPTION(OPTION_INIT)    },
     { TCP_OPTION(OPTION_INIT)       },
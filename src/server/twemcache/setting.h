@@ -5,9 +5,15 @@
 #include "core/core.h"
 #include "hotkey/hotkey.h"
 #include "protocol/data/memcache_include.h"
+#ifdef TWEMCACHE_SEG
+#include "storage/seg/item.h"
+#include "storage/seg/seg.h"
+#else
 #include "storage/slab/item.h"
 #include "storage/slab/slab.h"
+#endif
 #include "time/time.h"
+#include "util/upgrade.h"
 
 #include <buffer/cc_buf.h>
 #include <buffer/cc_dbuf.h>
@@ -19,13 +25,15 @@
 #include <stream/cc_sockio.h>
 
 /* option related */
-/*          name            type                default description */
-#define TWEMCACHE_OPTION(ACTION)                                                        \
-    ACTION( daemonize,      OPTION_TYPE_BOOL,   false,  "daemonize the process"        )\
-    ACTION( pid_filename,   OPTION_TYPE_STR,    NULL,   "file storing the pid"         )\
-    ACTION( dlog_intvl,     OPTION_TYPE_UINT,   500,    "debug log flush interval(ms)" )\
-    ACTION( klog_intvl,     OPTION_TYPE_UINT,   100,    "cmd log flush interval(ms)"   )\
-    ACTION( stats_intvl,    OPTION_TYPE_UINT,   100,    "stats dump interval(ms)"      )
+/*          name                type                default             description */
+#define TWEMCACHE_OPTION(ACTION)                                                                        \
+    ACTION( daemonize,          OPTION_TYPE_BOOL,   false,              "daemonize the process"        )\
+    ACTION( pid_filename,       OPTION_TYPE_STR,    NULL,               "file storing the pid"         )\
+    ACTION( dlog_intvl,         OPTION_TYPE_UINT,   500,                "debug log flush interval(ms)" )\
+    ACTION( klog_intvl,         OPTION_TYPE_UINT,   100,                "cmd log flush interval(ms)"   )\
+    ACTION( stats_intvl,        OPTION_TYPE_UINT,   100,                "stats dump interval(ms)"      )\
+    ACTION( upgrade_path,       OPTION_TYPE_STR,    NULL,               "unix socket for hot upgrades" )\
+    ACTION( upgrade_timeout,    OPTION_TYPE_UINT,   UPGRADE_TIMEOUT,    "upgrade wait(ms), 0: no limit")
 
 typedef struct {
     TWEMCACHE_OPTION(OPTION_DECLARE)
@@ -43,13 +51,18 @@ struct setting {
     hotkey_options_st       hotkey;
     request_options_st      request;
     response_options_st     response;
+#ifdef TWEMCACHE_SEG
+    seg_options_st          seg;
+#else
     slab_options_st         slab;
+#endif
     time_options_st         time;
     /* ccommon libraries */
     array_options_st        array;
     buf_options_st          buf;
     dbuf_options_st         dbuf;
     debug_options_st        debug;
+    event_options_st        event;
     stats_log_options_st    stats_log;
     sockio_options_st       sockio;
     tcp_options_st          tcp;
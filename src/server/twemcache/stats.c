@@ -8,7 +8,11 @@ struct stats stats = {
     { KLOG_METRIC(METRIC_INIT)          },
     { REQUEST_METRIC(METRIC_INIT)       },
     { RESPONSE_METRIC(METRIC_INIT)      },
+#ifdef TWEMCACHE_SEG
+    { SEG_METRIC(METRIC_INIT)           },
+#else
     { SLAB_METRIC(METRIC_INIT)          },
+#endif
     { CORE_SERVER_METRIC(METRIC_INIT)   },
     { CORE_WORKER_METRIC(METRIC_INIT)   },
     { BUF_METRIC(METRIC_INIT)           },
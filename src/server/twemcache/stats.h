@@ -4,8 +4,13 @@
 
 #include "core/core.h"
 #include "protocol/data/memcache_include.h"
+#ifdef TWEMCACHE_SEG
+#include "storage/seg/item.h"
+#include "storage/seg/seg.h"
+#else
 #include "storage/slab/item.h"
 #include "storage/slab/slab.h"
+#endif
 #include "util/procinfo.h"
 
 #include <cc_event.h>
@@ -24,7 +29,11 @@ struct stats {
     klog_metrics_st             klog;
     request_metrics_st          request;
     response_metrics_st         response;
+#ifdef TWEMCACHE_SEG
+    seg_metrics_st              seg;
+#else
     slab_metrics_st             slab;
+#endif
     server_metrics_st           server;
     worker_metrics_st           worker;
     /* ccommon libraries */
@@ -1,4 +1,5 @@
 #include "cuckoo.h"
+#include "overflow.h"
 
 #include <cc_debug.h>
 #include <cc_define.h>
@@ -8,17 +9,76 @@
 
 #include <datapool/datapool.h>
 
-/* TODO(yao): make D and iv[] configurable */
 #include <stdlib.h>
 #include <sysexits.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define CUCKOO_MODULE_NAME "storage::cuckoo"
 
-/* D is the degree/cardinality of the hash values computed for each key */
-#define D       4
+/*
+ * D is the degree/cardinality of the hash values computed for each key by
+ * default, up to NHASH_MAX can be configured
+ */
+#define D           4
+#define NHASH_MAX   8
+
+/*
+ * With buckets, a key maps by default to BUCKET_D buckets of up to BUCKET_MAX
+ * slots each instead of to D slots. Every slot has a 1-byte tag, a fingerprint of the key
+ * it holds or TAG_EMPTY, kept apart from the items so that the tags of a
+ * bucket are compared at once, and items are only read on a tag match.
+ */
+#define BUCKET_D    2
+#define BUCKET_MAX  8
+#define NCAND_MAX   (NHASH_MAX * BUCKET_MAX)
+#define TAG_EMPTY   0
+#define NO_SLOT     UINT32_MAX
+
+/* a slot whose item is moved, found by the displacement search */
+struct displace_node {
+    uint32_t slot;
+    uint32_t parent;    /* node whose item moves into slot, NO_SLOT if none */
+    uint32_t depth;     /* # moves to free this slot */
+};
+#define DISPLACE_QUEUE 1024 /* most slots visited per displacement search */
+#define DISPLACE_RETRY 4    /* most searches when paths change, concurrent */
+
+/*
+ * When concurrent, buckets are covered by stripes, each with a version that
+ * is odd while a writer holds the stripe. Writers lock the stripes of all
+ * buckets they change, readers retry if a version they saw has changed.
+ */
+#define STRIPE_MAX  (1 << 14)
+#define STRIPE(b)   ((b) & (nstripe - 1))
+
+#define OVERFLOW_EVICT_TRY 8 /* most items evicted for one overflow value */
+
+/*
+ * Where an item sits depends on how the table is laid out and keys are
+ * hashed, so that is recorded in the data pool, and a pool laid out any other
+ * way is started afresh. CUCKOO_POOL_MAGIC changes with the hashing scheme.
+ */
+#define CUCKOO_POOL_MAGIC 0x63756b6f6f030000ULL /* "cukoo", scheme 3 */
+struct cuckoo_pool_layout {
+    uint64_t magic;
+    uint64_t item_size;
+    uint32_t nitem;
+    uint32_t bucket_size;
+    uint32_t nhash;
+    uint32_t seed;
+    uint32_t cas;
+};
+
+/* for comparing the tags of a bucket as the bytes of a word */
+#define TAG_BYTES   0x0101010101010101ULL
+#define TAG_LOW7    0x7f7f7f7f7f7f7f7fULL
+#define TAG_PACK    0x0102040810204080ULL
 
 uint64_t cas_val;
 bool cas_enabled = CUCKOO_ITEM_CAS;
+bool cuckoo_concurrent = CUCKOO_CONCURRENT;
 uint32_t cuckoo_policy = CUCKOO_POLICY;
 delta_time_i max_ttl = CUCKOO_MAX_TTL;
 
@@ -28,25 +88,37 @@ static bool cuckoo_init; /* need to make sure memory has been pre-allocate */
 /**
  * Cuckoo hashing requires the D hash values to be generated by different hash
  * functions.
- * murmur3, our chosen hash function, takes an initial value when computing
- * hash values, so we choose D different initial values to be used by the same
- * hash function to approximate D different hash functions.
+ * Rather than running murmur3 D times with different initial values, all D
+ * are derived from one 128-bit murmur3 hash (h1, h2) by double hashing: the
+ * i-th is h1 + i * h2, which is as good for picking locations and costs a
+ * single pass over the key. h2 is made odd and non-zero modulo the number of
+ * buckets, so that with a power of 2 of them no two locations of a key are
+ * the same. The tag is taken from the top byte of h2.
  */
-static uint32_t iv[D] = {
-    /* these numbers can be picked arbitrarily as long as they are different */
-    0x3ac5d673,
-    0x6d7839d0,
-    0x2b581cf5,
-    0x4dd2be0a
-};
+static uint32_t seed = CUCKOO_SEED;
 
 static struct datapool *pool; /* data pool mapping for the hash table */
 static void* ds; /* data store is also the hash table */
 static size_t item_size = CUCKOO_ITEM_SIZE;
 static uint32_t max_nitem = CUCKOO_NITEM;
 static size_t hash_size; /* item_size * max_nitem, computed at setup */
+static uint32_t displace = CUCKOO_DISPLACE; /* most moves per insert */
+static uint32_t bucket_size = CUCKOO_BUCKET;
+static uint32_t nbucket; /* max_nitem / bucket_size */
+static uint32_t nhash = D; /* # buckets a key maps to */
+static uint32_t ncand = D; /* # slots a key can be in, nhash * bucket_size */
+static uint8_t *tags; /* one per slot, padded to read a bucket's as a word */
+static uint32_t *stripe; /* versions of stripes, when concurrent */
+static uint32_t nstripe;
+
+/* stripes locked by this thread, of its key and of a displacement path */
+static __thread uint32_t held[NHASH_MAX];
+static __thread uint32_t nheld;
+static __thread uint32_t path_held[DISPLACE_QUEUE + 1];
+static __thread uint32_t npath_held;
 
 #define OFFSET2ITEM(o) ((struct item *)((ds) + (o) * item_size))
+#define ITEM2OFFSET(it) ((uint32_t)(((void *)(it) - (ds)) / item_size))
 #define RANDOM(k) (random() % k)
 
 #define ITEM_METRICS_INCR(it)   do {                                        \
@@ -78,6 +150,123 @@ static inline uint32_t vlen(struct val *val)
     }
 }
 
+/* whether key and val fit in a slot */
+static inline bool
+_val_inline(uint32_t klen, struct val *val)
+{
+    return vlen(val) < VLEN_OVERFLOW && klen + vlen(val) + ITEM_OVERHEAD <=
+        item_size;
+}
+
+/* whether val fits in the overflow arena, and key and its ref in a slot */
+static inline bool
+_val_overflow(uint32_t klen, struct val *val)
+{
+    return val->type == VAL_TYPE_STR && overflow_fits(val->vstr.len) &&
+        klen + sizeof(uint32_t) + ITEM_OVERHEAD <= item_size;
+}
+
+/* give back the chunk of the item's value, if it is in the overflow arena */
+static inline void
+_item_release(struct item *it)
+{
+    if (item_overflowed(it)) {
+        overflow_free(item_ref(it));
+        DECR(cuckoo_metrics, overflow_curr);
+        it->vlen = 0;
+    }
+}
+
+static inline void
+_cpu_relax(void)
+{
+#ifdef __SSE2__
+    _mm_pause();
+#endif
+}
+
+/*
+ * Once a stripe is taken, the odd version has to be visible before any store
+ * to its items and tags, or a reader could see those with the old version.
+ * The acquire of the CAS does not order later stores, hence the fence.
+ */
+static inline void
+_stripe_lock(uint32_t s)
+{
+    uint32_t v;
+
+    for (;;) {
+        v = __atomic_load_n(&stripe[s], __ATOMIC_RELAXED);
+        if ((v & 1) == 0 && __atomic_compare_exchange_n(&stripe[s], &v, v + 1,
+                    false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            return;
+        }
+        _cpu_relax();
+    }
+}
+
+static inline bool
+_stripe_trylock(uint32_t s)
+{
+    uint32_t v = __atomic_load_n(&stripe[s], __ATOMIC_RELAXED);
+
+    if ((v & 1) == 0 && __atomic_compare_exchange_n(&stripe[s], &v, v + 1,
+                false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        return true;
+    }
+
+    return false;
+}
+
+static inline void
+_stripe_unlock(uint32_t s)
+{
+    __atomic_store_n(&stripe[s], stripe[s] + 1, __ATOMIC_RELEASE);
+}
+
+/* the version of stripe s once no writer holds it */
+static inline uint32_t
+_stripe_begin(uint32_t s)
+{
+    uint32_t v;
+
+    while ((v = __atomic_load_n(&stripe[s], __ATOMIC_ACQUIRE)) & 1) {
+        _cpu_relax();
+    }
+
+    return v;
+}
+
+/* whether a writer has had stripe s since version v, so reads may be torn */
+static inline bool
+_stripe_changed(uint32_t s, uint32_t v)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(&stripe[s], __ATOMIC_RELAXED) != v;
+}
+
+static inline bool
+_stripe_held(uint32_t s)
+{
+    uint32_t i;
+
+    for (i = 0; i < nheld; ++i) {
+        if (held[i] == s) {
+            return true;
+        }
+    }
+    for (i = 0; i < npath_held; ++i) {
+        if (path_held[i] == s) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 static bool
 cuckoo_hit(struct item *it, struct bstring *key)
 {
@@ -86,27 +275,122 @@ cuckoo_hit(struct item *it, struct bstring *key)
     return item_valid(it) && item_matched(it, key);
 }
 
+/*
+ * the buckets key maps to, and the tag of its slot. The tags of all buckets
+ * are prefetched before any is looked at, so that their misses overlap.
+ */
 static void
-cuckoo_hash(uint32_t offset[], struct bstring *key)
+cuckoo_hash(uint32_t bucket[], uint8_t *tag, struct bstring *key)
 {
-    int i;
-    uint32_t hv;
+    uint64_t hv[2], h1, h2;
+    uint32_t i;
 
-    for (i = 0; i < D; ++i) {
-        hash_murmur3_32(key->data, key->len, iv[i], &hv);
-        offset[i] = hv % max_nitem;
+    hash_murmur3_128_x64(key->data, key->len, seed, hv);
+
+    h1 = hv[0] % nbucket;
+    h2 = (hv[1] | 1) % nbucket;
+    h2 += (h2 == 0);
+    for (i = 0; i < nhash; ++i) {
+        bucket[i] = (h1 + i * h2) % nbucket;
+        __builtin_prefetch(tags + (size_t)bucket[i] * bucket_size);
     }
+    *tag = (hv[1] >> 56) == TAG_EMPTY ? 1 : (uint8_t)(hv[1] >> 56);
 
     return;
 }
 
+/* the slots of the buckets a key maps to */
+static inline void
+_candidates(uint32_t offset[], const uint32_t bucket[])
+{
+    uint32_t i, j;
+
+    for (i = 0; i < nhash; ++i) {
+        for (j = 0; j < bucket_size; ++j) {
+            offset[i * bucket_size + j] = bucket[i] * bucket_size + j;
+        }
+    }
+}
+
+/*
+ * Slots of bucket b tagged with tag, as a mask with bit i set for slot i. The
+ * tags of a bucket are compared at once with SSE2, or else as the bytes of a
+ * 64-bit word.
+ */
+static inline uint32_t
+_tag_match(uint32_t b, uint8_t tag)
+{
+    const uint8_t *t = tags + (size_t)b * bucket_size;
+    uint32_t all = (1U << bucket_size) - 1;
+#ifdef __SSE2__
+    __m128i w = _mm_loadl_epi64((const __m128i *)t);
+
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(w,
+                _mm_set1_epi8((char)tag))) & all;
+#else
+    uint64_t w, x, m;
+
+    cc_memcpy(&w, t, sizeof(w));
+    x = w ^ (TAG_BYTES * tag);
+    m = ~(((x & TAG_LOW7) + TAG_LOW7) | x | TAG_LOW7); /* 0x80 if equal */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    m = __builtin_bswap64(m);
+#endif
+
+    return (uint32_t)(((m >> 7) * TAG_PACK) >> 56) & all;
+#endif
+}
+
+/*
+ * A candidate slot holding no valid item: an empty one going by the tags, in
+ * the bucket with the most of them to keep buckets evenly filled, or else the
+ * first one whose item has expired. NO_SLOT if there is none.
+ */
+static uint32_t
+_slot_free(const uint32_t bucket[], const uint32_t offset[])
+{
+    uint32_t i, m, best = 0, nbest = 0;
+
+    for (i = 0; i < nhash; ++i) {
+        m = _tag_match(bucket[i], TAG_EMPTY);
+        if ((uint32_t)__builtin_popcount(m) > nbest) {
+            nbest = __builtin_popcount(m);
+            best = bucket[i] * bucket_size + __builtin_ctz(m);
+        }
+    }
+    if (nbest > 0) {
+        return best;
+    }
+
+    for (i = 0; i < ncand; ++i) {
+        if (!item_valid(OFFSET2ITEM(offset[i]))) {
+            return offset[i];
+        }
+    }
+
+    return NO_SLOT;
+}
+
+/* a free slot is about to be overwritten, account for an expired item in it */
+static inline void
+_slot_reclaim(uint32_t slot)
+{
+    struct item *it = OFFSET2ITEM(slot);
+
+    if (item_expired(it)) {
+        INCR(cuckoo_metrics, item_expire);
+        ITEM_METRICS_DECR(it);
+        _item_release(it);
+    }
+}
+
 static inline uint32_t
 _select_candidate(const uint32_t offset[])
 {
     uint32_t selected = offset[0];
 
     if (cuckoo_policy == CUCKOO_POLICY_RANDOM) {
-        selected = offset[RANDOM(D)];
+        selected = offset[RANDOM(ncand)];
     } else if (cuckoo_policy == CUCKOO_POLICY_EXPIRE) {
         /*
          * Selection prefers the item expiring soonest, followed by the one
@@ -115,7 +399,7 @@ _select_candidate(const uint32_t offset[])
         proc_time_i expire, min = INT32_MAX;
         uint32_t i;
 
-        for (i = 0; i < D; ++i) {
+        for (i = 0; i < ncand; ++i) {
             expire = item_expire(OFFSET2ITEM(offset[i]));
             if (expire < min) {
                 min = expire;
@@ -131,143 +415,336 @@ _select_candidate(const uint32_t offset[])
     return selected;
 }
 
-/* sorts candidate offsets based on policy */
-static void
-_sort_candidate(uint32_t ordered[], const uint32_t offset[])
+/* whether slot is on the displacement path ending in node n */
+static inline bool
+_on_path(const struct displace_node q[], uint32_t n, uint32_t slot)
 {
-    uint32_t i;
-    /* offset always holds D elements */
+    for (; n != NO_SLOT; n = q[n].parent) {
+        if (q[n].slot == slot) {
+            return true;
+        }
+    }
 
-    if (cuckoo_policy == CUCKOO_POLICY_RANDOM) {
-        /* only pick the first item randomly, and "sort" the rest linearly */
-        uint32_t j = RANDOM(D);
+    return false;
+}
 
-        for (i = 0; i < D; ++i, j = (j + 1) % D) {
-            ordered[i] = offset[j];
+/*
+ * Searches breadth-first for the shortest path of at most `displace' moves
+ * from one of the candidate slots of a new item, all of which hold valid
+ * items, to an empty or expired slot. Returns the node whose item moves into
+ * that slot, *end, or NO_SLOT if there is no such path. When concurrent, the
+ * items are read unlocked and may be torn, so the path is only a guess.
+ */
+static uint32_t
+_displace_search(struct displace_node q[], const uint32_t offset[],
+        uint32_t *end)
+{
+    struct bstring key;
+    struct item *it;
+    uint32_t bucket[NHASH_MAX];
+    uint32_t cand[NCAND_MAX];
+    uint32_t head, tail = 0, i, n;
+    uint8_t tag;
+
+    /* offset may have duplicates, which are queued once */
+    for (i = 0; displace > 0 && i < ncand; ++i) {
+        for (n = 0; n < tail; ++n) {
+            if (q[n].slot == offset[i]) {
+                break;
+            }
         }
-    } else if (cuckoo_policy == CUCKOO_POLICY_EXPIRE) {
-        proc_time_i expire[D];
-
-        for (i = 0; i < D; ++i) {
-            uint32_t j = i;
-            proc_time_i te;
-            uint32_t to;
-
-            /* basically an insert sort */
-            expire[i] = item_expire(OFFSET2ITEM(offset[i]));
-            ordered[i] = offset[i];
-            while (j > 0 && expire[j] < expire[j - 1]) {
-                /* swap */
-                te = expire[j - 1];
-                expire[j - 1] = expire[j];
-                expire[j] = te;
-                to = ordered[j - 1];
-                ordered[j - 1] = ordered[j];
-                ordered[j] = to;
-                j--;
+        if (n == tail) {
+            q[tail++] = (struct displace_node){offset[i], NO_SLOT, 1};
+        }
+    }
+
+    for (head = 0; head < tail; ++head) {
+        it = OFFSET2ITEM(q[head].slot);
+        if (item_klen(it) + ITEM_OVERHEAD > item_size) { /* torn */
+            continue;
+        }
+        item_key(&key, it);
+        cuckoo_hash(bucket, &tag, &key);
+        _candidates(cand, bucket);
+
+        *end = _slot_free(bucket, cand);
+        if (*end != NO_SLOT) {
+            return head;
+        }
+
+        if (q[head].depth == displace) {
+            continue;
+        }
+        for (i = 0; i < ncand && tail < DISPLACE_QUEUE; ++i) {
+            /* its own bucket is full, and a slot can't be moved twice */
+            if (cand[i] / bucket_size == q[head].slot / bucket_size ||
+                    _on_path(q, head, cand[i])) {
+                continue;
             }
+            q[tail++] = (struct displace_node){cand[i], head,
+                q[head].depth + 1};
         }
-    } else {
-        NOT_REACHED();
     }
+
+    return NO_SLOT;
 }
 
 static void
-cuckoo_displace(uint32_t displaced)
+_path_unlock(void)
+{
+    for (; npath_held > 0; --npath_held) {
+        _stripe_unlock(path_held[npath_held - 1]);
+    }
+}
+
+static bool
+_path_trylock(uint32_t slot)
+{
+    uint32_t s = STRIPE(slot / bucket_size);
+
+    if (_stripe_held(s)) {
+        return true;
+    }
+    if (!_stripe_trylock(s)) {
+        return false;
+    }
+    path_held[npath_held++] = s;
+
+    return true;
+}
+
+/*
+ * Locks the stripes of the path found by _displace_search that the key's
+ * don't cover, and checks that the path still holds: the last slot is free,
+ * and each item can still move to the slot after it. Stripes are only tried,
+ * as they are not taken in order. Returns false, holding none of them, if
+ * the path can't be used.
+ */
+static bool
+_path_lock(const struct displace_node q[], uint32_t head, uint32_t end)
 {
-    long int i, j, k, step;
     struct bstring key;
     struct item *it;
-    /* both offset and ordered may have duplicates, treat with care */
-    uint32_t offset[D];
-    uint32_t ordered[D];
-    uint32_t path[CUCKOO_DISPLACE + 1];
-    bool ended = false;
-    bool evict = true;
+    uint32_t bucket[NHASH_MAX];
+    uint32_t n, i, dst = end;
+    uint8_t tag;
 
-    INCR(cuckoo_metrics, cuckoo_displace);
+    if (!_path_trylock(end) || (item_valid(OFFSET2ITEM(end)) &&
+            tags[end] != TAG_EMPTY)) {
+        goto fail;
+    }
+    for (n = head; n != NO_SLOT; dst = q[n].slot, n = q[n].parent) {
+        if (!_path_trylock(q[n].slot)) {
+            goto fail;
+        }
+        it = OFFSET2ITEM(q[n].slot);
+        if (!item_valid(it)) {
+            goto fail;
+        }
+        item_key(&key, it);
+        cuckoo_hash(bucket, &tag, &key);
+        for (i = 0; i < nhash && bucket[i] != dst / bucket_size; ++i);
+        if (i == nhash) {
+            goto fail;
+        }
+    }
 
-    step = 0;
-    path[0] = displaced;
-    while (!ended && step < CUCKOO_DISPLACE) {
-        step++;
-        it = OFFSET2ITEM(displaced);
-        key.len = it->klen;
-        key.data = ITEM_KEY_POS(it);
-        cuckoo_hash(offset, &key);
-
-        /* first try to find an empty item */
-        for (i = 0; i < D; ++i) {
-            it = OFFSET2ITEM(offset[i]);
-            if (item_valid(it)) {
-                continue;
-            }
-            log_verb("item at %p is unoccupied", it);
+    return true;
 
-            ended = true;
-            evict = false;
-            path[step] = offset[i];
-            INCR(cuckoo_metrics, item_displace);
+fail:
+    _path_unlock();
 
-            if (item_expired(it)) {
-                INCR(cuckoo_metrics, item_expire);
-                ITEM_METRICS_DECR(it);
-            }
+    return false;
+}
+
+/* moves items along the path ending in end, returns the slot freed */
+static uint32_t
+_displace_move(const struct displace_node q[], uint32_t head, uint32_t end)
+{
+    uint32_t n, slot = end;
+
+    log_verb("item at %p is unoccupied", OFFSET2ITEM(slot));
+
+    _slot_reclaim(slot);
+    for (n = head; n != NO_SLOT; n = q[n].parent) {
+        log_vverb("move item at %p to %p", OFFSET2ITEM(q[n].slot),
+                OFFSET2ITEM(slot));
+
+        cc_memcpy(OFFSET2ITEM(slot), OFFSET2ITEM(q[n].slot), item_size);
+        tags[slot] = tags[q[n].slot];
+        if (item_overflowed(OFFSET2ITEM(slot))) {
+            overflow_owner_set(item_ref(OFFSET2ITEM(slot)), slot);
+        }
+        INCR(cuckoo_metrics, item_displace);
+        slot = q[n].slot;
+    }
+    OFFSET2ITEM(slot)->expire = 0;
+    tags[slot] = TAG_EMPTY;
+
+    return slot;
+}
+
+/*
+ * Frees one of the candidate slots of a new item, all of which hold valid
+ * items, moving items along the shortest path to a free slot. A live item,
+ * chosen by policy, is only evicted if there is no such path. When
+ * concurrent, the path is locked before the move and searched again if it
+ * changed meanwhile. Returns the slot freed.
+ */
+static uint32_t
+cuckoo_displace(const uint32_t offset[])
+{
+    struct displace_node q[DISPLACE_QUEUE];
+    struct item *it;
+    uint32_t head, slot, i;
 
+    INCR(cuckoo_metrics, cuckoo_displace);
+
+    for (i = 0; i < DISPLACE_RETRY; ++i) {
+        head = _displace_search(q, offset, &slot);
+        if (head == NO_SLOT) {
             break;
         }
+        if (!cuckoo_concurrent) {
+            return _displace_move(q, head, slot);
+        }
+        if (_path_lock(q, head, slot)) {
+            slot = _displace_move(q, head, slot);
+            _path_unlock();
 
-        /* no empty item, proceed to displacement */
-        if (D == i) {
-            _sort_candidate(ordered, offset);
-            /* need to find another item that's at a different location. */
-            for (j = 0; j < D; ++j) {
-                for (k = 0; k < step; k++) { /* there can be no circle */
-                    if (path[k] == ordered[j]) {
-                        continue;
-                    }
-                }
-                break; /* otherwise we have a candidate */
-            }
+            return slot;
+        }
+        INCR(cuckoo_metrics, cuckoo_path_retry);
+    }
+
+    log_debug("no displacement within %"PRIu32" moves, evicting", displace);
+
+    slot = _select_candidate(offset);
+    it = OFFSET2ITEM(slot);
+    INCR(cuckoo_metrics, item_evict);
+    ITEM_METRICS_DECR(it);
+    _item_release(it);
+
+    return slot;
+}
 
-            if (D == j) {
-                /* all offsets are the same. no candidate for eviction. */
-                log_debug("running out of displacement candidates");
+/*
+ * A chunk of the overflow arena for len bytes of the item in slot. If none is
+ * free, items with values in chunks of the same size are evicted to make
+ * room. When concurrent, only those whose stripes can be had right away are.
+ */
+static uint32_t
+_overflow_alloc(uint32_t len, uint32_t slot)
+{
+    struct item *it;
+    uint32_t ref, owner, s, i;
+    bool locked;
+
+    for (i = 0; i < OVERFLOW_EVICT_TRY; ++i) {
+        ref = overflow_alloc(len, slot);
+        if (ref != OVERFLOW_NONE) {
+            INCR(cuckoo_metrics, overflow_curr);
+            return ref;
+        }
 
-                ended = true;
-                --step; /* discard last step */
+        ref = overflow_victim(len, &owner);
+        if (ref == OVERFLOW_NONE) {
+            break;
+        }
+        s = STRIPE(owner / bucket_size);
+        locked = cuckoo_concurrent && !_stripe_held(s);
+        if (locked && !_stripe_trylock(s)) {
+            continue;
+        }
+        it = OFFSET2ITEM(owner);
+        /* the chunk may have changed hands since it was picked */
+        if (!item_empty(it) && item_overflowed(it) && item_ref(it) == ref) {
+            log_verb("evict item at %p for overflow room", it);
+            INCR(cuckoo_metrics, overflow_evict);
+            if (item_expired(it)) {
+                INCR(cuckoo_metrics, item_expire);
             } else {
-                INCR(cuckoo_metrics, item_displace);
-                displaced = ordered[j]; /* next displaced item */
-                path[step] = displaced;
+                INCR(cuckoo_metrics, item_evict);
             }
+            ITEM_METRICS_DECR(it);
+            _item_release(it);
+            item_delete(it);
+            tags[owner] = TAG_EMPTY;
+        }
+        if (locked) {
+            _stripe_unlock(s);
         }
     }
 
-    if (evict) {
-        log_verb("one item evicted during replacement");
+    log_debug("no overflow room for a value of %"PRIu32" bytes", len);
+    INCR(cuckoo_metrics, overflow_ex);
 
-        it = OFFSET2ITEM(path[step]);
-        INCR(cuckoo_metrics, item_evict);
-        ITEM_METRICS_DECR(it);
-    }
+    return OVERFLOW_NONE;
+}
+
+/* whether the data pool was laid out as the table is now */
+static bool
+_cuckoo_layout_check(struct cuckoo_pool_layout *layout)
+{
+    struct cuckoo_pool_layout old;
+
+    datapool_get_user_data(pool, &old, sizeof(old));
 
-    /* move items along the path we have found */
-    for (i = step; i > 0; --i) {
-        log_vverb("move item at %p to %p", OFFSET2ITEM(path[i - 1]),
-                OFFSET2ITEM(path[i]));
+    return old.magic == layout->magic && old.item_size == layout->item_size &&
+        old.nitem == layout->nitem && old.bucket_size == layout->bucket_size &&
+        old.nhash == layout->nhash && old.seed == layout->seed &&
+        old.cas == layout->cas;
+}
+
+/*
+ * tags are not kept in the data pool, so are rebuilt for items found there;
+ * an item not in one of the buckets of its key could never be found, and is
+ * dropped as are those with values in the overflow arena, which is not kept
+ */
+static void
+_cuckoo_tag_rebuild(void)
+{
+    struct bstring key;
+    struct item *it;
+    uint32_t bucket[NHASH_MAX];
+    uint32_t i, j, n = 0, ndrop = 0;
 
-        cc_memcpy(OFFSET2ITEM(path[i]), OFFSET2ITEM(path[i - 1]), item_size);
+    for (i = 0; i < max_nitem; ++i) {
+        it = OFFSET2ITEM(i);
+        if (item_empty(it)) {
+            continue;
+        }
+        item_key(&key, it);
+        cuckoo_hash(bucket, &tags[i], &key);
+        for (j = 0; j < nhash && bucket[j] != i / bucket_size; ++j);
+        if (j == nhash || item_overflowed(it)) {
+            item_delete(it);
+            tags[i] = TAG_EMPTY;
+            ndrop++;
+            continue;
+        }
+        n++;
     }
 
-    OFFSET2ITEM(path[0])->expire = 0;
-    return;
+    log_info("rebuilt tags of %"PRIu32" cuckoo slots in use, dropped %"PRIu32
+            " items", n, ndrop);
 }
 
+/* called by the last prefault thread, which may run in the background */
+static void
+_cuckoo_prefault_done(uint64_t ms)
+{
+    UPDATE_VAL(cuckoo_metrics, cuckoo_prefault_ms, ms);
+}
 
 void
 cuckoo_setup(cuckoo_options_st *options, cuckoo_metrics_st *metrics)
 {
+    struct cuckoo_pool_layout layout;
+    size_t page;
+    uint32_t n = CUCKOO_NHASH;
+    int fresh = 1;
+
     log_info("set up the %s module", CUCKOO_MODULE_NAME);
 
     if (cuckoo_init) {
@@ -283,17 +760,82 @@ cuckoo_setup(cuckoo_options_st *options, cuckoo_metrics_st *metrics)
         cuckoo_policy = option_uint(&options->cuckoo_policy);
         cas_enabled = option_bool(&options->cuckoo_item_cas);
         max_ttl = option_uint(&options->cuckoo_max_ttl);
+        displace = option_uint(&options->cuckoo_displace);
+        bucket_size = option_uint(&options->cuckoo_bucket);
+        n = option_uint(&options->cuckoo_nhash);
+        seed = option_uint(&options->cuckoo_seed);
+        cuckoo_concurrent = option_bool(&options->cuckoo_concurrent);
     }
 
+    if (bucket_size == 0 || bucket_size > BUCKET_MAX) {
+        log_crit("cuckoo bucket size %"PRIu32" not within 1 to %d", bucket_size,
+                BUCKET_MAX);
+        exit(EX_CONFIG);
+    }
+    if (n > NHASH_MAX) {
+        log_crit("cuckoo # hashes %"PRIu32" exceeds %d", n, NHASH_MAX);
+        exit(EX_CONFIG);
+    }
+    nhash = n > 0 ? n : (bucket_size > 1 ? BUCKET_D : D);
+    ncand = nhash * bucket_size;
+    nbucket = (max_nitem + bucket_size - 1) / bucket_size;
+    max_nitem = nbucket * bucket_size;
+
     hash_size = item_size * max_nitem;
     pool = datapool_open(option_str(&options->cuckoo_datapool),
         option_str(&options->cuckoo_datapool_name), hash_size,
-        NULL, option_bool(&options->cuckoo_datapool_prefault));
+        &fresh, false, option_uint(&options->cuckoo_hugepage));
     if (pool == NULL) {
         log_crit("cuckoo data store allocation failed");
         exit(EX_CONFIG);
     }
     ds = datapool_addr(pool);
+    page = datapool_page_size(pool);
+    UPDATE_VAL(cuckoo_metrics, cuckoo_page, page);
+    log_info("cuckoo data store of %zu bytes on pages of %zu bytes", hash_size,
+        page);
+
+    tags = cc_zalloc(max_nitem + sizeof(uint64_t));
+    if (tags == NULL) {
+        log_crit("cuckoo tag allocation failed");
+        exit(EX_CONFIG);
+    }
+    layout = (struct cuckoo_pool_layout){CUCKOO_POOL_MAGIC, item_size,
+        max_nitem, bucket_size, nhash, seed, cas_enabled};
+    if (!fresh && !_cuckoo_layout_check(&layout)) {
+        log_warn("cuckoo data store was laid out differently, starting fresh");
+        cc_memset(ds, 0, hash_size);
+        fresh = 1;
+    }
+    if (!fresh) {
+        _cuckoo_tag_rebuild();
+    }
+    datapool_set_user_data(pool, &layout, sizeof(layout));
+    if (overflow_setup(option_uint(&options->cuckoo_overflow_size),
+                option_uint(&options->cuckoo_overflow_slab)) != CC_OK) {
+        log_crit("cuckoo overflow arena allocation failed");
+        exit(EX_CONFIG);
+    }
+    if (cuckoo_concurrent) {
+        for (nstripe = 1; nstripe * 2 <= MIN(nbucket, STRIPE_MAX);
+                nstripe *= 2);
+        stripe = cc_zalloc(sizeof(uint32_t) * nstripe);
+        if (stripe == NULL) {
+            log_crit("cuckoo stripe allocation failed");
+            exit(EX_CONFIG);
+        }
+        log_info("cuckoo is concurrent with %"PRIu32" stripes", nstripe);
+    }
+    log_info("cuckoo has %"PRIu32" buckets of %"PRIu32" slots, %"PRIu32" per "
+        "key", nbucket, bucket_size, nhash);
+
+    if (option_bool(&options->cuckoo_datapool_prefault) &&
+            datapool_prefault(pool,
+                option_uint(&options->cuckoo_prefault_nthread),
+                option_bool(&options->cuckoo_prefault_async),
+                _cuckoo_prefault_done) != CC_OK) {
+        log_warn("prefaulting cuckoo data store failed");
+    }
 
     cc_create_itt_malloc(cuckoo_malloc);
     cc_create_itt_free(cuckoo_free);
@@ -310,6 +852,11 @@ cuckoo_teardown(void)
         log_warn("%s has never been setup", CUCKOO_MODULE_NAME);
     } else {
         datapool_close(pool);
+        cc_free(tags);
+        tags = NULL;
+        cc_free(stripe);
+        stripe = NULL;
+        overflow_teardown();
     }
 
     cuckoo_metrics = NULL;
@@ -319,33 +866,141 @@ cuckoo_teardown(void)
 void
 cuckoo_reset(void) /* reset hash table */
 {
+    uint32_t i;
+
     log_info("reset the main hash table in cuckoo");
 
     if (!cuckoo_init || ds == NULL) {
         log_warn("hash table has never been initialized");
     } else {
+        /* in order, as writers lock stripes */
+        for (i = 0; cuckoo_concurrent && i < nstripe; ++i) {
+            _stripe_lock(i);
+        }
         cc_memset(ds, 0, hash_size);
+        cc_memset(tags, TAG_EMPTY, max_nitem);
+        overflow_reset();
+        for (i = 0; cuckoo_concurrent && i < nstripe; ++i) {
+            _stripe_unlock(i);
+        }
+    }
+}
+
+size_t
+cuckoo_item_size(void)
+{
+    return item_size;
+}
+
+void
+cuckoo_lock(struct bstring *key)
+{
+    uint32_t bucket[NHASH_MAX];
+    uint32_t i, j, s;
+    uint8_t tag;
+
+    if (!cuckoo_concurrent) {
+        return;
+    }
+
+    ASSERT(nheld == 0);
+
+    /* each stripe once and in ascending order, so writers can't deadlock */
+    cuckoo_hash(bucket, &tag, key);
+    for (i = 0; i < nhash; ++i) {
+        s = STRIPE(bucket[i]);
+        for (j = 0; j < nheld && held[j] < s; ++j);
+        if (j < nheld && held[j] == s) {
+            continue;
+        }
+        cc_memmove(&held[j + 1], &held[j], sizeof(uint32_t) * (nheld - j));
+        held[j] = s;
+        nheld++;
+    }
+    for (i = 0; i < nheld; ++i) {
+        _stripe_lock(held[i]);
+    }
+}
+
+void
+cuckoo_unlock(void)
+{
+    for (; nheld > 0; --nheld) {
+        _stripe_unlock(held[nheld - 1]);
+    }
+}
+
+struct item *
+cuckoo_read(struct bstring *key, struct item *buf)
+{
+    uint32_t bucket[NHASH_MAX];
+    uint32_t ver[NHASH_MAX];
+    uint32_t i, m;
+    uint8_t tag;
+
+    if (!cuckoo_concurrent) {
+        return cuckoo_get(key);
+    }
+
+    ASSERT(cuckoo_init == true && key != NULL && buf != NULL);
+
+    INCR(cuckoo_metrics, cuckoo_get);
+
+    cuckoo_hash(bucket, &tag, key);
+
+retry:
+    for (i = 0; i < nhash; ++i) {
+        ver[i] = _stripe_begin(STRIPE(bucket[i]));
+    }
+    for (i = 0; i < nhash; ++i) {
+        for (m = _tag_match(bucket[i], tag); m != 0; m &= m - 1) {
+            cc_memcpy(buf, OFFSET2ITEM(bucket[i] * bucket_size +
+                        __builtin_ctz(m)), item_size);
+            if (_stripe_changed(STRIPE(bucket[i]), ver[i])) {
+                INCR(cuckoo_metrics, cuckoo_get_retry);
+                goto retry;
+            }
+            if (cuckoo_hit(buf, key)) {
+                log_verb("found item, copied to %p", buf);
+                return buf;
+            }
+        }
     }
+
+    /* a miss may be a key displaced from a bucket not yet read to one read */
+    for (i = 0; i < nhash; ++i) {
+        if (_stripe_changed(STRIPE(bucket[i]), ver[i])) {
+            INCR(cuckoo_metrics, cuckoo_get_retry);
+            goto retry;
+        }
+    }
+
+    log_verb("item not found");
+
+    return NULL;
 }
 
 struct item *
 cuckoo_get(struct bstring *key)
 {
-    uint32_t offset[D];
-    int i;
+    uint32_t bucket[NHASH_MAX];
+    uint32_t i, m;
+    uint8_t tag;
     struct item *it;
 
     ASSERT(cuckoo_init == true && key != NULL);
 
     INCR(cuckoo_metrics, cuckoo_get);
 
-    cuckoo_hash(offset, key);
+    cuckoo_hash(bucket, &tag, key);
 
-    for (i = 0; i < D; ++i) {
-        it = OFFSET2ITEM(offset[i]);
-        if (cuckoo_hit(it, key)) {
-        log_verb("found item at location: %p", it);
-            return it;
+    for (i = 0; i < nhash; ++i) {
+        for (m = _tag_match(bucket[i], tag); m != 0; m &= m - 1) {
+            it = OFFSET2ITEM(bucket[i] * bucket_size + __builtin_ctz(m));
+            if (cuckoo_hit(it, key)) {
+                log_verb("found item at location: %p", it);
+                return it;
+            }
         }
     }
 
@@ -359,15 +1014,18 @@ struct item *
 cuckoo_insert(struct bstring *key, struct val *val, proc_time_i expire)
 {
     struct item *it;
-    uint32_t offset[D];
-    uint32_t displaced;
-    int i;
+    uint32_t bucket[NHASH_MAX];
+    uint32_t offset[NCAND_MAX];
+    uint32_t slot, ref = OVERFLOW_NONE;
+    uint8_t tag;
+    bool inline_val;
 
     ASSERT(key != NULL && val != NULL);
 
     INCR(cuckoo_metrics, cuckoo_insert);
 
-    if (key->len + vlen(val) + ITEM_OVERHEAD > item_size) {
+    inline_val = _val_inline(key->len, val);
+    if (!inline_val && !_val_overflow(key->len, val)) {
         log_warn("key value exceed chunk size %zu: key len %"PRIu32", vlen %"
                 PRIu32", item overhead %u", item_size, key->len, vlen(val),
                 ITEM_OVERHEAD);
@@ -376,30 +1034,33 @@ cuckoo_insert(struct bstring *key, struct val *val, proc_time_i expire)
         return NULL;
     }
 
-    cuckoo_hash(offset, key);
+    cuckoo_hash(bucket, &tag, key);
+    _candidates(offset, bucket);
 
-    for (i = 0; i < D; ++i) {
-        it = OFFSET2ITEM(offset[i]);
-        if (item_valid(it)) {
-            continue;
-        }
-        if (item_expired(it)) {
-            INCR(cuckoo_metrics, item_expire);
-            ITEM_METRICS_DECR(it);
-        }
-
-        log_verb("inserting into location: %p", it);
-
-        break;
+    slot = _slot_free(bucket, offset);
+    if (slot == NO_SLOT) {
+        slot = cuckoo_displace(offset);
+    } else {
+        _slot_reclaim(slot);
     }
+    log_verb("inserting into location: %p", OFFSET2ITEM(slot));
 
-    if (D == i) {
-        displaced = _select_candidate(offset);
-        it = OFFSET2ITEM(displaced); /* we are writing into this item */
-        cuckoo_displace(displaced);
-    }
+    it = OFFSET2ITEM(slot);
+    if (!inline_val) {
+        ref = _overflow_alloc(val->vstr.len, slot);
+        if (ref == OVERFLOW_NONE) {
+            item_delete(it);
+            tags[slot] = TAG_EMPTY;
+            INCR(cuckoo_metrics, cuckoo_insert_ex);
 
-    item_set(it, key, val, expire);
+            return NULL;
+        }
+        cc_memcpy(overflow_chunk(ref)->data, val->vstr.data, val->vstr.len);
+        item_set_ref(it, key, ref, expire);
+    } else {
+        item_set(it, key, val, expire);
+    }
+    tags[slot] = tag;
     INCR(cuckoo_metrics, item_insert);
     ITEM_METRICS_INCR(it);
     cc_itt_alloc(cuckoo_malloc, it, item_size);
@@ -410,11 +1071,15 @@ cuckoo_insert(struct bstring *key, struct val *val, proc_time_i expire)
 rstatus_i
 cuckoo_update(struct item *it, struct val *val, proc_time_i expire)
 {
+    uint32_t ref, slot;
+    bool inline_val;
+
     ASSERT(it != NULL && val != NULL);
 
     INCR(cuckoo_metrics, cuckoo_update);
 
-    if (item_klen(it) + vlen(val) + ITEM_OVERHEAD > item_size) {
+    inline_val = _val_inline(item_klen(it), val);
+    if (!inline_val && !_val_overflow(item_klen(it), val)) {
         log_warn("key value exceed chunk size");
         INCR(cuckoo_metrics, cuckoo_update_ex);
 
@@ -423,7 +1088,26 @@ cuckoo_update(struct item *it, struct val *val, proc_time_i expire)
 
     DECR_N(cuckoo_metrics, item_val_curr, item_vlen(it));
     DECR_N(cuckoo_metrics, item_data_curr, item_vlen(it));
-    item_update(it, val, expire);
+    _item_release(it);
+    if (inline_val) {
+        item_update(it, val, expire);
+    } else {
+        slot = ITEM2OFFSET(it);
+        ref = _overflow_alloc(val->vstr.len, slot);
+        if (ref == OVERFLOW_NONE) {
+            /* the old value is gone already, so is the item */
+            DECR(cuckoo_metrics, item_curr);
+            DECR_N(cuckoo_metrics, item_key_curr, item_klen(it));
+            DECR_N(cuckoo_metrics, item_data_curr, item_klen(it));
+            item_delete(it);
+            tags[slot] = TAG_EMPTY;
+            INCR(cuckoo_metrics, cuckoo_update_ex);
+
+            return CC_ERROR;
+        }
+        cc_memcpy(overflow_chunk(ref)->data, val->vstr.data, val->vstr.len);
+        item_update_ref(it, ref, expire);
+    }
     INCR_N(cuckoo_metrics, item_val_curr, item_vlen(it));
     INCR_N(cuckoo_metrics, item_data_curr, item_vlen(it));
 
@@ -444,7 +1128,9 @@ cuckoo_delete(struct bstring *key)
     if (it != NULL) {
         INCR(cuckoo_metrics, item_delete);
         ITEM_METRICS_DECR(it);
+        _item_release(it);
         item_delete(it);
+        tags[ITEM2OFFSET(it)] = TAG_EMPTY;
         log_verb("deleting item at location %p", it);
         cc_itt_free(cuckoo_free, it);
 
@@ -12,6 +12,9 @@
 #define CUCKOO_POLICY_EXPIRE 2
 
 #define CUCKOO_DISPLACE 2
+#define CUCKOO_BUCKET 1 /* slots per bucket, 1: no buckets */
+#define CUCKOO_NHASH 0 /* buckets per key, 0: 4, or 2 with buckets */
+#define CUCKOO_SEED 0x3ac5d673
 #define CUCKOO_ITEM_CAS true
 #define CUCKOO_ITEM_SIZE 64
 #define CUCKOO_NITEM 1024
@@ -20,10 +23,19 @@
 #define CUCKOO_DATAPOOL NULL
 #define CUCKOO_DATAPOOL_NAME "cuckoo_datapool"
 #define CUCKOO_PREFAULT false
+#define CUCKOO_PREFAULT_NTHREAD 0 /* one per online CPU */
+#define CUCKOO_PREFAULT_ASYNC false
+#define CUCKOO_HUGEPAGE 0 /* regular pages */
+#define CUCKOO_CONCURRENT false
+#define CUCKOO_OVERFLOW_SIZE 0 /* no overflow arena */
+#define CUCKOO_OVERFLOW_SLAB MiB
 
 /*          name                      type                default                  description */
 #define CUCKOO_OPTION(ACTION)                                                                          \
     ACTION( cuckoo_displace,          OPTION_TYPE_UINT,   CUCKOO_DISPLACE,         "# displaces allowed"   )\
+    ACTION( cuckoo_bucket,            OPTION_TYPE_UINT,   CUCKOO_BUCKET,           "slots per bucket: 1-8" )\
+    ACTION( cuckoo_nhash,             OPTION_TYPE_UINT,   CUCKOO_NHASH,            "buckets per key: 0-8"  )\
+    ACTION( cuckoo_seed,              OPTION_TYPE_UINT,   CUCKOO_SEED,             "seed of the hash"      )\
     ACTION( cuckoo_item_cas,          OPTION_TYPE_BOOL,   CUCKOO_ITEM_CAS,         "support cas in items"  )\
     ACTION( cuckoo_item_size,         OPTION_TYPE_UINT,   CUCKOO_ITEM_SIZE,        "item size (inclusive)" )\
     ACTION( cuckoo_nitem,             OPTION_TYPE_UINT,   CUCKOO_NITEM,            "# items allocated"     )\
@@ -31,7 +43,13 @@
     ACTION( cuckoo_max_ttl,           OPTION_TYPE_UINT,   CUCKOO_MAX_TTL,          "max ttl in seconds"    )\
     ACTION( cuckoo_datapool,          OPTION_TYPE_STR,    CUCKOO_DATAPOOL,         "path to data pool"     )\
     ACTION( cuckoo_datapool_name,     OPTION_TYPE_STR,    CUCKOO_DATAPOOL_NAME,    "cuckoo datapool name"  )\
-    ACTION( cuckoo_datapool_prefault, OPTION_TYPE_BOOL,   CUCKOO_PREFAULT,         "prefault data pool"    )
+    ACTION( cuckoo_datapool_prefault, OPTION_TYPE_BOOL,   CUCKOO_PREFAULT,         "prefault data pool"    )\
+    ACTION( cuckoo_prefault_nthread,  OPTION_TYPE_UINT,   CUCKOO_PREFAULT_NTHREAD, "# prefault threads"    )\
+    ACTION( cuckoo_prefault_async,    OPTION_TYPE_BOOL,   CUCKOO_PREFAULT_ASYNC,   "serve while prefaulting")\
+    ACTION( cuckoo_hugepage,          OPTION_TYPE_UINT,   CUCKOO_HUGEPAGE,         "huge page size, 0: off")\
+    ACTION( cuckoo_concurrent,        OPTION_TYPE_BOOL,   CUCKOO_CONCURRENT,       "shared by threads"     )\
+    ACTION( cuckoo_overflow_size,     OPTION_TYPE_UINT,   CUCKOO_OVERFLOW_SIZE,    "overflow bytes, 0: off")\
+    ACTION( cuckoo_overflow_slab,     OPTION_TYPE_UINT,   CUCKOO_OVERFLOW_SLAB,    "overflow slab size"    )
 
 
 typedef struct {
@@ -41,9 +59,11 @@ typedef struct {
 /*          name            type            description */
 #define CUCKOO_METRIC(ACTION)                                           \
     ACTION( cuckoo_get,         METRIC_COUNTER, "# cuckoo lookups"     )\
+    ACTION( cuckoo_get_retry,   METRIC_COUNTER, "# lookups retried"    )\
     ACTION( cuckoo_insert,      METRIC_COUNTER, "# cuckoo inserts"     )\
     ACTION( cuckoo_insert_ex,   METRIC_COUNTER, "# insert errors"      )\
     ACTION( cuckoo_displace,    METRIC_COUNTER, "# displacements"      )\
+    ACTION( cuckoo_path_retry,  METRIC_COUNTER, "# displaces retried"  )\
     ACTION( cuckoo_update,      METRIC_COUNTER, "# cuckoo updates"     )\
     ACTION( cuckoo_update_ex,   METRIC_COUNTER, "# update errors"      )\
     ACTION( cuckoo_delete,      METRIC_COUNTER, "# cuckoo deletes"     )\
@@ -55,7 +75,12 @@ typedef struct {
     ACTION( item_evict,         METRIC_COUNTER, "# evicted items"      )\
     ACTION( item_expire,        METRIC_COUNTER, "# expired items"      )\
     ACTION( item_insert,        METRIC_COUNTER, "# item inserts"       )\
-    ACTION( item_delete,        METRIC_COUNTER, "# item deletes"       )
+    ACTION( item_delete,        METRIC_COUNTER, "# item deletes"       )\
+    ACTION( overflow_curr,      METRIC_GAUGE,   "# vals in overflow"   )\
+    ACTION( overflow_evict,     METRIC_COUNTER, "# evicted for room"   )\
+    ACTION( overflow_ex,        METRIC_COUNTER, "# no overflow room"   )\
+    ACTION( cuckoo_page,        METRIC_GAUGE,   "page size of items"   )\
+    ACTION( cuckoo_prefault_ms, METRIC_GAUGE,   "ms taken to prefault" )
 
 
 typedef struct {
@@ -63,11 +88,32 @@ typedef struct {
 } cuckoo_metrics_st;
 
 extern cuckoo_metrics_st *cuckoo_metrics;
+extern bool cuckoo_concurrent;
 
 void cuckoo_setup(cuckoo_options_st *options, cuckoo_metrics_st *metrics);
 void cuckoo_teardown(void);
 void cuckoo_reset(void);
 
+size_t cuckoo_item_size(void);
+
+/*
+ * A concurrent table is shared by threads. Lookups by cuckoo_read take no
+ * locks: they check the version of each bucket they read before and after,
+ * and start over if it changed under them, e.g. because a displacement moved
+ * the key. Writes lock the buckets of their key; cuckoo_get, cuckoo_insert,
+ * cuckoo_update, cuckoo_delete and changes to an item in place may only be
+ * called between cuckoo_lock and cuckoo_unlock on the key, and cuckoo_read
+ * not at all. Without concurrent, locking does nothing.
+ */
+void cuckoo_lock(struct bstring *key);
+void cuckoo_unlock(void);
+/*
+ * the item of key, copied to buf, which holds an item, when concurrent. A
+ * value in the overflow arena is not copied, and may only be read with the
+ * key locked.
+ */
+struct item * cuckoo_read(struct bstring *key, struct item *buf);
+
 struct item * cuckoo_get(struct bstring *key);
 struct item * cuckoo_insert(struct bstring *key, struct val *val, proc_time_i expire);
 rstatus_i cuckoo_update(struct item *it, struct val *val, proc_time_i expire);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "overflow.h"
+
 #include "time/time.h"
 
 #include <cc_bstring.h>
@@ -20,7 +22,8 @@ extern delta_time_i max_ttl;
  * val_type_t and struct val makes it easier to use one object to communicate
  * values between in-memory storage and other modules
  *
- * max value length is 127 given the encoding scheme
+ * values of up to 254 bytes are kept in the item, larger ones in the overflow
+ * arena if there is one
  */
 typedef enum val_type {
     VAL_TYPE_INT=1,
@@ -61,7 +64,8 @@ struct val {
  * item->data is followed by:
  * - 8-byte cas, if ITEM_CAS flag is set
  * - key as a binary string (no terminating '\0')
- * - value as a binary string (no terminating '\0')
+ * - value as a binary string (no terminating '\0'), or if vlen is
+ *   VLEN_OVERFLOW, the 4-byte reference of its chunk in the overflow arena
  */
 
 struct item {
@@ -72,6 +76,7 @@ struct item {
 };
 
 #define KEY_MAXLEN 255
+#define VLEN_OVERFLOW UINT8_MAX /* value kept in the overflow arena */
 #define CAS_VAL_MIN 1
 #define CAS_LEN (cas_enabled * sizeof(cas_val))
 #define MIN_ITEM_CHUNK_SIZE CC_ALIGN(sizeof(struct item) + 2, CC_ALIGNMENT)
@@ -112,6 +117,22 @@ item_key(struct bstring *key, struct item *it)
     key->data = ITEM_KEY_POS(it);
 }
 
+static inline bool
+item_overflowed(struct item *it)
+{
+    return it->vlen == VLEN_OVERFLOW;
+}
+
+static inline uint32_t
+item_ref(struct item *it)
+{
+    uint32_t ref;
+
+    cc_memcpy(&ref, ITEM_VAL_POS(it), sizeof(ref));
+
+    return ref;
+}
+
 static inline bool
 item_matched(struct item *it, struct bstring *key)
 {
@@ -175,9 +196,13 @@ item_vtype(struct item *it)
     }
 }
 
-static inline uint8_t
+static inline uint32_t
 item_vlen(struct item *it)
 {
+    if (item_overflowed(it)) {
+        return overflow_chunk(item_ref(it))->len;
+    }
+
     return (it->vlen == 0) ? sizeof(uint64_t) : it->vlen;
 }
 
@@ -191,7 +216,8 @@ static inline void
 item_value_str(struct bstring *str, struct item *it)
 {
     str->len = item_vlen(it);
-    str->data = ITEM_VAL_POS(it);
+    str->data = item_overflowed(it) ? overflow_chunk(item_ref(it))->data :
+        ITEM_VAL_POS(it);
 }
 
 static inline uint64_t
@@ -218,8 +244,9 @@ static inline void
 item_value_update(struct item *it, struct val *val)
 {
     if (cas_enabled) {
-        cas_val++;
-        *(uint64_t *)ITEM_CAS_POS(it) = cas_val;
+        /* atomic, as writers of other keys may run concurrently */
+        *(uint64_t *)ITEM_CAS_POS(it) = __atomic_add_fetch(&cas_val, 1,
+                __ATOMIC_RELAXED);
     }
 
     if (val->type == VAL_TYPE_INT) {
@@ -231,6 +258,19 @@ item_value_update(struct item *it, struct val *val)
     }
 }
 
+/* point it to the value in chunk ref of the overflow arena, which is set */
+static inline void
+item_value_ref(struct item *it, uint32_t ref)
+{
+    if (cas_enabled) {
+        *(uint64_t *)ITEM_CAS_POS(it) = __atomic_add_fetch(&cas_val, 1,
+                __ATOMIC_RELAXED);
+    }
+
+    it->vlen = VLEN_OVERFLOW;
+    cc_memcpy(ITEM_VAL_POS(it), &ref, sizeof(ref));
+}
+
 static inline void
 item_update(struct item *it, struct val *val, proc_time_i expire)
 {
@@ -239,6 +279,14 @@ item_update(struct item *it, struct val *val, proc_time_i expire)
     item_value_update(it, val);
 }
 
+static inline void
+item_update_ref(struct item *it, uint32_t ref, proc_time_i expire)
+{
+    proc_time_i expire_cap = time_delta2proc_sec(max_ttl);
+    it->expire = expire < expire_cap ? expire : expire_cap;
+    item_value_ref(it, ref);
+}
+
 static inline void
 item_set(struct item *it, struct bstring *key, struct val *val, proc_time_i expire)
 {
@@ -247,6 +295,15 @@ item_set(struct item *it, struct bstring *key, struct val *val, proc_time_i expi
     item_update(it, val, expire);
 }
 
+static inline void
+item_set_ref(struct item *it, struct bstring *key, uint32_t ref,
+        proc_time_i expire)
+{
+    it->klen = (uint8_t)key->len;
+    cc_memcpy(ITEM_KEY_POS(it), key->data, key->len);
+    item_update_ref(it, ref, expire);
+}
+
 static inline void
 item_delete(struct item *it)
 {
@@ -0,0 +1,224 @@
+#include "overflow.h"
+
+#include <cc_debug.h>
+#include <cc_mm.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#define CLASS_MAX 64
+
+struct overflow_class {
+    uint32_t size;  /* of a chunk, with its header */
+    uint32_t free;  /* first free chunk, OVERFLOW_NONE if none */
+    uint32_t nslab;
+    uint32_t *slab; /* ids of the slabs given to the class */
+};
+
+uint8_t *overflow_base = NULL;
+
+static size_t slab_size;
+static uint32_t nslab;
+static uint32_t nslab_used; /* slabs are given out in order, never back */
+static struct overflow_class class[CLASS_MAX];
+static uint32_t nclass;
+static pthread_mutex_t overflow_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint32_t
+_ref(const uint8_t *p)
+{
+    return (uint32_t)((p - overflow_base) / OVERFLOW_ALIGN);
+}
+
+/* the smallest class with room for len bytes, nclass if there is none */
+static inline uint32_t
+_class(uint32_t len)
+{
+    uint32_t i;
+
+    for (i = 0; i < nclass && class[i].size - OVERFLOW_CHUNK_HDR < len; ++i);
+
+    return i;
+}
+
+/* carve the next unused slab into free chunks of class c */
+static bool
+_slab_grow(struct overflow_class *c)
+{
+    struct overflow_chunk *chunk;
+    uint8_t *slab;
+    uint32_t i;
+
+    if (nslab_used == nslab) {
+        return false;
+    }
+
+    slab = overflow_base + (size_t)nslab_used * slab_size;
+    c->slab[c->nslab++] = nslab_used++;
+
+    /* from the end, so that chunks are handed out in address order */
+    for (i = slab_size / c->size; i > 0; --i) {
+        chunk = (struct overflow_chunk *)(slab + (size_t)(i - 1) * c->size);
+        chunk->owner = OVERFLOW_FREE;
+        chunk->len = c->free;
+        c->free = _ref((uint8_t *)chunk);
+    }
+
+    log_verb("overflow slab %"PRIu32" given to chunks of %"PRIu32" bytes",
+            nslab_used - 1, c->size);
+
+    return true;
+}
+
+rstatus_i
+overflow_setup(size_t size, size_t slab)
+{
+    uint32_t s, i;
+
+    if (size == 0) {
+        return CC_OK;
+    }
+
+    slab_size = slab / OVERFLOW_ALIGN * OVERFLOW_ALIGN;
+    if (slab_size < OVERFLOW_CHUNK_MIN || slab_size > UINT32_MAX ||
+            size < slab_size || size / OVERFLOW_ALIGN > UINT32_MAX) {
+        log_error("overflow arena of %zu bytes with slabs of %zu bytes is "
+                "not supported", size, slab);
+        return CC_ERROR;
+    }
+    nslab = size / slab_size;
+
+    overflow_base = cc_alloc((size_t)nslab * slab_size);
+    if (overflow_base == NULL) {
+        return CC_ENOMEM;
+    }
+
+    for (s = OVERFLOW_CHUNK_MIN, nclass = 0;; ++nclass) {
+        if (s >= slab_size || nclass == CLASS_MAX - 1) {
+            s = slab_size;
+        }
+        class[nclass].size = s;
+        class[nclass].slab = cc_alloc(sizeof(uint32_t) * nslab);
+        if (class[nclass].slab == NULL) {
+            nclass++;
+            overflow_teardown();
+            return CC_ENOMEM;
+        }
+        if (s == slab_size) {
+            nclass++;
+            break;
+        }
+        s = CC_ALIGN(s * 5 / 4, OVERFLOW_ALIGN);
+    }
+    overflow_reset();
+
+    log_info("overflow arena of %"PRIu32" slabs of %zu bytes, chunks of %"
+            PRIu32" to %"PRIu32" bytes", nslab, slab_size, class[0].size,
+            class[nclass - 1].size);
+    for (i = 0; i < nclass; ++i) {
+        log_verb("overflow class %"PRIu32": %"PRIu32" bytes", i,
+                class[i].size);
+    }
+
+    return CC_OK;
+}
+
+void
+overflow_teardown(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < nclass; ++i) {
+        cc_free(class[i].slab);
+        class[i].slab = NULL;
+    }
+    nclass = 0;
+    cc_free(overflow_base);
+    overflow_base = NULL;
+}
+
+void
+overflow_reset(void)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&overflow_lock);
+    for (i = 0; i < nclass; ++i) {
+        class[i].free = OVERFLOW_NONE;
+        class[i].nslab = 0;
+    }
+    nslab_used = 0;
+    pthread_mutex_unlock(&overflow_lock);
+}
+
+bool
+overflow_fits(uint32_t len)
+{
+    return overflow_base != NULL && len <= slab_size - OVERFLOW_CHUNK_HDR;
+}
+
+uint32_t
+overflow_alloc(uint32_t len, uint32_t owner)
+{
+    struct overflow_chunk *chunk;
+    struct overflow_class *c;
+    uint32_t ref = OVERFLOW_NONE;
+
+    ASSERT(overflow_fits(len));
+
+    pthread_mutex_lock(&overflow_lock);
+    c = &class[_class(len)];
+    if (c->free != OVERFLOW_NONE || _slab_grow(c)) {
+        ref = c->free;
+        chunk = overflow_chunk(ref);
+        c->free = chunk->len;
+        chunk->len = len;
+        overflow_owner_set(ref, owner);
+    }
+    pthread_mutex_unlock(&overflow_lock);
+
+    return ref;
+}
+
+void
+overflow_free(uint32_t ref)
+{
+    struct overflow_chunk *chunk = overflow_chunk(ref);
+    struct overflow_class *c;
+
+    pthread_mutex_lock(&overflow_lock);
+    c = &class[_class(chunk->len)];
+    overflow_owner_set(ref, OVERFLOW_FREE);
+    chunk->len = c->free;
+    c->free = ref;
+    pthread_mutex_unlock(&overflow_lock);
+}
+
+uint32_t
+overflow_victim(uint32_t len, uint32_t *owner)
+{
+    struct overflow_class *c;
+    uint8_t *slab;
+    uint32_t n, i, start, ref = OVERFLOW_NONE;
+
+    pthread_mutex_lock(&overflow_lock);
+    c = &class[_class(len)];
+    if (c->nslab > 0) {
+        slab = overflow_base + (size_t)c->slab[random() % c->nslab] *
+            slab_size;
+        n = slab_size / c->size;
+        start = random() % n;
+        for (i = 0; i < n; ++i) {
+            ref = _ref(slab + (size_t)((start + i) % n) * c->size);
+            *owner = __atomic_load_n(&overflow_chunk(ref)->owner,
+                    __ATOMIC_RELAXED);
+            if (*owner != OVERFLOW_FREE) {
+                break;
+            }
+            ref = OVERFLOW_NONE;
+        }
+    }
+    pthread_mutex_unlock(&overflow_lock);
+
+    return ref;
+}
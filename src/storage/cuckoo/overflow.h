@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cc_define.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The overflow arena holds values too large to be kept in their cuckoo slot.
+ * It is carved into slabs of equal size, and each slab, once given to a size
+ * class, into chunks of that class. Chunk sizes grow by a factor of 1.25 from
+ * OVERFLOW_CHUNK_MIN up to the slab size.
+ *
+ * An item refers to its chunk by offset in units of OVERFLOW_ALIGN, so the
+ * arena can be up to 32GiB. Each chunk records the slot of the item it
+ * belongs to, so that a chunk picked for eviction leads back to its item.
+ *
+ * The arena has its own lock, and may be used by several threads.
+ */
+
+#define OVERFLOW_ALIGN      8
+#define OVERFLOW_CHUNK_MIN  64
+#define OVERFLOW_NONE       UINT32_MAX  /* no chunk */
+#define OVERFLOW_FREE       UINT32_MAX  /* owner of a free chunk */
+
+struct overflow_chunk {
+    uint32_t owner; /* slot of the item, OVERFLOW_FREE if free */
+    uint32_t len;   /* of the value, or the next free chunk if free */
+    char     data[1];
+};
+
+#define OVERFLOW_CHUNK_HDR offsetof(struct overflow_chunk, data)
+
+extern uint8_t *overflow_base;
+
+static inline struct overflow_chunk *
+overflow_chunk(uint32_t ref)
+{
+    return (struct overflow_chunk *)(overflow_base + (size_t)ref *
+            OVERFLOW_ALIGN);
+}
+
+/* slab_size must be at least OVERFLOW_CHUNK_MIN, size 0 means no arena */
+rstatus_i overflow_setup(size_t size, size_t slab_size);
+void overflow_teardown(void);
+/* free all chunks */
+void overflow_reset(void);
+
+/* whether a value of len bytes can be kept in the arena */
+bool overflow_fits(uint32_t len);
+/* a chunk for len bytes owned by slot owner, OVERFLOW_NONE if none is free */
+uint32_t overflow_alloc(uint32_t len, uint32_t owner);
+void overflow_free(uint32_t ref);
+/* a random chunk in use in the class of len bytes, and its owner */
+uint32_t overflow_victim(uint32_t len, uint32_t *owner);
+
+static inline void
+overflow_owner_set(uint32_t ref, uint32_t owner)
+{
+    __atomic_store_n(&overflow_chunk(ref)->owner, owner, __ATOMIC_RELAXED);
+}
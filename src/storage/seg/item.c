@@ -0,0 +1,249 @@
+#include "seg.h"
+
+#include <cc_debug.h>
+
+extern delta_time_i max_ttl;
+
+static inline bool
+_item_expired(struct item *it)
+{
+    return it->expire_at < time_proc_sec() || seg_item_flushed(it);
+}
+
+static item_rstatus_e
+_item_link(struct item *it)
+{
+    ASSERT(it->magic == ITEM_MAGIC);
+    ASSERT(!(it->is_linked));
+
+    if (hashtable_put(it, hash_table) != CC_OK) {
+        return ITEM_ENOMEM;
+    }
+    it->is_linked = 1;
+
+    INCR(seg_metrics, item_linked_curr);
+    INCR(seg_metrics, item_link);
+    INCR_N(seg_metrics, item_keyval_byte, it->klen + it->vlen);
+    INCR_N(seg_metrics, item_val_byte, it->vlen);
+
+    return ITEM_OK;
+}
+
+struct item *
+item_get(const struct bstring *key)
+{
+    struct item *it;
+
+    it = hashtable_get(key->data, key->len, hash_table);
+    if (it == NULL) {
+        log_verb("get it '%.*s' not found", key->len, key->data);
+        return NULL;
+    }
+
+    if (_item_expired(it)) {
+        log_verb("get it '%.*s' expired and nuked", key->len, key->data);
+        seg_unlink_item(it);
+        INCR(seg_metrics, item_expire);
+        return NULL;
+    }
+
+    if (it->freq < UINT8_MAX) {
+        it->freq++;
+    }
+
+    log_verb("get it %p for key %.*s", it, key->len, key->data);
+
+    return it;
+}
+
+bool
+item_pin(struct item *it)
+{
+    ASSERT(it->is_linked);
+
+    seg_ref(item_to_seg(it));
+
+    return true;
+}
+
+void
+item_unpin(struct item *it)
+{
+    seg_deref(item_to_seg(it));
+}
+
+item_rstatus_e
+item_insert(struct item *it, const struct bstring *key)
+{
+    struct item *oit;
+
+    ASSERT(it != NULL && key != NULL);
+
+    oit = hashtable_get(key->data, key->len, hash_table);
+    if (oit != NULL) {
+        seg_unlink_item(oit);
+    }
+
+    if (_item_link(it) != ITEM_OK) {
+        log_warn("server error on inserting it %p for key %.*s", it, key->len,
+                key->data);
+        item_release(&it);
+
+        return ITEM_ENOMEM;
+    }
+    seg_deref(item_to_seg(it)); /* seg ref'ed in item_reserve */
+
+    log_verb("insert it %p for key %.*s", it, key->len, key->data);
+
+    return ITEM_OK;
+}
+
+item_rstatus_e
+item_reserve(struct item **it_p, const struct bstring *key, const struct bstring
+        *val, uint32_t vlen, uint8_t olen, proc_time_i expire_at)
+{
+    proc_time_i expire_cap = time_delta2proc_sec(max_ttl);
+    size_t size = item_ntotal(key->len, vlen, olen);
+    struct item *it;
+
+    *it_p = NULL;
+    if (size > seg_size) {
+        return ITEM_EOVERSIZED;
+    }
+
+    it = seg_get_item(size, MIN(expire_at, expire_cap));
+    if (it == NULL) {
+        INCR(seg_metrics, item_alloc_ex);
+        log_warn("server error on allocating item of %zu bytes", size);
+
+        return ITEM_ENOMEM;
+    }
+    seg_ref(item_to_seg(it)); /* seg to be deref'ed in item_insert/release */
+
+#if defined CC_ASSERT_PANIC || defined CC_ASSERT_LOG
+    it->magic = ITEM_MAGIC;
+#endif
+    it->expire_at = MIN(expire_at, expire_cap);
+    it->size = size;
+    it->is_linked = 0;
+    it->freq = 0;
+    it->unused = 0;
+    item_set_cas(it);
+    it->olen = olen;
+    cc_memcpy(item_key(it), key->data, key->len);
+    it->klen = key->len;
+    if (val != NULL) {
+        cc_memcpy(item_data(it), val->data, val->len);
+    }
+    it->vlen = (val == NULL) ? 0 : val->len;
+    *it_p = it;
+
+    INCR(seg_metrics, item_alloc);
+    log_verb("reserve it %p of %zu bytes for key '%.*s' optional len %"PRIu8,
+            it, size, key->len, key->data, olen);
+
+    return ITEM_OK;
+}
+
+void
+item_release(struct item **it_p)
+{
+    /* the space is reclaimed along with the segment */
+    seg_deref(item_to_seg(*it_p)); /* seg ref'ed in item_reserve */
+    *it_p = NULL;
+}
+
+void
+item_backfill(struct item *it, const struct bstring *val)
+{
+    ASSERT(it != NULL);
+    ASSERT(item_fits(it, it->vlen + val->len));
+
+    cc_memcpy(item_data(it) + it->vlen, val->data, val->len);
+    it->vlen += val->len;
+
+    log_verb("backfill it %p with %"PRIu32" bytes, now %"PRIu32" bytes total",
+            it, val->len, it->vlen);
+}
+
+/* items are never grown in place, the annexed value goes into a new item */
+item_rstatus_e
+item_annex(struct item *oit, const struct bstring *key, const struct bstring
+        *val, bool append)
+{
+    item_rstatus_e status;
+    struct item *nit;
+    struct seg *oseg = item_to_seg(oit);
+    uint32_t ntotal = oit->vlen + val->len;
+
+    if (item_ntotal(oit->klen, ntotal, oit->olen) > seg_size) {
+        log_info("client error: annex operation results in oversized item with"
+                   "key size %"PRIu8" old value size %"PRIu32" and new value "
+                   "size %"PRIu32, oit->klen, oit->vlen, ntotal);
+
+        return ITEM_EOVERSIZED;
+    }
+
+    seg_ref(oseg); /* keep oit in place while allocating */
+    status = item_reserve(&nit, key, NULL, ntotal, oit->olen, oit->expire_at);
+    if (status != ITEM_OK) {
+        seg_deref(oseg);
+        log_debug("annex failed due to failure to allocate new item");
+        return status;
+    }
+
+    cc_memcpy(item_optional(nit), item_optional(oit), oit->olen);
+    if (append) {
+        cc_memcpy(item_data(nit), item_data(oit), oit->vlen);
+        cc_memcpy(item_data(nit) + oit->vlen, val->data, val->len);
+    } else {
+        cc_memcpy(item_data(nit), val->data, val->len);
+        cc_memcpy(item_data(nit) + val->len, item_data(oit), oit->vlen);
+    }
+    nit->vlen = ntotal;
+    seg_deref(oseg);
+    status = item_insert(nit, key);
+
+    log_verb("annex to it %p, new it at %p", oit, nit);
+
+    return status;
+}
+
+void
+item_update(struct item *it, const struct bstring *val)
+{
+    ASSERT(item_fits(it, val->len));
+
+    DECR_N(seg_metrics, item_keyval_byte, it->vlen);
+    DECR_N(seg_metrics, item_val_byte, it->vlen);
+    it->vlen = val->len;
+    cc_memcpy(item_data(it), val->data, val->len);
+    item_set_cas(it);
+    INCR_N(seg_metrics, item_keyval_byte, it->vlen);
+    INCR_N(seg_metrics, item_val_byte, it->vlen);
+
+    log_verb("update it %p", it);
+}
+
+bool
+item_delete(const struct bstring *key)
+{
+    struct item *it;
+
+    it = item_get(key);
+    if (it != NULL) {
+        seg_unlink_item(it);
+
+        return true;
+    } else {
+        return false;
+    }
+}
+
+void
+item_flush(void)
+{
+    time_update();
+    seg_flush();
+    log_info("all keys flushed at %"PRIu32, time_proc_sec());
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "time/time.h"
+
+#include <cc_bstring.h>
+#include <cc_debug.h>
+#include <cc_define.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Items of the seg engine are appended back to back to a segment, and are
+ * never freed one by one: a deleted or replaced item is merely unlinked from
+ * the hash table and its space is reclaimed with the rest of its segment.
+ * Items are 8-byte aligned, and `size' records the full space reserved so
+ * that a segment can be walked item by item.
+ *
+ *   <-------------------------size-------------------------->
+ *   +---------------+-----+----------+-----+-----------------+
+ *   |  item header  | cas | optional | key |      value      |
+ *   | (struct item) |     |          |     |                 |
+ *   +---------------+-----+----------+-----+-----------------+
+ *   ^               ^                ^     ^
+ *   item            item->end        |     item_data()
+ *                                    item_key()
+ */
+struct item {
+#if defined CC_ASSERT_PANIC || defined CC_ASSERT_LOG
+    uint32_t          magic;         /* item magic (const) */
+#endif
+    proc_time_i       expire_at;     /* expiry time in secs */
+    uint32_t          size;          /* bytes reserved in the segment */
+    uint32_t          is_linked:1;   /* item in hash */
+    uint32_t          vlen:31;       /* data size */
+    uint8_t           klen;          /* key length */
+    uint8_t           olen;          /* optional length (right after cas) */
+    uint8_t           freq;          /* # reads since written or last merged */
+    uint8_t           unused;
+    char              end[1];        /* item data */
+};
+
+#define ITEM_MAGIC      0xfeedface
+#define ITEM_HDR_SIZE   offsetof(struct item, end)
+#define ITEM_CAS_SIZE   sizeof(uint64_t)
+#define ITEM_ALIGNMENT  8
+
+typedef enum item_rstatus {
+    ITEM_OK,
+    ITEM_EOVERSIZED,
+    ITEM_ENOMEM,
+    ITEM_ENAN, /* not a number */
+    ITEM_EOTHER,
+} item_rstatus_e;
+
+extern bool use_cas;
+extern uint64_t cas_id;
+
+static inline uint64_t
+item_get_cas(struct item *it)
+{
+    return use_cas ? *((uint64_t *)it->end) : 0;
+}
+
+static inline void
+item_set_cas(struct item *it)
+{
+    if (use_cas) {
+        *((uint64_t *)it->end) = ++cas_id;
+    }
+}
+
+static inline size_t
+item_cas_size(void)
+{
+    return use_cas * ITEM_CAS_SIZE;
+}
+
+static inline char *
+item_key(struct item *it)
+{
+    return it->end + item_cas_size() + it->olen;
+}
+
+static inline uint32_t
+item_nkey(const struct item *it)
+{
+    return it->klen;
+}
+
+static inline uint32_t
+item_nval(const struct item *it)
+{
+    return it->vlen;
+}
+
+static inline size_t
+item_ntotal(uint8_t klen, uint32_t vlen, uint8_t olen)
+{
+    return CC_ALIGN(ITEM_HDR_SIZE + item_cas_size() + olen + klen + vlen,
+            ITEM_ALIGNMENT);
+}
+
+static inline char *
+item_optional(struct item *it)
+{
+    return it->end + item_cas_size();
+}
+
+static inline char *
+item_data(struct item *it)
+{
+    return it->end + item_cas_size() + it->olen + it->klen;
+}
+
+/* return true if the value of it can be replaced in place by vlen bytes */
+static inline bool
+item_fits(const struct item *it, uint32_t vlen)
+{
+    return item_ntotal(it->klen, vlen, it->olen) <= it->size;
+}
+
+static inline item_rstatus_e
+item_atou64(uint64_t *vint, struct item *it)
+{
+    struct bstring vstr;
+
+    vstr.len = it->vlen;
+    vstr.data = item_data(it);
+
+    return bstring_atou64(vint, &vstr) == CC_OK ? ITEM_OK : ITEM_ENAN;
+}
+
+/* acquire an item */
+struct item *item_get(const struct bstring *key);
+
+/* pin/unpin a linked item, e.g. while its value is sent from item memory.
+ * The segment of a pinned item is neither merged nor reclaimed.
+ */
+bool item_pin(struct item *it);
+void item_unpin(struct item *it);
+
+/* insert an item, removes existing item of the same key (if applicable).
+ * ITEM_ENOMEM if the hash table is full, the item is released then.
+ */
+item_rstatus_e item_insert(struct item *it, const struct bstring *key);
+
+/* reserve an item, this does not link it or remove existing item with the
+ * same key. olen is the length of optional data stored after cas.
+ */
+item_rstatus_e item_reserve(struct item **it_p, const struct bstring *key, const
+        struct bstring *val, uint32_t vlen, uint8_t olen, proc_time_i expire_at);
+/* item_release is used for reserved item only (not linked) */
+void item_release(struct item **it_p);
+
+void item_backfill(struct item *it, const struct bstring *val);
+
+/* Append/prepend */
+item_rstatus_e item_annex(struct item *it, const struct bstring *key, const
+        struct bstring *val, bool append);
+
+/* In place item update (replace item value), see item_fits */
+void item_update(struct item *it, const struct bstring *val);
+
+/* Remove item from cache */
+bool item_delete(const struct bstring *key);
+
+/* flush the cache */
+void item_flush(void);
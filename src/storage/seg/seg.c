@@ -0,0 +1,553 @@
+#include "seg.h"
+
+#include <datapool/hugepage.h>
+#include <cc_mm.h>
+
+#include <stdlib.h>
+#include <sysexits.h>
+
+#define SEG_MODULE_NAME         "storage::seg"
+#define SEG_SIZE_MIN            ((size_t)4 * KiB)
+#define SEG_SIZE_MAX            ((size_t)1 * GiB)
+#define SEG_MERGE_NSEG_MAX      16
+
+/*
+ * TTL buckets get wider as TTL grows: 8s wide up to ~34min, 128s up to ~9h,
+ * 2048s up to ~6d, 32768s beyond, with the last bucket taking everything
+ * longer than ~97d.
+ */
+#define NTTL_BUCKET             1024
+
+struct ttl_bucket {
+    int32_t         head;       /* oldest segment, -1 if none */
+    int32_t         tail;       /* active segment, -1 if none */
+};
+
+static uint8_t *heap_base = NULL;           /* all segment data */
+static struct seg *segs = NULL;             /* segment headers */
+static uint32_t nseg;                       /* # segments */
+static int32_t free_head = -1;              /* free segments */
+static struct ttl_bucket ttl_bucket[NTTL_BUCKET];
+static uint32_t merge_next;                 /* next ttl bucket to merge */
+static uint32_t flush_seq = 0;              /* # flushes so far */
+static proc_time_i expire_scan_at = -1;     /* time of last expiration scan */
+
+size_t seg_size = SEG_SIZE;                 /* # bytes in a segment */
+static size_t seg_mem = SEG_MEM;            /* maximum bytes for segments */
+static int evict_opt = SEG_EVICT_OPT;       /* segment eviction policy */
+static uint32_t merge_nseg = SEG_MERGE_NSEG;/* # segments merged at a time */
+static uint32_t hash_power = HASH_POWER;    /* power (of 2) entries for hashtable */
+
+bool use_cas = SEG_USE_CAS;
+struct hash_table *hash_table = NULL;
+uint64_t cas_id;
+
+delta_time_i max_ttl = ITEM_MAX_TTL;
+
+static bool seg_init = false;
+seg_metrics_st *seg_metrics = NULL;
+
+static inline uint8_t *
+_seg_data(int32_t id)
+{
+    return heap_base + (size_t)id * seg_size;
+}
+
+static inline uint32_t
+_ttl_bucket_idx(delta_time_i ttl)
+{
+    if (ttl < (1 << 11)) {
+        return ttl >> 3;
+    }
+    if (ttl < (1 << 15)) {
+        return 256 + (ttl >> 7);
+    }
+    if (ttl < (1 << 19)) {
+        return 512 + (ttl >> 11);
+    }
+    if (ttl < (1 << 23)) {
+        return 768 + (ttl >> 15);
+    }
+
+    return NTTL_BUCKET - 1;
+}
+
+struct seg *
+item_to_seg(struct item *it)
+{
+    ASSERT((uint8_t *)it >= heap_base &&
+            (uint8_t *)it < heap_base + (size_t)nseg * seg_size);
+
+    return &segs[((uint8_t *)it - heap_base) / seg_size];
+}
+
+static inline bool
+_seg_expired(struct seg *seg, proc_time_i now)
+{
+    return seg->expire_at < now || seg->flush_seq < flush_seq;
+}
+
+static void
+_seg_free_push(int32_t id)
+{
+    segs[id].next = free_head;
+    free_head = id;
+
+    DECR(seg_metrics, seg_curr);
+    INCR(seg_metrics, seg_free);
+}
+
+static int32_t
+_seg_free_pop(void)
+{
+    int32_t id = free_head;
+
+    if (id != -1) {
+        free_head = segs[id].next;
+        INCR(seg_metrics, seg_curr);
+        DECR(seg_metrics, seg_free);
+    }
+
+    return id;
+}
+
+static void
+_seg_append(struct ttl_bucket *b, int32_t id)
+{
+    segs[id].prev = b->tail;
+    segs[id].next = -1;
+    if (b->tail == -1) {
+        b->head = id;
+    } else {
+        segs[b->tail].next = id;
+    }
+    b->tail = id;
+}
+
+static void
+_seg_remove(int32_t id)
+{
+    struct seg *seg = &segs[id];
+    struct ttl_bucket *b = &ttl_bucket[seg->ttl_bucket];
+
+    if (seg->prev == -1) {
+        b->head = seg->next;
+    } else {
+        segs[seg->prev].next = seg->next;
+    }
+    if (seg->next == -1) {
+        b->tail = seg->prev;
+    } else {
+        segs[seg->next].prev = seg->prev;
+    }
+    seg->prev = seg->next = -1;
+}
+
+/* unlink all items in a segment and put it on the free list */
+static void
+_seg_reclaim(int32_t id, bool expire)
+{
+    struct seg *seg = &segs[id];
+    uint8_t *p = _seg_data(id), *end = p + seg->write_offset;
+    struct item *it;
+
+    ASSERT(seg->refcount == 0);
+
+    log_verb("reclaim %s seg %"PRId32" of %"PRIu32" bytes",
+            expire ? "expired" : "evicted", id, seg->write_offset);
+
+    for (; p < end; p += it->size) {
+        it = (struct item *)p;
+        ASSERT(it->magic == ITEM_MAGIC);
+        if (it->is_linked) {
+            seg_unlink_item(it);
+            if (expire) {
+                INCR(seg_metrics, item_expire);
+            } else {
+                INCR(seg_metrics, item_evict);
+            }
+        }
+    }
+
+    if (expire) {
+        INCR(seg_metrics, seg_expire);
+    } else {
+        INCR(seg_metrics, seg_evict);
+    }
+
+    _seg_remove(id);
+    seg->write_offset = 0;
+    _seg_free_push(id);
+}
+
+/*
+ * Merge segments chain[0..n-1], consecutive in a ttl bucket, into chain[0].
+ * Live items read since they were written are moved forward, compacting
+ * chain[0] in place first, until it is full, everything else is evicted.
+ */
+static void
+_seg_merge(int32_t *chain, uint32_t n)
+{
+    struct seg *dst = &segs[chain[0]];
+    uint8_t *base = _seg_data(chain[0]);
+    uint8_t *p, *end;
+    proc_time_i now = time_proc_sec(), expire_at = 0;
+    uint32_t i, size, woff = 0;
+    struct item *it, *nit;
+    bool flushed;
+
+    for (i = 0; i < n; ++i) {
+        p = _seg_data(chain[i]);
+        end = p + segs[chain[i]].write_offset;
+        flushed = segs[chain[i]].flush_seq < flush_seq;
+        for (; p < end; p += size) {
+            it = (struct item *)p;
+            size = it->size;
+            ASSERT(it->magic == ITEM_MAGIC);
+            if (!it->is_linked) {
+                continue;
+            }
+            if (flushed || it->expire_at < now) {
+                seg_unlink_item(it);
+                INCR(seg_metrics, item_expire);
+                continue;
+            }
+            if (it->freq == 0 || woff + size > seg_size) {
+                seg_unlink_item(it);
+                INCR(seg_metrics, item_evict);
+                continue;
+            }
+
+            nit = (struct item *)(base + woff);
+            if (nit != it) {
+                cc_memmove(nit, it, size);
+                hashtable_replace(it, nit, hash_table);
+            }
+            nit->freq = 0;
+            expire_at = MAX(expire_at, nit->expire_at);
+            woff += size;
+            INCR(seg_metrics, item_merge_keep);
+        }
+        if (i > 0) {
+            _seg_remove(chain[i]);
+            segs[chain[i]].write_offset = 0;
+            _seg_free_push(chain[i]);
+            INCR(seg_metrics, seg_evict);
+        }
+    }
+
+    dst->write_offset = woff;
+    dst->expire_at = expire_at;
+    /* items kept were all written since the last flush, as was the newest */
+    dst->create_at = segs[chain[n - 1]].create_at;
+    dst->flush_seq = segs[chain[n - 1]].flush_seq;
+    if (woff == 0) {
+        _seg_remove(chain[0]);
+        _seg_free_push(chain[0]);
+        INCR(seg_metrics, seg_evict);
+    }
+
+    INCR(seg_metrics, seg_merge);
+    log_verb("merged %"PRIu32" segs into seg %"PRId32", keeping %"PRIu32
+            " bytes", n, chain[0], woff);
+}
+
+/* merge the oldest segments of the next ttl bucket that has enough of them */
+static rstatus_i
+_seg_evict_merge(void)
+{
+    int32_t chain[SEG_MERGE_NSEG_MAX];
+    struct ttl_bucket *b;
+    uint32_t i, n;
+    int32_t id;
+
+    for (i = 0; i < NTTL_BUCKET; ++i) {
+        b = &ttl_bucket[merge_next];
+        merge_next = (merge_next + 1) % NTTL_BUCKET;
+
+        /* the active segment is never merged */
+        for (n = 0, id = b->head; n < merge_nseg && id != -1 && id != b->tail
+                && segs[id].refcount == 0; ++n, id = segs[id].next) {
+            chain[n] = id;
+        }
+        if (n >= 2) {
+            _seg_merge(chain, n);
+            return CC_OK;
+        }
+    }
+
+    return CC_ERROR;
+}
+
+/* evict the oldest segment that is not in use */
+static rstatus_i
+_seg_evict_fifo(void)
+{
+    int32_t id, victim = -1;
+    uint32_t i;
+
+    for (i = 0; i < NTTL_BUCKET; ++i) {
+        for (id = ttl_bucket[i].head; id != -1; id = segs[id].next) {
+            if (segs[id].refcount == 0) {
+                break;
+            }
+        }
+        if (id != -1 && (victim == -1 ||
+                segs[id].create_at < segs[victim].create_at)) {
+            victim = id;
+        }
+    }
+
+    if (victim == -1) {
+        return CC_ERROR;
+    }
+
+    _seg_reclaim(victim, false);
+
+    return CC_OK;
+}
+
+static int32_t
+_seg_get_new(void)
+{
+    int32_t id;
+
+    INCR(seg_metrics, seg_req);
+
+    if (free_head == -1) {
+        seg_expire();
+    }
+
+    if (free_head == -1) {
+        switch (evict_opt) {
+        case SEG_EVICT_NONE:
+            break;
+
+        case SEG_EVICT_MERGE:
+            if (_seg_evict_merge() == CC_OK) {
+                break;
+            }
+            /* fall through when there is nothing to merge */
+
+        case SEG_EVICT_FIFO:
+            _seg_evict_fifo();
+            break;
+
+        default:
+            NOT_REACHED();
+            break;
+        }
+    }
+
+    id = _seg_free_pop();
+    if (id == -1) {
+        INCR(seg_metrics, seg_req_ex);
+        log_warn("no segment is free or can be evicted");
+    }
+
+    return id;
+}
+
+struct item *
+seg_get_item(size_t size, proc_time_i expire_at)
+{
+    proc_time_i now = time_proc_sec();
+    struct ttl_bucket *b;
+    struct seg *seg;
+    struct item *it;
+    int32_t id;
+    uint32_t idx;
+
+    ASSERT(size <= seg_size);
+
+    if (now != expire_scan_at) {
+        expire_scan_at = now;
+        seg_expire();
+    }
+
+    idx = _ttl_bucket_idx(expire_at > now ? expire_at - now : 0);
+    b = &ttl_bucket[idx];
+    id = b->tail;
+    if (id == -1 || segs[id].write_offset + size > seg_size ||
+            segs[id].flush_seq < flush_seq) {
+        id = _seg_get_new();
+        if (id == -1) {
+            return NULL;
+        }
+        seg = &segs[id];
+        seg->write_offset = 0;
+        seg->refcount = 0;
+        seg->create_at = now;
+        seg->flush_seq = flush_seq;
+        seg->expire_at = 0;
+        seg->ttl_bucket = idx;
+        _seg_append(b, id);
+    }
+
+    seg = &segs[id];
+    it = (struct item *)(_seg_data(id) + seg->write_offset);
+    seg->write_offset += size;
+    seg->expire_at = MAX(seg->expire_at, expire_at);
+
+    return it;
+}
+
+void
+seg_unlink_item(struct item *it)
+{
+    ASSERT(it->is_linked);
+
+    it->is_linked = 0;
+    hashtable_delete(item_key(it), it->klen, hash_table);
+
+    DECR(seg_metrics, item_linked_curr);
+    INCR(seg_metrics, item_unlink);
+    DECR_N(seg_metrics, item_keyval_byte, it->klen + it->vlen);
+    DECR_N(seg_metrics, item_val_byte, it->vlen);
+}
+
+bool
+seg_item_flushed(struct item *it)
+{
+    return item_to_seg(it)->flush_seq < flush_seq;
+}
+
+uint32_t
+seg_expire(void)
+{
+    proc_time_i now = time_proc_sec();
+    uint32_t i, n = 0;
+    int32_t id;
+
+    /* segments in a bucket expire about in the order they were created */
+    for (i = 0; i < NTTL_BUCKET; ++i) {
+        while ((id = ttl_bucket[i].head) != -1 &&
+                _seg_expired(&segs[id], now) && segs[id].refcount == 0) {
+            _seg_reclaim(id, true);
+            n++;
+        }
+    }
+
+    if (n > 0) {
+        log_verb("reclaimed %"PRIu32" expired segments", n);
+    }
+
+    return n;
+}
+
+void
+seg_flush(void)
+{
+    /* segments written so far are flushed, even those of this very second */
+    flush_seq++;
+    seg_expire();
+}
+
+void
+seg_teardown(void)
+{
+    log_info("tear down the %s module", SEG_MODULE_NAME);
+
+    if (!seg_init) {
+        log_warn("%s has never been set up", SEG_MODULE_NAME);
+    }
+
+    hashtable_destroy(hash_table);
+    hash_table = NULL;
+    if (heap_base != NULL) {
+        cc_munmap(heap_base, (size_t)nseg * seg_size);
+        heap_base = NULL;
+    }
+    cc_free(segs);
+    segs = NULL;
+    seg_metrics = NULL;
+
+    seg_init = false;
+}
+
+void
+seg_setup(seg_options_st *options, seg_metrics_st *metrics)
+{
+    uint32_t i;
+
+    log_info("set up the %s module", SEG_MODULE_NAME);
+
+    if (seg_init) {
+        log_warn("%s has already been set up, re-creating", SEG_MODULE_NAME);
+        seg_teardown();
+    }
+
+    seg_metrics = metrics;
+
+    if (options != NULL) {
+        seg_size = option_uint(&options->seg_size);
+        seg_mem = option_uint(&options->seg_mem);
+        evict_opt = option_uint(&options->seg_evict_opt);
+        merge_nseg = option_uint(&options->seg_merge_nseg);
+        max_ttl = option_uint(&options->seg_item_max_ttl);
+        use_cas = option_bool(&options->seg_use_cas);
+        hash_power = option_uint(&options->seg_hash_power);
+    }
+
+    if (seg_size < SEG_SIZE_MIN || seg_size > SEG_SIZE_MAX ||
+            seg_size % ITEM_ALIGNMENT != 0) {
+        log_crit("invalid segment size %zu", seg_size);
+        goto error;
+    }
+    if (evict_opt >= SEG_EVICT_INVALID) {
+        log_crit("invalid segment eviction option %d", evict_opt);
+        goto error;
+    }
+    if (merge_nseg < 2 || merge_nseg > SEG_MERGE_NSEG_MAX) {
+        log_crit("# segments merged must be between 2 and %d",
+                SEG_MERGE_NSEG_MAX);
+        goto error;
+    }
+
+    nseg = seg_mem / seg_size;
+    if (nseg == 0 || nseg > INT32_MAX) {
+        log_crit("cannot fit segments of %zu bytes into %zu bytes", seg_size,
+                seg_mem);
+        goto error;
+    }
+
+    /* no base, the table keeps item addresses */
+    hash_table = hashtable_create(hash_power, HUGEPAGE_NONE, NULL);
+    if (hash_table == NULL) {
+        log_crit("Could not create hash table");
+        goto error;
+    }
+
+    heap_base = cc_mmap((size_t)nseg * seg_size);
+    segs = cc_alloc(sizeof(struct seg) * nseg);
+    if (heap_base == NULL || segs == NULL) {
+        log_crit("Could not allocate %"PRIu32" segments", nseg);
+        goto error;
+    }
+
+    for (i = 0; i < NTTL_BUCKET; ++i) {
+        ttl_bucket[i].head = ttl_bucket[i].tail = -1;
+    }
+    free_head = -1;
+    for (i = nseg; i > 0; --i) {
+        segs[i - 1].prev = -1;
+        segs[i - 1].write_offset = 0;
+        segs[i - 1].refcount = 0;
+        segs[i - 1].next = free_head;
+        free_head = i - 1;
+    }
+    UPDATE_VAL(seg_metrics, seg_free, nseg);
+
+    merge_next = 0;
+    flush_seq = 0;
+    expire_scan_at = -1;
+    cas_id = 0;
+
+    seg_init = true;
+
+    return;
+
+error:
+    seg_teardown();
+    exit(EX_CONFIG);
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "item.h"
+
+#include <storage/slab/hashtable.h>
+
+#include <cc_define.h>
+#include <cc_metric.h>
+#include <cc_option.h>
+#include <cc_util.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * The seg engine stores items in fixed-size segments. Items are appended to
+ * the active segment of their TTL bucket, so all items in a segment expire at
+ * about the same time, and segments in a bucket expire in the order they were
+ * written. Expired segments are reclaimed whole, by a scan that runs at most
+ * once a second, instead of waiting for each item to be read.
+ *
+ * When no segment is free, the oldest few segments of a TTL bucket are merged
+ * into the first of them: live items that have been read since they were
+ * written (or last merged) are kept as long as there is room, the rest are
+ * evicted, and all but the first segment become free.
+ *
+ *   ttl_bucket[i]:  head -> seg -> seg -> ... -> tail (active, appended to)
+ *   free segments:  seg -> seg -> ...
+ */
+
+#define SEG_SIZE        MiB
+#define SEG_MEM         (64 * MiB)
+#define SEG_EVICT_OPT   SEG_EVICT_MERGE
+#define SEG_MERGE_NSEG  4
+#define SEG_USE_CAS     true
+#define ITEM_MAX_TTL    (30 * 24 * 60 * 60) /* 30 days */
+#define HASH_POWER      16
+
+/* Eviction options */
+#define SEG_EVICT_NONE    0 /* throw OOM, no eviction */
+#define SEG_EVICT_FIFO    1 /* evict the oldest segment */
+#define SEG_EVICT_MERGE   2 /* merge segments, keeping items that are read */
+#define SEG_EVICT_INVALID 3 /* go no further! */
+
+/*          name                type                default             description */
+#define SEG_OPTION(ACTION)                                                                               \
+    ACTION( seg_size,           OPTION_TYPE_UINT,   SEG_SIZE,           "Segment size"                  )\
+    ACTION( seg_mem,            OPTION_TYPE_UINT,   SEG_MEM,            "Max memory by segments (byte)" )\
+    ACTION( seg_evict_opt,      OPTION_TYPE_UINT,   SEG_EVICT_OPT,      "Eviction strategy"             )\
+    ACTION( seg_merge_nseg,     OPTION_TYPE_UINT,   SEG_MERGE_NSEG,     "# segments merged at a time"   )\
+    ACTION( seg_item_max_ttl,   OPTION_TYPE_UINT,   ITEM_MAX_TTL,       "Max ttl in seconds"            )\
+    ACTION( seg_use_cas,        OPTION_TYPE_BOOL,   SEG_USE_CAS,        "Store CAS value in item"       )\
+    ACTION( seg_hash_power,     OPTION_TYPE_UINT,   HASH_POWER,         "Power for lookup hash table"   )
+
+typedef struct {
+    SEG_OPTION(OPTION_DECLARE)
+} seg_options_st;
+
+/*          name                type            description */
+#define SEG_METRIC(ACTION)                                                  \
+    ACTION( seg_req,            METRIC_COUNTER, "# req for new segment"    )\
+    ACTION( seg_req_ex,         METRIC_COUNTER, "# segment get exceptions" )\
+    ACTION( seg_expire,         METRIC_COUNTER, "# segments expired"       )\
+    ACTION( seg_evict,          METRIC_COUNTER, "# segments evicted"       )\
+    ACTION( seg_merge,          METRIC_COUNTER, "# segment merges"         )\
+    ACTION( seg_curr,           METRIC_GAUGE,   "# segments in use"        )\
+    ACTION( seg_free,           METRIC_GAUGE,   "# free segments"          )\
+    ACTION( item_alloc,         METRIC_COUNTER, "# items allocated"        )\
+    ACTION( item_alloc_ex,      METRIC_COUNTER, "# item alloc errors"      )\
+    ACTION( item_linked_curr,   METRIC_GAUGE,   "# current items, linked"  )\
+    ACTION( item_link,          METRIC_COUNTER, "# items inserted to HT"   )\
+    ACTION( item_unlink,        METRIC_COUNTER, "# items removed from HT"  )\
+    ACTION( item_expire,        METRIC_COUNTER, "# items expired"          )\
+    ACTION( item_evict,         METRIC_COUNTER, "# items evicted"          )\
+    ACTION( item_merge_keep,    METRIC_COUNTER, "# items kept by merge"    )\
+    ACTION( item_keyval_byte,   METRIC_GAUGE,   "key+val in bytes, linked" )\
+    ACTION( item_val_byte,      METRIC_GAUGE,   "value only in bytes"      )\
+    ACTION( hash_item,          METRIC_GAUGE,   "# items in hash table"    )\
+    ACTION( hash_load,          METRIC_FPN,     "hash table load factor"   )\
+    ACTION( hash_grow,          METRIC_COUNTER, "# hash table resizes"     )\
+    ACTION( hash_migrate,       METRIC_GAUGE,   "# hash buckets to migrate")\
+    ACTION( hash_page,          METRIC_GAUGE,   "page size of hash table"  )
+
+typedef struct {
+    SEG_METRIC(METRIC_DECLARE)
+} seg_metrics_st;
+
+struct seg {
+    int32_t         prev;        /* in ttl bucket, -1 if head */
+    int32_t         next;        /* in ttl bucket or free list, -1 if last */
+    uint32_t        write_offset;/* # bytes appended */
+    uint32_t        refcount;    /* # reserved or pinned items */
+    proc_time_i     create_at;
+    proc_time_i     expire_at;   /* when all items have expired */
+    uint32_t        flush_seq;   /* # flushes before it was created */
+    uint16_t        ttl_bucket;  /* index of ttl bucket */
+    uint16_t        unused;
+};
+
+extern struct hash_table *hash_table;
+extern size_t seg_size;        /* also the largest item, see item_reserve */
+extern seg_metrics_st *seg_metrics;
+
+/* the segment an item was appended to */
+struct seg *item_to_seg(struct item *it);
+
+static inline void
+seg_ref(struct seg *seg)
+{
+    seg->refcount++;
+}
+
+static inline void
+seg_deref(struct seg *seg)
+{
+    ASSERT(seg->refcount > 0);
+
+    seg->refcount--;
+}
+
+/* make room for an item of size bytes in the active segment of the ttl bucket
+ * for expire_at, returns NULL if no segment could be found
+ */
+struct item *seg_get_item(size_t size, proc_time_i expire_at);
+/* unlink a linked item, its space is reclaimed with its segment */
+void seg_unlink_item(struct item *it);
+/* true if the segment holding it was flushed */
+bool seg_item_flushed(struct item *it);
+/* reclaim segments that have expired or been flushed, returns # reclaimed */
+uint32_t seg_expire(void);
+/* seal all active segments, later writes go to new segments */
+void seg_flush(void);
+
+void seg_setup(seg_options_st *options, seg_metrics_st *metrics);
+void seg_teardown(void);
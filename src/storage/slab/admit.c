@@ -0,0 +1,176 @@
+#include "admit.h"
+
+#include <hash/cc_murmur3.h>
+#include <cc_bstring.h>
+#include <cc_debug.h>
+#include <cc_mm.h>
+
+#include <stdbool.h>
+
+#define COUNTER_PER_WORD 16
+#define HALF_MASK        0x7777777777777777ULL
+#define DOOR_NPROBE      2
+#define WIDTH_MIN        64
+
+static uint32_t murmur3_iv = 0x5bd1e995;
+
+static uint32_t
+_pow2(uint32_t n)
+{
+    uint32_t p = WIDTH_MIN;
+
+    while (p < n && p < (1U << 31)) {
+        p <<= 1;
+    }
+
+    return p;
+}
+
+/* the i-th index is h1 + i * h2 (Kirsch-Mitzenmacher) */
+static inline void
+_hash(const char *key, uint32_t klen, uint32_t *h1, uint32_t *h2)
+{
+    uint32_t hv;
+    uint64_t mix;
+
+    hash_murmur3_32(key, klen, murmur3_iv, &hv);
+    mix = (uint64_t)hv * 0x9e3779b97f4a7c15ULL;
+    *h1 = hv;
+    *h2 = (uint32_t)(mix >> 32) | 1;
+}
+
+static inline uint32_t
+_counter_get(struct admit *admit, uint32_t row, uint32_t idx)
+{
+    uint64_t i = (uint64_t)row * admit->width + idx;
+
+    return (admit->sketch[i / COUNTER_PER_WORD] >> (i % COUNTER_PER_WORD * 4)) &
+        ADMIT_COUNTER_MAX;
+}
+
+static inline void
+_counter_incr(struct admit *admit, uint32_t row, uint32_t idx)
+{
+    uint64_t i = (uint64_t)row * admit->width + idx;
+
+    if (_counter_get(admit, row, idx) < ADMIT_COUNTER_MAX) {
+        admit->sketch[i / COUNTER_PER_WORD] += 1ULL << (i % COUNTER_PER_WORD * 4);
+    }
+}
+
+static inline bool
+_door_test(struct admit *admit, uint32_t h1, uint32_t h2)
+{
+    uint32_t i, bit;
+
+    for (i = 0; i < DOOR_NPROBE; i++) {
+        bit = (h2 + i * h1) & (admit->ndoor - 1);
+        if ((admit->door[bit / 64] & (1ULL << (bit % 64))) == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static inline void
+_door_set(struct admit *admit, uint32_t h1, uint32_t h2)
+{
+    uint32_t i, bit;
+
+    for (i = 0; i < DOOR_NPROBE; i++) {
+        bit = (h2 + i * h1) & (admit->ndoor - 1);
+        admit->door[bit / 64] |= 1ULL << (bit % 64);
+    }
+}
+
+static void
+_admit_age(struct admit *admit)
+{
+    uint64_t i, nword = (uint64_t)ADMIT_DEPTH * admit->width / COUNTER_PER_WORD;
+
+    for (i = 0; i < nword; i++) {
+        admit->sketch[i] = (admit->sketch[i] >> 1) & HALF_MASK;
+    }
+    cc_memset(admit->door, 0, admit->ndoor / 8);
+    admit->naccess /= 2;
+
+    log_verb("admission filter counters halved");
+}
+
+struct admit *
+admit_create(uint64_t nkey)
+{
+    struct admit *admit;
+
+    if (nkey > ADMIT_NKEY_MAX) {
+        log_error("admission filter for %"PRIu64" keys exceeds the most, %"
+                PRIu32, nkey, ADMIT_NKEY_MAX);
+        return NULL;
+    }
+
+    admit = cc_alloc(sizeof(struct admit));
+    if (admit == NULL) {
+        return NULL;
+    }
+
+    admit->width = _pow2((uint32_t)nkey);
+    admit->ndoor = admit->width * 8;
+    admit->naccess = 0;
+    admit->sketch = cc_zalloc((size_t)ADMIT_DEPTH * admit->width / 2);
+    admit->door = cc_zalloc(admit->ndoor / 8);
+    if (admit->sketch == NULL || admit->door == NULL) {
+        admit_destroy(admit);
+        return NULL;
+    }
+
+    log_info("admission filter with %"PRIu32" counters per row created",
+            admit->width);
+
+    return admit;
+}
+
+void
+admit_destroy(struct admit *admit)
+{
+    if (admit != NULL) {
+        cc_free(admit->sketch);
+        cc_free(admit->door);
+        cc_free(admit);
+    }
+}
+
+void
+admit_record(struct admit *admit, const char *key, uint32_t klen)
+{
+    uint32_t h1, h2, i;
+
+    _hash(key, klen, &h1, &h2);
+
+    if (!_door_test(admit, h1, h2)) {
+        _door_set(admit, h1, h2);
+    } else {
+        for (i = 0; i < ADMIT_DEPTH; i++) {
+            _counter_incr(admit, i, (h1 + i * h2) & (admit->width - 1));
+        }
+    }
+
+    if (++admit->naccess >= (uint64_t)ADMIT_SAMPLE * admit->width) {
+        _admit_age(admit);
+    }
+}
+
+uint32_t
+admit_estimate(struct admit *admit, const char *key, uint32_t klen)
+{
+    uint32_t h1, h2, i, n, min = ADMIT_COUNTER_MAX;
+
+    _hash(key, klen, &h1, &h2);
+
+    for (i = 0; i < ADMIT_DEPTH; i++) {
+        n = _counter_get(admit, i, (h1 + i * h2) & (admit->width - 1));
+        min = n < min ? n : min;
+    }
+
+    return min + _door_test(admit, h1, h2);
+}
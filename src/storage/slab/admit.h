@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * The admission filter (TinyLFU) estimates how often each key was accessed
+ * lately. A count-min sketch keeps ADMIT_DEPTH rows of 4-bit counters, and a
+ * key's estimate is the smallest of its counters. Keys seen for the first
+ * time only set their bits in a Bloom filter (the doorkeeper) in front of the
+ * sketch, so that keys that are never seen again take up no counters.
+ *
+ * After ADMIT_SAMPLE accesses per counter in a row, all counters are halved
+ * and the doorkeeper is cleared, so estimates follow changes in popularity.
+ */
+
+#define ADMIT_DEPTH         4
+#define ADMIT_SAMPLE        10
+#define ADMIT_COUNTER_MAX   15
+#define ADMIT_NKEY_MAX      (1U << 28) /* so that ndoor fits in 32 bits */
+
+struct admit {
+    uint64_t    *sketch;    /* ADMIT_DEPTH rows of 4-bit counters */
+    uint64_t    *door;      /* doorkeeper bits */
+    uint32_t    width;      /* # counters per row, power of 2 */
+    uint32_t    ndoor;      /* # doorkeeper bits, power of 2 */
+    uint64_t    naccess;    /* # accesses since counters were last halved */
+};
+
+/* create a filter sized for about nkey keys, up to ADMIT_NKEY_MAX */
+struct admit *admit_create(uint64_t nkey);
+void admit_destroy(struct admit *admit);
+
+/* record an access to key */
+void admit_record(struct admit *admit, const char *key, uint32_t klen);
+/* return the estimated # accesses to key */
+uint32_t admit_estimate(struct admit *admit, const char *key, uint32_t klen);
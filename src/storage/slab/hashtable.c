@@ -1,37 +1,315 @@
 #include "hashtable.h"
 
+/* the seg engine builds this file with STORAGE_SEG, for its own items */
+#ifdef STORAGE_SEG
+#include <storage/seg/seg.h>
+#define hash_metrics seg_metrics
+#else
+#include "slab.h"
+#define hash_metrics slab_metrics
+#endif
+
+#include <datapool/hugepage.h>
+#include <util/util.h>
 #include <hash/cc_murmur3.h>
+#include <cc_debug.h>
 #include <cc_mm.h>
 
+#include <stddef.h>
+
 static uint32_t murmur3_iv = 0x3ac5d673;
 
+/* a bucket has about 8 items, hash_power is given in # items */
+#define BUCKET_POWER(_p) ((_p) > 3 ? (_p) - 3 : 0)
+
+/* grow when more than 4/5 of all item slots are taken */
+#define HASH_LOAD_NUM 4
+#define HASH_LOAD_DEN 5
+
+/* each thread filling a table owns at least this many buckets (as a power) */
+#define PUT_RANGE_POWER 6
+
+#define BYTE_LO  0x0101010101010101ULL
+#define BYTE_HI7 0x7f7f7f7f7f7f7f7fULL
+#define TAG_MASK ((1ULL << (HASH_BUCKET_NITEM * 8)) - 1)
+
+static inline uint64_t
+_hash(const char *key, uint32_t klen)
+{
+    uint64_t hv[2];
+
+    hash_murmur3_128_x64(key, klen, murmur3_iv, hv);
+
+    return hv[0];
+}
+
+/*
+ * the bucket index comes from the low bits of the hash, the tag from the top
+ * byte, which no table is large enough to index with
+ */
+static inline uint8_t
+_tag(uint64_t hv)
+{
+    return (uint8_t)(hv >> 56);
+}
+
 /*
- * Allocate table given size
+ * Compare all tags of a bucket at once: return a mask with the high bit of
+ * byte i set if tag[i] matches. Tags and the overflow count share one 64-bit
+ * word (read little-endian), and the overflow byte is masked out.
  */
-static struct item_slh *
-_hashtable_alloc(uint64_t size)
+static inline uint64_t
+_tag_match(const struct hash_bucket *b, uint8_t tag)
+{
+    uint64_t w, x;
+
+    cc_memcpy(&w, b->tag, sizeof(w));
+    x = w ^ (BYTE_LO * tag);  /* matching bytes are now zero */
+    x = ~(((x & BYTE_HI7) + BYTE_HI7) | x | BYTE_HI7);
+
+    return x & TAG_MASK;
+}
+
+/* items are kept as offsets from ht->base, 0 is an empty slot */
+static inline struct item *
+_item(const struct hash_table *ht, uint64_t offset)
 {
-    struct item_slh *table;
-    uint32_t i;
+    return offset == 0 ? NULL : (struct item *)((uintptr_t)ht->base + offset);
+}
 
-    table = cc_alloc(sizeof(*table) * size);
+static inline uint64_t
+_offset(const struct hash_table *ht, struct item *it)
+{
+    return (uint64_t)((uintptr_t)it - (uintptr_t)ht->base);
+}
 
+static inline bool
+_item_match(struct item *it, const char *key, uint32_t klen)
+{
+    return it != NULL && klen == it->klen &&
+        cc_memcmp(key, item_key(it), klen) == 0;
+}
+
+/*
+ * Allocate table given # buckets, mmap'ed memory comes zeroed and aligned
+ */
+static struct hash_bucket *
+_hashtable_alloc(struct hash_table *ht, uint64_t size)
+{
+    struct hash_bucket *table;
+    size_t page_used;
+
+    table = hugepage_map(sizeof(struct hash_bucket) * size, ht->page_size,
+            &page_used);
     if (table != NULL) {
-        for (i = 0; i < size; ++i) {
-            SLIST_INIT(&table[i]);
-        }
+        UPDATE_VAL(hash_metrics, hash_page, page_used);
     }
 
     return table;
 }
 
-struct hash_table *
-hashtable_create(uint32_t hash_power)
+static void
+_hashtable_free(struct hash_table *ht, struct hash_bucket *table, uint64_t size)
 {
-    struct hash_table *ht;
-    uint64_t size;
+    if (table != ht->ext) {
+        hugepage_unmap(table, sizeof(struct hash_bucket) * size, ht->page_size);
+    }
+}
 
-    ASSERT(hash_power > 0);
+static void
+_hashtable_insert(const struct hash_table *ht, struct hash_bucket *table,
+        uint32_t hash_power, struct item *it, uint64_t hv)
+{
+    uint64_t i, mask = HASHMASK(hash_power);
+    struct hash_bucket *b;
+    uint32_t j;
+
+    for (i = hv & mask;; i = (i + 1) & mask) {
+        b = &table[i];
+        for (j = 0; j < HASH_BUCKET_NITEM; ++j) {
+            if (b->item[j] == 0) {
+                b->tag[j] = _tag(hv);
+                b->item[j] = _offset(ht, it);
+                return;
+            }
+        }
+        if (b->overflow < HASH_OVERFLOW_MAX) {
+            b->overflow++;
+        }
+    }
+}
+
+/*
+ * Find the slot holding key in one table, and the bucket it was found in.
+ * Probing stops at the first bucket nothing has overflowed from.
+ */
+static uint64_t *
+_hashtable_find(const struct hash_table *ht, struct hash_bucket *table,
+        uint32_t hash_power, const char *key, uint32_t klen, uint64_t hv,
+        uint64_t *idx)
+{
+    uint64_t i, n, mask = HASHMASK(hash_power);
+    struct hash_bucket *b;
+    uint64_t m;
+    uint32_t j;
+
+    for (i = hv & mask, n = 0; n <= mask; i = (i + 1) & mask, ++n) {
+        b = &table[i];
+        for (m = _tag_match(b, _tag(hv)); m != 0; m &= m - 1) {
+            j = __builtin_ctzll(m) / 8;
+            if (_item_match(_item(ht, b->item[j]), key, klen)) {
+                *idx = i;
+                return &b->item[j];
+            }
+        }
+        if (b->overflow == 0) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static bool
+_hashtable_remove(const struct hash_table *ht, struct hash_bucket *table,
+        uint32_t hash_power, const char *key, uint32_t klen, uint64_t hv)
+{
+    uint64_t i, h, mask = HASHMASK(hash_power);
+    uint64_t *slot;
+    struct hash_bucket *b;
+
+    slot = _hashtable_find(ht, table, hash_power, key, klen, hv, &i);
+    if (slot == NULL) {
+        return false;
+    }
+
+    *slot = 0;
+    /* buckets probed past no longer hold this item in overflow */
+    for (h = hv & mask; h != i; h = (h + 1) & mask) {
+        b = &table[h];
+        if (b->overflow < HASH_OVERFLOW_MAX) {
+            ASSERT(b->overflow > 0);
+            b->overflow--;
+        }
+    }
+
+    return true;
+}
+
+/* point the slot holding oit in one table to nit, false if there is none */
+static bool
+_hashtable_swap(const struct hash_table *ht, struct hash_bucket *table,
+        uint32_t hash_power, struct item *oit, struct item *nit, uint64_t hv)
+{
+    uint64_t i, n, mask = HASHMASK(hash_power);
+    struct hash_bucket *b;
+    uint64_t m;
+    uint32_t j;
+
+    /* oit may already be overwritten, so match by offset only */
+    for (i = hv & mask, n = 0; n <= mask; i = (i + 1) & mask, ++n) {
+        b = &table[i];
+        for (m = _tag_match(b, _tag(hv)); m != 0; m &= m - 1) {
+            j = __builtin_ctzll(m) / 8;
+            if (b->item[j] == _offset(ht, oit)) {
+                b->item[j] = _offset(ht, nit);
+                return true;
+            }
+        }
+        if (b->overflow == 0) {
+            break;
+        }
+    }
+
+    return false;
+}
+
+static void
+_hashtable_metrics(struct hash_table *ht)
+{
+    uint64_t nleft = 0;
+    double load;
+
+    if (ht->old != NULL) {
+        nleft = HASHSIZE(ht->hash_power - 1) - ht->migrate;
+    }
+    load = (double)ht->nhash_item /
+        (HASHSIZE(ht->hash_power) * HASH_BUCKET_NITEM);
+
+    UPDATE_VAL(hash_metrics, hash_item, ht->nhash_item);
+    UPDATE_VAL(hash_metrics, hash_load, load);
+    UPDATE_VAL(hash_metrics, hash_migrate, nleft);
+}
+
+/*
+ * Move up to nbucket buckets from the old table into the current one. Slots
+ * are emptied but overflow counts are left as they are, they only make later
+ * lookups into old probe a little further than needed.
+ */
+static void
+_hashtable_migrate(struct hash_table *ht, uint64_t nbucket)
+{
+    uint64_t size = HASHSIZE(ht->hash_power - 1);
+    uint64_t end = MIN(size, ht->migrate + nbucket);
+    struct hash_bucket *b;
+    struct item *it;
+    uint32_t j;
+
+    for (; ht->migrate < end; ++ht->migrate) {
+        b = &ht->old[ht->migrate];
+        for (j = 0; j < HASH_BUCKET_NITEM; ++j) {
+            it = _item(ht, b->item[j]);
+            if (it != NULL) {
+                _hashtable_insert(ht, ht->table, ht->hash_power, it,
+                        _hash(item_key(it), it->klen));
+                b->item[j] = 0;
+            }
+        }
+    }
+
+    if (ht->migrate == size) {
+        _hashtable_free(ht, ht->old, size);
+        ht->old = NULL;
+        ht->migrate = 0;
+        log_info("hash table migrated to %"PRIu64" buckets",
+                HASHSIZE(ht->hash_power));
+    }
+}
+
+/* start migrating into a table twice the size */
+static rstatus_i
+_hashtable_grow(struct hash_table *ht)
+{
+    struct hash_bucket *table;
+
+    ASSERT(ht->old == NULL);
+
+    table = _hashtable_alloc(ht, HASHSIZE(ht->hash_power + 1));
+    if (table == NULL) {
+        return CC_ENOMEM;
+    }
+
+    if (ht->table == ht->ext) {
+        log_warn("hash table outgrew the memory it was attached to, and will "
+                "be rebuilt from the items on the next restart");
+    }
+
+    ht->old = ht->table;
+    ht->migrate = 0;
+    ht->table = table;
+    ht->hash_power++;
+    INCR(hash_metrics, hash_grow);
+
+    log_info("hash table growing to %"PRIu64" buckets for %"PRIu32" items",
+            HASHSIZE(ht->hash_power), ht->nhash_item);
+
+    return CC_OK;
+}
+
+static struct hash_table *
+_hashtable_new(uint32_t bucket_power, size_t page_size, void *base)
+{
+    struct hash_table *ht;
 
     /* alloc struct */
     ht = cc_alloc(sizeof(struct hash_table));
@@ -42,95 +320,356 @@ hashtable_create(uint32_t hash_power)
 
     /* init members */
     ht->table = NULL;
-    ht->hash_power = hash_power;
+    ht->old = NULL;
+    ht->ext = NULL;
+    ht->base = base;
+    ht->migrate = 0;
+    ht->hash_power = bucket_power;
     ht->nhash_item = 0;
-    size = HASHSIZE(ht->hash_power);
+    ht->page_size = page_size;
+
+    return ht;
+}
+
+struct hash_table *
+hashtable_create(uint32_t hash_power, size_t page_size, void *base)
+{
+    struct hash_table *ht;
+
+    ASSERT(hash_power > 0);
+
+    ht = _hashtable_new(BUCKET_POWER(hash_power), page_size, base);
+    if (ht == NULL) {
+        return NULL;
+    }
 
     /* alloc table */
-    ht->table = _hashtable_alloc(size);
+    ht->table = _hashtable_alloc(ht, HASHSIZE(ht->hash_power));
     if (ht->table == NULL) {
         cc_free(ht);
         return NULL;
     }
+    _hashtable_metrics(ht);
 
     return ht;
 }
 
-void
-hashtable_destroy(struct hash_table *ht)
+size_t
+hashtable_size(uint32_t hash_power)
 {
-    if (ht != NULL && ht->table != NULL) {
-        cc_free(ht->table);
-    }
+    return sizeof(struct hash_bucket) * HASHSIZE(BUCKET_POWER(hash_power));
 }
 
-static struct item_slh *
-_get_bucket(const char *key, size_t klen, struct hash_table *ht)
+struct hash_table *
+hashtable_attach(void *table, uint32_t hash_power, uint32_t nitem, void *base)
 {
-    uint32_t hv;
+    struct hash_table *ht;
+
+    ASSERT(hash_power > 0);
 
-    hash_murmur3_32(key, klen, murmur3_iv, &hv);
+    ht = _hashtable_new(BUCKET_POWER(hash_power), HUGEPAGE_NONE, base);
+    if (ht == NULL) {
+        return NULL;
+    }
+
+    ht->table = ht->ext = table;
+    ht->nhash_item = nitem;
+    if (nitem == 0) {
+        cc_memset(table, 0, hashtable_size(hash_power));
+    }
+    _hashtable_metrics(ht);
+
+    log_info("hash table attached at %p with %"PRIu64" buckets and %"PRIu32
+            " items", table, HASHSIZE(ht->hash_power), nitem);
+
+    return ht;
+}
 
-    return &(ht->table[hv & HASHMASK(ht->hash_power)]);
+bool
+hashtable_attached(const struct hash_table *ht)
+{
+    return ht->ext != NULL && ht->table == ht->ext && ht->old == NULL;
 }
 
 void
-hashtable_put(struct item *it, struct hash_table *ht)
+hashtable_destroy(struct hash_table *ht)
 {
-    struct item_slh *bucket;
+    if (ht != NULL) {
+        _hashtable_free(ht, ht->table, HASHSIZE(ht->hash_power));
+        if (ht->old != NULL) {
+            _hashtable_free(ht, ht->old, HASHSIZE(ht->hash_power - 1));
+        }
+        cc_free(ht);
+    }
+}
 
+rstatus_i
+hashtable_put(struct item *it, struct hash_table *ht)
+{
     ASSERT(hashtable_get(item_key(it), it->klen, ht) == NULL);
 
-    bucket = _get_bucket(item_key(it), it->klen, ht);
-    SLIST_INSERT_HEAD(bucket, it, i_sle);
+    if ((uint64_t)(ht->nhash_item + 1) * HASH_LOAD_DEN >
+            HASHSIZE(ht->hash_power) * HASH_BUCKET_NITEM * HASH_LOAD_NUM) {
+        if (ht->old != NULL) {
+            /* updates outpaced migration, finish it before growing again */
+            _hashtable_migrate(ht, HASHSIZE(ht->hash_power - 1));
+        }
+        if (_hashtable_grow(ht) != CC_OK) {
+            /* the table still works when (over)full, only slower */
+            log_warn("failed to grow hash table of %"PRIu32" items",
+                    ht->nhash_item);
+        }
+    }
+    if (ht->nhash_item == HASHSIZE(ht->hash_power) * HASH_BUCKET_NITEM) {
+        log_warn("hash table is full with %"PRIu32" items", ht->nhash_item);
+        return CC_ENOMEM;
+    }
 
+    _hashtable_insert(ht, ht->table, ht->hash_power, it,
+            _hash(item_key(it), it->klen));
     ++(ht->nhash_item);
+
+    if (ht->old != NULL) {
+        _hashtable_migrate(ht, HASH_MIGRATE_NBUCKET);
+    }
+    _hashtable_metrics(ht);
+
+    return CC_OK;
+}
+
+#ifndef STORAGE_SEG
+/* seg items are not kept on lists, and never put all at once */
+
+/*
+ * Like _hashtable_insert, but without probing at or past bucket end, which is
+ * never wrapped around. False is returned if there is no room before end.
+ */
+static bool
+_hashtable_insert_before(const struct hash_table *ht,
+        struct hash_bucket *table, uint32_t hash_power, struct item *it,
+        uint64_t hv, uint64_t end)
+{
+    uint64_t i, h = hv & HASHMASK(hash_power);
+    struct hash_bucket *b;
+    uint32_t j;
+
+    for (i = h; i < end; ++i) {
+        b = &table[i];
+        for (j = 0; j < HASH_BUCKET_NITEM; ++j) {
+            if (b->item[j] == 0) {
+                b->tag[j] = _tag(hv);
+                b->item[j] = _offset(ht, it);
+                for (; h < i; ++h) {
+                    if (table[h].overflow < HASH_OVERFLOW_MAX) {
+                        table[h].overflow++;
+                    }
+                }
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+struct put_arg {
+    struct hash_table   *ht;
+    struct item_slh     *list;      /* lists to put */
+    uint32_t            nlist;
+    struct item_slh     *bin;       /* nthread x nthread lists */
+    struct item_slh     *spill;     /* items left for the calling thread */
+    uint32_t            idx;        /* index of this thread */
+    uint32_t            nthread;
+};
+
+static void
+_list_move(struct item_slh *dst, struct item_slh *src)
+{
+    struct item *it;
+
+    while ((it = SLIST_FIRST(src)) != NULL) {
+        SLIST_REMOVE_HEAD(src, i_sle);
+        SLIST_INSERT_HEAD(dst, it, i_sle);
+    }
+}
+
+/* first bucket of the idx-th of n ranges, bucket i is in range i * n >> power */
+static inline uint64_t
+_range_start(uint32_t idx, uint32_t n, uint32_t hash_power)
+{
+    return (((uint64_t)idx << hash_power) + n - 1) / n;
+}
+
+/* move items on every nthread-th list to the bin of the thread owning them */
+static void *
+_put_bin(void *arg)
+{
+    struct put_arg *pa = arg;
+    uint32_t hash_power = pa->ht->hash_power, l, owner;
+    struct item *it;
+
+    for (l = pa->idx; l < pa->nlist; l += pa->nthread) {
+        while ((it = SLIST_FIRST(&pa->list[l])) != NULL) {
+            SLIST_REMOVE_HEAD(&pa->list[l], i_sle);
+            owner = (uint32_t)(((_hash(item_key(it), it->klen) &
+                    HASHMASK(hash_power)) * pa->nthread) >> hash_power);
+            SLIST_INSERT_HEAD(&pa->bin[pa->idx * pa->nthread + owner], it,
+                    i_sle);
+        }
+    }
+
+    return NULL;
+}
+
+/* insert items binned to this thread, within its range of buckets */
+static void *
+_put_range(void *arg)
+{
+    struct put_arg *pa = arg;
+    struct hash_table *ht = pa->ht;
+    uint64_t end = _range_start(pa->idx + 1, pa->nthread, ht->hash_power);
+    struct item_slh *bin;
+    struct item *it;
+    uint32_t t;
+
+    for (t = 0; t < pa->nthread; ++t) {
+        bin = &pa->bin[t * pa->nthread + pa->idx];
+        while ((it = SLIST_FIRST(bin)) != NULL) {
+            SLIST_REMOVE_HEAD(bin, i_sle);
+            if (!_hashtable_insert_before(ht, ht->table, ht->hash_power, it,
+                    _hash(item_key(it), it->klen), end)) {
+                SLIST_INSERT_HEAD(pa->spill, it, i_sle);
+            }
+        }
+    }
+
+    return NULL;
 }
 
 void
-hashtable_delete(const char *key, uint32_t klen, struct hash_table *ht)
+hashtable_put_all(struct item_slh *list, uint32_t nlist, uint32_t nitem,
+        struct hash_table *ht, uint32_t nthread)
 {
-    struct item_slh *bucket;
-    struct item *it, *prev;
+    struct put_arg *pa = NULL;
+    struct item_slh *bin = NULL, spill;
+    struct hash_bucket *table;
+    struct item *it;
+    uint32_t hash_power = ht->hash_power, i, nspill = 0;
 
-    ASSERT(hashtable_get(key, klen, ht) != NULL);
+    ASSERT(ht->nhash_item == 0 && ht->old == NULL);
 
-    bucket = _get_bucket(key, klen, ht);
-    for (prev = NULL, it = SLIST_FIRST(bucket); it != NULL;
-        prev = it, it = SLIST_NEXT(it, i_sle)) {
-        /* iterate through bucket to find item to be removed */
-        if ((klen == it->klen) && cc_memcmp(key, item_key(it), klen) == 0) {
-            /* found item */
-            break;
+    /* size the table for all items up front, nothing needs migrating yet */
+    while ((uint64_t)nitem * HASH_LOAD_DEN >
+            HASHSIZE(hash_power) * HASH_BUCKET_NITEM * HASH_LOAD_NUM) {
+        hash_power++;
+    }
+    if (hash_power > ht->hash_power) {
+        table = _hashtable_alloc(ht, HASHSIZE(hash_power));
+        if (table != NULL) {
+            _hashtable_free(ht, ht->table, HASHSIZE(ht->hash_power));
+            ht->table = table;
+            ht->hash_power = hash_power;
+            log_info("hash table sized to %"PRIu64" buckets for %"PRIu32
+                    " items", HASHSIZE(hash_power), nitem);
         }
     }
 
-    if (prev == NULL) {
-        SLIST_REMOVE_HEAD(bucket, i_sle);
+    nthread = MIN(nthread, HASHSIZE(ht->hash_power) >> PUT_RANGE_POWER);
+    if (nthread > 1) {
+        pa = cc_alloc(sizeof(*pa) * nthread);
+        bin = cc_alloc(sizeof(*bin) * nthread * (nthread + 1));
+    }
+    SLIST_INIT(&spill);
+    if (pa == NULL || bin == NULL) {
+        /* one thread, or not enough memory for more: put them all here */
+        for (i = 0; i < nlist; ++i) {
+            _list_move(&spill, &list[i]);
+        }
     } else {
-        SLIST_REMOVE_AFTER(prev, i_sle);
+        for (i = 0; i < nthread * (nthread + 1); ++i) {
+            SLIST_INIT(&bin[i]);
+        }
+        for (i = 0; i < nthread; ++i) {
+            pa[i] = (struct put_arg){ht, list, nlist, bin,
+                &bin[nthread * nthread + i], i, nthread};
+        }
+        run_parallel(_put_bin, pa, sizeof(*pa), nthread);
+        run_parallel(_put_range, pa, sizeof(*pa), nthread);
+        for (i = 0; i < nthread; ++i) {
+            _list_move(&spill, pa[i].spill);
+        }
+    }
+    cc_free(pa);
+    cc_free(bin);
+
+    while ((it = SLIST_FIRST(&spill)) != NULL) {
+        SLIST_REMOVE_HEAD(&spill, i_sle);
+        _hashtable_insert(ht, ht->table, ht->hash_power, it,
+                _hash(item_key(it), it->klen));
+        nspill++;
     }
+    ht->nhash_item = nitem;
+    _hashtable_metrics(ht);
 
+    log_info("put %"PRIu32" items into hash table with %"PRIu32" thread(s), "
+            "%"PRIu32" by the calling thread", nitem, MAX(nthread, 1), nspill);
+}
+#endif
+
+void
+hashtable_delete(const char *key, uint32_t klen, struct hash_table *ht)
+{
+    uint64_t hv = _hash(key, klen);
+    bool removed;
+
+    ASSERT(hashtable_get(key, klen, ht) != NULL);
+
+    removed = _hashtable_remove(ht, ht->table, ht->hash_power, key, klen,
+            hv);
+    if (!removed && ht->old != NULL) {
+        removed = _hashtable_remove(ht, ht->old, ht->hash_power - 1, key, klen,
+                hv);
+    }
+    ASSERT(removed);
     --(ht->nhash_item);
+
+    if (ht->old != NULL) {
+        _hashtable_migrate(ht, HASH_MIGRATE_NBUCKET);
+    }
+    _hashtable_metrics(ht);
 }
 
 struct item *
 hashtable_get(const char *key, uint32_t klen, struct hash_table *ht)
 {
-    struct item_slh *bucket;
-    struct item *it;
+    uint64_t hv;
+    uint64_t i;
+    uint64_t *slot;
 
     ASSERT(key != NULL);
     ASSERT(klen != 0);
 
-    bucket = _get_bucket(key, klen, ht);
-    /* iterate through bucket looking for item */
-    for (it = SLIST_FIRST(bucket); it != NULL; it = SLIST_NEXT(it, i_sle)) {
-        if ((klen == it->klen) && cc_memcmp(key, item_key(it), klen) == 0) {
-            /* found item */
-            return it;
-        }
+    hv = _hash(key, klen);
+    slot = _hashtable_find(ht, ht->table, ht->hash_power, key, klen, hv,
+            &i);
+    if (slot == NULL && ht->old != NULL) {
+        slot = _hashtable_find(ht, ht->old, ht->hash_power - 1, key, klen,
+                hv, &i);
     }
 
-    return NULL;
+    return slot == NULL ? NULL : _item(ht, *slot);
+}
+
+void
+hashtable_replace(struct item *oit, struct item *nit, struct hash_table *ht)
+{
+    uint64_t hv = _hash(item_key(nit), nit->klen);
+    bool replaced;
+
+    replaced = _hashtable_swap(ht, ht->table, ht->hash_power, oit, nit, hv);
+    if (!replaced && ht->old != NULL) {
+        replaced = _hashtable_swap(ht, ht->old, ht->hash_power - 1, oit, nit,
+                hv);
+    }
+    ASSERT(replaced);
 }
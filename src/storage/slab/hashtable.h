@@ -1,19 +1,94 @@
 #pragma once
 
-#include "item.h"
+#include <cc_define.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct item;
+struct item_slh;
+
+/*
+ * The hash index is a bucketized open-addressing table. Each bucket fills a
+ * cache line and holds up to HASH_BUCKET_NITEM items, along with an 8-bit tag
+ * taken from the key hash for each of them. Lookups compare all tags of a
+ * bucket at once and only read the keys of items whose tag matches, so most
+ * misses never touch item memory.
+ *
+ * An item that finds its home bucket full is placed in the next bucket with
+ * room (linear probing), and every bucket it passes counts it in `overflow'.
+ * A lookup can stop at the first bucket with no overflow. The count saturates
+ * at UINT8_MAX and then stays there until the table is rebuilt.
+ *
+ * The table starts with room for about 2^hash_power items, and doubles in
+ * size whenever it gets too full. Rather than rehashing everything at once,
+ * the old table is kept around and each later update moves a few of its
+ * buckets over (HASH_MIGRATE_NBUCKET), while lookups check both tables.
+ * The migration is always done before the new table itself fills up.
+ *
+ * An empty table can also be filled from several threads at once, which is
+ * how the index is rebuilt when a persistent slab pool is recovered. Each
+ * thread owns a contiguous range of buckets and inserts the items whose home
+ * bucket is in it; the few that would probe past the end of the range are
+ * inserted afterwards by the calling thread.
+ *
+ * Items are kept as offsets from a base address rather than as pointers, so
+ * a table in a data pool stays valid when the pool and the slab heap are
+ * mapped elsewhere after a restart. Such a table is attached to memory owned
+ * by the caller. It can still grow, but the bigger table is then an ordinary
+ * one and the attached memory is left behind.
+ *
+ * The seg engine uses the same table, built against its own items (see
+ * src/storage/seg/CMakeLists.txt). Its items move when segments are merged,
+ * hashtable_replace points their entry at the new copy.
+ */
+
+#define HASH_BUCKET_NITEM 7
+#define HASH_OVERFLOW_MAX UINT8_MAX
+#define HASH_MIGRATE_NBUCKET 4      /* old buckets moved per update */
+
+struct hash_bucket {
+    uint8_t         tag[HASH_BUCKET_NITEM];
+    uint8_t         overflow;       /* # items that probed past this bucket */
+    uint64_t        item[HASH_BUCKET_NITEM]; /* offsets from base, 0: empty */
+};
 
 struct hash_table {
-    struct item_slh *table;
-    uint32_t nhash_item;
-    uint32_t hash_power;
+    struct hash_bucket  *table;
+    struct hash_bucket  *old;       /* table being migrated from, or NULL */
+    struct hash_bucket  *ext;       /* attached table, or NULL */
+    uint8_t             *base;      /* items are kept as offsets from here */
+    uint64_t            migrate;    /* next bucket in old to migrate */
+    uint32_t            nhash_item; /* # items in both tables */
+    uint32_t            hash_power; /* 2^hash_power buckets */
+    size_t              page_size;  /* huge page size for tables, or 0 */
 };
 
 #define HASHSIZE(_n) (1ULL << (_n))
 #define HASHMASK(_n) (HASHSIZE(_n) - 1)
 
-struct hash_table *hashtable_create(uint32_t hash_power);
+struct hash_table *hashtable_create(uint32_t hash_power, size_t page_size,
+        void *base);
+/* bytes of the table hashtable_create would start with */
+size_t hashtable_size(uint32_t hash_power);
+/* use hashtable_size(hash_power) bytes at table, which already holds nitem
+ * items from an earlier attach, or is cleared if nitem is 0
+ */
+struct hash_table *hashtable_attach(void *table, uint32_t hash_power,
+        uint32_t nitem, void *base);
+/* true if all items are still in the attached table */
+bool hashtable_attached(const struct hash_table *ht);
 void hashtable_destroy(struct hash_table *ht);
 
-void hashtable_put(struct item *it, struct hash_table *ht);
+/* CC_ENOMEM if the table is full and could not grow, it is not put then */
+rstatus_i hashtable_put(struct item *it, struct hash_table *ht);
+/* put all nitem items on the nlist lists into an empty table, with nthread
+ * threads; the lists are emptied
+ */
+void hashtable_put_all(struct item_slh *list, uint32_t nlist, uint32_t nitem,
+        struct hash_table *ht, uint32_t nthread);
 void hashtable_delete(const char *key, uint32_t klen, struct hash_table *ht);
 struct item *hashtable_get(const char *key, uint32_t klen, struct hash_table *ht);
+/* point the entry of oit to nit, which holds the same key */
+void hashtable_replace(struct item *oit, struct item *nit, struct hash_table *ht);
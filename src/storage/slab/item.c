@@ -32,7 +32,8 @@ item_hdr_init(struct item *it, uint32_t offset, uint8_t id)
 #endif
     it->offset = offset;
     it->id = id;
-    it->is_linked = it->in_freeq = it->is_raligned = 0;
+    it->is_linked = it->in_freeq = it->is_raligned = it->is_accessed = 0;
+    it->refcount = 0;
 }
 
 static inline void
@@ -41,9 +42,11 @@ _item_reset(struct item *it)
     it->is_linked = 0;
     it->in_freeq = 0;
     it->is_raligned = 0;
+    it->is_accessed = 0;
     it->vlen = 0;
     it->klen = 0;
     it->olen = 0;
+    it->refcount = 0;
     it->expire_at = 0;
     it->create_at = 0;
 }
@@ -93,6 +96,13 @@ _item_dealloc(struct item **it_p)
 {
     uint8_t id = (*it_p)->id;
 
+    if ((*it_p)->refcount > 0) {
+        /* still being read, item_unpin frees it once the last pin is gone */
+        log_verb("defer dealloc of pinned it %p", *it_p);
+        *it_p = NULL;
+        return;
+    }
+
     DECR(slab_metrics, item_curr);
     INCR(slab_metrics, item_dealloc);
     PERSLAB_DECR(id, item_curr);
@@ -105,15 +115,18 @@ _item_dealloc(struct item **it_p)
 /*
  * (Re)Link an item into the hash table
  */
-static void
+static item_rstatus_e
 _item_link(struct item *it, bool relink)
 {
     ASSERT(it->magic == ITEM_MAGIC);
     ASSERT(!(it->in_freeq));
+    ASSERT(relink || !(it->is_linked));
 
-    if (!relink) {
-        ASSERT(!(it->is_linked));
+    if (hashtable_put(it, hash_table) != CC_OK) {
+        return ITEM_ENOMEM;
+    }
 
+    if (!relink) {
         it->is_linked = 1;
         slab_deref(item_to_slab(it)); /* slab ref'ed in _item_alloc */
     }
@@ -121,8 +134,6 @@ _item_link(struct item *it, bool relink)
     log_verb("link it %p of id %"PRIu8" at offset %"PRIu32, it, it->id,
             it->offset);
 
-    hashtable_put(it, hash_table);
-
     INCR(slab_metrics, item_linked_curr);
     INCR(slab_metrics, item_link);
     /* TODO(yao): how do we track optional storage? Separate or treat as val? */
@@ -130,26 +141,36 @@ _item_link(struct item *it, bool relink)
     INCR_N(slab_metrics, item_val_byte, it->vlen);
     PERSLAB_INCR_N(it->id, item_keyval_byte, it->klen + it->vlen);
     PERSLAB_INCR_N(it->id, item_val_byte, it->vlen);
+
+    return ITEM_OK;
 }
 
-void
+item_rstatus_e
 item_relink(struct item *it)
 {
-    _item_link(it, true);
+    return _item_link(it, true);
 }
 
-void
+item_rstatus_e
 item_insert(struct item *it, const struct bstring *key)
 {
     ASSERT(it != NULL && key != NULL);
 
     item_delete(key);
 
-    _item_link(it, false);
+    if (_item_link(it, false) != ITEM_OK) {
+        log_warn("server error on inserting it %p for key %.*s", it, key->len,
+                key->data);
+        item_release(&it);
+
+        return ITEM_ENOMEM;
+    }
     log_verb("insert it %p of id %"PRIu8" for key %.*s", it, it->id, key->len,
         key->data);
 
     cc_itt_alloc(slab_malloc, it, item_size(it));
+
+    return ITEM_OK;
 }
 
 /*
@@ -188,8 +209,8 @@ _item_delete(struct item **it)
  * Return an item if it hasn't been marked as expired, lazily expiring
  * item as-and-when needed
  */
-struct item *
-item_get(const struct bstring *key)
+static struct item *
+_item_get(const struct bstring *key)
 {
     struct item *it;
 
@@ -208,11 +229,78 @@ item_get(const struct bstring *key)
         return NULL;
     }
 
+    /* only the first read since the last clock sweep writes to the item */
+    if (!it->is_accessed) {
+        it->is_accessed = 1;
+    }
+
     log_verb("get it %p of id %"PRIu8, it, it->id);
 
     return it;
 }
 
+/* lookups made internally, e.g. by item_insert, are not recorded */
+struct item *
+item_get(const struct bstring *key)
+{
+    if (admit_filter != NULL) {
+        admit_record(admit_filter, key->data, key->len);
+    }
+
+    return _item_get(key);
+}
+
+bool
+item_expire(struct item *it)
+{
+    if (!it->is_linked || !_item_expired(it)) {
+        return false;
+    }
+
+    log_verb("expire it %p of id %"PRIu8" at offset %"PRIu32, it, it->id,
+            it->offset);
+    _item_delete(&it);
+
+    return true;
+}
+
+void
+item_evict(struct item *it)
+{
+    ASSERT(it->is_linked && it->refcount == 0);
+
+    log_verb("evict it %p of id %"PRIu8" at offset %"PRIu32, it, it->id,
+            it->offset);
+    _item_delete(&it);
+}
+
+bool
+item_pin(struct item *it)
+{
+    ASSERT(it->is_linked);
+
+    if (it->refcount == UINT8_MAX) {
+        return false;
+    }
+
+    it->refcount++;
+    slab_ref(item_to_slab(it));
+
+    return true;
+}
+
+void
+item_unpin(struct item *it)
+{
+    ASSERT(it->refcount > 0);
+
+    slab_deref(item_to_slab(it));
+    if (--it->refcount == 0 && !it->is_linked) {
+        /* deleted or replaced while pinned */
+        _item_dealloc(&it);
+    }
+}
+
 /* TODO(yao): move this to memcache-specific location */
 static void
 _item_define(struct item *it, const struct bstring *key, const struct bstring
@@ -254,6 +342,27 @@ item_reserve(struct item **it_p, const struct bstring *key, const struct bstring
     return ITEM_OK;
 }
 
+bool
+item_admit(const struct bstring *key, uint32_t vlen, uint8_t olen)
+{
+    uint8_t id = item_slabid(key->len, vlen, olen);
+
+    if (admit_filter != NULL) {
+        admit_record(admit_filter, key->data, key->len);
+    }
+
+    if (id == SLABCLASS_INVALID_ID) {
+        return true; /* item_reserve tells the caller */
+    }
+
+    /* rejecting the new value of a key would leave the old one to be read */
+    if (hashtable_get(key->data, key->len, hash_table) != NULL) {
+        return true;
+    }
+
+    return slab_admit(id, key);
+}
+
 void
 item_release(struct item **it_p)
 {
@@ -317,7 +426,7 @@ item_annex(struct item *oit, const struct bstring *key, const struct bstring
             cc_memcpy(item_data(nit), item_data(oit), oit->vlen);
             cc_memcpy(item_data(nit) + oit->vlen, val->data, val->len);
             nit->vlen = ntotal;
-            item_insert(nit, key);
+            status = item_insert(nit, key);
         }
     } else {
         /* if oit is large enough to hold the extra data and is already
@@ -346,7 +455,7 @@ item_annex(struct item *oit, const struct bstring *key, const struct bstring
             cc_memcpy(item_data(nit) - ntotal, val->data, val->len);
             cc_memcpy(item_data(nit) - oit->vlen, item_data(oit), oit->vlen);
             nit->vlen = ntotal;
-            item_insert(nit, key);
+            status = item_insert(nit, key);
         }
     }
 
@@ -373,7 +482,7 @@ item_delete(const struct bstring *key)
 {
     struct item *it;
 
-    it = item_get(key);
+    it = _item_get(key);
     if (it != NULL) {
         _item_delete(&it);
 
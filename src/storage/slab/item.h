@@ -58,8 +58,9 @@ struct item {
     uint32_t          is_linked:1;   /* item in hash */
     uint32_t          in_freeq:1;    /* item in free queue */
     uint32_t          is_raligned:1; /* item data (payload) is right-aligned */
-    uint32_t          vlen:29;       /* data size (29 bits since uint32_t is 32
-                                      * bits and we have 3 flags)
+    uint32_t          is_accessed:1; /* read since linked or last clock sweep */
+    uint32_t          vlen:28;       /* data size (28 bits since uint32_t is 32
+                                      * bits and we have 4 flags)
                                       * NOTE: need at least enough bits to
                                       * support the largest value size allowed
                                       * by the implementation, i.e. SLAB_MAX_SIZE
@@ -69,7 +70,7 @@ struct item {
     uint8_t           id;            /* slab class id */
     uint8_t           klen;          /* key length */
     uint8_t           olen;          /* optional length (right after cas) */
-    uint8_t           padding;       /* keep end 64-bit aligned */
+    uint8_t           refcount;      /* # readers pinning the payload */
     char              end[1];        /* item data */
 };
 
@@ -211,10 +212,20 @@ void item_hdr_init(struct item *it, uint32_t offset, uint8_t id);
 /* acquire an item */
 struct item *item_get(const struct bstring *key);
 
+/* pin/unpin the payload of a linked item, e.g. while it is being sent from
+ * the item memory directly. A pinned item that gets deleted or replaced keeps
+ * its memory until the last pin is dropped. Pinning fails if the item is
+ * already pinned by too many readers.
+ */
+bool item_pin(struct item *it);
+void item_unpin(struct item *it);
+
 /* TODO: make the following APIs protocol agnostic */
 
-/* insert an item, removes existing item of the same key (if applicable) */
-void item_insert(struct item *it, const struct bstring *key);
+/* insert an item, removes existing item of the same key (if applicable).
+ * ITEM_ENOMEM if the hash table is full, the item is released then.
+ */
+item_rstatus_e item_insert(struct item *it, const struct bstring *key);
 
 /* reserve an item, this does not link it or remove existing item with the same
  * key.
@@ -226,6 +237,13 @@ item_rstatus_e item_reserve(struct item **it_p, const struct bstring *key, const
 /* item_release is used for reserved item only (not linked) */
 void item_release(struct item **it_p);
 
+/* return false if an item for key should not be stored, as it would evict an
+ * item that is accessed more often, see slab_admit. Keys already stored are
+ * always admitted. Callers are expected to treat the write as done, and the
+ * item as evicted right away. This records the access of the set request.
+ */
+bool item_admit(const struct bstring *key, uint32_t vlen, uint8_t olen);
+
 void item_backfill(struct item *it, const struct bstring *val);
 
 /* Append/prepend */
@@ -238,8 +256,14 @@ void item_update(struct item *it, const struct bstring *val);
 /* Remove item from cache */
 bool item_delete(const struct bstring *key);
 
-/* Relink item */
-void item_relink(struct item *it);
+/* Relink item, ITEM_ENOMEM if the hash table is full */
+item_rstatus_e item_relink(struct item *it);
+
+/* Remove a linked item if it has expired or been flushed, returns true if so */
+bool item_expire(struct item *it);
+
+/* Remove a linked item that is not pinned to make room for another */
+void item_evict(struct item *it);
 
 /* flush the cache */
 void item_flush(void);
@@ -3,14 +3,20 @@
 #include "hashtable.h"
 #include "item.h"
 #include <datapool/datapool.h>
+#include <datapool/hugepage.h>
+#include <util/affinity.h>
+#include <util/util.h>
 #include <cc_mm.h>
 #include <cc_util.h>
+#include <time/cc_timer.h>
 
 #include <errno.h>
+#include <fcntl.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sysexits.h>
+#include <unistd.h>
 
 #define SLAB_MODULE_NAME        "storage::slab"
 #define SLAB_ALIGN_DOWN(d, n)   ((d) - ((d) % (n)))
@@ -30,8 +36,41 @@ struct slab_pool_metadata {
     struct slab *slab_lruq_head;/* lru slab q head */
 };
 
+/*
+ * With slab_hash_datapool set, the hash index is kept in its own data pool,
+ * after this record of everything else a restart would otherwise have to
+ * count from the items. The record is written by a clean teardown, and is
+ * only trusted if the slab heap was closed cleanly as well.
+ */
+#define SLAB_INDEX_MAGIC    0x32444e49534c4142ULL   /* "BALSIND2", hash 2 */
+#define SLAB_INDEX_HDR_SIZE CC_ALIGN(sizeof(struct slab_index_state), 4096)
+
+struct slab_index_state {
+    uint64_t        magic;          /* SLAB_INDEX_MAGIC if saved */
+    uint64_t        heap_addr;      /* heap address at teardown */
+    uint64_t        heap_size;
+    uint32_t        hash_power;
+    uint32_t        nhash_item;
+    uint32_t        last_id;        /* profile_last_id */
+    int64_t         item_curr;
+    int64_t         item_keyval_byte;
+    int64_t         item_val_byte;
+    struct {
+        uint64_t    size;           /* item size */
+        uint32_t    nfree_item;
+        uint32_t    nfree_itemq;
+        struct item *next_item_in_slab;
+        struct item *free_itemq;    /* head of the free q */
+        int64_t     item_curr;
+        int64_t     item_keyval_byte;
+        int64_t     item_val_byte;
+    } class[SLABCLASS_MAX_ID + 1];
+};
+
 static struct datapool *pool_slab;              /* data pool mapping for the slabs */
 static int pool_slab_state;                     /* data pool state */
+static struct datapool *pool_hash;              /* data pool for the hash index */
+static bool index_restore;                      /* hash index kept as it was */
 perslab_metrics_st perslab[SLABCLASS_MAX_ID];
 uint8_t profile_last_id; /* last id in slab profile */
 size_t slab_profile[SLABCLASS_MAX_ID + 1];        /* slab profile */
@@ -50,10 +89,83 @@ static double item_growth = ITEM_FACTOR;/* item size growth factor */
 static uint32_t hash_power = HASH_POWER;/* power (of 2) entries for hashtable */
 static char *slab_datapool = SLAB_DATAPOOL;   /* slab datapool path */
 static bool prefault = SLAB_PREFAULT;         /* slab datapool prefault option */
+static uint32_t prefault_nthread = SLAB_PREFAULT_NTHREAD; /* # prefault threads */
+static bool prefault_async = SLAB_PREFAULT_ASYNC; /* serve while prefaulting */
+static uint32_t recovery_nthread = SLAB_RECOVERY_NTHREAD; /* # recovery threads */
 static char *slab_datapool_name = SLAB_DATAPOOL_NAME;   /* slab datapool name */
+static char *hash_datapool = SLAB_HASH_DATAPOOL; /* hash index datapool path */
+static bool memfd = SLAB_MEMFD;               /* heap in a memfd */
+static int heap_fd = -1;                      /* memfd to set up heap from */
+static uint32_t expire_intvl = SLAB_EXPIRE_INTVL; /* expiry scan interval */
+static uint32_t expire_nitem = SLAB_EXPIRE_NITEM; /* chunks per expiry scan */
+
+/* position of the expiry scan, by index into heapinfo.slab_table */
+struct slab_expire_cursor {
+    uint32_t            slab;       /* slab being scanned */
+    uint32_t            item;       /* next item in slab */
+    uint64_t            nscan;      /* # chunks scanned in this pass */
+    proc_time_fine_i    pass_start; /* when this pass started (ms) */
+    proc_time_fine_i    last;       /* last scan (ms) */
+};
+static struct slab_expire_cursor expire;
+
+static uint32_t automove_intvl = SLAB_AUTOMOVE_INTVL; /* automove interval */
+static uint64_t admit_nkey = SLAB_ADMIT_NKEY;  /* # keys tracked for admission */
+static size_t hugepage = SLAB_HUGEPAGE;        /* huge page size, 0 for none */
+static struct affinity_list numa_nodes;        /* nodes of the heap, if any */
+
+/* the next slab move, made by _slab_get of class dst once the heap is full */
+struct slab_automove {
+    uint8_t         src;        /* class to take a slab from */
+    uint8_t         dst;        /* class to give the slab to */
+    proc_time_i     last;       /* last automove run (sec) */
+    uint64_t        nevict[SLABCLASS_MAX_ID + 1]; /* slab_evict_req then */
+};
+static struct slab_automove automove;
+
+/*
+ * A snapshot file is a header followed by one record per item, each followed
+ * by the optional data, key and value of the item, and a record with klen 0.
+ * It is written to a temporary file that replaces the snapshot once complete.
+ */
+#define SNAPSHOT_MAGIC      0x50414e53534c4142ULL   /* "BALSSNAP" */
+#define SNAPSHOT_VERSION    1
+#define SNAPSHOT_BUF_SIZE   MiB
+#define SNAPSHOT_TMP_SUFFIX ".tmp"
+
+struct slab_snapshot_hdr {
+    uint64_t        magic;
+    uint32_t        version;
+    uint32_t        unused;
+};
+
+struct slab_snapshot_rec {
+    int64_t         expire_at;  /* unix time */
+    uint32_t        vlen;
+    uint8_t         klen;       /* 0: end of snapshot */
+    uint8_t         olen;
+    uint16_t        unused;
+};
+
+struct slab_snapshot {
+    int             fd;         /* temporary file, -1 if not writing */
+    char            *tmp;       /* path of the temporary file */
+    uint8_t         *buf;
+    size_t          len;        /* # bytes in buf */
+    size_t          cap;
+    uint32_t        slab;       /* position by index into slab_table */
+    uint32_t        item;
+    uint64_t        nitem;      /* # items written */
+    bool            requested;  /* set by slab_snapshot_request */
+};
+
+static char *snapshot_path = SLAB_SNAPSHOT;    /* snapshot file, if any */
+static uint32_t snapshot_nitem = SLAB_SNAPSHOT_NITEM; /* chunks per tick */
+static struct slab_snapshot snapshot = { .fd = -1 };
 
 bool use_cas = SLAB_USE_CAS;
 struct hash_table *hash_table = NULL;
+struct admit *admit_filter = NULL;
 uint64_t cas_id;
 
 delta_time_i max_ttl = ITEM_MAX_TTL;
@@ -174,42 +286,6 @@ _slab_check_no_refcount(struct slab *slab)
     return (slab->refcount == 0);
 }
 
-/*
- * Recreate items
- */
-static void
-_slab_recreate_items(struct slab *slab)
-{
-    struct slabclass *p;
-    struct item *it;
-    uint32_t i;
-
-    p = &slabclass[slab->id];
-    p->nfree_item = p->nitem;
-    for (i = 0; i < p->nitem; i++) {
-        it = _slab_to_item(slab, i, p->size);
-        if (it->is_linked) {
-            p->next_item_in_slab = (struct item *)&slab->data[0];
-            INCR(slab_metrics, item_curr);
-            INCR(slab_metrics, item_alloc);
-            PERSLAB_INCR(slab->id, item_curr);
-            item_relink(it);
-            if (--p->nfree_item != 0) {
-                p->next_item_in_slab = (struct item *)((char *)p->next_item_in_slab + p->size);
-            } else {
-                p->next_item_in_slab = NULL;
-            }
-        } else if (it->in_freeq) {
-            _slab_put_item_into_freeq(it, slab->id);
-        } else if (it->klen && !_slab_check_no_refcount(slab)) {
-           /* before reset, item could be only reserved
-            * ensure that slab has a reserved item(s)
-            */
-           item_release(&it);
-        }
-    }
-}
-
 static void
 _slab_table_update(struct slab *slab)
 {
@@ -243,11 +319,9 @@ _slab_lruq_rebuild(const uint8_t *heap_start)
     }
 }
 
-/*
- * Recreate slabs structure when persistent memory features are enabled (USE_PMEM)
- */
+/* put the slabs of the heap into the slab table and lruq, in heap order */
 static void
-_slab_recovery(void)
+_slab_table_rebuild(void)
 {
     uint32_t i;
     uint8_t *heap_start = heapinfo.curr;
@@ -261,13 +335,391 @@ _slab_recovery(void)
             INCR(slab_metrics, slab_curr);
             PERSLAB_INCR(slab->id, slab_curr);
             INCR_N(slab_metrics, slab_memory, slab_size);
-            _slab_recreate_items(slab);
             heapinfo.curr += slab_size;
         }
         heap_start += slab_size;
     }
 }
 
+struct slab_recovery_arg {
+    uint32_t        first;      /* slabs [first, last) of the slab table */
+    uint32_t        last;
+    uint32_t        *nused;     /* # leading items in use, per slab */
+    struct item_slh *linked;    /* items to put into the hash table */
+    struct item_slh freeq;      /* items to put back into the free q */
+    uint32_t        nlinked;
+    struct {
+        uint32_t    nitem;
+        uint64_t    keyval_byte;
+        uint64_t    val_byte;
+    } perslab[SLABCLASS_MAX_ID + 1];
+};
+
+/*
+ * Sort the items of a range of slabs by what is left to do for them, without
+ * touching any shared state, so ranges can be recovered in parallel.
+ */
+static void *
+_slab_recover_items(void *arg)
+{
+    struct slab_recovery_arg *ra = arg;
+    struct slabclass *p;
+    struct slab *slab;
+    struct item *it;
+    uint32_t i, j, nref;
+
+    for (i = ra->first; i < ra->last; i++) {
+        slab = heapinfo.slab_table[i];
+        p = &slabclass[slab->id];
+        nref = slab->refcount;
+        slab->refcount = 0; /* reservations and pins do not survive either */
+        ra->nused[i] = 0;
+        for (j = 0; j < p->nitem; j++) {
+            it = _slab_to_item(slab, j, p->size);
+            it->refcount = 0; /* pins do not survive a restart */
+            if (it->is_linked) {
+                SLIST_INSERT_HEAD(ra->linked, it, i_sle);
+                ra->nlinked++;
+                ra->perslab[slab->id].nitem++;
+                ra->perslab[slab->id].keyval_byte += it->klen + it->vlen;
+                ra->perslab[slab->id].val_byte += it->vlen;
+            } else if (it->in_freeq) {
+                SLIST_INSERT_HEAD(&ra->freeq, it, i_sle);
+            } else if (it->klen && nref > 0) {
+                /* before reset, item could be only reserved, or deleted
+                 * while pinned; ensure that slab had such item(s)
+                 */
+                SLIST_INSERT_HEAD(&ra->freeq, it, i_sle);
+                nref--;
+            } else if (!it->klen) {
+                continue; /* never handed out since the slab was initialized */
+            }
+            ra->nused[i] = j + 1;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Recreate slabs structure when persistent memory features are enabled (USE_PMEM)
+ *
+ * Slabs are found and put into the slab table in heap order, then their items
+ * are scanned by up to recovery_nthread threads, each taking a contiguous
+ * range of slabs. Linked items are put into the hash table from as many
+ * threads, the rest (free q, metrics) is cheap and done here.
+ */
+static rstatus_i
+_slab_recovery(void)
+{
+    struct slab_recovery_arg *ra;
+    struct item_slh *linked;
+    struct duration d;
+    struct slabclass *p;
+    struct item *it;
+    uint32_t *nused;
+    uint32_t i, id, nthread = recovery_nthread, nlinked = 0;
+
+    duration_start(&d);
+
+    _slab_table_rebuild();
+    if (heapinfo.nslab == 0) {
+        return CC_OK;
+    }
+
+    if (nthread == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthread = ncpu > 0 ? (uint32_t)ncpu : 1;
+    }
+    nthread = MIN(nthread, heapinfo.nslab);
+
+    ra = cc_alloc(sizeof(*ra) * nthread);
+    linked = cc_alloc(sizeof(*linked) * nthread);
+    nused = cc_alloc(sizeof(*nused) * heapinfo.nslab);
+    if (ra == NULL || linked == NULL || nused == NULL) {
+        log_error("alloc of recovery state for %"PRIu32" slabs failed",
+                heapinfo.nslab);
+        cc_free(ra);
+        cc_free(linked);
+        cc_free(nused);
+        return CC_ENOMEM;
+    }
+
+    for (i = 0; i < nthread; i++) {
+        cc_memset(&ra[i], 0, sizeof(ra[i]));
+        ra[i].first = (uint32_t)((uint64_t)heapinfo.nslab * i / nthread);
+        ra[i].last = (uint32_t)((uint64_t)heapinfo.nslab * (i + 1) / nthread);
+        ra[i].nused = nused;
+        ra[i].linked = &linked[i];
+        SLIST_INIT(&linked[i]);
+        SLIST_INIT(&ra[i].freeq);
+    }
+    run_parallel(_slab_recover_items, ra, sizeof(*ra), nthread);
+
+    /* the last slab of a class that is not fully carved is its current one */
+    for (i = 0; i < heapinfo.nslab; i++) {
+        p = &slabclass[heapinfo.slab_table[i]->id];
+        if (nused[i] < p->nitem) {
+            p->nfree_item = p->nitem - nused[i];
+            p->next_item_in_slab = _slab_to_item(heapinfo.slab_table[i],
+                    nused[i], p->size);
+        }
+    }
+
+    for (i = 0; i < nthread; i++) {
+        nlinked += ra[i].nlinked;
+        for (id = SLABCLASS_MIN_ID; id <= profile_last_id; id++) {
+            INCR_N(slab_metrics, item_keyval_byte,
+                    ra[i].perslab[id].keyval_byte);
+            INCR_N(slab_metrics, item_val_byte, ra[i].perslab[id].val_byte);
+            PERSLAB_INCR_N(id, item_curr, ra[i].perslab[id].nitem);
+            PERSLAB_INCR_N(id, item_keyval_byte, ra[i].perslab[id].keyval_byte);
+            PERSLAB_INCR_N(id, item_val_byte, ra[i].perslab[id].val_byte);
+        }
+    }
+    INCR_N(slab_metrics, item_curr, nlinked);
+    INCR_N(slab_metrics, item_alloc, nlinked);
+    INCR_N(slab_metrics, item_linked_curr, nlinked);
+    INCR_N(slab_metrics, item_link, nlinked);
+    hashtable_put_all(linked, nthread, nlinked, hash_table, nthread);
+
+    for (i = 0; i < nthread; i++) {
+        while ((it = SLIST_FIRST(&ra[i].freeq)) != NULL) {
+            SLIST_REMOVE_HEAD(&ra[i].freeq, i_sle);
+            _slab_put_item_into_freeq(it, it->id);
+        }
+    }
+
+    cc_free(ra);
+    cc_free(linked);
+    cc_free(nused);
+
+    duration_stop(&d);
+    log_info("recovered %"PRIu32" slabs with %"PRIu32" linked items in %.3f ms "
+            "with %"PRIu32" thread(s)", heapinfo.nslab, nlinked,
+            duration_ms(&d), nthread);
+
+    return CC_OK;
+}
+
+/*
+ * Clear the pins and reservations of a slab, none of which have an owner after
+ * a restart, and free the items that were reserved, or deleted while pinned.
+ * Only the items carved from the slab so far are looked at.
+ */
+static void
+_slab_release_reserved(struct slab *slab)
+{
+    struct slabclass *p = &slabclass[slab->id];
+    struct item *it;
+    uint32_t i, nitem = p->nitem;
+
+    if (p->next_item_in_slab != NULL &&
+            item_to_slab(p->next_item_in_slab) == slab) {
+        nitem -= p->nfree_item;
+    }
+
+    slab->refcount = 0;
+    for (i = 0; i < nitem; i++) {
+        it = _slab_to_item(slab, i, p->size);
+        it->refcount = 0;
+        if (it->klen && !it->is_linked && !it->in_freeq) {
+            DECR(slab_metrics, item_curr);
+            INCR(slab_metrics, item_dealloc);
+            PERSLAB_DECR(slab->id, item_curr);
+            _slab_put_item_into_freeq(it, slab->id);
+        }
+    }
+}
+
+/*
+ * Restart from a hash index kept in its data pool: only the slab headers are
+ * read, the slabclasses and metrics are as they were saved at teardown. Free
+ * q links are pointers and are moved along with the heap, if it moved.
+ */
+static rstatus_i
+_slab_restore(void)
+{
+    struct slab_index_state *state = datapool_addr(pool_hash);
+    ptrdiff_t delta = heapinfo.base - (uint8_t *)(uintptr_t)state->heap_addr;
+    struct slabclass *p;
+    struct item *it;
+    struct duration d;
+    uint32_t i, id;
+
+    duration_start(&d);
+
+    _slab_table_rebuild();
+
+    for (id = SLABCLASS_MIN_ID; id <= profile_last_id; id++) {
+        p = &slabclass[id];
+        p->nfree_item = state->class[id].nfree_item;
+        p->next_item_in_slab = state->class[id].next_item_in_slab;
+        if (p->next_item_in_slab != NULL) {
+            p->next_item_in_slab = (void *)((uint8_t *)p->next_item_in_slab +
+                    delta);
+        }
+        p->nfree_itemq = state->class[id].nfree_itemq;
+        SLIST_FIRST(&p->free_itemq) = state->class[id].free_itemq;
+        if (SLIST_FIRST(&p->free_itemq) != NULL) {
+            SLIST_FIRST(&p->free_itemq) = (void *)
+                ((uint8_t *)SLIST_FIRST(&p->free_itemq) + delta);
+        }
+        if (delta != 0) {
+            SLIST_FOREACH(it, &p->free_itemq, i_sle) {
+                if (SLIST_NEXT(it, i_sle) != NULL) {
+                    SLIST_NEXT(it, i_sle) = (void *)
+                        ((uint8_t *)SLIST_NEXT(it, i_sle) + delta);
+                }
+            }
+        }
+
+        UPDATE_VAL(&perslab[id], item_curr, state->class[id].item_curr);
+        UPDATE_VAL(&perslab[id], item_free, p->nfree_itemq);
+        UPDATE_VAL(&perslab[id], item_keyval_byte,
+                state->class[id].item_keyval_byte);
+        UPDATE_VAL(&perslab[id], item_val_byte, state->class[id].item_val_byte);
+    }
+    UPDATE_VAL(slab_metrics, item_curr, state->item_curr);
+    UPDATE_VAL(slab_metrics, item_alloc, state->nhash_item);
+    UPDATE_VAL(slab_metrics, item_linked_curr, state->nhash_item);
+    UPDATE_VAL(slab_metrics, item_link, state->nhash_item);
+    UPDATE_VAL(slab_metrics, item_keyval_byte, state->item_keyval_byte);
+    UPDATE_VAL(slab_metrics, item_val_byte, state->item_val_byte);
+
+    for (i = 0; i < heapinfo.nslab; i++) {
+        _slab_release_reserved(heapinfo.slab_table[i]);
+    }
+
+    duration_stop(&d);
+    log_info("restored %"PRIu32" slabs with %"PRIu32" linked items in %.3f ms",
+            heapinfo.nslab, state->nhash_item, duration_ms(&d));
+
+    return CC_OK;
+}
+
+/* can the index kept in the data pool be used with this heap and profile? */
+static bool
+_slab_index_valid(const struct slab_index_state *state)
+{
+    uint8_t id;
+
+    if (state->magic != SLAB_INDEX_MAGIC) {
+        log_info("hash index was not saved at the last teardown");
+        return false;
+    }
+
+    if (state->heap_size != (uint64_t)heapinfo.max_nslab * slab_size ||
+            state->hash_power != hash_power ||
+            state->last_id != profile_last_id) {
+        log_info("hash index was saved for a different heap");
+        return false;
+    }
+
+    for (id = SLABCLASS_MIN_ID; id <= profile_last_id; id++) {
+        if (state->class[id].size != slab_profile[id]) {
+            log_info("hash index was saved for a different slab profile");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* record what _slab_restore needs, if all items are in the kept index */
+static void
+_slab_index_save(void)
+{
+    struct slab_index_state *state = datapool_addr(pool_hash);
+    struct slabclass *p;
+    uint8_t id;
+
+    if (!hashtable_attached(hash_table)) {
+        log_info("hash index is not saved, it is rebuilt on the next restart");
+        return;
+    }
+
+    state->heap_addr = (uint64_t)(uintptr_t)heapinfo.base;
+    state->heap_size = (uint64_t)heapinfo.max_nslab * slab_size;
+    state->hash_power = hash_power;
+    state->nhash_item = hash_table->nhash_item;
+    state->last_id = profile_last_id;
+    state->item_curr = slab_metrics == NULL ? 0 : slab_metrics->item_curr.gauge;
+    state->item_keyval_byte = slab_metrics == NULL ? 0 :
+        slab_metrics->item_keyval_byte.gauge;
+    state->item_val_byte = slab_metrics == NULL ? 0 :
+        slab_metrics->item_val_byte.gauge;
+    for (id = SLABCLASS_MIN_ID; id <= profile_last_id; id++) {
+        p = &slabclass[id];
+        state->class[id].size = p->size;
+        state->class[id].nfree_item = p->nfree_item;
+        state->class[id].nfree_itemq = p->nfree_itemq;
+        state->class[id].next_item_in_slab = p->next_item_in_slab;
+        state->class[id].free_itemq = SLIST_FIRST(&p->free_itemq);
+        state->class[id].item_curr = perslab[id].item_curr.gauge;
+        state->class[id].item_keyval_byte = perslab[id].item_keyval_byte.gauge;
+        state->class[id].item_val_byte = perslab[id].item_val_byte.gauge;
+    }
+    state->magic = SLAB_INDEX_MAGIC;
+
+    log_info("hash index with %"PRIu32" items saved", state->nhash_item);
+}
+
+/*
+ * Create the hash index, in DRAM or, with slab_hash_datapool, in its own data
+ * pool. The index in the pool is kept as it was if both pools were closed
+ * cleanly, otherwise it is cleared and rebuilt from the items.
+ */
+static rstatus_i
+_slab_hash_setup(void)
+{
+    struct slab_index_state *state;
+    int fresh = 1;
+
+    index_restore = false;
+    if (hash_datapool == NULL) {
+        hash_table = hashtable_create(hash_power, hugepage, heapinfo.base);
+        return hash_table == NULL ? CC_ENOMEM : CC_OK;
+    }
+
+    if (slab_datapool == NULL) {
+        log_error("hash index can only be kept in a data pool along with the "
+                "slab heap");
+        return CC_EINVAL;
+    }
+
+    pool_hash = datapool_open(hash_datapool, SLAB_HASH_DATAPOOL_NAME,
+            SLAB_INDEX_HDR_SIZE + hashtable_size(hash_power), &fresh, false,
+            HUGEPAGE_NONE);
+    if (pool_hash == NULL) {
+        log_error("Could not create pool_hash");
+        return CC_ERROR;
+    }
+    UPDATE_VAL(slab_metrics, hash_page, datapool_page_size(pool_hash));
+
+    state = datapool_addr(pool_hash);
+    index_restore = !fresh && pool_slab_state == 0 && _slab_index_valid(state);
+    hash_table = hashtable_attach((uint8_t *)state + SLAB_INDEX_HDR_SIZE,
+            hash_power, index_restore ? state->nhash_item : 0, heapinfo.base);
+    state->magic = 0; /* saved again by a clean teardown */
+
+    return hash_table == NULL ? CC_ENOMEM : CC_OK;
+}
+
+static void
+_slab_hash_teardown(void)
+{
+    if (pool_hash != NULL && hash_table != NULL) {
+        _slab_index_save();
+    }
+    hashtable_destroy(hash_table);
+    hash_table = NULL;
+    if (pool_hash != NULL) {
+        datapool_close(pool_hash);
+        pool_hash = NULL;
+    }
+}
+
 /*
  * Initialize all slabclasses.
  *
@@ -310,10 +762,13 @@ _slab_slabclass_setup(void)
 
         p->nfree_item = 0;
         p->next_item_in_slab = NULL;
+
+        p->clock_slab = 0;
+        p->clock_item = 0;
     }
 
     if (pool_slab_state == 0) {
-        _slab_recovery();
+        return index_restore ? _slab_restore() : _slab_recovery();
     }
 
     return CC_OK;
@@ -324,6 +779,13 @@ _slab_slabclass_teardown(void)
 {
 }
 
+/* called by the last prefault thread, which may run in the background */
+static void
+_slab_prefault_done(uint64_t ms)
+{
+    UPDATE_VAL(slab_metrics, heap_prefault_ms, ms);
+}
+
 /*
  * Initialize slab heap related info
  *
@@ -335,13 +797,30 @@ _slab_slabclass_teardown(void)
 static rstatus_i
 _slab_heapinfo_setup(void)
 {
+    size_t page;
+
     heapinfo.nslab = 0;
     heapinfo.max_nslab = slab_mem / slab_size;
 
     heapinfo.base = NULL;
-    if (prealloc) {
+    if (prealloc && (memfd || heap_fd >= 0)) {
+        if (slab_datapool != NULL) {
+            log_error("slab heap can be in a memfd or a data pool, not both");
+            return CC_EINVAL;
+        }
+        if (hugepage != HUGEPAGE_NONE) {
+            log_warn("slab heap in a memfd is not on huge pages");
+        }
+        pool_slab = datapool_open_fd(heap_fd, slab_datapool_name,
+                 heapinfo.max_nslab * slab_size, &pool_slab_state, false);
+        heap_fd = -1;
+    } else if (prealloc) {
         pool_slab = datapool_open(slab_datapool, slab_datapool_name,
-                 heapinfo.max_nslab * slab_size, &pool_slab_state, prefault);
+                 heapinfo.max_nslab * slab_size, &pool_slab_state, false,
+                 hugepage);
+    }
+    if (prealloc) {
+        /* prefaulted below, once the memory policy (if any) is set */
         if (pool_slab == NULL) {
             log_crit("Could not create pool_slab");
             exit(EX_CONFIG);
@@ -354,11 +833,40 @@ _slab_heapinfo_setup(void)
             return CC_ENOMEM;
         }
 
-        log_info("pre-allocated %zu bytes for %"PRIu32" slabs",
-                  slab_mem, heapinfo.max_nslab);
+        page = datapool_page_size(pool_slab);
+        UPDATE_VAL(slab_metrics, heap_page, page);
+
+        if (numa_nodes.n > 0 && slab_datapool != NULL) {
+            log_warn("NUMA nodes are ignored for a file-backed data pool");
+        }
+        if (numa_nodes.n > 0 && slab_datapool == NULL) {
+            if (affinity_mbind(heapinfo.base, heapinfo.max_nslab * slab_size,
+                    &numa_nodes) != CC_OK) {
+                log_warn("slab heap placed by the default memory policy");
+            }
+            if (prefault && affinity_prefault(heapinfo.base,
+                    heapinfo.max_nslab * slab_size, page, &numa_nodes)
+                    != CC_OK) {
+                log_warn("prefaulting slab heap by node failed");
+            }
+        } else if (prefault && datapool_prefault(pool_slab, prefault_nthread,
+                prefault_async, _slab_prefault_done) != CC_OK) {
+            log_warn("prefaulting slab heap failed");
+        } else if (prefault && prefault_async) {
+            log_info("slab heap is prefaulted in the background");
+        }
+
+        log_info("pre-allocated %zu bytes for %"PRIu32" slabs on %zu pages of "
+                  "%zu bytes", slab_mem, heapinfo.max_nslab,
+                  heapinfo.max_nslab * slab_size / page, page);
     } else if (slab_datapool) {
         log_error("PMEM is supported only for prealloc option");
         return CC_EINVAL;
+    } else if (memfd || heap_fd >= 0) {
+        log_error("slab heap is only kept in a memfd with prealloc option");
+        return CC_EINVAL;
+    } else if (hugepage != HUGEPAGE_NONE) {
+        log_warn("slabs allocated on demand are not on huge pages");
     }
     heapinfo.curr = heapinfo.base;
 
@@ -388,6 +896,7 @@ _slab_heapinfo_teardown(void)
 
         datapool_set_user_data(pool_slab, &pool_metadata, sizeof(struct slab_pool_metadata));
         datapool_close(pool_slab);
+        pool_slab = NULL;
     }
 }
 
@@ -544,62 +1053,434 @@ _slab_profile_setup(char *profile_str)
     return CC_OK;
 }
 
-void
-slab_teardown(void)
+static void
+_slab_snapshot_close(void)
 {
-    log_info("tear down the %s module", SLAB_MODULE_NAME);
+    if (snapshot.fd >= 0) {
+        close(snapshot.fd);
+        snapshot.fd = -1;
+    }
+    cc_free(snapshot.tmp);
+    cc_free(snapshot.buf);
+    snapshot.tmp = NULL;
+    snapshot.buf = NULL;
+}
 
-    if (!slab_init) {
-        log_warn("%s has never been set up", SLAB_MODULE_NAME);
+static void
+_slab_snapshot_abort(void)
+{
+    if (snapshot.fd >= 0) {
+        unlink(snapshot.tmp);
     }
+    _slab_snapshot_close();
+    INCR(slab_metrics, snapshot_ex);
+}
 
-    hashtable_destroy(hash_table);
-    _slab_heapinfo_teardown();
-    _slab_slabclass_teardown();
-    slab_metrics = NULL;
+static rstatus_i
+_slab_snapshot_flush(void)
+{
+    size_t off = 0;
+    ssize_t n;
 
-    slab_init = false;
+    while (off < snapshot.len) {
+        n = write(snapshot.fd, snapshot.buf + off, snapshot.len - off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            log_error("writing snapshot %s failed: %s", snapshot.tmp,
+                    strerror(errno));
+            return CC_ERROR;
+        }
+        off += n;
+    }
+    snapshot.len = 0;
+
+    return CC_OK;
 }
 
-void
-slab_setup(slab_options_st *options, slab_metrics_st *metrics)
+static void
+_slab_snapshot_append(const void *data, size_t len)
 {
-    char *profile_str = SLAB_PROFILE;
+    ASSERT(snapshot.len + len <= snapshot.cap);
 
-    log_info("set up the %s module", SLAB_MODULE_NAME);
+    cc_memcpy(snapshot.buf + snapshot.len, data, len);
+    snapshot.len += len;
+}
 
-    if (slab_init) {
-        log_warn("%s has already been set up, re-creating", SLAB_MODULE_NAME);
-        slab_teardown();
+static rstatus_i
+_slab_snapshot_start(void)
+{
+    struct slab_snapshot_hdr hdr = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION, 0 };
+    size_t len = strlen(snapshot_path);
+
+    ASSERT(snapshot.fd < 0);
+
+    snapshot.cap = MAX(SNAPSHOT_BUF_SIZE, slab_size);
+    snapshot.buf = cc_alloc(snapshot.cap);
+    snapshot.tmp = cc_alloc(len + sizeof(SNAPSHOT_TMP_SUFFIX));
+    if (snapshot.buf == NULL || snapshot.tmp == NULL) {
+        log_error("no memory to write snapshot %s", snapshot_path);
+        _slab_snapshot_abort();
+        return CC_ENOMEM;
+    }
+    cc_memcpy(snapshot.tmp, snapshot_path, len);
+    cc_memcpy(snapshot.tmp + len, SNAPSHOT_TMP_SUFFIX,
+            sizeof(SNAPSHOT_TMP_SUFFIX));
+
+    snapshot.fd = open(snapshot.tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (snapshot.fd < 0) {
+        log_error("opening snapshot %s failed: %s", snapshot.tmp,
+                strerror(errno));
+        _slab_snapshot_abort();
+        return CC_ERROR;
     }
 
-    log_verb("Slab header size: %d, item header size: %d", SLAB_HDR_SIZE,
-            ITEM_HDR_SIZE);
+    snapshot.len = 0;
+    snapshot.slab = 0;
+    snapshot.item = 0;
+    snapshot.nitem = 0;
+    _slab_snapshot_append(&hdr, sizeof(hdr));
 
-    slab_metrics = metrics;
+    log_info("writing snapshot of %"PRIu32" slabs to %s", heapinfo.nslab,
+            snapshot_path);
 
-    if (options != NULL) {
-        slab_size = option_uint(&options->slab_size);
-        slab_mem = option_uint(&options->slab_mem);
-        prealloc = option_bool(&options->slab_prealloc);
-        evict_opt = option_uint(&options->slab_evict_opt);
-        use_freeq = option_bool(&options->slab_use_freeq);
-        profile_str = option_str(&options->slab_profile);
-        item_min = option_uint(&options->slab_item_min);
-        item_max = option_uint(&options->slab_item_max);
-        item_growth = option_fpn(&options->slab_item_growth);
-        max_ttl = option_uint(&options->slab_item_max_ttl);
-        use_cas = option_bool(&options->slab_use_cas);
-        hash_power = option_uint(&options->slab_hash_power);
-        slab_datapool = option_str(&options->slab_datapool);
-        slab_datapool_name = option_str(&options->slab_datapool_name);
-        prefault = option_bool(&options->slab_datapool_prefault);
+    return CC_OK;
+}
+
+static rstatus_i
+_slab_snapshot_finish(void)
+{
+    struct slab_snapshot_rec end = { 0 };
+
+    if (snapshot.len + sizeof(end) > snapshot.cap &&
+            _slab_snapshot_flush() != CC_OK) {
+        return CC_ERROR;
+    }
+    _slab_snapshot_append(&end, sizeof(end));
+    if (_slab_snapshot_flush() != CC_OK) {
+        return CC_ERROR;
     }
 
-    hash_table = hashtable_create(hash_power);
-    if (hash_table == NULL) {
-        log_crit("Could not create hash table");
-        goto error;
+    if (rename(snapshot.tmp, snapshot_path) < 0) {
+        log_error("renaming snapshot %s failed: %s", snapshot.tmp,
+                strerror(errno));
+        return CC_ERROR;
+    }
+
+    log_info("wrote %"PRIu64" items to snapshot %s", snapshot.nitem,
+            snapshot_path);
+    INCR(slab_metrics, snapshot_write);
+    _slab_snapshot_close();
+
+    return CC_OK;
+}
+
+/* save the next nitem chunks with at most one write, and finish the snapshot
+ * at the end of the heap; the snapshot is aborted on error
+ */
+static rstatus_i
+_slab_snapshot_step(uint32_t nitem)
+{
+    struct slab_snapshot_rec rec = { 0 };
+    struct slab *slab;
+    struct slabclass *p;
+    struct item *it;
+    uint32_t nscan = 0;
+    uint64_t nsave = 0;
+    bool flushed = false;
+    size_t len;
+
+    while (nscan < nitem) {
+        if (snapshot.slab >= heapinfo.nslab) {
+            if (_slab_snapshot_finish() != CC_OK) {
+                goto error;
+            }
+            break;
+        }
+
+        slab = heapinfo.slab_table[snapshot.slab];
+        p = &slabclass[slab->id];
+        if (snapshot.item >= p->nitem) {
+            snapshot.slab++;
+            snapshot.item = 0;
+            continue;
+        }
+
+        it = _slab_to_item(slab, snapshot.item, p->size);
+        nscan++;
+        if (!it->is_linked || item_expire(it)) {
+            snapshot.item++;
+            continue;
+        }
+
+        len = sizeof(rec) + it->olen + it->klen + it->vlen;
+        if (snapshot.len + len > snapshot.cap) {
+            if (flushed) {
+                break; /* continue from this item next time */
+            }
+            if (_slab_snapshot_flush() != CC_OK) {
+                goto error;
+            }
+            flushed = true;
+        }
+
+        rec.expire_at = (int64_t)time_started() + it->expire_at;
+        rec.vlen = it->vlen;
+        rec.klen = it->klen;
+        rec.olen = it->olen;
+        _slab_snapshot_append(&rec, sizeof(rec));
+        _slab_snapshot_append(item_optional(it), it->olen);
+        _slab_snapshot_append(item_key(it), it->klen);
+        _slab_snapshot_append(item_data(it), it->vlen);
+        snapshot.item++;
+        snapshot.nitem++;
+        nsave++;
+    }
+
+    INCR_N(slab_metrics, snapshot_item, nsave);
+
+    return CC_OK;
+
+error:
+    INCR_N(slab_metrics, snapshot_item, nsave);
+    _slab_snapshot_abort();
+
+    return CC_ERROR;
+}
+
+/* make sure at least need bytes are buffered from pos on, false at EOF */
+static bool
+_slab_snapshot_fill(int fd, uint8_t *buf, size_t cap, size_t *pos, size_t *end,
+        size_t need)
+{
+    ssize_t n;
+
+    if (*end - *pos >= need) {
+        return true;
+    }
+
+    cc_memmove(buf, buf + *pos, *end - *pos);
+    *end -= *pos;
+    *pos = 0;
+    while (*end < need) {
+        n = read(fd, buf + *end, cap - *end);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        *end += n;
+    }
+
+    return true;
+}
+
+static void
+_slab_snapshot_load(void)
+{
+    struct slab_snapshot_hdr hdr;
+    struct slab_snapshot_rec rec;
+    struct bstring key, val;
+    struct item *it;
+    uint8_t *buf, *data;
+    size_t cap = MAX(SNAPSHOT_BUF_SIZE, slab_size), pos = 0, end = 0;
+    uint64_t nload = 0, nskip = 0;
+    int64_t expire_at;
+    bool complete = false;
+    int fd;
+
+    fd = open(snapshot_path, O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            log_info("no snapshot %s to load", snapshot_path);
+        } else {
+            log_warn("opening snapshot %s failed: %s", snapshot_path,
+                    strerror(errno));
+        }
+        return;
+    }
+
+    buf = cc_alloc(cap);
+    if (buf == NULL) {
+        log_warn("no memory to load snapshot %s", snapshot_path);
+        close(fd);
+        return;
+    }
+
+    if (!_slab_snapshot_fill(fd, buf, cap, &pos, &end, sizeof(hdr))) {
+        goto done;
+    }
+    cc_memcpy(&hdr, buf, sizeof(hdr));
+    pos += sizeof(hdr);
+    if (hdr.magic != SNAPSHOT_MAGIC || hdr.version != SNAPSHOT_VERSION) {
+        log_warn("%s is not a snapshot of version %d", snapshot_path,
+                SNAPSHOT_VERSION);
+        goto done;
+    }
+
+    while (_slab_snapshot_fill(fd, buf, cap, &pos, &end, sizeof(rec))) {
+        cc_memcpy(&rec, buf + pos, sizeof(rec));
+        if (rec.klen == 0) {
+            complete = true;
+            break;
+        }
+        if (sizeof(rec) + rec.olen + rec.klen + rec.vlen > cap ||
+                !_slab_snapshot_fill(fd, buf, cap, &pos, &end,
+                sizeof(rec) + rec.olen + rec.klen + rec.vlen)) {
+            break;
+        }
+
+        data = buf + pos + sizeof(rec);
+        pos += sizeof(rec) + rec.olen + rec.klen + rec.vlen;
+
+        expire_at = rec.expire_at - (int64_t)time_started();
+        if (expire_at < time_proc_sec()) {
+            nskip++;
+            continue;
+        }
+
+        key.len = rec.klen;
+        key.data = (char *)data + rec.olen;
+        val.len = rec.vlen;
+        val.data = (char *)data + rec.olen + rec.klen;
+        if (item_reserve(&it, &key, &val, val.len, rec.olen,
+                (proc_time_i)MIN(expire_at, INT32_MAX)) != ITEM_OK) {
+            nskip++;
+            continue;
+        }
+        cc_memcpy(item_optional(it), data, rec.olen);
+        if (item_insert(it, &key) != ITEM_OK) {
+            nskip++;
+            continue;
+        }
+        nload++;
+    }
+
+    if (!complete) {
+        log_warn("snapshot %s ends early", snapshot_path);
+    }
+
+done:
+    log_info("loaded %"PRIu64" items from snapshot %s, skipped %"PRIu64,
+            nload, snapshot_path, nskip);
+    INCR_N(slab_metrics, snapshot_load, nload);
+
+    cc_free(buf);
+    close(fd);
+}
+
+static void
+_slab_snapshot_teardown(void)
+{
+    if (snapshot.fd >= 0) {
+        /* a partial snapshot is superseded by the complete one below */
+        _slab_snapshot_abort();
+    }
+    snapshot.requested = false;
+
+    if (!slab_init || snapshot_path == NULL) {
+        return;
+    }
+
+    if (_slab_snapshot_start() != CC_OK) {
+        return;
+    }
+    while (snapshot.fd >= 0 && _slab_snapshot_step(UINT32_MAX) == CC_OK);
+}
+
+void
+slab_teardown(void)
+{
+    log_info("tear down the %s module", SLAB_MODULE_NAME);
+
+    if (!slab_init) {
+        log_warn("%s has never been set up", SLAB_MODULE_NAME);
+    }
+
+    _slab_snapshot_teardown();
+    _slab_hash_teardown();
+    admit_destroy(admit_filter);
+    admit_filter = NULL;
+    _slab_heapinfo_teardown();
+    _slab_slabclass_teardown();
+    slab_metrics = NULL;
+
+    slab_init = false;
+}
+
+void
+slab_setup(slab_options_st *options, slab_metrics_st *metrics)
+{
+    char *profile_str = SLAB_PROFILE;
+
+    log_info("set up the %s module", SLAB_MODULE_NAME);
+
+    if (slab_init) {
+        log_warn("%s has already been set up, re-creating", SLAB_MODULE_NAME);
+        slab_teardown();
+    }
+
+    log_verb("Slab header size: %d, item header size: %d", SLAB_HDR_SIZE,
+            ITEM_HDR_SIZE);
+
+    slab_metrics = metrics;
+
+    numa_nodes.n = 0;
+    if (options != NULL) {
+        slab_size = option_uint(&options->slab_size);
+        slab_mem = option_uint(&options->slab_mem);
+        prealloc = option_bool(&options->slab_prealloc);
+        evict_opt = option_uint(&options->slab_evict_opt);
+        use_freeq = option_bool(&options->slab_use_freeq);
+        profile_str = option_str(&options->slab_profile);
+        item_min = option_uint(&options->slab_item_min);
+        item_max = option_uint(&options->slab_item_max);
+        item_growth = option_fpn(&options->slab_item_growth);
+        max_ttl = option_uint(&options->slab_item_max_ttl);
+        use_cas = option_bool(&options->slab_use_cas);
+        hash_power = option_uint(&options->slab_hash_power);
+        slab_datapool = option_str(&options->slab_datapool);
+        slab_datapool_name = option_str(&options->slab_datapool_name);
+        hash_datapool = option_str(&options->slab_hash_datapool);
+        prefault = option_bool(&options->slab_datapool_prefault);
+        prefault_nthread = option_uint(&options->slab_prefault_nthread);
+        prefault_async = option_bool(&options->slab_prefault_async);
+        recovery_nthread = option_uint(&options->slab_recovery_nthread);
+        expire_intvl = option_uint(&options->slab_expire_intvl);
+        expire_nitem = option_uint(&options->slab_expire_nitem);
+        automove_intvl = option_uint(&options->slab_automove_intvl);
+        admit_nkey = option_uint(&options->slab_admit_nkey);
+        hugepage = option_uint(&options->slab_hugepage);
+        memfd = option_bool(&options->slab_memfd);
+        snapshot_path = option_str(&options->slab_snapshot);
+        snapshot_nitem = option_uint(&options->slab_snapshot_nitem);
+        if (option_str(&options->slab_numa_nodes) != NULL &&
+                affinity_parse(&numa_nodes,
+                option_str(&options->slab_numa_nodes)) != CC_OK) {
+            log_crit("invalid NUMA node list");
+            goto error;
+        }
+    }
+
+    if (evict_opt >= EVICT_INVALID) {
+        log_crit("invalid eviction option %d", evict_opt);
+        goto error;
+    }
+
+    cc_memset(&expire, 0, sizeof(expire));
+    expire.pass_start = time_proc_ms();
+    cc_memset(&automove, 0, sizeof(automove));
+    automove.src = automove.dst = SLABCLASS_INVALID_ID;
+    automove.last = time_proc_sec();
+
+    if (admit_nkey > 0) {
+        admit_filter = admit_create(admit_nkey);
+        if (admit_filter == NULL) {
+            log_crit("Could not create admission filter");
+            goto error;
+        }
     }
 
     if (_slab_heapinfo_setup() != CC_OK) {
@@ -612,6 +1493,11 @@ slab_setup(slab_options_st *options, slab_metrics_st *metrics)
         goto error;
     }
 
+    if (_slab_hash_setup() != CC_OK) {
+        log_crit("Could not create hash table");
+        goto error;
+    }
+
     if (_slab_slabclass_setup() != CC_OK) {
         log_crit("Could not setup slabclasses");
         goto error;
@@ -620,6 +1506,10 @@ slab_setup(slab_options_st *options, slab_metrics_st *metrics)
      cc_create_itt_malloc(slab_malloc);
      cc_create_itt_free(slab_free);
 
+    if (snapshot_path != NULL && hash_table->nhash_item == 0) {
+        _slab_snapshot_load();
+    }
+
     slab_init = true;
 
     return;
@@ -712,7 +1602,6 @@ _slab_get_new(void)
 
     _slab_table_update(slab);
     INCR(slab_metrics, slab_curr);
-    PERSLAB_INCR(slab->id, slab_curr);
     INCR_N(slab_metrics, slab_memory, slab_size);
 
     return slab;
@@ -736,6 +1625,7 @@ _slab_evict_one(struct slab *slab)
     p = &slabclass[slab->id];
 
     INCR(slab_metrics, slab_evict);
+    PERSLAB_DECR(slab->id, slab_curr);
 
     /* candidate slab is also the current slab */
     if (p->next_item_in_slab != NULL && slab == item_to_slab(p->next_item_in_slab)) {
@@ -824,6 +1714,40 @@ _slab_evict_lru(int id)
     return slab;
 }
 
+/*
+ * Evict the oldest slab of the class picked by the automover, so that it can
+ * be given to the class under pressure.
+ */
+static struct slab *
+_slab_evict_automove(void)
+{
+    struct slab *slab;
+    uint8_t src = automove.src, dst = automove.dst;
+
+    automove.src = automove.dst = SLABCLASS_INVALID_ID;
+
+    if (perslab[src].slab_curr.gauge <= 1) {
+        return NULL;
+    }
+
+    TAILQ_FOREACH(slab, &heapinfo.slab_lruq, s_tqe) {
+        if (slab->id == src && _slab_check_no_refcount(slab)) {
+            break;
+        }
+    }
+
+    if (slab != NULL) {
+        log_info("automove slab %p from class %"PRIu8" to %"PRIu8, slab, src,
+                dst);
+        _slab_evict_one(slab);
+        INCR(slab_metrics, slab_move);
+        PERSLAB_INCR(src, slab_move_out);
+        PERSLAB_INCR(dst, slab_move_in);
+    }
+
+    return slab;
+}
+
 /*
  * All the prep work before start using a slab.
  */
@@ -838,6 +1762,7 @@ _slab_init(struct slab *slab, uint8_t id)
 
     /* initialize slab header */
     _slab_hdr_init(slab, id);
+    PERSLAB_INCR(id, slab_curr);
 
     _slab_lruq_append(slab);
 
@@ -872,6 +1797,14 @@ _slab_get(uint8_t id)
 
     slab = _slab_get_new();
 
+    if (slab == NULL) {
+        PERSLAB_INCR(id, slab_evict_req);
+    }
+
+    if (slab == NULL && id == automove.dst) {
+        slab = _slab_evict_automove();
+    }
+
     if (slab == NULL && (evict_opt & EVICT_CS)) {
         slab = _slab_evict_lru(id);
     }
@@ -893,19 +1826,12 @@ _slab_get(uint8_t id)
     return status;
 }
 
-/*
- * Get an item from the item free q of the given slab with id.
- */
 static struct item *
-_slab_get_item_from_freeq(uint8_t id)
+_slab_freeq_pop(uint8_t id)
 {
     struct slabclass *p; /* parent slabclass */
     struct item *it;
 
-    if (!use_freeq) {
-        return NULL;
-    }
-
     p = &slabclass[id];
 
     if (p->nfree_itemq == 0) {
@@ -931,6 +1857,152 @@ _slab_get_item_from_freeq(uint8_t id)
     return it;
 }
 
+/*
+ * Get an item from the item free q of the given slab with id.
+ */
+static struct item *
+_slab_get_item_from_freeq(uint8_t id)
+{
+    if (!use_freeq) {
+        return NULL;
+    }
+
+    return _slab_freeq_pop(id);
+}
+
+/*
+ * Move the clock hand of class id to the next item to evict, see EVICT_IC, and
+ * return that item. The hand sweeps the slab table, and gives up after passing
+ * every item of the class twice, e.g. if they are all pinned or reserved.
+ *
+ * Only called once the class has no current slab, so that all items the hand
+ * passes have been carved out.
+ */
+static struct item *
+_slab_clock_next(uint8_t id)
+{
+    struct slabclass *p = &slabclass[id];
+    struct slab *slab;
+    struct item *it;
+    uint32_t i;
+
+    ASSERT(p->next_item_in_slab == NULL);
+
+    if (perslab[id].slab_curr.gauge == 0) {
+        return NULL;
+    }
+
+    for (i = 0; i <= 2 * heapinfo.nslab; i++) {
+        if (p->clock_slab >= heapinfo.nslab) {
+            p->clock_slab = 0;
+            p->clock_item = 0;
+        }
+
+        slab = heapinfo.slab_table[p->clock_slab];
+        for (; slab->id == id && p->clock_item < p->nitem; p->clock_item++) {
+            it = _slab_to_item(slab, p->clock_item, p->size);
+            if (!it->is_linked || it->refcount > 0) {
+                continue;
+            }
+
+            if (it->is_accessed) {
+                it->is_accessed = 0;
+                continue;
+            }
+
+            return it;
+        }
+
+        p->clock_slab++;
+        p->clock_item = 0;
+    }
+
+    log_warn("can't find an item to evict in slabclass %"PRIu8, id);
+
+    return NULL;
+}
+
+/*
+ * Return the item _slab_clock_next would return next, without clearing access
+ * bits or moving the hand. If every item the hand can reach has been accessed,
+ * that is the first of them.
+ */
+static struct item *
+_slab_clock_peek(uint8_t id)
+{
+    struct slabclass *p = &slabclass[id];
+    struct slab *slab;
+    struct item *it, *first = NULL;
+    uint32_t i, sid = p->clock_slab, iid = p->clock_item;
+
+    ASSERT(p->next_item_in_slab == NULL);
+
+    if (perslab[id].slab_curr.gauge == 0) {
+        return NULL;
+    }
+
+    for (i = 0; i <= heapinfo.nslab; i++) {
+        if (sid >= heapinfo.nslab) {
+            sid = 0;
+            iid = 0;
+        }
+
+        slab = heapinfo.slab_table[sid];
+        for (; slab->id == id && iid < p->nitem; iid++) {
+            it = _slab_to_item(slab, iid, p->size);
+            if (!it->is_linked || it->refcount > 0) {
+                continue;
+            }
+
+            if (!it->is_accessed) {
+                return it;
+            }
+
+            if (first == NULL) {
+                first = it;
+            }
+        }
+
+        sid++;
+        iid = 0;
+    }
+
+    return first;
+}
+
+/*
+ * Make room for an item of class id by evicting one of the items of the class.
+ */
+static struct item *
+_slab_evict_item(uint8_t id)
+{
+    struct item *it;
+
+    it = _slab_clock_next(id);
+    if (it == NULL) {
+        return NULL;
+    }
+
+    slabclass[id].clock_item++;
+    if (!item_expire(it)) {
+        item_evict(it);
+        INCR(slab_metrics, item_evict);
+        PERSLAB_INCR(id, slab_evict_req);
+    }
+
+    return _slab_freeq_pop(id);
+}
+
+/*
+ * Once the heap is full, evict an item of this class rather than a slab,
+ * unless the automover has a slab for it.
+ */
+static inline bool
+_slab_evict_item_first(uint8_t id)
+{
+    return (evict_opt & EVICT_IC) && _slab_heap_full() && id != automove.dst;
+}
+
 /*
  * Get an item from the slab with a given id. We get an item either from:
  * 1. item free Q of given slab with id. or,
@@ -951,8 +2023,17 @@ _slab_get_item(uint8_t id)
         return it;
     }
 
-    if (p->next_item_in_slab == NULL && (_slab_get(id) != CC_OK)) {
-        return NULL;
+    if (p->next_item_in_slab == NULL) {
+        if (_slab_evict_item_first(id)) {
+            it = _slab_evict_item(id);
+            if (it != NULL) {
+                return it;
+            }
+        }
+
+        if (_slab_get(id) != CC_OK) {
+            return NULL;
+        }
     }
 
     /* return item from current slab */
@@ -990,3 +2071,230 @@ slab_put_item(struct item *it, uint8_t id)
      ASSERT(!(it->in_freeq));
     _slab_put_item_into_freeq(it, id);
 }
+
+static void
+_slab_expire_pass_done(void)
+{
+    proc_time_fine_i elapsed = time_proc_ms() - expire.pass_start;
+    double rate = 0.0;
+
+    if (elapsed > 0) {
+        rate = (double)expire.nscan * MSEC_PER_SEC / elapsed;
+    }
+
+    INCR(slab_metrics, expire_pass);
+    UPDATE_VAL(slab_metrics, expire_rate, rate);
+
+    log_verb("expiry scan of %"PRIu32" slabs done in %"PRId64" ms",
+            heapinfo.nslab, (int64_t)elapsed);
+
+    expire.slab = 0;
+    expire.item = 0;
+    expire.nscan = 0;
+    expire.pass_start = time_proc_ms();
+}
+
+uint32_t
+slab_expire(uint32_t nitem)
+{
+    struct slab *slab;
+    struct slabclass *p;
+    struct item *it;
+    uint32_t nscan = 0, nexpire = 0;
+
+    while (nscan < nitem && heapinfo.nslab > 0) {
+        if (expire.slab >= heapinfo.nslab) {
+            /* pick up from the first slab on the next call */
+            _slab_expire_pass_done();
+            break;
+        }
+
+        slab = heapinfo.slab_table[expire.slab];
+        p = &slabclass[slab->id];
+        if (expire.item >= p->nitem) {
+            expire.slab++;
+            expire.item = 0;
+            continue;
+        }
+
+        it = _slab_to_item(slab, expire.item++, p->size);
+        nscan++;
+        if (item_expire(it)) {
+            nexpire++;
+            INCR_N(slab_metrics, expire_byte, p->size);
+        }
+    }
+
+    expire.nscan += nscan;
+    INCR_N(slab_metrics, expire_scan, nscan);
+    INCR_N(slab_metrics, expire_reclaim, nexpire);
+
+    return nexpire;
+}
+
+void
+slab_expire_tick(void)
+{
+    proc_time_fine_i now = time_proc_ms();
+
+    if (expire_nitem == 0 || now - expire.last < expire_intvl) {
+        return;
+    }
+
+    expire.last = now;
+    slab_expire(expire_nitem);
+}
+
+static void
+_slab_automove(proc_time_i now)
+{
+    struct slab *oldest[SLABCLASS_MAX_ID + 1] = { NULL };
+    uint64_t nevict[SLABCLASS_MAX_ID + 1];
+    uint64_t nevict_max = 0;
+    proc_time_i age, age_max = -1;
+    struct slab *slab;
+    struct item *it;
+    uint8_t id, src = SLABCLASS_INVALID_ID, dst = SLABCLASS_INVALID_ID;
+
+    /* the hot class needed the most evictions since the last run */
+    for (id = SLABCLASS_MIN_ID; id <= profile_last_id; id++) {
+        nevict[id] = perslab[id].slab_evict_req.counter - automove.nevict[id];
+        automove.nevict[id] = perslab[id].slab_evict_req.counter;
+        if (nevict[id] > nevict_max) {
+            nevict_max = nevict[id];
+            dst = id;
+        }
+    }
+
+    /* slabs are in lruq in the order they were (re)initialized */
+    TAILQ_FOREACH(slab, &heapinfo.slab_lruq, s_tqe) {
+        if (oldest[slab->id] == NULL) {
+            oldest[slab->id] = slab;
+        }
+    }
+
+    /* the cold class needed no evictions and was written the longest ago,
+     * going by the first item of its oldest slab
+     */
+    for (id = SLABCLASS_MIN_ID; id <= profile_last_id; id++) {
+        if (oldest[id] == NULL) {
+            continue;
+        }
+
+        it = _slab_to_item(oldest[id], 0, slabclass[id].size);
+        age = now - it->create_at;
+        UPDATE_VAL(&perslab[id], item_age, age);
+
+        if (dst != SLABCLASS_INVALID_ID && nevict[id] == 0 &&
+                perslab[id].slab_curr.gauge > 1 && age > age_max) {
+            age_max = age;
+            src = id;
+        }
+    }
+
+    if (src != SLABCLASS_INVALID_ID) {
+        log_verb("automove next slab from class %"PRIu8" to %"PRIu8, src, dst);
+        automove.src = src;
+        automove.dst = dst;
+    } else {
+        automove.src = automove.dst = SLABCLASS_INVALID_ID;
+    }
+}
+
+void
+slab_automove_tick(void)
+{
+    proc_time_i now = time_proc_sec();
+
+    if (automove_intvl == 0 || evict_opt == EVICT_NONE ||
+            now - automove.last < (proc_time_i)automove_intvl) {
+        return;
+    }
+
+    automove.last = now;
+    _slab_automove(now);
+}
+
+bool
+slab_admit(uint8_t id, const struct bstring *key)
+{
+    struct slabclass *p = &slabclass[id];
+    struct item *victim;
+    uint32_t nkey, nvictim;
+
+    ASSERT(id >= SLABCLASS_MIN_ID && id <= profile_last_id);
+
+    if (admit_filter == NULL) {
+        return true;
+    }
+
+    /* admission is only decided when an item has to be evicted */
+    if ((use_freeq && p->nfree_itemq > 0) || p->next_item_in_slab != NULL ||
+            !_slab_evict_item_first(id)) {
+        return true;
+    }
+
+    /* a rejected write must leave the clock as it was */
+    victim = _slab_clock_peek(id);
+    if (victim == NULL) {
+        return true;
+    }
+
+    nkey = admit_estimate(admit_filter, key->data, key->len);
+    nvictim = admit_estimate(admit_filter, item_key(victim), victim->klen);
+    if (nkey > nvictim || item_expire(victim)) {
+        INCR(slab_metrics, admit_accept);
+        return true;
+    }
+
+    log_verb("reject key %.*s accessed ~%"PRIu32" times for victim accessed "
+            "~%"PRIu32" times", key->len, key->data, nkey, nvictim);
+    INCR(slab_metrics, admit_reject);
+
+    return false;
+}
+
+rstatus_i
+slab_snapshot_request(void)
+{
+    if (snapshot_path == NULL) {
+        return CC_ERROR;
+    }
+
+    __atomic_store_n(&snapshot.requested, true, __ATOMIC_RELEASE);
+
+    return CC_OK;
+}
+
+void
+slab_snapshot_tick(void)
+{
+    if (snapshot.fd < 0) {
+        if (!__atomic_load_n(&snapshot.requested, __ATOMIC_ACQUIRE) ||
+                !__atomic_exchange_n(&snapshot.requested, false,
+                __ATOMIC_ACQ_REL) || _slab_snapshot_start() != CC_OK) {
+            return;
+        }
+    }
+
+    _slab_snapshot_step(snapshot_nitem);
+}
+
+int
+slab_heap_fd(void)
+{
+    if (pool_slab == NULL || datapool_fd(pool_slab) < 0) {
+        return -1;
+    }
+
+    return fcntl(datapool_fd(pool_slab), F_DUPFD_CLOEXEC, 0);
+}
+
+void
+slab_heap_inherit(int fd)
+{
+    if (heap_fd >= 0) {
+        close(heap_fd);
+    }
+    heap_fd = fd;
+}
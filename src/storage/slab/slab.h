@@ -1,5 +1,6 @@
 #pragma once
 
+#include "admit.h"
 #include "item.h"
 #include "hashtable.h"
 #include "slabclass.h"
@@ -31,13 +32,36 @@
 #define HASH_POWER      16
 #define SLAB_DATAPOOL   NULL
 #define SLAB_PREFAULT   false
+#define SLAB_PREFAULT_NTHREAD 0    /* one per online CPU */
+#define SLAB_PREFAULT_ASYNC false
+#define SLAB_RECOVERY_NTHREAD 0    /* one per online CPU */
 #define SLAB_DATAPOOL_NAME "slab_datapool"
+#define SLAB_HASH_DATAPOOL NULL    /* hash index in DRAM */
+#define SLAB_HASH_DATAPOOL_NAME "slab_hash_datapool"
+#define SLAB_EXPIRE_INTVL  100     /* in ms */
+#define SLAB_EXPIRE_NITEM  8192
+#define SLAB_AUTOMOVE_INTVL 10     /* in sec */
+#define SLAB_ADMIT_NKEY    0       /* admission filter off */
+#define SLAB_HUGEPAGE      0       /* regular pages */
+#define SLAB_NUMA_NODES    NULL    /* default memory policy */
+#define SLAB_MEMFD         false   /* heap in anonymous memory */
+#define SLAB_SNAPSHOT      NULL    /* no snapshot */
+#define SLAB_SNAPSHOT_NITEM 8192
 
 /* Eviction options */
 #define EVICT_NONE    0 /* throw OOM, no eviction */
 #define EVICT_RS      1 /* random slab eviction */
 #define EVICT_CS      2 /* lrc (least recently created) slab eviction */
-#define EVICT_INVALID 4 /* go no further! */
+#define EVICT_IC      4 /* item clock eviction within a slabclass */
+#define EVICT_INVALID 8 /* go no further! */
+
+/*
+ * Eviction options can be combined. With EVICT_IC, a slabclass that has no
+ * free item left once the heap is full evicts one of its own items, picked by
+ * CLOCK: items read since the hand last passed them are skipped (and their
+ * access bit cleared), so only a bit is written on a read. Slab eviction (if
+ * also set) is the fallback, e.g. for a class that does not have any slab yet.
+ */
 
 /* The defaults here are placeholder values for now */
 /* TODO: consider moving item options to item.[h|c] */
@@ -57,7 +81,20 @@
     ACTION( slab_hash_power,        OPTION_TYPE_UINT,   HASH_POWER,          "Power for lookup hash table"   )\
     ACTION( slab_datapool,          OPTION_TYPE_STR,    SLAB_DATAPOOL,       "Path to data pool"             )\
     ACTION( slab_datapool_name,     OPTION_TYPE_STR,    SLAB_DATAPOOL_NAME,  "Slab data pool name"           )\
-    ACTION( slab_datapool_prefault, OPTION_TYPE_BOOL,   SLAB_PREFAULT,       "Prefault data pool"            )
+    ACTION( slab_hash_datapool,     OPTION_TYPE_STR,    SLAB_HASH_DATAPOOL,  "Path to hash index data pool"  )\
+    ACTION( slab_datapool_prefault, OPTION_TYPE_BOOL,   SLAB_PREFAULT,       "Prefault data pool"            )\
+    ACTION( slab_prefault_nthread,  OPTION_TYPE_UINT,   SLAB_PREFAULT_NTHREAD,"# prefault threads, 0: # CPUs")\
+    ACTION( slab_prefault_async,    OPTION_TYPE_BOOL,   SLAB_PREFAULT_ASYNC, "Serve while prefaulting"       )\
+    ACTION( slab_recovery_nthread,  OPTION_TYPE_UINT,   SLAB_RECOVERY_NTHREAD,"# recovery threads, 0: # CPUs")\
+    ACTION( slab_expire_intvl,      OPTION_TYPE_UINT,   SLAB_EXPIRE_INTVL,   "Expiry scan interval (ms)"     )\
+    ACTION( slab_expire_nitem,      OPTION_TYPE_UINT,   SLAB_EXPIRE_NITEM,   "Max items scanned per interval")\
+    ACTION( slab_automove_intvl,    OPTION_TYPE_UINT,   SLAB_AUTOMOVE_INTVL, "Min sec between slab moves"    )\
+    ACTION( slab_admit_nkey,        OPTION_TYPE_UINT,   SLAB_ADMIT_NKEY,     "# keys tracked for admission"  )\
+    ACTION( slab_hugepage,          OPTION_TYPE_UINT,   SLAB_HUGEPAGE,       "Huge page size (byte), 0: off" )\
+    ACTION( slab_numa_nodes,        OPTION_TYPE_STR,    SLAB_NUMA_NODES,     "NUMA nodes for the slab heap"  )\
+    ACTION( slab_memfd,             OPTION_TYPE_BOOL,   SLAB_MEMFD,          "Keep heap in a memfd"          )\
+    ACTION( slab_snapshot,          OPTION_TYPE_STR,    SLAB_SNAPSHOT,       "Path to cache snapshot file"   )\
+    ACTION( slab_snapshot_nitem,    OPTION_TYPE_UINT,   SLAB_SNAPSHOT_NITEM, "Max chunks snapshotted a tick" )
 
 
 typedef struct {
@@ -79,7 +116,27 @@ typedef struct {
     ACTION( item_link,          METRIC_COUNTER, "# items inserted to HT"   )\
     ACTION( item_unlink,        METRIC_COUNTER, "# items removed from HT"  )\
     ACTION( item_keyval_byte,   METRIC_GAUGE,   "key+val in bytes, linked" )\
-    ACTION( item_val_byte,      METRIC_GAUGE,   "value only in bytes"      )
+    ACTION( item_val_byte,      METRIC_GAUGE,   "value only in bytes"      )\
+    ACTION( hash_item,          METRIC_GAUGE,   "# items in hash table"    )\
+    ACTION( hash_load,          METRIC_FPN,     "hash table load factor"   )\
+    ACTION( hash_grow,          METRIC_COUNTER, "# hash table resizes"     )\
+    ACTION( hash_migrate,       METRIC_GAUGE,   "# hash buckets to migrate")\
+    ACTION( expire_scan,        METRIC_COUNTER, "# item chunks scanned"    )\
+    ACTION( expire_reclaim,     METRIC_COUNTER, "# items expired by scan"  )\
+    ACTION( expire_byte,        METRIC_COUNTER, "bytes reclaimed by scan"  )\
+    ACTION( expire_pass,        METRIC_COUNTER, "# full scans of the heap" )\
+    ACTION( expire_rate,        METRIC_FPN,     "chunks/sec of last scan"  )\
+    ACTION( slab_move,          METRIC_COUNTER, "# slabs moved by automove")\
+    ACTION( item_evict,         METRIC_COUNTER, "# items evicted by clock" )\
+    ACTION( admit_accept,       METRIC_COUNTER, "# items admitted by filter")\
+    ACTION( admit_reject,       METRIC_COUNTER, "# items rejected by filter")\
+    ACTION( heap_page,          METRIC_GAUGE,   "page size of slab heap"   )\
+    ACTION( hash_page,          METRIC_GAUGE,   "page size of hash table"  )\
+    ACTION( heap_prefault_ms,   METRIC_GAUGE,   "ms taken to prefault heap")\
+    ACTION( snapshot_write,     METRIC_COUNTER, "# snapshots written"      )\
+    ACTION( snapshot_item,      METRIC_COUNTER, "# items snapshotted"      )\
+    ACTION( snapshot_ex,        METRIC_COUNTER, "# snapshot errors"        )\
+    ACTION( snapshot_load,      METRIC_COUNTER, "# items loaded at setup"  )
 
 typedef struct {
     SLAB_METRIC(METRIC_DECLARE)
@@ -92,7 +149,11 @@ typedef struct {
     ACTION( item_val_byte,      METRIC_GAUGE,   "value portion of data")\
     ACTION( item_curr,          METRIC_GAUGE,   "# items stored"       )\
     ACTION( item_free,          METRIC_GAUGE,   "# free items"         )\
-    ACTION( slab_curr,          METRIC_GAUGE,   "# slabs"              )
+    ACTION( slab_curr,          METRIC_GAUGE,   "# slabs"              )\
+    ACTION( slab_evict_req,     METRIC_COUNTER, "# evictions for class")\
+    ACTION( slab_move_in,       METRIC_COUNTER, "# slabs moved in"     )\
+    ACTION( slab_move_out,      METRIC_COUNTER, "# slabs moved out"    )\
+    ACTION( item_age,           METRIC_GAUGE,   "oldest slab age (sec)")
 
 typedef struct {
     PERSLAB_METRIC(METRIC_DECLARE)
@@ -145,6 +206,7 @@ TAILQ_HEAD(slab_tqh, slab);
 #define SLAB_HDR_SIZE    offsetof(struct slab, data)
 
 extern struct hash_table *hash_table;
+extern struct admit *admit_filter;
 extern size_t slab_size;
 extern slab_metrics_st *slab_metrics;
 cc_declare_itt_function(extern, slab_malloc);
@@ -201,8 +263,72 @@ item_slabid(uint8_t klen, uint32_t vlen, uint8_t mlen)
     return slab_id(item_ntotal(klen, vlen, mlen));
 }
 
+/* return true if the value of it can be replaced in place by vlen bytes */
+static inline bool
+item_fits(struct item *it, uint32_t vlen)
+{
+    return item_slabid(it->klen, vlen, it->olen) == it->id;
+}
+
 void slab_setup(slab_options_st *options, slab_metrics_st *metrics);
 void slab_teardown(void);
 
 struct item *slab_get_item(uint8_t id);
 void slab_put_item(struct item *it, uint8_t id);
+
+/* Expired items are otherwise only reclaimed when they are read, or when their
+ * slab is evicted. The expiry scan walks all slabs in the order they were
+ * allocated, a few items at a time, and moves expired items to the free queue
+ * of their slabclass, so that their memory is reused before any eviction.
+ */
+/* scan the next nitem item chunks, returns # items expired */
+uint32_t slab_expire(uint32_t nitem);
+/* scan up to slab_expire_nitem chunks if slab_expire_intvl ms have passed
+ * since the last scan, e.g. from the worker event loop
+ */
+void slab_expire_tick(void);
+
+/* Once the heap is full, a slabclass only gets more slabs by eviction. Every
+ * slab_automove_intvl seconds, the automover picks the class that needed the
+ * most evictions since its last run, and a class that needed none and holds
+ * more than one slab, preferring the one whose oldest slab was written the
+ * longest ago. The next slab the former needs is the oldest slab of the
+ * latter, so at most one slab is moved per interval.
+ */
+void slab_automove_tick(void);
+
+/* With slab_admit_nkey set, an item that can only be stored by evicting
+ * another one (see EVICT_IC) is admitted only if its key was accessed more
+ * often lately than the key of the item it would evict, as estimated by the
+ * admission filter. Accesses are recorded once per get or set request, by
+ * item_get and item_admit, and not by lookups made within the item module.
+ */
+/* return false if an item of class id for key should not be stored, this
+ * neither records an access nor changes the state of the clock
+ */
+bool slab_admit(uint8_t id, const struct bstring *key);
+
+/* With slab_snapshot set, slab_teardown saves all live items to that file, and
+ * slab_setup loads them back if the heap starts out empty, so that a cache that
+ * is not kept in a data pool is warm again after a restart or an upgrade.
+ * A snapshot can also be requested while serving; it is then written by
+ * slab_snapshot_tick, at most slab_snapshot_nitem chunks and one buffer write
+ * at a time. Such a snapshot is not a point in time: an item changed while it
+ * is in progress is saved as it was when the scan passed it.
+ */
+/* ask for a snapshot, from any thread; CC_ERROR if slab_snapshot is not set */
+rstatus_i slab_snapshot_request(void);
+/* start a requested snapshot or continue one, e.g. from the worker event loop */
+void slab_snapshot_tick(void);
+
+/* With slab_memfd set, the preallocated heap is kept in a memfd instead of
+ * anonymous memory, so that a process replacing this one can take it over
+ * with all its items: this process gets the memfd from slab_heap_fd before its
+ * slab_teardown, and the new one passes it to slab_heap_inherit before its
+ * slab_setup, which then recovers the items as from a data pool. Both must be
+ * set up with the same slab options.
+ */
+/* a duplicate of the memfd of the heap, or -1 */
+int slab_heap_fd(void);
+/* set up the heap from fd on the next slab_setup, which takes ownership */
+void slab_heap_inherit(int fd);
@@ -73,6 +73,9 @@ struct slabclass {
 
     uint32_t        nfree_item;            /* # free item (in current slab) */
     struct item     *next_item_in_slab;    /* next free item (in current slab, not freeq) */
+
+    uint32_t        clock_slab;            /* clock hand: slab table index */
+    uint32_t        clock_item;            /* clock hand: item in that slab */
 };
 
 /*
@@ -12,13 +12,14 @@ proc_time_fine_i proc_us;
 proc_time_fine_i proc_ns;
 
 static struct duration start;
-static struct duration proc_snapshot;
 
 uint8_t time_type = TIME_UNIX;
 
 void
 time_update(void)
 {
+    struct duration proc_snapshot; /* local, time_update runs on many threads */
+
     duration_snapshot(&proc_snapshot, &start);
 
     __atomic_store_n(&proc_sec, (proc_time_i)duration_sec(&proc_snapshot),
@@ -53,7 +54,6 @@ void
 time_teardown(void)
 {
     duration_reset(&start);
-    duration_reset(&proc_snapshot);
 
     log_info("timer ended at %"PRIu64, (uint64_t)time(NULL));
 }
@@ -0,0 +1,290 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "affinity.h"
+#include "util.h"
+
+#include <cc_debug.h>
+#include <cc_mm.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+#define BITS_PER_WORD   (8 * sizeof(unsigned long))
+#define NODE_CPULIST    "/sys/devices/system/node/node%"PRIu16"/cpulist"
+#define NODE_PATH_MAX   64
+#define CPULIST_MAX     4096
+
+#ifndef MPOL_BIND
+#define MPOL_BIND       2
+#define MPOL_INTERLEAVE 3
+#endif
+
+rstatus_i
+affinity_parse(struct affinity_list *l, const char *list)
+{
+    unsigned long mask[AFFINITY_LIST_MAX / BITS_PER_WORD] = {0};
+    const char *p = list;
+    char *end;
+    unsigned long lo, hi, i;
+
+    l->n = 0;
+    if (list == NULL) {
+        return CC_ERROR;
+    }
+
+    while (*p != '\0') {
+        if (!isdigit((unsigned char)*p)) {
+            goto error;
+        }
+        lo = hi = strtoul(p, &end, 10);
+        p = end;
+        if (*p == '-') {
+            p++;
+            if (!isdigit((unsigned char)*p)) {
+                goto error;
+            }
+            hi = strtoul(p, &end, 10);
+            p = end;
+        }
+        if (lo > hi || hi >= AFFINITY_LIST_MAX) {
+            goto error;
+        }
+        for (i = lo; i <= hi; i++) {
+            mask[i / BITS_PER_WORD] |= 1UL << (i % BITS_PER_WORD);
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p == '\n') { /* as read from sysfs */
+            break;
+        } else if (*p != '\0') {
+            goto error;
+        }
+    }
+
+    for (i = 0; i < AFFINITY_LIST_MAX; i++) {
+        if (mask[i / BITS_PER_WORD] & (1UL << (i % BITS_PER_WORD))) {
+            l->id[l->n++] = (uint16_t)i;
+        }
+    }
+
+    return l->n > 0 ? CC_OK : CC_ERROR;
+
+error:
+    log_error("malformed cpu/node list '%s'", list);
+    l->n = 0;
+
+    return CC_ERROR;
+}
+
+#ifdef __linux__
+
+static rstatus_i
+_pin(const uint16_t *id, uint32_t n)
+{
+    cpu_set_t set;
+    uint32_t i;
+    int ret;
+
+    CPU_ZERO(&set);
+    for (i = 0; i < n; i++) {
+        CPU_SET(id[i], &set);
+    }
+
+    ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+        log_error("pinning thread to %"PRIu32" cpu(s) from %"PRIu16" failed: "
+                "%s", n, id[0], strerror(ret));
+        return CC_ERROR;
+    }
+
+    return CC_OK;
+}
+
+rstatus_i
+affinity_pin(const struct affinity_list *l)
+{
+    ASSERT(l->n > 0);
+
+    return _pin(l->id, l->n);
+}
+
+rstatus_i
+affinity_pin_nth(const struct affinity_list *l, uint32_t n)
+{
+    ASSERT(l->n > 0);
+
+    return _pin(&l->id[n % l->n], 1);
+}
+
+rstatus_i
+affinity_mbind(void *addr, size_t len, const struct affinity_list *l)
+{
+    unsigned long mask[AFFINITY_LIST_MAX / BITS_PER_WORD] = {0};
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start, end;
+    int mode = l->n > 1 ? MPOL_INTERLEAVE : MPOL_BIND;
+    uint32_t i;
+
+    ASSERT(l->n > 0);
+
+    /* only whole pages can be given a policy */
+    start = ((uintptr_t)addr + page - 1) & ~(page - 1);
+    end = ((uintptr_t)addr + len) & ~(page - 1);
+    if (end <= start) {
+        return CC_OK;
+    }
+
+    for (i = 0; i < l->n; i++) {
+        mask[l->id[i] / BITS_PER_WORD] |= 1UL << (l->id[i] % BITS_PER_WORD);
+    }
+
+    if (syscall(SYS_mbind, start, end - start, mode, mask,
+            (unsigned long)AFFINITY_LIST_MAX + 1, 0) < 0) {
+        log_error("mbind of %zu bytes to %"PRIu32" node(s) failed: %s",
+                (size_t)(end - start), l->n, strerror(errno));
+        return CC_ERROR;
+    }
+
+    log_info("%s %zu bytes at %p on %"PRIu32" node(s) from node %"PRIu16,
+            mode == MPOL_INTERLEAVE ? "interleaved" : "bound",
+            (size_t)(end - start), (void *)start, l->n, l->id[0]);
+
+    return CC_OK;
+}
+
+struct prefault_arg {
+    uint8_t     *addr;
+    size_t      len;
+    size_t      page;
+    uint16_t    node;
+    uint32_t    idx;    /* index of node in the list */
+    uint32_t    n;      /* # nodes in the list */
+};
+
+/* read the cpus of a node from sysfs */
+static rstatus_i
+_node_cpus(struct affinity_list *cpus, uint16_t node)
+{
+    char path[NODE_PATH_MAX], buf[CPULIST_MAX];
+    FILE *fp;
+    char *s;
+
+    snprintf(path, NODE_PATH_MAX, NODE_CPULIST, node);
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        return CC_ERROR;
+    }
+    s = fgets(buf, CPULIST_MAX, fp);
+    fclose(fp);
+
+    return s == NULL ? CC_ERROR : affinity_parse(cpus, buf);
+}
+
+/*
+ * Interleaving places page i (counted from address 0, in units of the pages
+ * backing the mapping) on the (i % n)-th node, so each thread touches those.
+ * The thread's affinity is restored afterwards, as run_parallel may call this
+ * from the caller's thread when it cannot start one.
+ */
+static void *
+_prefault(void *arg)
+{
+    struct prefault_arg *pa = arg;
+    struct affinity_list cpus;
+    cpu_set_t saved;
+    bool pinned = false;
+    uintptr_t i, first, last;
+
+    if (_node_cpus(&cpus, pa->node) == CC_OK) {
+        pinned = pthread_getaffinity_np(pthread_self(), sizeof(saved),
+                &saved) == 0 && _pin(cpus.id, cpus.n) == CC_OK;
+    } else {
+        log_warn("cpus of node %"PRIu16" unknown, prefaulting unpinned",
+                pa->node);
+    }
+
+    first = (uintptr_t)pa->addr / pa->page;
+    last = ((uintptr_t)pa->addr + pa->len - 1) / pa->page;
+    for (i = first; i <= last; i++) {
+        if (i % pa->n == pa->idx) {
+            volatile uint8_t *p = (uint8_t *)MAX(i * pa->page,
+                    (uintptr_t)pa->addr);
+            *p = *p;
+        }
+    }
+
+    if (pinned) {
+        pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+    }
+
+    return NULL;
+}
+
+rstatus_i
+affinity_prefault(void *addr, size_t len, size_t page,
+        const struct affinity_list *l)
+{
+    struct prefault_arg *pa;
+    uint32_t i;
+
+    ASSERT(l->n > 0 && page > 0);
+
+    pa = cc_alloc(sizeof(*pa) * l->n);
+    if (pa == NULL) {
+        return CC_ENOMEM;
+    }
+
+    for (i = 0; i < l->n; i++) {
+        pa[i] = (struct prefault_arg){addr, len, page, l->id[i], i, l->n};
+    }
+    run_parallel(_prefault, pa, sizeof(*pa), l->n);
+
+    cc_free(pa);
+
+    return CC_OK;
+}
+
+#else /* !__linux__ */
+
+rstatus_i
+affinity_pin(const struct affinity_list *l)
+{
+    log_warn("thread pinning not supported on this platform");
+
+    return CC_ERROR;
+}
+
+rstatus_i
+affinity_pin_nth(const struct affinity_list *l, uint32_t n)
+{
+    return affinity_pin(l);
+}
+
+rstatus_i
+affinity_mbind(void *addr, size_t len, const struct affinity_list *l)
+{
+    log_warn("NUMA memory placement not supported on this platform");
+
+    return CC_ERROR;
+}
+
+rstatus_i
+affinity_prefault(void *addr, size_t len, size_t page,
+        const struct affinity_list *l)
+{
+    return CC_ERROR;
+}
+
+#endif /* __linux__ */
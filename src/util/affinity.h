@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cc_define.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CPU and NUMA node placement. CPUs and nodes are given as lists such as
+ * "0-3,8,10-11", the format of /sys/devices/system/node/node0/cpulist.
+ *
+ * Memory placement uses the mbind system call directly, so no libnuma is
+ * needed. All of this is Linux only; elsewhere these calls fail and callers
+ * should carry on unpinned.
+ */
+
+#define AFFINITY_LIST_MAX 1024
+
+struct affinity_list {
+    uint32_t n;
+    uint16_t id[AFFINITY_LIST_MAX];
+};
+
+/* parse list into ids in ascending order, returns CC_ERROR if malformed */
+rstatus_i affinity_parse(struct affinity_list *l, const char *list);
+
+/* pin the calling thread to all CPUs in l */
+rstatus_i affinity_pin(const struct affinity_list *l);
+/* pin the calling thread to the n-th CPU in l, wrapping around */
+rstatus_i affinity_pin_nth(const struct affinity_list *l, uint32_t n);
+
+/* set the memory policy of [addr, addr + len) to the nodes in l: bound to a
+ * single node, or interleaved across several
+ */
+rstatus_i affinity_mbind(void *addr, size_t len, const struct affinity_list *l);
+/* touch each page of [addr, addr + len) placed by affinity_mbind, from one
+ * thread per node running on that node's CPUs
+ */
+rstatus_i affinity_prefault(void *addr, size_t len, size_t page,
+        const struct affinity_list *l);
@@ -0,0 +1,231 @@
+#include "upgrade.h"
+
+#include <cc_debug.h>
+#include <cc_mm.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define UPGRADE_MAGIC 0x50475055    /* "UPGP" */
+
+/* sent along with the descriptors, which are only those marked present */
+struct upgrade_msg {
+    uint32_t magic;
+    uint32_t nfd;
+    uint32_t present;   /* bit i set if fd[i] is sent */
+};
+
+static rstatus_i
+_upgrade_addr(struct sockaddr_un *addr, const char *path)
+{
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        log_error("upgrade socket path %s is too long", path);
+        return CC_ERROR;
+    }
+
+    cc_memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    cc_memcpy(addr->sun_path, path, strlen(path));
+
+    return CC_OK;
+}
+
+int
+upgrade_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    int sd;
+
+    if (_upgrade_addr(&addr, path) != CC_OK) {
+        return -1;
+    }
+
+    sd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sd < 0) {
+        log_error("upgrade socket failed: %s", strerror(errno));
+        return -1;
+    }
+
+    unlink(path);
+    if (bind(sd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+            listen(sd, 1) < 0) {
+        log_error("listening for upgrades on %s failed: %s", path,
+                strerror(errno));
+        close(sd);
+        return -1;
+    }
+
+    log_info("listening for upgrades on %s", path);
+
+    return sd;
+}
+
+int
+upgrade_accept(int sd)
+{
+    int peer;
+
+    peer = accept4(sd, NULL, NULL, SOCK_CLOEXEC);
+    if (peer < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+            errno != EINTR) {
+        log_warn("accepting upgrade failed: %s", strerror(errno));
+    }
+
+    return peer;
+}
+
+rstatus_i
+upgrade_send(int sd, const int *fd, uint32_t nfd)
+{
+    struct upgrade_msg msg = { UPGRADE_MAGIC, nfd, 0 };
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int) * UPGRADE_NFD_MAX)];
+    } ctl;
+    struct iovec iov = { &msg, sizeof(msg) };
+    struct msghdr mh;
+    struct cmsghdr *cmsg;
+    uint32_t i, n = 0;
+    int *sent;
+    ssize_t ret;
+
+    ASSERT(nfd <= UPGRADE_NFD_MAX);
+
+    cc_memset(&ctl, 0, sizeof(ctl));
+    cc_memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctl.buf;
+    mh.msg_controllen = sizeof(ctl.buf);
+
+    cmsg = CMSG_FIRSTHDR(&mh);
+    sent = (int *)CMSG_DATA(cmsg);
+    for (i = 0; i < nfd; i++) {
+        if (fd[i] >= 0) {
+            msg.present |= 1U << i;
+            sent[n++] = fd[i];
+        }
+    }
+
+    if (n > 0) {
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n);
+        mh.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+    } else {
+        mh.msg_control = NULL;
+        mh.msg_controllen = 0;
+    }
+
+    do {
+        ret = sendmsg(sd, &mh, MSG_NOSIGNAL);
+    } while (ret < 0 && errno == EINTR);
+    close(sd);
+
+    if (ret != sizeof(msg)) {
+        log_error("sending %"PRIu32" descriptors for upgrade failed: %s", n,
+                ret < 0 ? strerror(errno) : "short write");
+        return CC_ERROR;
+    }
+
+    log_info("sent %"PRIu32" descriptors for upgrade", n);
+
+    return CC_OK;
+}
+
+rstatus_i
+upgrade_recv(const char *path, int *fd, uint32_t nfd, uint32_t timeout)
+{
+    struct sockaddr_un addr;
+    struct upgrade_msg msg;
+    struct timeval tv = { timeout / 1000, timeout % 1000 * 1000 };
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int) * UPGRADE_NFD_MAX)];
+    } ctl;
+    struct iovec iov = { &msg, sizeof(msg) };
+    struct msghdr mh;
+    struct cmsghdr *cmsg;
+    int *recvd = NULL;
+    uint32_t i, n = 0, nrecvd = 0;
+    ssize_t ret;
+    int sd;
+
+    ASSERT(nfd <= UPGRADE_NFD_MAX);
+
+    for (i = 0; i < nfd; i++) {
+        fd[i] = -1;
+    }
+
+    if (_upgrade_addr(&addr, path) != CC_OK) {
+        return CC_ERROR;
+    }
+
+    sd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sd < 0) {
+        log_error("upgrade socket failed: %s", strerror(errno));
+        return CC_ERROR;
+    }
+
+    if (connect(sd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        log_info("no process to take over at %s: %s", path, strerror(errno));
+        close(sd);
+        return CC_ERROR;
+    }
+
+    log_info("taking over from the process at %s", path);
+
+    cc_memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctl.buf;
+    mh.msg_controllen = sizeof(ctl.buf);
+
+    /* the running process only sends once it has stopped serving, which
+     * takes as long as its teardown does
+     */
+    if (timeout > 0) {
+        setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+    do {
+        ret = recvmsg(sd, &mh, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    } while (ret < 0 && errno == EINTR);
+    close(sd);
+
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        log_error("process at %s did not hand over within %"PRIu32" ms", path,
+                timeout);
+        return CC_EAGAIN;
+    }
+
+    cmsg = CMSG_FIRSTHDR(&mh);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET &&
+            cmsg->cmsg_type == SCM_RIGHTS) {
+        recvd = (int *)CMSG_DATA(cmsg);
+        nrecvd = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    }
+
+    if (ret != sizeof(msg) || msg.magic != UPGRADE_MAGIC || msg.nfd != nfd ||
+            (mh.msg_flags & MSG_CTRUNC)) {
+        log_error("receiving descriptors for upgrade failed: %s",
+                ret < 0 ? strerror(errno) : "unexpected message");
+        for (i = 0; i < nrecvd; i++) {
+            close(recvd[i]);
+        }
+        return CC_ERROR;
+    }
+
+    for (i = 0; i < nfd; i++) {
+        if ((msg.present & (1U << i)) && n < nrecvd) {
+            fd[i] = recvd[n++];
+        }
+    }
+
+    log_info("received %"PRIu32" descriptors for upgrade", n);
+
+    return CC_OK;
+}
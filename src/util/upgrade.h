@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cc_define.h>
+
+#include <stdint.h>
+
+/*
+ * Hot upgrade: a new process taking over from a running one connects to a unix
+ * socket the running one listens on, and receives file descriptors over it
+ * (SCM_RIGHTS), e.g. of its listening sockets and of the memory its data is
+ * kept in. The running process sends them once it has stopped serving, right
+ * before it exits. Descriptors are sent in an order both sides agree on, with
+ * -1 for ones the running process does not have.
+ */
+
+#define UPGRADE_NFD_MAX     8
+/* in ms, to wait for the descriptors, 0 to wait until the running process
+ * either sends them or exits, and so no longer holds its listening sockets
+ */
+#define UPGRADE_TIMEOUT     0
+
+/* listen on a unix socket at path, replacing any file there; returns a
+ * nonblocking socket, or -1
+ */
+int upgrade_listen(const char *path);
+/* accept a new process waiting to take over, or -1 if there is none */
+int upgrade_accept(int sd);
+/* send nfd descriptors to a process returned by upgrade_accept, closing sd */
+rstatus_i upgrade_send(int sd, const int *fd, uint32_t nfd);
+/* take over from the process listening at path, receiving nfd descriptors
+ * into fd, waiting up to timeout ms (see UPGRADE_TIMEOUT); CC_ERROR if there
+ * is none, or it exited without sending the descriptors, CC_EAGAIN if it is
+ * still running but did not send them in time
+ */
+rstatus_i upgrade_recv(const char *path, int *fd, uint32_t nfd,
+        uint32_t timeout);
@@ -2,11 +2,15 @@
 
 #include <cc_debug.h>
 #include <cc_log.h>
+#include <cc_mm.h>
 #include <cc_print.h>
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <netdb.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -181,3 +185,65 @@ remove_pidfile(const char *filename)
                   filename, strerror(errno));
     }
 }
+
+void
+run_parallel_start(struct parallel *p, void *(*fn)(void *), void *arg,
+        size_t size, uint32_t n)
+{
+    uint32_t i;
+    int ret;
+
+    ASSERT(p->tid == NULL);
+
+    p->tid = cc_alloc(sizeof(*p->tid) * n);
+    p->started = cc_alloc(sizeof(*p->started) * n);
+    if (p->tid == NULL || p->started == NULL) {
+        cc_free(p->tid);
+        cc_free(p->started);
+        p->tid = NULL;
+        for (i = 0; i < n; i++) {
+            fn((uint8_t *)arg + i * size);
+        }
+        return;
+    }
+
+    p->n = n;
+    for (i = 0; i < n; i++) {
+        ret = pthread_create(&p->tid[i], NULL, fn, (uint8_t *)arg + i * size);
+        p->started[i] = (ret == 0);
+        if (!p->started[i]) {
+            log_warn("creating thread %"PRIu32" of %"PRIu32" failed: %s", i, n,
+                    strerror(ret));
+            fn((uint8_t *)arg + i * size);
+        }
+    }
+}
+
+void
+run_parallel_wait(struct parallel *p)
+{
+    uint32_t i;
+
+    if (p->tid == NULL) {
+        return;
+    }
+
+    for (i = 0; i < p->n; i++) {
+        if (p->started[i]) {
+            pthread_join(p->tid[i], NULL);
+        }
+    }
+
+    cc_free(p->tid);
+    cc_free(p->started);
+    p->tid = NULL;
+}
+
+void
+run_parallel(void *(*fn)(void *), void *arg, size_t size, uint32_t n)
+{
+    struct parallel p = { NULL, NULL, 0 };
+
+    run_parallel_start(&p, fn, arg, size, n);
+    run_parallel_wait(&p);
+}
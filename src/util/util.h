@@ -2,6 +2,11 @@
 
 #include <cc_define.h>
 
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 struct addrinfo;
 
 /* Daemonize the process (have it run in the background) */
@@ -18,3 +23,20 @@ void create_pidfile(const char *filename);
 
 /* Remove pid file */
 void remove_pidfile(const char *filename);
+
+/* threads started by run_parallel_start */
+struct parallel {
+    pthread_t   *tid;       /* tid[n], NULL if none are running */
+    bool        *started;   /* started[i] if tid[i] is to be joined */
+    uint32_t    n;
+};
+
+/* Call fn(arg + i * size) for i in [0, n) on n threads, without waiting for
+ * them; calls that fail to get a thread are made from the calling thread
+ */
+void run_parallel_start(struct parallel *p, void *(*fn)(void *), void *arg,
+        size_t size, uint32_t n);
+/* wait for all threads of run_parallel_start, if any are running */
+void run_parallel_wait(struct parallel *p);
+/* run_parallel_start and run_parallel_wait */
+void run_parallel(void *(*fn)(void *), void *arg, size_t size, uint32_t n);
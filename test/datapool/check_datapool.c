@@ -5,7 +5,9 @@
 #include <check.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #define SUITE_NAME "datapool"
 #define DEBUG_LOG  SUITE_NAME ".log"
@@ -25,7 +27,7 @@ test_teardown(const char* str)
 START_TEST(test_datapool)
 {
     int fresh = 0;
-    struct datapool *pool = datapool_open(TEST_DATAFILE, TEST_DATA_NAME, TEST_DATASIZE, &fresh, false);
+    struct datapool *pool = datapool_open(TEST_DATAFILE, TEST_DATA_NAME, TEST_DATASIZE, &fresh, false, 0);
     ck_assert_ptr_nonnull(pool);
     size_t s = datapool_size(pool);
     ck_assert_int_ge(s, TEST_DATASIZE);
@@ -33,7 +35,7 @@ START_TEST(test_datapool)
     ck_assert_ptr_nonnull(datapool_addr(pool));
     datapool_close(pool);
 
-    pool = datapool_open(TEST_DATAFILE, TEST_DATA_NAME, TEST_DATASIZE, &fresh, false);
+    pool = datapool_open(TEST_DATAFILE, TEST_DATA_NAME, TEST_DATASIZE, &fresh, false, 0);
     ck_assert_ptr_nonnull(pool);
     ck_assert_int_eq(s, datapool_size(pool));
     ck_assert_int_eq(fresh, 0);
@@ -45,7 +47,7 @@ END_TEST
 START_TEST(test_devzero)
 {
     int fresh = 0;
-    struct datapool *pool = datapool_open(NULL, TEST_DATA_NAME, TEST_DATASIZE, &fresh, false);
+    struct datapool *pool = datapool_open(NULL, TEST_DATA_NAME, TEST_DATASIZE, &fresh, false, 0);
     ck_assert_ptr_nonnull(pool);
     size_t s = datapool_size(pool);
     ck_assert_int_ge(s, TEST_DATASIZE);
@@ -53,7 +55,7 @@ START_TEST(test_devzero)
     ck_assert_ptr_nonnull(datapool_addr(pool));
     datapool_close(pool);
 
-    pool = datapool_open(NULL, TEST_DATA_NAME, TEST_DATASIZE, &fresh, false);
+    pool = datapool_open(NULL, TEST_DATA_NAME, TEST_DATASIZE, &fresh, false, 0);
     ck_assert_ptr_nonnull(pool);
     ck_assert_int_eq(s, datapool_size(pool));
     ck_assert_int_eq(fresh, 1);
@@ -62,19 +64,69 @@ START_TEST(test_devzero)
 }
 END_TEST
 
+START_TEST(test_hugepage)
+{
+#define HUGEPAGE_SIZE (2 << 20)
+    size_t size = 3 * TEST_DATASIZE + 1;
+    struct datapool *pool = datapool_open(NULL, TEST_DATA_NAME, size, NULL, false, HUGEPAGE_SIZE);
+    ck_assert_ptr_nonnull(pool);
+    ck_assert_int_ge(datapool_size(pool), size);
+
+    /* explicit huge pages may not be reserved, then base pages are used */
+    size_t page = datapool_page_size(pool);
+    ck_assert(page == HUGEPAGE_SIZE || page == (size_t)sysconf(_SC_PAGESIZE));
+
+    char *addr = datapool_addr(pool);
+    ck_assert_ptr_nonnull(addr);
+    ck_assert_int_eq(addr[0], 0);
+    ck_assert_int_eq(addr[size - 1], 0);
+    memset(addr, 0xff, size);
+    datapool_close(pool);
+#undef HUGEPAGE_SIZE
+}
+END_TEST
+
+static uint32_t prefault_ndone;
+
+static void
+prefault_done(uint64_t ms)
+{
+    prefault_ndone++;
+}
+
+START_TEST(test_prefault)
+{
+    size_t size = 8 * TEST_DATASIZE + 1;
+    struct datapool *pool = datapool_open(NULL, TEST_DATA_NAME, size, NULL, false, 0);
+    ck_assert_ptr_nonnull(pool);
+
+    prefault_ndone = 0;
+    ck_assert_int_eq(datapool_prefault(pool, 3, false, prefault_done), CC_OK);
+    ck_assert_int_eq(prefault_ndone, 1);
+
+    /* the pool can be written to while it is prefaulted in the background */
+    ck_assert_int_eq(datapool_prefault(pool, 0, true, prefault_done), CC_OK);
+    char *addr = datapool_addr(pool);
+    memset(addr, 0xff, size);
+    ck_assert_int_eq(addr[size - 1], (char)0xff);
+    datapool_close(pool);
+    ck_assert_int_eq(prefault_ndone, 2);
+}
+END_TEST
+
 START_TEST(test_datapool_userdata)
 {
 #define MAX_USER_DATA_SIZE 2000
     char data_set[MAX_USER_DATA_SIZE] = {0};
     char data_get[MAX_USER_DATA_SIZE] = {0};
 
-    struct datapool *pool = datapool_open(TEST_DATAFILE, TEST_DATA_NAME, TEST_DATASIZE, NULL, false);
+    struct datapool *pool = datapool_open(TEST_DATAFILE, TEST_DATA_NAME, TEST_DATASIZE, NULL, false, 0);
     ck_assert_ptr_nonnull(pool);
     cc_memset(data_set, 'A', MAX_USER_DATA_SIZE);
     datapool_set_user_data(pool, data_set, MAX_USER_DATA_SIZE);
     datapool_close(pool);
 
-    pool = datapool_open(TEST_DATAFILE, TEST_DATA_NAME, TEST_DATASIZE, NULL, false);
+    pool = datapool_open(TEST_DATAFILE, TEST_DATA_NAME, TEST_DATASIZE, NULL, false, 0);
     ck_assert_ptr_nonnull(pool);
     datapool_get_user_data(pool, data_get, MAX_USER_DATA_SIZE);
     ck_assert_mem_eq(data_set, data_get, MAX_USER_DATA_SIZE);
@@ -87,7 +139,7 @@ END_TEST
 
 START_TEST(test_datapool_prealloc)
 {
-    struct datapool *pool = datapool_open(TEST_DATAFILE, TEST_DATA_NAME, TEST_DATASIZE, NULL, true);
+    struct datapool *pool = datapool_open(TEST_DATAFILE, TEST_DATA_NAME, TEST_DATASIZE, NULL, true, 0);
     ck_assert_ptr_nonnull(pool);
     datapool_close(pool);
     test_teardown(TEST_DATAFILE);
@@ -96,7 +148,7 @@ END_TEST
 
 START_TEST(test_datapool_empty_signature)
 {
-    struct datapool *pool = datapool_open(TEST_DATAFILE, NULL, TEST_DATASIZE, NULL, false);
+    struct datapool *pool = datapool_open(TEST_DATAFILE, NULL, TEST_DATASIZE, NULL, false, 0);
     ck_assert_ptr_null(pool);
 }
 END_TEST
@@ -104,7 +156,7 @@ END_TEST
 START_TEST(test_datapool_too_long_signature)
 {
 #define LONG_SIGNATURE "Lorem ipsum dolor sit amet, consectetur volutpat"
-    struct datapool *pool = datapool_open(TEST_DATAFILE, LONG_SIGNATURE, TEST_DATASIZE, NULL, false);
+    struct datapool *pool = datapool_open(TEST_DATAFILE, LONG_SIGNATURE, TEST_DATASIZE, NULL, false, 0);
     ck_assert_ptr_null(pool);
 #undef LONG_SIGNATURE
 }
@@ -113,7 +165,7 @@ END_TEST
 START_TEST(test_datapool_max_length_signature)
 {
 #define MAX_SIGNATURE "Lorem ipsum dolor sit amet, consectetur volutpa"
-    struct datapool *pool = datapool_open(TEST_DATAFILE, MAX_SIGNATURE, TEST_DATASIZE, NULL, false);
+    struct datapool *pool = datapool_open(TEST_DATAFILE, MAX_SIGNATURE, TEST_DATASIZE, NULL, false, 0);
     ck_assert_ptr_nonnull(pool);
     datapool_close(pool);
     test_teardown(TEST_DATAFILE);
@@ -125,7 +177,7 @@ START_TEST(test_datapool_wrong_signature_long_variant)
 {
 #define WRONG_POOL_NAME_LONG_VAR "datapool_pelikan_no_exist"
     int fresh = 0;
-    struct datapool *pool = datapool_open(TEST_DATAFILE, TEST_DATA_NAME, TEST_DATASIZE, &fresh, false);
+    struct datapool *pool = datapool_open(TEST_DATAFILE, TEST_DATA_NAME, TEST_DATASIZE, &fresh, false, 0);
     ck_assert_ptr_nonnull(pool);
     size_t s = datapool_size(pool);
     ck_assert_int_ge(s, TEST_DATASIZE);
@@ -133,7 +185,7 @@ START_TEST(test_datapool_wrong_signature_long_variant)
     ck_assert_ptr_nonnull(datapool_addr(pool));
     datapool_close(pool);
 
-    pool = datapool_open(TEST_DATAFILE, WRONG_POOL_NAME_LONG_VAR, TEST_DATASIZE, NULL, false);
+    pool = datapool_open(TEST_DATAFILE, WRONG_POOL_NAME_LONG_VAR, TEST_DATASIZE, NULL, false, 0);
     ck_assert_ptr_null(pool);
     test_teardown(TEST_DATAFILE);
 #undef WRONG_POOL_NAME_LONG_VAR
@@ -144,7 +196,7 @@ START_TEST(test_datapool_wrong_signature_short_variant)
 {
 #define WRONG_POOL_NAME_SHORT_VAR "datapool"
     int fresh = 0;
-    struct datapool *pool = datapool_open(TEST_DATAFILE, TEST_DATA_NAME, TEST_DATASIZE, &fresh, false);
+    struct datapool *pool = datapool_open(TEST_DATAFILE, TEST_DATA_NAME, TEST_DATASIZE, &fresh, false, 0);
     ck_assert_ptr_nonnull(pool);
     size_t s = datapool_size(pool);
     ck_assert_int_ge(s, TEST_DATASIZE);
@@ -152,7 +204,7 @@ START_TEST(test_datapool_wrong_signature_short_variant)
     ck_assert_ptr_nonnull(datapool_addr(pool));
     datapool_close(pool);
 
-    pool = datapool_open(TEST_DATAFILE, WRONG_POOL_NAME_SHORT_VAR, TEST_DATASIZE, NULL, false);
+    pool = datapool_open(TEST_DATAFILE, WRONG_POOL_NAME_SHORT_VAR, TEST_DATASIZE, NULL, false, 0);
     ck_assert_ptr_null(pool);
     test_teardown(TEST_DATAFILE);
 #undef WRONG_POOL_NAME_SHORT_VAR
@@ -170,6 +222,8 @@ datapool_suite(void)
     TCase *tc_pool = tcase_create("pool");
     tcase_add_test(tc_pool, test_datapool);
     tcase_add_test(tc_pool, test_devzero);
+    tcase_add_test(tc_pool, test_hugepage);
+    tcase_add_test(tc_pool, test_prefault);
     tcase_add_test(tc_pool, test_datapool_userdata);
     tcase_add_test(tc_pool, test_datapool_prealloc);
     tcase_add_test(tc_pool, test_datapool_max_length_signature);
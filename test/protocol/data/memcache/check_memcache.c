@@ -4,11 +4,13 @@
 #include <cc_array.h>
 #include <cc_bstring.h>
 #include <cc_define.h>
+#include <cc_print.h>
 
 #include <check.h>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* define for each suite, local scope due to macro visibility rule */
 #define SUITE_NAME "memcache"
@@ -27,6 +29,7 @@ test_setup(void)
     req = request_create();
     rsp = response_create();
     buf = buf_create();
+    parse_setup(NULL, NULL);
 }
 
 static void
@@ -40,6 +43,7 @@ test_reset(void)
 static void
 test_teardown(void)
 {
+    parse_teardown();
     buf_destroy(&buf);
     response_destroy(&rsp);
     request_destroy(&req);
@@ -725,6 +729,84 @@ START_TEST(test_partial_header)
 #undef SERIALIZED
 }
 END_TEST
+
+START_TEST(test_multikey_long)
+{
+#define NKEY MAX_BATCH_SIZE
+    char serialized[NKEY * 64 + 8];
+    char keys[NKEY][64];
+    struct bstring key;
+    int i, j, n, len, ret;
+
+    /* keys of varying length, some with a CR that does not end the line */
+    len = cc_scnprintf(serialized, sizeof(serialized), "get");
+    for (i = 0; i < NKEY; ++i) {
+        n = (i * 7) % 60 + 1;
+        for (j = 0; j < n; ++j) {
+            keys[i][j] = 'a' + (i + j) % 26;
+        }
+        if (i % 10 == 3 && n > 2) {
+            keys[i][n / 2] = CR;
+        }
+        keys[i][n] = '\0';
+        len += cc_scnprintf(serialized + len, sizeof(serialized) - len,
+                (i % 5 == 0) ? "  %s" : " %s", keys[i]);
+    }
+    len += cc_scnprintf(serialized + len, sizeof(serialized) - len, "\r\n");
+
+    /* every strict prefix is incomplete */
+    for (n = 0; n < len; ++n) {
+        test_reset();
+        buf_write(buf, serialized, n);
+        ret = parse_req(req, buf);
+        ck_assert_msg(ret == PARSE_EUNFIN, "prefix %d ret: %d", n, ret);
+        ck_assert(buf->rpos == buf->begin);
+    }
+
+    test_reset();
+    buf_write(buf, serialized, len);
+    ret = parse_req(req, buf);
+    ck_assert_msg(ret == PARSE_OK, "ret: %d", ret);
+    ck_assert(req->type == REQ_GET);
+    ck_assert_int_eq(array_nelem(req->keys), NKEY);
+    for (i = 0; i < NKEY; ++i) {
+        key.len = strlen(keys[i]);
+        key.data = keys[i];
+        ck_assert_int_eq(bstring_compare(&key, array_get(req->keys, i)), 0);
+    }
+    ck_assert(buf->rpos == buf->wpos);
+#undef NKEY
+}
+END_TEST
+
+START_TEST(test_key_oversize)
+{
+    char serialized[MAX_TOKEN_LEN + 16];
+    int len, ret;
+
+    /* a key of exactly MAX_TOKEN_LEN bytes is accepted */
+    test_reset();
+    len = cc_scnprintf(serialized, sizeof(serialized), "get %0*d\r\n",
+            MAX_TOKEN_LEN, 0);
+    buf_write(buf, serialized, len);
+    ret = parse_req(req, buf);
+    ck_assert_msg(ret == PARSE_OK, "ret: %d", ret);
+    ck_assert_int_eq(((struct bstring *)array_first(req->keys))->len,
+            MAX_TOKEN_LEN);
+
+    /* one more byte is too many, even before the key ends */
+    test_reset();
+    len = cc_scnprintf(serialized, sizeof(serialized), "get %0*d",
+            MAX_TOKEN_LEN + 1, 0);
+    buf_write(buf, serialized, len);
+    ret = parse_req(req, buf);
+    ck_assert_msg(ret == PARSE_EUNFIN, "ret: %d", ret);
+    buf_write(buf, "1", 1);
+    ret = parse_req(req, buf);
+    ck_assert_msg(ret == PARSE_EOVERSIZE, "ret: %d", ret);
+}
+END_TEST
+
 /*
  * basic responses
  */
@@ -1307,6 +1389,8 @@ memcache_suite(void)
     tcase_add_test(tc_basic_req, test_delete_noreply);
     tcase_add_test(tc_basic_req, test_get);
     tcase_add_test(tc_basic_req, test_multikey);
+    tcase_add_test(tc_basic_req, test_multikey_long);
+    tcase_add_test(tc_basic_req, test_key_oversize);
     tcase_add_test(tc_basic_req, test_gets);
     tcase_add_test(tc_basic_req, test_set);
     tcase_add_test(tc_basic_req, test_add_noreply);
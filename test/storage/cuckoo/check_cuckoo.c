@@ -7,6 +7,7 @@
 #include <cc_mm.h>
 
 #include <check.h>
+#include <pthread.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -28,13 +29,18 @@ cuckoo_metrics_st metrics = { CUCKOO_METRIC(METRIC_INIT) };
  * utilities
  */
 static void
-test_setup(uint32_t policy, bool cas, delta_time_i ttl)
+test_options(uint32_t policy, bool cas, delta_time_i ttl)
 {
     option_load_default((struct option *)&options, OPTION_CARDINALITY(options));
     options.cuckoo_policy.val.vuint = policy;
     options.cuckoo_item_cas.val.vbool = cas;
     options.cuckoo_max_ttl.val.vuint = ttl;
+}
 
+static void
+test_setup(uint32_t policy, bool cas, delta_time_i ttl)
+{
+    test_options(policy, cas, ttl);
     cuckoo_setup(&options, &metrics);
 }
 
@@ -44,11 +50,20 @@ test_teardown(void)
     cuckoo_teardown();
 }
 
+/* set up again, with the options as set since test_options */
 static void
-test_reset(uint32_t policy, bool cas, delta_time_i ttl)
+test_reload(void)
 {
     test_teardown();
-    test_setup(policy, cas, ttl);
+    metric_reset((struct metric *)&metrics, METRIC_CARDINALITY(metrics));
+    cuckoo_setup(&options, &metrics);
+}
+
+static void
+test_reset(uint32_t policy, bool cas, delta_time_i ttl)
+{
+    test_options(policy, cas, ttl);
+    test_reload();
 }
 
 /**
@@ -442,6 +457,482 @@ START_TEST(test_insert_insert_expire_swap)
 #undef TIME
 }
 END_TEST
+
+#define FILL_NITEM 4096
+
+/*
+ * fill a table of FILL_NITEM slots until the first eviction, returns the
+ * number of items in it by then, after checking that they can all be found
+ */
+static uint64_t
+test_fill(uint32_t bucket, uint32_t displace)
+{
+    struct bstring key;
+    struct val val;
+    struct item *it;
+    char keystring[30];
+    uint64_t i, n, hits = 0;
+
+    test_options(CUCKOO_POLICY, CUCKOO_ITEM_CAS, CUCKOO_MAX_TTL);
+    options.cuckoo_nitem.val.vuint = FILL_NITEM;
+    options.cuckoo_bucket.val.vuint = bucket;
+    options.cuckoo_displace.val.vuint = displace;
+    test_reload();
+
+    time_update();
+    for (i = 0; metrics.item_evict.counter == 0; i++) {
+        key.len = sprintf(keystring, "%"PRIu64, i);
+        key.data = keystring;
+
+        val.type = VAL_TYPE_INT;
+        val.vint = i;
+
+        ck_assert_msg(cuckoo_insert(&key, &val, INT32_MAX) != NULL,
+                "cuckoo_insert not OK");
+    }
+
+    for (n = 0; n < i; n++) {
+        key.len = sprintf(keystring, "%"PRIu64, n);
+        key.data = keystring;
+
+        it = cuckoo_get(&key);
+        if (it != NULL) {
+            ck_assert_int_eq(item_value_int(it), n);
+            hits++;
+        }
+    }
+    ck_assert_int_eq(hits, metrics.item_curr.gauge);
+
+    return metrics.item_curr.gauge;
+}
+
+START_TEST(test_bucket_basic)
+{
+#define NKEY 512
+    struct bstring key;
+    struct val val;
+    struct item *it;
+    char keystring[30];
+    uint32_t bucket;
+    uint64_t i;
+
+    for (bucket = 4; bucket <= 8; bucket *= 2) {
+        test_options(CUCKOO_POLICY, CUCKOO_ITEM_CAS, CUCKOO_MAX_TTL);
+        options.cuckoo_bucket.val.vuint = bucket;
+        test_reload();
+
+        time_update();
+        for (i = 0; i < NKEY; i++) {
+            key.len = sprintf(keystring, "%"PRIu64, i);
+            key.data = keystring;
+            val.type = VAL_TYPE_INT;
+            val.vint = i;
+            ck_assert_msg(cuckoo_insert(&key, &val, INT32_MAX) != NULL,
+                    "cuckoo_insert not OK");
+        }
+
+        /* delete every other key */
+        for (i = 0; i < NKEY; i += 2) {
+            key.len = sprintf(keystring, "%"PRIu64, i);
+            key.data = keystring;
+            ck_assert(cuckoo_delete(&key));
+        }
+
+        for (i = 0; i < NKEY; i++) {
+            key.len = sprintf(keystring, "%"PRIu64, i);
+            key.data = keystring;
+            it = cuckoo_get(&key);
+            if (i % 2 == 0) {
+                ck_assert_msg(it == NULL, "deleted key %"PRIu64" found", i);
+            } else {
+                ck_assert_msg(it != NULL, "key %"PRIu64" not found", i);
+                ck_assert_int_eq(item_value_int(it), i);
+            }
+        }
+    }
+#undef NKEY
+}
+END_TEST
+
+START_TEST(test_bucket_load)
+{
+    uint64_t nslot, nbucket;
+
+    nslot = test_fill(1, CUCKOO_DISPLACE);
+    nbucket = test_fill(8, CUCKOO_DISPLACE);
+
+    ck_assert_uint_gt(nbucket, nslot);
+    ck_assert_uint_ge(nbucket, FILL_NITEM * 9 / 10);
+}
+END_TEST
+
+START_TEST(test_displace_depth)
+{
+    uint64_t n0, n2, n4;
+
+    n0 = test_fill(1, 0);
+    n2 = test_fill(1, 2);
+    n4 = test_fill(1, 4);
+
+    /* deeper searches find room for more items before evicting any */
+    ck_assert_uint_lt(n0, n2);
+    ck_assert_uint_lt(n2, n4);
+    ck_assert_uint_ge(n4, FILL_NITEM * 9 / 10);
+}
+END_TEST
+
+START_TEST(test_nhash_seed)
+{
+#define NKEY 256
+#define SEED 12345
+    struct bstring key;
+    struct val val;
+    struct item *it;
+    char keystring[30];
+    struct item *first[NKEY];
+    uint32_t nhash, nmoved = 0;
+    uint64_t i;
+
+    for (nhash = 2; nhash <= 8; nhash += 6) {
+        test_options(CUCKOO_POLICY, CUCKOO_ITEM_CAS, CUCKOO_MAX_TTL);
+        options.cuckoo_nhash.val.vuint = nhash;
+        options.cuckoo_seed.val.vuint = nhash == 2 ? CUCKOO_SEED : SEED;
+        test_reload();
+
+        time_update();
+        for (i = 0; i < NKEY; i++) {
+            key.len = sprintf(keystring, "%"PRIu64, i);
+            key.data = keystring;
+            val.type = VAL_TYPE_INT;
+            val.vint = i;
+            ck_assert_msg(cuckoo_insert(&key, &val, INT32_MAX) != NULL,
+                    "cuckoo_insert not OK");
+        }
+        ck_assert_int_eq(metrics.item_evict.counter, 0);
+
+        for (i = 0; i < NKEY; i++) {
+            key.len = sprintf(keystring, "%"PRIu64, i);
+            key.data = keystring;
+            it = cuckoo_get(&key);
+            ck_assert_msg(it != NULL, "key %"PRIu64" not found", i);
+            ck_assert_int_eq(item_value_int(it), i);
+            if (nhash == 2) {
+                first[i] = it;
+            } else {
+                nmoved += (it != first[i]);
+            }
+        }
+    }
+
+    /* another seed places keys elsewhere */
+    ck_assert_uint_gt(nmoved, NKEY / 2);
+#undef NKEY
+#undef SEED
+}
+END_TEST
+
+static void
+test_setup_concurrent(uint32_t nitem)
+{
+    test_options(CUCKOO_POLICY, CUCKOO_ITEM_CAS, CUCKOO_MAX_TTL);
+    options.cuckoo_nitem.val.vuint = nitem;
+    options.cuckoo_concurrent.val.vbool = true;
+    test_reload();
+}
+
+START_TEST(test_concurrent_basic)
+{
+#define KEY "key"
+    struct bstring key;
+    struct val val;
+    struct item *it, *buf;
+
+    test_setup_concurrent(CUCKOO_NITEM);
+    buf = cc_alloc(cuckoo_item_size());
+    bstring_set_literal(&key, KEY);
+
+    time_update();
+    ck_assert_ptr_eq(cuckoo_read(&key, buf), NULL);
+
+    val.type = VAL_TYPE_INT;
+    val.vint = 42;
+    cuckoo_lock(&key);
+    it = cuckoo_insert(&key, &val, INT32_MAX);
+    cuckoo_unlock();
+    ck_assert_msg(it != NULL, "cuckoo_insert not OK");
+
+    /* reads return a copy, which a later write leaves alone */
+    ck_assert_ptr_eq(cuckoo_read(&key, buf), buf);
+    ck_assert_int_eq(item_value_int(buf), 42);
+    val.vint = 43;
+    cuckoo_lock(&key);
+    ck_assert_int_eq(cuckoo_update(cuckoo_get(&key), &val, INT32_MAX), CC_OK);
+    cuckoo_unlock();
+    ck_assert_int_eq(item_value_int(buf), 42);
+    ck_assert_ptr_eq(cuckoo_read(&key, buf), buf);
+    ck_assert_int_eq(item_value_int(buf), 43);
+
+    cuckoo_lock(&key);
+    ck_assert(cuckoo_delete(&key));
+    cuckoo_unlock();
+    ck_assert_ptr_eq(cuckoo_read(&key, buf), NULL);
+
+    cc_free(buf);
+#undef KEY
+}
+END_TEST
+
+#define CONCURRENT_NITEM    4096
+#define CONCURRENT_NKEY     3000 /* per writer, keys of writers don't overlap */
+#define CONCURRENT_NWRITER  2
+#define CONCURRENT_NREADER  2
+#define CONCURRENT_NROUND   20
+#define KEY_BITS            16
+
+static uint32_t concurrent_nwriting;
+static uint64_t concurrent_nerror;
+
+static void
+_concurrent_key(struct bstring *key, char *buf, uint64_t i)
+{
+    key->len = sprintf(buf, "key%"PRIu64, i);
+    key->data = buf;
+}
+
+/* writes the keys of writer id, CONCURRENT_NROUND times, the round in vals */
+static void *
+_concurrent_write(void *arg)
+{
+    uint64_t id = (uintptr_t)arg, i, r;
+    struct bstring key;
+    struct val val;
+    char buf[30];
+
+    for (r = 0; r < CONCURRENT_NROUND; r++) {
+        for (i = id * CONCURRENT_NKEY; i < (id + 1) * CONCURRENT_NKEY; i++) {
+            _concurrent_key(&key, buf, i);
+            val.type = VAL_TYPE_INT;
+            val.vint = (r << KEY_BITS) | i;
+            cuckoo_lock(&key);
+            if (cuckoo_get(&key) != NULL) {
+                cuckoo_update(cuckoo_get(&key), &val, INT32_MAX);
+            } else if (cuckoo_insert(&key, &val, INT32_MAX) == NULL) {
+                __atomic_add_fetch(&concurrent_nerror, 1, __ATOMIC_RELAXED);
+            }
+            cuckoo_unlock();
+        }
+    }
+    __atomic_sub_fetch(&concurrent_nwriting, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+/* reads keys until writers are done, every item read must be the key's */
+static void *
+_concurrent_read(void *arg)
+{
+    uint64_t i = (uintptr_t)arg;
+    struct bstring key;
+    struct item *it, *copy;
+    char buf[30];
+
+    copy = cc_alloc(cuckoo_item_size());
+    while (__atomic_load_n(&concurrent_nwriting, __ATOMIC_ACQUIRE) > 0) {
+        i = (i + 7919) % (CONCURRENT_NKEY * CONCURRENT_NWRITER);
+        _concurrent_key(&key, buf, i);
+        it = cuckoo_read(&key, copy);
+        if (it != NULL && (!item_matched(it, &key) ||
+                    (item_value_int(it) & ((1 << KEY_BITS) - 1)) != i)) {
+            __atomic_add_fetch(&concurrent_nerror, 1, __ATOMIC_RELAXED);
+        }
+    }
+    cc_free(copy);
+
+    return NULL;
+}
+
+START_TEST(test_concurrent_readers)
+{
+    pthread_t writer[CONCURRENT_NWRITER], reader[CONCURRENT_NREADER];
+    struct bstring key;
+    struct item *it;
+    char buf[30];
+    uint64_t i, hits = 0;
+
+    test_setup_concurrent(CONCURRENT_NITEM);
+    time_update();
+
+    concurrent_nerror = 0;
+    concurrent_nwriting = CONCURRENT_NWRITER;
+    for (i = 0; i < CONCURRENT_NWRITER; i++) {
+        ck_assert_int_eq(pthread_create(&writer[i], NULL, _concurrent_write,
+                    (void *)(uintptr_t)i), 0);
+    }
+    for (i = 0; i < CONCURRENT_NREADER; i++) {
+        ck_assert_int_eq(pthread_create(&reader[i], NULL, _concurrent_read,
+                    (void *)(uintptr_t)i), 0);
+    }
+    for (i = 0; i < CONCURRENT_NWRITER; i++) {
+        pthread_join(writer[i], NULL);
+    }
+    for (i = 0; i < CONCURRENT_NREADER; i++) {
+        pthread_join(reader[i], NULL);
+    }
+    ck_assert_int_eq(concurrent_nerror, 0);
+
+    /* no item was lost or duplicated by racing displacements */
+    for (i = 0; i < CONCURRENT_NKEY * CONCURRENT_NWRITER; i++) {
+        _concurrent_key(&key, buf, i);
+        it = cuckoo_get(&key);
+        if (it != NULL) {
+            ck_assert_int_eq(item_value_int(it),
+                    ((uint64_t)(CONCURRENT_NROUND - 1) << KEY_BITS) | i);
+            hits++;
+        }
+    }
+    ck_assert_int_eq(hits, metrics.item_curr.gauge);
+    ck_assert_uint_gt(hits, CONCURRENT_NITEM / 2);
+}
+END_TEST
+
+static void
+test_setup_overflow(uint32_t nitem, size_t size, size_t slab)
+{
+    test_options(CUCKOO_POLICY, CUCKOO_ITEM_CAS, CUCKOO_MAX_TTL);
+    options.cuckoo_nitem.val.vuint = nitem;
+    options.cuckoo_overflow_size.val.vuint = size;
+    options.cuckoo_overflow_slab.val.vuint = slab;
+    test_reload();
+}
+
+START_TEST(test_overflow_basic)
+{
+#define KEY "key"
+#define VLEN 1000
+    struct bstring key, vstr;
+    struct val val;
+    struct item *it;
+    char large[VLEN];
+
+    memset(large, 'v', VLEN);
+    bstring_set_literal(&key, KEY);
+    val.type = VAL_TYPE_STR;
+    val.vstr.data = large;
+    val.vstr.len = VLEN;
+
+    /* without an arena, values larger than a slot are rejected */
+    test_setup_overflow(CUCKOO_NITEM, 0, CUCKOO_OVERFLOW_SLAB);
+    time_update();
+    ck_assert_ptr_eq(cuckoo_insert(&key, &val, INT32_MAX), NULL);
+
+    test_setup_overflow(CUCKOO_NITEM, 64 * KiB, 16 * KiB);
+    time_update();
+    it = cuckoo_insert(&key, &val, INT32_MAX);
+    ck_assert_msg(it != NULL, "cuckoo_insert not OK");
+    ck_assert(item_overflowed(it));
+    ck_assert_int_eq(metrics.overflow_curr.gauge, 1);
+    ck_assert_int_eq(metrics.item_val_curr.gauge, VLEN);
+
+    it = cuckoo_get(&key);
+    ck_assert_msg(it != NULL, "cuckoo_get returned NULL");
+    item_value_str(&vstr, it);
+    ck_assert_int_eq(vstr.len, VLEN);
+    ck_assert_int_eq(cc_bcmp(vstr.data, large, VLEN), 0);
+
+    /* back to a small value in the slot, and out again */
+    bstring_set_literal(&val.vstr, "small");
+    ck_assert_int_eq(cuckoo_update(it, &val, INT32_MAX), CC_OK);
+    ck_assert(!item_overflowed(it));
+    ck_assert_int_eq(metrics.overflow_curr.gauge, 0);
+    item_value_str(&vstr, it);
+    ck_assert_int_eq(vstr.len, sizeof("small") - 1);
+
+    large[0] = 'w';
+    val.vstr.data = large;
+    val.vstr.len = VLEN;
+    ck_assert_int_eq(cuckoo_update(it, &val, INT32_MAX), CC_OK);
+    ck_assert(item_overflowed(it));
+    item_value_str(&vstr, it);
+    ck_assert_int_eq(cc_bcmp(vstr.data, large, VLEN), 0);
+
+    /* a value larger than a slab has no room anywhere */
+    val.vstr.len = 16 * KiB;
+    ck_assert_int_eq(cuckoo_update(it, &val, INT32_MAX), CC_ERROR);
+    ck_assert_int_eq(metrics.overflow_curr.gauge, 1);
+
+    ck_assert(cuckoo_delete(&key));
+    ck_assert_int_eq(metrics.overflow_curr.gauge, 0);
+    ck_assert_int_eq(metrics.item_curr.gauge, 0);
+    ck_assert_int_eq(metrics.item_data_curr.gauge, 0);
+#undef KEY
+#undef VLEN
+}
+END_TEST
+
+/*
+ * with room for fewer values than keys, and few slots, inserting values needs
+ * both evictions from the arena and displacements in the table
+ */
+START_TEST(test_overflow_evict)
+{
+#define NITEM 256
+#define NKEY 1024
+#define VLEN 500
+    struct bstring key, vstr;
+    struct val val;
+    struct item *it;
+    char keystring[30], large[VLEN];
+    uint64_t i, hits = 0, noverflow = 0;
+
+    test_setup_overflow(NITEM, 64 * KiB, 8 * KiB);
+    time_update();
+
+    val.type = VAL_TYPE_STR;
+    for (i = 0; i < NKEY; i++) {
+        key.len = sprintf(keystring, "%"PRIu64, i);
+        key.data = keystring;
+        if (i % 4 == 0) { /* some small ones, too */
+            val.vstr = key;
+        } else {
+            memset(large, 'a' + i % 26, VLEN);
+            val.vstr.data = large;
+            val.vstr.len = VLEN;
+        }
+        ck_assert_msg(cuckoo_insert(&key, &val, INT32_MAX) != NULL,
+                "cuckoo_insert not OK");
+    }
+    ck_assert_uint_gt(metrics.overflow_evict.counter, 0);
+    ck_assert_uint_gt(metrics.item_displace.counter, 0);
+
+    for (i = 0; i < NKEY; i++) {
+        key.len = sprintf(keystring, "%"PRIu64, i);
+        key.data = keystring;
+        it = cuckoo_get(&key);
+        if (it == NULL) {
+            continue;
+        }
+        hits++;
+        item_value_str(&vstr, it);
+        if (i % 4 == 0) {
+            ck_assert(!item_overflowed(it));
+            ck_assert_int_eq(bstring_compare(&vstr, &key), 0);
+        } else {
+            ck_assert(item_overflowed(it));
+            ck_assert_int_eq(vstr.len, VLEN);
+            ck_assert_int_eq(vstr.data[0], 'a' + i % 26);
+            ck_assert_int_eq(vstr.data[VLEN - 1], 'a' + i % 26);
+            noverflow++;
+        }
+    }
+    ck_assert_int_eq(hits, metrics.item_curr.gauge);
+    ck_assert_int_eq(noverflow, metrics.overflow_curr.gauge);
+    ck_assert_uint_gt(noverflow, 64 * KiB / (VLEN * 2));
+#undef NITEM
+#undef NKEY
+#undef VLEN
+}
+END_TEST
+
 /*
  * test suite
  */
@@ -472,6 +963,26 @@ cuckoo_suite(void)
     tcase_add_test(tc_basic_req, test_expire_truncated_random_false);
     tcase_add_test(tc_basic_req, test_insert_replace_expired);
     tcase_add_test(tc_basic_req, test_insert_insert_expire_swap);
+    tcase_add_test(tc_basic_req, test_nhash_seed);
+    tcase_add_test(tc_basic_req, test_displace_depth);
+
+    TCase *tc_bucket = tcase_create("bucketized table");
+    suite_add_tcase(s, tc_bucket);
+
+    tcase_add_test(tc_bucket, test_bucket_basic);
+    tcase_add_test(tc_bucket, test_bucket_load);
+
+    TCase *tc_concurrent = tcase_create("concurrent table");
+    suite_add_tcase(s, tc_concurrent);
+
+    tcase_add_test(tc_concurrent, test_concurrent_basic);
+    tcase_add_test(tc_concurrent, test_concurrent_readers);
+
+    TCase *tc_overflow = tcase_create("overflow arena");
+    suite_add_tcase(s, tc_overflow);
+
+    tcase_add_test(tc_overflow, test_overflow_basic);
+    tcase_add_test(tc_overflow, test_overflow_evict);
 
     return s;
 }
@@ -148,6 +148,48 @@ test_insert_collision(uint32_t policy, bool cas)
     ck_assert_msg(hits <= CUCKOO_NITEM, "hit rate is too high, expected more evicted values");
 }
 
+/**
+ * Tests that a data pool laid out with other options is started afresh, as
+ * its items would not be where their keys now map to.
+ */
+START_TEST(test_layout_change)
+{
+#define KEY "key"
+#define VAL "value"
+    struct bstring key;
+    struct val val;
+
+    test_reset(CUCKOO_POLICY_RANDOM, true, CUCKOO_MAX_TTL, 1);
+
+    bstring_set_literal(&key, KEY);
+    val.type = VAL_TYPE_STR;
+    bstring_set_literal(&val.vstr, VAL);
+
+    time_update();
+    ck_assert_msg(cuckoo_insert(&key, &val, INT32_MAX) != NULL,
+            "cuckoo_insert not OK");
+
+    test_teardown(0);
+    options.cuckoo_seed.val.vuint = CUCKOO_SEED + 1;
+    cuckoo_setup(&options, &metrics);
+    ck_assert_ptr_eq(cuckoo_get(&key), NULL);
+    /* nor is the item back with the old layout */
+    test_teardown(0);
+    options.cuckoo_seed.val.vuint = CUCKOO_SEED;
+    cuckoo_setup(&options, &metrics);
+    ck_assert_ptr_eq(cuckoo_get(&key), NULL);
+
+    ck_assert_msg(cuckoo_insert(&key, &val, INT32_MAX) != NULL,
+            "cuckoo_insert not OK");
+    test_teardown(0);
+    cuckoo_setup(&options, &metrics);
+    test_assert_entry_exists(&key, &val);
+
+    test_reset(CUCKOO_POLICY_RANDOM, true, CUCKOO_MAX_TTL, 1);
+#undef KEY
+#undef VAL
+}
+END_TEST
 
 START_TEST(test_insert_basic_random_true)
 {
@@ -187,6 +229,7 @@ cuckoo_suite(void)
 
     tcase_add_test(tc_basic, test_insert_basic_random_true);
     tcase_add_test(tc_basic, test_insert_basic_expire_true);
+    tcase_add_test(tc_basic, test_layout_change);
 
     TCase *tc_collision = tcase_create("collision");
     suite_add_tcase(s, tc_collision);
@@ -0,0 +1,645 @@
+#include <storage/seg/item.h>
+#include <storage/seg/seg.h>
+
+#include <time/time.h>
+
+#include <cc_bstring.h>
+#include <cc_mm.h>
+
+#include <check.h>
+#include <stdio.h>
+#include <string.h>
+
+/* define for each suite, local scope due to macro visibility rule */
+#define SUITE_NAME "seg"
+#define DEBUG_LOG  SUITE_NAME ".log"
+
+seg_options_st options = { SEG_OPTION(OPTION_INIT) };
+seg_metrics_st metrics = { SEG_METRIC(METRIC_INIT) };
+
+extern delta_time_i max_ttl;
+
+/*
+ * utilities
+ */
+static void
+test_setup(void)
+{
+    option_load_default((struct option *)&options, OPTION_CARDINALITY(options));
+    metric_reset((struct metric *)&metrics, METRIC_CARDINALITY(metrics));
+    seg_setup(&options, &metrics);
+}
+
+static void
+test_teardown(void)
+{
+    seg_teardown();
+}
+
+static void
+test_reset(void)
+{
+    test_teardown();
+    test_setup();
+}
+
+/* set up with few small segments, so that tests run out of memory quickly */
+static void
+test_reset_small(uint32_t nseg, uint32_t evict_opt, uint32_t hash_power)
+{
+    test_teardown();
+    option_load_default((struct option *)&options, OPTION_CARDINALITY(options));
+    metric_reset((struct metric *)&metrics, METRIC_CARDINALITY(metrics));
+    options.seg_size.val.vuint = 4 * KiB;
+    options.seg_mem.val.vuint = nseg * 4 * KiB;
+    options.seg_evict_opt.val.vuint = evict_opt;
+    options.seg_hash_power.val.vuint = hash_power;
+    seg_setup(&options, &metrics);
+}
+
+static struct item *
+_insert(const char *k, const char *v, proc_time_i expire_at)
+{
+    struct bstring key, val;
+    item_rstatus_e status;
+    struct item *it;
+
+    key.data = (char *)k;
+    key.len = strlen(k);
+    val.data = (char *)v;
+    val.len = strlen(v);
+
+    status = item_reserve(&it, &key, &val, val.len, 0, expire_at);
+    if (status != ITEM_OK) {
+        return NULL;
+    }
+    item_insert(it, &key);
+
+    return it;
+}
+
+static struct item *
+_get(const char *k)
+{
+    struct bstring key;
+
+    key.data = (char *)k;
+    key.len = strlen(k);
+
+    return item_get(&key);
+}
+
+/**
+ * Tests basic functionality for item_insert with small key/val. Checks that the
+ * commands succeed and that the item returned is well-formed.
+ */
+START_TEST(test_insert_basic)
+{
+#define KEY "key"
+#define VAL "val"
+#define MLEN 8
+    struct bstring key, val;
+    item_rstatus_e status;
+    struct item *it;
+
+    test_reset();
+
+    key = str2bstr(KEY);
+    val = str2bstr(VAL);
+
+    time_update();
+    status = item_reserve(&it, &key, &val, val.len, MLEN, INT32_MAX);
+    ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d",
+            status);
+    ck_assert_msg(it != NULL, "item_reserve with key %.*s reserved NULL item",
+            key.len, key.data);
+    ck_assert_msg(!it->is_linked, "item with key %.*s not linked", key.len,
+            key.data);
+    ck_assert_int_eq(it->vlen, sizeof(VAL) - 1);
+    ck_assert_int_eq(it->klen, sizeof(KEY) - 1);
+    ck_assert_int_eq(item_data(it) - (char *)it, offsetof(struct item, end) +
+            item_cas_size() + MLEN + sizeof(KEY) - 1);
+    ck_assert_int_eq(it->size % ITEM_ALIGNMENT, 0);
+    ck_assert_int_eq(cc_memcmp(item_data(it), VAL, val.len), 0);
+
+    item_insert(it, &key);
+    it = item_get(&key);
+    ck_assert_msg(it != NULL, "item_get could not find key %.*s", key.len, key.data);
+    ck_assert_msg(it->is_linked, "item with key %.*s not linked", key.len, key.data);
+    ck_assert_int_eq(it->vlen, sizeof(VAL) - 1);
+    ck_assert_int_eq(cc_memcmp(VAL, item_data(it), sizeof(VAL) - 1), 0);
+    ck_assert_int_eq(it->klen, sizeof(KEY) - 1);
+    ck_assert_int_eq(cc_memcmp(KEY, item_key(it), sizeof(KEY) - 1), 0);
+    ck_assert_int_eq(metrics.item_linked_curr.gauge, 1);
+#undef MLEN
+#undef KEY
+#undef VAL
+}
+END_TEST
+
+/**
+ * Tests that an item cannot be larger than a segment
+ */
+START_TEST(test_insert_oversize)
+{
+#define KEY "key"
+    struct bstring key, val;
+    item_rstatus_e status;
+    struct item *it;
+
+    test_reset();
+
+    key = str2bstr(KEY);
+    val.len = SEG_SIZE;
+    val.data = cc_alloc(val.len);
+    cc_memset(val.data, 'A', val.len);
+
+    time_update();
+    status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+    ck_assert_int_eq(status, ITEM_EOVERSIZED);
+    ck_assert_ptr_eq(it, NULL);
+
+    val.len = SEG_SIZE / 2;
+    status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+    ck_assert_int_eq(status, ITEM_OK);
+    item_insert(it, &key);
+    it = item_get(&key);
+    ck_assert_ptr_ne(it, NULL);
+    ck_assert_int_eq(it->vlen, SEG_SIZE / 2);
+    ck_assert_int_eq(cc_memcmp(val.data, item_data(it), val.len), 0);
+
+    cc_free(val.data);
+#undef KEY
+}
+END_TEST
+
+/**
+ * Tests reserve, backfill and insert of an item with a value given in parts,
+ * and that a released reservation is never linked.
+ */
+START_TEST(test_reserve_backfill)
+{
+#define KEY "key"
+#define KEY2 "key2"
+#define VAL "val"
+    struct bstring key, val;
+    item_rstatus_e status;
+    struct item *it;
+    uint32_t vlen = 1000;
+
+    test_reset();
+
+    key = str2bstr(KEY);
+    val = str2bstr(VAL);
+
+    time_update();
+    status = item_reserve(&it, &key, &val, vlen, 0, INT32_MAX);
+    ck_assert_int_eq(status, ITEM_OK);
+    ck_assert_int_eq(item_to_seg(it)->refcount, 1);
+    ck_assert_int_eq(it->vlen, val.len);
+    while (it->vlen + val.len <= vlen) {
+        item_backfill(it, &val);
+    }
+    item_insert(it, &key);
+    ck_assert_int_eq(item_to_seg(it)->refcount, 0);
+
+    it = item_get(&key);
+    ck_assert_ptr_ne(it, NULL);
+    ck_assert_int_eq(it->vlen, vlen / val.len * val.len);
+    ck_assert_int_eq(cc_memcmp(item_data(it) + it->vlen - val.len, VAL,
+            val.len), 0);
+
+    key = str2bstr(KEY2);
+    status = item_reserve(&it, &key, &val, vlen, 0, INT32_MAX);
+    ck_assert_int_eq(status, ITEM_OK);
+    item_release(&it);
+    ck_assert_ptr_eq(it, NULL);
+    ck_assert_ptr_eq(item_get(&key), NULL);
+#undef KEY
+#undef KEY2
+#undef VAL
+}
+END_TEST
+
+/**
+ * Tests append and prepend, which move the value into a new item
+ */
+START_TEST(test_annex)
+{
+#define KEY "key"
+#define VAL "val"
+#define MLEN 4
+    struct bstring key, val, app, pre;
+    item_rstatus_e status;
+    struct item *it, *oit;
+
+    test_reset();
+
+    key = str2bstr(KEY);
+    val = str2bstr(VAL);
+    app = str2bstr("_app");
+    pre = str2bstr("pre_");
+
+    time_update();
+    status = item_reserve(&it, &key, &val, val.len, MLEN, INT32_MAX);
+    ck_assert_int_eq(status, ITEM_OK);
+    cc_memcpy(item_optional(it), "flag", MLEN);
+    item_insert(it, &key);
+
+    oit = item_get(&key);
+    status = item_annex(oit, &key, &app, true);
+    ck_assert_int_eq(status, ITEM_OK);
+    it = item_get(&key);
+    ck_assert_ptr_ne(it, oit);
+    ck_assert(!oit->is_linked);
+    ck_assert_int_eq(it->vlen, 7);
+    ck_assert_int_eq(cc_memcmp(item_data(it), "val_app", 7), 0);
+
+    status = item_annex(it, &key, &pre, false);
+    ck_assert_int_eq(status, ITEM_OK);
+    it = item_get(&key);
+    ck_assert_int_eq(it->vlen, 11);
+    ck_assert_int_eq(cc_memcmp(item_data(it), "pre_val_app", 11), 0);
+    ck_assert_int_eq(cc_memcmp(item_optional(it), "flag", MLEN), 0);
+    ck_assert_int_eq(metrics.item_linked_curr.gauge, 1);
+#undef KEY
+#undef VAL
+#undef MLEN
+}
+END_TEST
+
+/**
+ * Tests in place update, which is only allowed within the space reserved
+ */
+START_TEST(test_update_basic)
+{
+#define KEY "key"
+#define VAL "val"
+#define NEW_VAL "new"
+    struct bstring key, new_val;
+    struct item *it;
+
+    test_reset();
+
+    key = str2bstr(KEY);
+    new_val = str2bstr(NEW_VAL);
+
+    time_update();
+    it = _insert(KEY, VAL, INT32_MAX);
+    ck_assert_ptr_ne(it, NULL);
+    ck_assert(item_fits(it, new_val.len));
+    ck_assert(!item_fits(it, it->size));
+
+    item_update(it, &new_val);
+    it = item_get(&key);
+    ck_assert_int_eq(it->vlen, new_val.len);
+    ck_assert_int_eq(cc_memcmp(item_data(it), NEW_VAL, new_val.len), 0);
+#undef KEY
+#undef VAL
+#undef NEW_VAL
+}
+END_TEST
+
+/**
+ * Tests delete, and that replacing an item unlinks the old one
+ */
+START_TEST(test_delete_replace)
+{
+#define KEY "key"
+    struct bstring key;
+    struct item *oit, *it;
+
+    test_reset();
+
+    key = str2bstr(KEY);
+
+    time_update();
+    oit = _insert(KEY, "val1", INT32_MAX);
+    it = _insert(KEY, "val2", INT32_MAX);
+    ck_assert(!oit->is_linked);
+    ck_assert_ptr_eq(item_get(&key), it);
+    ck_assert_int_eq(metrics.item_linked_curr.gauge, 1);
+
+    ck_assert(item_delete(&key));
+    ck_assert_ptr_eq(item_get(&key), NULL);
+    ck_assert(!item_delete(&key));
+    ck_assert_int_eq(metrics.item_linked_curr.gauge, 0);
+#undef KEY
+}
+END_TEST
+
+/**
+ * Tests that flush drops all items, and that items written after the flush
+ * are kept
+ */
+START_TEST(test_flush_basic)
+{
+    struct item *it;
+
+    test_reset();
+
+    time_update();
+    _insert("key1", "val1", INT32_MAX);
+    _insert("key2", "val2", INT32_MAX);
+
+    item_flush();
+    ck_assert_ptr_eq(_get("key1"), NULL);
+    ck_assert_ptr_eq(_get("key2"), NULL);
+    ck_assert_int_eq(metrics.item_linked_curr.gauge, 0);
+    ck_assert_int_eq(metrics.seg_curr.gauge, 0);
+
+    /* writes in the same second as the flush are kept */
+    it = _insert("key1", "val1", INT32_MAX);
+    ck_assert_ptr_ne(it, NULL);
+    ck_assert_ptr_eq(_get("key1"), it);
+    ck_assert_int_eq(metrics.seg_curr.gauge, 1);
+
+    proc_sec++;
+    it = _insert("key3", "val3", INT32_MAX);
+    ck_assert_ptr_ne(it, NULL);
+    ck_assert_ptr_eq(_get("key3"), it);
+}
+END_TEST
+
+START_TEST(test_expire_basic)
+{
+#define TIME 12345678
+    struct item *it;
+
+    test_reset();
+
+    proc_sec = TIME;
+    _insert("key", "val", TIME + 1);
+
+    it = _get("key");
+    ck_assert_msg(it != NULL, "item_get on unexpired item not successful");
+
+    proc_sec += 2;
+    it = _get("key");
+    ck_assert_msg(it == NULL, "item_get returned not NULL after expiration");
+#undef TIME
+}
+END_TEST
+
+START_TEST(test_expire_truncated)
+{
+#define TIME 12345678
+#define TTL_MAX 10
+#define TTL_LONG (TTL_MAX + 5)
+    struct item *it;
+
+    test_reset();
+    max_ttl = TTL_MAX;
+
+    proc_sec = TIME;
+    _insert("key", "value", TIME + TTL_LONG);
+
+    it = _get("key");
+    ck_assert_msg(it != NULL, "item_get on unexpired item not successful");
+    proc_sec += (TTL_MAX + 2);
+    it = _get("key");
+    ck_assert_msg(it == NULL, "item_get returned not NULL after max ttl elapsed");
+    max_ttl = ITEM_MAX_TTL;
+#undef TIME
+#undef TTL_MAX
+#undef TTL_LONG
+}
+END_TEST
+
+/**
+ * Tests that segments are reclaimed once all their items have expired,
+ * without the items being read, and that items of other TTLs are kept
+ */
+START_TEST(test_expire_segment)
+{
+#define TIME 12345678
+    char key[32];
+    uint32_t i;
+
+    test_reset();
+
+    proc_sec = TIME;
+    for (i = 0; i < 100; ++i) {
+        sprintf(key, "short%u", i);
+        ck_assert_ptr_ne(_insert(key, "val", TIME + 10), NULL);
+        sprintf(key, "long%u", i);
+        ck_assert_ptr_ne(_insert(key, "val", TIME + 1000), NULL);
+    }
+    ck_assert_int_eq(metrics.seg_curr.gauge, 2);
+    ck_assert_int_eq(metrics.item_linked_curr.gauge, 200);
+
+    proc_sec += 20;
+    ck_assert_int_eq(seg_expire(), 1);
+    ck_assert_int_eq(metrics.seg_curr.gauge, 1);
+    ck_assert_int_eq(metrics.seg_expire.counter, 1);
+    ck_assert_int_eq(metrics.item_expire.counter, 100);
+    ck_assert_int_eq(metrics.item_linked_curr.gauge, 100);
+    ck_assert_ptr_eq(_get("short0"), NULL);
+    ck_assert_ptr_ne(_get("long0"), NULL);
+
+    /* writes scan for expired segments once a second */
+    proc_sec += 1000;
+    ck_assert_ptr_ne(_insert("other", "val", TIME + 10000), NULL);
+    ck_assert_int_eq(metrics.seg_curr.gauge, 1);
+    ck_assert_int_eq(metrics.item_linked_curr.gauge, 1);
+#undef TIME
+}
+END_TEST
+
+/**
+ * Tests that merging keeps items that were read and evicts the rest
+ */
+START_TEST(test_evict_merge)
+{
+#define NSEG 4
+#define TIME 12345678
+    char key[32], val[200];
+    uint32_t i, n, nkept = 0;
+
+    test_reset_small(NSEG, SEG_EVICT_MERGE, HASH_POWER);
+
+    proc_sec = TIME;
+    cc_memset(val, 'v', sizeof(val) - 1);
+    val[sizeof(val) - 1] = '\0';
+
+    /* fill all segments, reading every 4th item */
+    for (n = 0; metrics.seg_free.gauge > 0; ++n) {
+        sprintf(key, "key%u", n);
+        ck_assert_ptr_ne(_insert(key, val, TIME + 1000), NULL);
+        if (n % 4 == 0) {
+            ck_assert_ptr_ne(_get(key), NULL);
+        }
+    }
+    ck_assert_int_eq(metrics.seg_merge.counter, 0);
+
+    /* more writes fill the last segment, then need merging once */
+    for (i = 0; i < n / 2; ++i) {
+        sprintf(key, "new%u", i);
+        ck_assert_ptr_ne(_insert(key, val, TIME + 1000), NULL);
+    }
+    ck_assert_int_gt(metrics.seg_merge.counter, 0);
+    ck_assert_int_gt(metrics.item_merge_keep.counter, 0);
+
+    ck_assert_int_eq(metrics.seg_merge.counter, 1);
+
+    /* the last key went into the segment that was not merged */
+    for (i = 0; i < n - 1; ++i) {
+        sprintf(key, "key%u", i);
+        if (_get(key) != NULL) {
+            ck_assert_msg(i % 4 == 0, "unread key %s kept by merge", key);
+            nkept++;
+        }
+    }
+    ck_assert_int_gt(nkept, 0);
+    ck_assert_int_eq(nkept, metrics.item_merge_keep.counter);
+    for (i = 0; i < n / 2; ++i) {
+        sprintf(key, "new%u", i);
+        ck_assert_ptr_ne(_get(key), NULL);
+    }
+#undef NSEG
+#undef TIME
+}
+END_TEST
+
+/**
+ * Tests that items moved elsewhere are found while the hash table grows
+ */
+START_TEST(test_hash_replace)
+{
+#define TIME 12345678
+#define VAL "val"
+    char key[32];
+    struct bstring bkey, bval;
+    item_rstatus_e status;
+    struct item *it, *nit, *copy;
+    uint32_t i, n;
+
+    test_reset_small(16, SEG_EVICT_NONE, 4);
+
+    proc_sec = TIME;
+    bval = str2bstr(VAL);
+
+    /* stop while items are still being moved into the bigger table */
+    for (n = 0; hash_table->old == NULL; ++n) {
+        sprintf(key, "key%u", n);
+        ck_assert_ptr_ne(_insert(key, VAL, TIME + 1000), NULL);
+    }
+    ck_assert_int_gt(metrics.hash_grow.counter, 0);
+
+    /* as a merge does, copy each item and point its entry to the copy */
+    for (i = 0; i < n; ++i) {
+        sprintf(key, "key%u", i);
+        it = _get(key);
+        ck_assert_ptr_ne(it, NULL);
+        bkey.data = key;
+        bkey.len = strlen(key);
+        status = item_reserve(&nit, &bkey, &bval, bval.len, 0, TIME + 1000);
+        ck_assert_int_eq(status, ITEM_OK);
+        nit->is_linked = 1;
+        it->is_linked = 0;
+        hashtable_replace(it, nit, hash_table);
+        copy = nit;
+        item_release(&nit);
+        ck_assert_ptr_eq(_get(key), copy);
+    }
+    ck_assert_ptr_ne(hash_table->old, NULL);
+    ck_assert_int_eq(hash_table->nhash_item, n);
+#undef TIME
+#undef VAL
+}
+END_TEST
+
+/**
+ * Tests FIFO eviction, and that pinned or reserved items keep their segment
+ */
+START_TEST(test_evict_pin)
+{
+#define TIME 12345678
+    char key[32], val[2000];
+    struct bstring bkey, bval;
+    item_rstatus_e status;
+    struct item *pinned, *reserved;
+
+    test_reset_small(2, SEG_EVICT_FIFO, HASH_POWER);
+
+    proc_sec = TIME;
+    cc_memset(val, 'v', sizeof(val) - 1);
+    val[sizeof(val) - 1] = '\0';
+
+    pinned = _insert("pinned", val, TIME + 1000);
+    ck_assert(item_pin(pinned));
+
+    bkey = str2bstr("reserved");
+    bval.data = val;
+    bval.len = sizeof(val) - 1;
+    status = item_reserve(&reserved, &bkey, &bval, bval.len, 0, TIME + 10);
+    ck_assert_int_eq(status, ITEM_OK);
+
+    /* both segments are in use, nothing can be evicted */
+    sprintf(key, "key");
+    ck_assert_ptr_eq(_insert(key, val, TIME + 100000), NULL);
+    ck_assert_int_eq(metrics.seg_req_ex.counter, 1);
+
+    item_unpin(pinned);
+    ck_assert_ptr_ne(_insert(key, val, TIME + 100000), NULL);
+    ck_assert_ptr_eq(_get("pinned"), NULL);
+    ck_assert_int_eq(metrics.seg_evict.counter, 1);
+
+    item_insert(reserved, &bkey);
+    ck_assert_ptr_eq(_get("reserved"), reserved);
+#undef TIME
+}
+END_TEST
+
+/*
+ * test suite
+ */
+static Suite *
+seg_suite(void)
+{
+    Suite *s = suite_create(SUITE_NAME);
+
+    /* basic item */
+    TCase *tc_item = tcase_create("item api");
+    suite_add_tcase(s, tc_item);
+
+    tcase_add_test(tc_item, test_insert_basic);
+    tcase_add_test(tc_item, test_insert_oversize);
+    tcase_add_test(tc_item, test_reserve_backfill);
+    tcase_add_test(tc_item, test_annex);
+    tcase_add_test(tc_item, test_update_basic);
+    tcase_add_test(tc_item, test_delete_replace);
+    tcase_add_test(tc_item, test_flush_basic);
+    tcase_add_test(tc_item, test_expire_basic);
+    tcase_add_test(tc_item, test_expire_truncated);
+
+    TCase *tc_seg = tcase_create("seg api");
+    suite_add_tcase(s, tc_seg);
+    tcase_add_test(tc_seg, test_expire_segment);
+    tcase_add_test(tc_seg, test_evict_merge);
+    tcase_add_test(tc_seg, test_hash_replace);
+    tcase_add_test(tc_seg, test_evict_pin);
+
+    return s;
+}
+
+int
+main(void)
+{
+    int nfail;
+
+    /* setup */
+    test_setup();
+
+    Suite *suite = seg_suite();
+    SRunner *srunner = srunner_create(suite);
+    srunner_set_log(srunner, DEBUG_LOG);
+    srunner_run_all(srunner, CK_ENV); /* set CK_VEBOSITY in ENV to customize */
+    nfail = srunner_ntests_failed(srunner);
+    srunner_free(srunner);
+
+    /* teardown */
+    test_teardown();
+
+    return (nfail == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
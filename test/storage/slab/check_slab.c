@@ -1,3 +1,5 @@
+#include <storage/slab/admit.h>
+#include <storage/slab/hashtable.h>
 #include <storage/slab/item.h>
 #include <storage/slab/slab.h>
 
@@ -9,6 +11,7 @@
 #include <check.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 /* define for each suite, local scope due to macro visibility rule */
 #define SUITE_NAME "slab"
@@ -474,6 +477,62 @@ START_TEST(test_delete_basic)
 }
 END_TEST
 
+/**
+ * Tests that the hash table grows past its initial size, keeping all items
+ */
+START_TEST(test_hash_grow)
+{
+#define NKEY 2000
+#define VAL "val"
+    struct bstring key, val;
+    item_rstatus_e status;
+    struct item *it;
+    char keystr[32];
+    uint32_t i, hash_power;
+
+    option_load_default((struct option *)&options, OPTION_CARDINALITY(options));
+    options.slab_hash_power.val.vuint = 4;
+    test_teardown();
+    slab_setup(&options, &metrics);
+
+    hash_power = hash_table->hash_power;
+    val = str2bstr(VAL);
+    time_update();
+    for (i = 0; i < NKEY; i++) {
+        key.len = sprintf(keystr, "key%"PRIu32, i);
+        key.data = keystr;
+        status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+        ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+        item_insert(it, &key);
+    }
+    ck_assert_int_gt(hash_table->hash_power, hash_power);
+    ck_assert_int_eq(hash_table->nhash_item, NKEY);
+
+    for (i = 0; i < NKEY; i += 2) {
+        key.len = sprintf(keystr, "key%"PRIu32, i);
+        key.data = keystr;
+        ck_assert_msg(item_delete(&key), "item_delete for key %.*s not successful", key.len, key.data);
+    }
+    for (i = 0; i < NKEY; i++) {
+        key.len = sprintf(keystr, "key%"PRIu32, i);
+        key.data = keystr;
+        it = item_get(&key);
+        if (i % 2 == 0) {
+            ck_assert_msg(it == NULL, "item with key %.*s still exists after delete", key.len, key.data);
+        } else {
+            ck_assert_msg(it != NULL, "item_get could not find key %.*s", key.len, key.data);
+            ck_assert_int_eq(cc_memcmp(item_key(it), keystr, key.len), 0);
+        }
+    }
+    ck_assert_int_eq(hash_table->nhash_item, NKEY / 2);
+    ck_assert_int_eq(metrics.hash_item.gauge, NKEY / 2);
+    ck_assert_int_gt(metrics.hash_grow.counter, 0);
+    ck_assert(metrics.hash_load.fpn > 0 && metrics.hash_load.fpn < 1);
+#undef NKEY
+#undef VAL
+}
+END_TEST
+
 /**
  * Tests basic functionality for item_flush
  */
@@ -583,6 +642,74 @@ START_TEST(test_expire_truncated)
 }
 END_TEST
 
+/**
+ * Tests that the expiry scan reclaims expired items that are never read, and
+ * scans no more than the given number of items per call
+ */
+START_TEST(test_expire_scan)
+{
+#define NKEY 100
+#define NSCAN 10
+#define VAL "val"
+#define TIME 12345678
+    struct bstring key, val;
+    item_rstatus_e status;
+    struct item *it;
+    char keystr[32];
+    uint32_t i, nexpire, nfree, nloop;
+    uint8_t id;
+
+    test_reset();
+    metric_reset((struct metric *)&metrics, METRIC_CARDINALITY(metrics));
+
+    val = str2bstr(VAL);
+    proc_sec = TIME;
+    for (i = 0; i < NKEY; i++) {
+        key.len = sprintf(keystr, "key%03"PRIu32, i);
+        key.data = keystr;
+        status = item_reserve(&it, &key, &val, val.len, 0,
+                i % 2 == 0 ? TIME + 1 : INT32_MAX);
+        ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+        item_insert(it, &key);
+    }
+    id = it->id;
+    nfree = slabclass[id].nfree_itemq;
+
+    proc_sec += 2;
+    nexpire = slab_expire(NSCAN);
+    ck_assert_int_eq(nexpire, NSCAN / 2);
+    ck_assert_int_eq(metrics.expire_scan.counter, NSCAN);
+    ck_assert_int_eq(metrics.expire_pass.counter, 0);
+
+    /* all items are in one slab */
+    nloop = slabclass[id].nitem / NSCAN + 1;
+    for (i = 0; i < nloop && metrics.expire_pass.counter == 0; i++) {
+        nexpire += slab_expire(NSCAN);
+    }
+    ck_assert_int_eq(metrics.expire_pass.counter, 1);
+    ck_assert_int_eq(nexpire, NKEY / 2);
+    ck_assert_int_eq(metrics.expire_reclaim.counter, NKEY / 2);
+    ck_assert_int_eq(metrics.expire_byte.counter, NKEY / 2 * slabclass[id].size);
+    ck_assert_int_eq(slabclass[id].nfree_itemq, nfree + NKEY / 2);
+    ck_assert_int_eq(metrics.hash_item.gauge, NKEY / 2);
+
+    for (i = 0; i < NKEY; i++) {
+        key.len = sprintf(keystr, "key%03"PRIu32, i);
+        key.data = keystr;
+        it = item_get(&key);
+        if (i % 2 == 0) {
+            ck_assert_msg(it == NULL, "expired key %.*s still exists", key.len, key.data);
+        } else {
+            ck_assert_msg(it != NULL, "item_get could not find key %.*s", key.len, key.data);
+        }
+    }
+#undef NKEY
+#undef NSCAN
+#undef VAL
+#undef TIME
+}
+END_TEST
+
 START_TEST(test_evict_lru_basic)
 {
 #define MY_SLAB_SIZE 160
@@ -648,6 +775,278 @@ START_TEST(test_evict_lru_basic)
 }
 END_TEST
 
+/**
+ * Tests that the automover gives the oldest slab of a class that needs no
+ * evictions to the class that does, instead of that class evicting itself
+ */
+START_TEST(test_automove)
+{
+#define MY_SLAB_SIZE 4096
+#define MY_SLAB_NSLAB 4
+#define TIME 12345678
+#define SMALL 32
+#define BIG 800
+    char profile[] = "128 1024";
+    char keystr[32], valstr[BIG];
+    struct bstring key, val;
+    item_rstatus_e status;
+    struct item *it;
+    uint32_t i, nsmall, nbig;
+
+    option_load_default((struct option *)&options, OPTION_CARDINALITY(options));
+    options.slab_size.val.vuint = MY_SLAB_SIZE;
+    options.slab_mem.val.vuint = MY_SLAB_SIZE * MY_SLAB_NSLAB;
+    options.slab_evict_opt.val.vuint = EVICT_CS;
+    options.slab_profile.val.vstr = profile;
+    options.slab_item_max.val.vuint = MY_SLAB_SIZE - SLAB_HDR_SIZE;
+    options.slab_expire_nitem.val.vuint = 0;
+    proc_sec = TIME;
+    test_teardown();
+    slab_setup(&options, &metrics);
+    metric_reset((struct metric *)&metrics, METRIC_CARDINALITY(metrics));
+
+    cc_memset(valstr, 'v', BIG);
+    key.data = keystr;
+    val.data = valstr;
+    nsmall = slabclass[1].nitem;
+    nbig = slabclass[2].nitem;
+
+    /* the big items get the first slab, the small items all the others */
+    val.len = BIG;
+    for (i = 0; i < nbig; i++) {
+        key.len = sprintf(keystr, "b%"PRIu32, i);
+        status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+        ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+        item_insert(it, &key);
+    }
+    val.len = SMALL;
+    for (i = 0; i < nsmall * (MY_SLAB_NSLAB - 1); i++) {
+        key.len = sprintf(keystr, "s%"PRIu32, i);
+        status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+        ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+        item_insert(it, &key);
+    }
+    ck_assert_int_eq(perslab[1].slab_curr.gauge, MY_SLAB_NSLAB - 1);
+    ck_assert_int_eq(perslab[2].slab_curr.gauge, 1);
+
+    /* without a move, the big items can only evict their own (oldest) slab */
+    val.len = BIG;
+    key.len = sprintf(keystr, "b%"PRIu32, nbig);
+    status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+    ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+    item_insert(it, &key);
+    ck_assert_int_eq(perslab[2].slab_evict_req.counter, 1);
+    ck_assert_int_eq(perslab[2].slab_curr.gauge, 1);
+    key.len = sprintf(keystr, "b%"PRIu32, 0);
+    ck_assert_msg(item_get(&key) == NULL, "item b0 found, expected to be evicted");
+
+    /* rate-limited */
+    slab_automove_tick();
+    for (i = 1; i < nbig; i++) {
+        key.len = sprintf(keystr, "b%"PRIu32, nbig + i);
+        status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+        ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+        item_insert(it, &key);
+    }
+    ck_assert_int_eq(metrics.slab_move.counter, 0);
+
+    proc_sec += SLAB_AUTOMOVE_INTVL;
+    slab_automove_tick();
+    key.len = sprintf(keystr, "b%"PRIu32, 2 * nbig);
+    status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+    ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+    item_insert(it, &key);
+
+    ck_assert_int_eq(metrics.slab_move.counter, 1);
+    ck_assert_int_eq(perslab[1].slab_move_out.counter, 1);
+    ck_assert_int_eq(perslab[2].slab_move_in.counter, 1);
+    ck_assert_int_eq(perslab[1].slab_curr.gauge, MY_SLAB_NSLAB - 2);
+    ck_assert_int_eq(perslab[2].slab_curr.gauge, 2);
+    for (i = nbig; i <= 2 * nbig; i++) {
+        key.len = sprintf(keystr, "b%"PRIu32, i);
+        ck_assert_msg(item_get(&key) != NULL, "item_get could not find key %.*s", key.len, key.data);
+    }
+    key.len = sprintf(keystr, "s%"PRIu32, 0);
+    ck_assert_msg(item_get(&key) == NULL, "item s0 found, expected to be moved");
+    key.len = sprintf(keystr, "s%"PRIu32, nsmall);
+    ck_assert_msg(item_get(&key) != NULL, "item_get could not find key %.*s", key.len, key.data);
+#undef MY_SLAB_SIZE
+#undef MY_SLAB_NSLAB
+#undef TIME
+#undef SMALL
+#undef BIG
+}
+END_TEST
+
+/**
+ * Tests that item clock eviction evicts items that were not read since the
+ * hand last passed them, and not whole slabs
+ */
+START_TEST(test_evict_clock)
+{
+#define MY_SLAB_SIZE 4096
+#define MY_SLAB_NSLAB 2
+#define VAL "val"
+    char profile[] = "128";
+    char keystr[32];
+    struct bstring key, val;
+    item_rstatus_e status;
+    struct item *it;
+    uint32_t i, nkey;
+
+    option_load_default((struct option *)&options, OPTION_CARDINALITY(options));
+    options.slab_size.val.vuint = MY_SLAB_SIZE;
+    options.slab_mem.val.vuint = MY_SLAB_SIZE * MY_SLAB_NSLAB;
+    options.slab_evict_opt.val.vuint = EVICT_IC;
+    options.slab_profile.val.vstr = profile;
+    options.slab_item_max.val.vuint = MY_SLAB_SIZE - SLAB_HDR_SIZE;
+    test_teardown();
+    slab_setup(&options, &metrics);
+    metric_reset((struct metric *)&metrics, METRIC_CARDINALITY(metrics));
+
+    key.data = keystr;
+    val = str2bstr(VAL);
+    nkey = slabclass[1].nitem * MY_SLAB_NSLAB;
+    time_update();
+    for (i = 0; i < nkey; i++) {
+        key.len = sprintf(keystr, "k%"PRIu32, i);
+        status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+        ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+        item_insert(it, &key);
+    }
+
+    /* read every other key, then replace the other half */
+    for (i = 0; i < nkey; i += 2) {
+        key.len = sprintf(keystr, "k%"PRIu32, i);
+        ck_assert_msg(item_get(&key) != NULL, "item_get could not find key %.*s", key.len, key.data);
+    }
+    for (i = nkey; i < nkey + nkey / 2; i++) {
+        key.len = sprintf(keystr, "k%"PRIu32, i);
+        status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+        ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+        item_insert(it, &key);
+    }
+
+    ck_assert_int_eq(metrics.item_evict.counter, nkey / 2);
+    ck_assert_int_eq(metrics.slab_evict.counter, 0);
+    for (i = 0; i < nkey + nkey / 2; i++) {
+        key.len = sprintf(keystr, "k%"PRIu32, i);
+        it = item_get(&key);
+        if (i < nkey && i % 2 == 1) {
+            ck_assert_msg(it == NULL, "unread key %.*s not evicted", key.len, key.data);
+        } else {
+            ck_assert_msg(it != NULL, "item_get could not find key %.*s", key.len, key.data);
+        }
+    }
+#undef MY_SLAB_SIZE
+#undef MY_SLAB_NSLAB
+#undef VAL
+}
+END_TEST
+
+/**
+ * Tests that with the admission filter, a key that would evict an item which
+ * is read more often is rejected, until it is accessed more often itself.
+ * A set is recorded once, and a rejected set leaves the clock alone.
+ */
+START_TEST(test_admit)
+{
+#define MY_SLAB_SIZE 4096
+#define MY_SLAB_NSLAB 2
+#define NREAD 3
+#define NEW "new"
+#define VAL "val"
+    char profile[] = "128";
+    char keystr[32];
+    struct bstring key, val;
+    item_rstatus_e status;
+    struct item *it;
+    uint32_t i, j, nkey, nread, clock_slab, clock_item;
+
+    option_load_default((struct option *)&options, OPTION_CARDINALITY(options));
+    options.slab_size.val.vuint = MY_SLAB_SIZE;
+    options.slab_mem.val.vuint = MY_SLAB_SIZE * MY_SLAB_NSLAB;
+    options.slab_evict_opt.val.vuint = EVICT_IC;
+    options.slab_profile.val.vstr = profile;
+    options.slab_item_max.val.vuint = MY_SLAB_SIZE - SLAB_HDR_SIZE;
+    options.slab_admit_nkey.val.vuint = 1024;
+    test_teardown();
+    slab_setup(&options, &metrics);
+    metric_reset((struct metric *)&metrics, METRIC_CARDINALITY(metrics));
+
+    key.data = keystr;
+    val = str2bstr(VAL);
+    nkey = slabclass[1].nitem * MY_SLAB_NSLAB;
+    time_update();
+    for (i = 0; i < nkey; i++) {
+        key.len = sprintf(keystr, "k%"PRIu32, i);
+        ck_assert(item_admit(&key, val.len, 0));
+        status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+        ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+        item_insert(it, &key);
+        ck_assert_uint_eq(admit_estimate(admit_filter, key.data, key.len), 1);
+        for (j = 0; j < NREAD; j++) {
+            ck_assert(item_get(&key) != NULL);
+        }
+    }
+    ck_assert_int_eq(metrics.admit_accept.counter, 0);
+    ck_assert_int_eq(metrics.admit_reject.counter, 0);
+
+    clock_slab = slabclass[1].clock_slab;
+    clock_item = slabclass[1].clock_item;
+    key = str2bstr(NEW);
+    ck_assert_msg(!item_admit(&key, val.len, 0), "new key admitted over read keys");
+    ck_assert_int_eq(metrics.admit_reject.counter, 1);
+    ck_assert_uint_eq(slabclass[1].clock_slab, clock_slab);
+    ck_assert_uint_eq(slabclass[1].clock_item, clock_item);
+    key.data = keystr;
+    for (i = 0; i < nkey; i++) {
+        key.len = sprintf(keystr, "k%"PRIu32, i);
+        it = hashtable_get(key.data, key.len, hash_table);
+        ck_assert_msg(it->is_accessed, "access bit cleared by rejected set");
+    }
+    key = str2bstr(NEW);
+
+    for (j = 0; j < 2 * NREAD; j++) {
+        ck_assert(item_get(&key) == NULL);
+    }
+    ck_assert_msg(item_admit(&key, val.len, 0), "key read more often not admitted");
+    ck_assert_int_eq(metrics.admit_accept.counter, 1);
+    status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+    ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+    item_insert(it, &key);
+    ck_assert(item_get(&key) != NULL);
+    ck_assert_int_eq(metrics.item_evict.counter, 1);
+
+    /* a key that is stored is admitted however rarely it is read */
+    key.data = keystr;
+    for (i = 0; i < nkey; i++) {
+        key.len = sprintf(keystr, "k%"PRIu32, i);
+        if (hashtable_get(key.data, key.len, hash_table) != NULL) {
+            break;
+        }
+    }
+    ck_assert_uint_lt(i, nkey);
+    for (j = i + 1; j < nkey; j++) {
+        key.len = sprintf(keystr, "k%"PRIu32, j);
+        for (nread = 0; nread < 4 * NREAD; nread++) {
+            item_get(&key);
+        }
+    }
+    key.len = sprintf(keystr, "k%"PRIu32, i);
+    ck_assert_msg(item_admit(&key, val.len, 0), "stored key not admitted");
+
+    /* a filter too large to index is not created */
+    ck_assert_ptr_eq(admit_create((uint64_t)ADMIT_NKEY_MAX + 1), NULL);
+    ck_assert_ptr_eq(admit_create(UINT32_MAX + 2ULL), NULL);
+#undef MY_SLAB_SIZE
+#undef MY_SLAB_NSLAB
+#undef NREAD
+#undef NEW
+#undef VAL
+}
+END_TEST
+
 START_TEST(test_refcount)
 {
 #define KEY "key"
@@ -682,6 +1081,52 @@ START_TEST(test_refcount)
 }
 END_TEST
 
+START_TEST(test_pin)
+{
+#define KEY "key"
+#define VAL "val"
+    struct bstring key, val;
+    item_rstatus_e status;
+    struct item *it, *nit;
+    struct slab *s;
+
+    test_reset();
+
+    key = str2bstr(KEY);
+    val = str2bstr(VAL);
+
+    status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+    ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+    item_insert(it, &key);
+    s = item_to_slab(it);
+
+    /* pinning holds the slab, unpinning a linked item does not free it */
+    ck_assert(item_pin(it));
+    ck_assert_msg(s->refcount == 1, "slab refcount %"PRIu32"; 1 expected", s->refcount);
+    item_unpin(it);
+    ck_assert_msg(s->refcount == 0, "slab refcount %"PRIu32"; 0 expected", s->refcount);
+    ck_assert_ptr_eq(item_get(&key), it);
+
+    /* a pinned item deleted is not reused until unpinned */
+    ck_assert(item_pin(it));
+    ck_assert(item_delete(&key));
+    ck_assert_msg(item_get(&key) == NULL, "item with key %.*s still exists after delete", key.len, key.data);
+    ck_assert_int_eq(it->in_freeq, 0);
+    ck_assert_int_eq(cc_memcmp(item_data(it), VAL, sizeof(VAL) - 1), 0);
+
+    status = item_reserve(&nit, &key, &val, val.len, 0, INT32_MAX);
+    ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+    ck_assert_ptr_ne(nit, it);
+    item_release(&nit);
+
+    item_unpin(it);
+    ck_assert_int_eq(it->in_freeq, 1);
+    ck_assert_msg(s->refcount == 0, "slab refcount %"PRIu32"; 0 expected", s->refcount);
+#undef KEY
+#undef VAL
+}
+END_TEST
+
 START_TEST(test_evict_refcount)
 {
 #define MY_SLAB_SIZE 96
@@ -725,6 +1170,208 @@ START_TEST(test_evict_refcount)
 }
 END_TEST
 
+START_TEST(test_numa)
+{
+#define MY_SLAB_SIZE (64 * KiB)
+#define MY_SLAB_NSLAB 4
+#define KEY "key"
+#define VAL "val"
+    char nodes[] = "0";
+    struct bstring key, val;
+    item_rstatus_e status;
+    struct item *it;
+
+    option_load_default((struct option *)&options, OPTION_CARDINALITY(options));
+    options.slab_size.val.vuint = MY_SLAB_SIZE;
+    options.slab_mem.val.vuint = MY_SLAB_SIZE * MY_SLAB_NSLAB;
+    options.slab_item_max.val.vuint = MY_SLAB_SIZE - SLAB_HDR_SIZE;
+    options.slab_datapool_prefault.val.vbool = true;
+    options.slab_numa_nodes.val.vstr = nodes;
+
+    test_teardown();
+    slab_setup(&options, &metrics);
+    ck_assert_int_gt(metrics.heap_page.gauge, 0);
+
+    key = str2bstr(KEY);
+    val = str2bstr(VAL);
+    time_update();
+    status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+    ck_assert_int_eq(status, ITEM_OK);
+    item_insert(it, &key);
+
+    it = item_get(&key);
+    ck_assert_ptr_nonnull(it);
+    ck_assert_int_eq(cc_bcmp(item_data(it), VAL, val.len), 0);
+#undef KEY
+#undef VAL
+#undef MY_SLAB_SIZE
+#undef MY_SLAB_NSLAB
+}
+END_TEST
+
+START_TEST(test_snapshot)
+{
+#define NKEY 1000
+#define NSCAN 64
+#define OPT "abcd"
+#define TIME 12345678
+#define SNAPSHOT "./slab_snapshot.pelikan"
+#define SAVED SNAPSHOT ".saved"
+    char path[] = SNAPSHOT;
+    struct bstring key, val;
+    item_rstatus_e status;
+    struct item *it;
+    char keystr[32], valstr[32];
+    uint32_t i, nloop;
+    uint8_t id;
+
+    unlink(SNAPSHOT);
+    option_load_default((struct option *)&options, OPTION_CARDINALITY(options));
+    options.slab_snapshot.val.vstr = path;
+    options.slab_snapshot_nitem.val.vuint = NSCAN;
+
+    test_teardown();
+    slab_setup(&options, &metrics);
+    metric_reset((struct metric *)&metrics, METRIC_CARDINALITY(metrics));
+
+    proc_sec = TIME;
+    for (i = 0; i < NKEY; i++) {
+        key.len = sprintf(keystr, "key%04"PRIu32, i);
+        key.data = keystr;
+        val.len = sprintf(valstr, "val%04"PRIu32, i);
+        val.data = valstr;
+        status = item_reserve(&it, &key, &val, val.len, sizeof(OPT) - 1,
+                i % 4 == 0 ? TIME + 1 : INT32_MAX);
+        ck_assert_int_eq(status, ITEM_OK);
+        cc_memcpy(item_optional(it), OPT, sizeof(OPT) - 1);
+        item_insert(it, &key);
+        if (i % 4 == 1) {
+            ck_assert(item_delete(&key));
+        }
+    }
+    id = it->id;
+    proc_sec += 2;
+
+    /* nothing is written unless requested */
+    slab_snapshot_tick();
+    ck_assert_int_eq(metrics.snapshot_item.counter, 0);
+
+    ck_assert_int_eq(slab_snapshot_request(), CC_OK);
+    slab_snapshot_tick();
+    ck_assert_int_le(metrics.snapshot_item.counter, NSCAN);
+    ck_assert_int_eq(metrics.snapshot_write.counter, 0);
+
+    /* all items are in one slab */
+    nloop = slabclass[id].nitem / NSCAN + 1;
+    for (i = 0; i < nloop && metrics.snapshot_write.counter == 0; i++) {
+        slab_snapshot_tick();
+    }
+    ck_assert_int_eq(metrics.snapshot_write.counter, 1);
+    ck_assert_int_eq(metrics.snapshot_item.counter, NKEY / 2);
+    ck_assert_int_eq(metrics.snapshot_ex.counter, 0);
+
+    /* changes after the snapshot are not in it, but teardown saves them in a
+     * new one, so keep the requested one aside to load it
+     */
+    key.len = sprintf(keystr, "key%04"PRIu32, 2);
+    ck_assert(item_delete(&key));
+    ck_assert_int_eq(rename(SNAPSHOT, SAVED), 0);
+    slab_teardown();
+    ck_assert_int_eq(access(SNAPSHOT, F_OK), 0);
+    ck_assert_int_eq(rename(SAVED, SNAPSHOT), 0);
+
+    metric_reset((struct metric *)&metrics, METRIC_CARDINALITY(metrics));
+    slab_setup(&options, &metrics);
+    ck_assert_int_eq(metrics.snapshot_load.counter, NKEY / 2);
+    ck_assert_int_eq(metrics.item_linked_curr.gauge, NKEY / 2);
+
+    for (i = 0; i < NKEY; i++) {
+        key.len = sprintf(keystr, "key%04"PRIu32, i);
+        key.data = keystr;
+        val.len = sprintf(valstr, "val%04"PRIu32, i);
+        it = item_get(&key);
+        if (i % 4 < 2) {
+            ck_assert_msg(it == NULL, "key %.*s is back", key.len, key.data);
+            continue;
+        }
+        ck_assert_msg(it != NULL, "key %.*s not loaded", key.len, key.data);
+        ck_assert_int_eq(it->vlen, val.len);
+        ck_assert_int_eq(cc_memcmp(item_data(it), valstr, val.len), 0);
+        ck_assert_int_eq(it->olen, sizeof(OPT) - 1);
+        ck_assert_int_eq(cc_memcmp(item_optional(it), OPT, it->olen), 0);
+        ck_assert_int_eq(it->expire_at, TIME + max_ttl);
+    }
+
+    slab_teardown();
+    unlink(SNAPSHOT);
+#undef NKEY
+#undef NSCAN
+#undef OPT
+#undef TIME
+#undef SNAPSHOT
+#undef SAVED
+}
+END_TEST
+
+START_TEST(test_memfd)
+{
+#define NKEY 1000
+#define MY_SLAB_SIZE (64 * KiB)
+#define MY_SLAB_NSLAB 16
+    struct bstring key, val;
+    item_rstatus_e status;
+    struct item *it;
+    char keystr[32], valstr[32];
+    uint32_t i;
+    int fd;
+
+    test_reset();
+    ck_assert_int_eq(slab_heap_fd(), -1);
+
+    option_load_default((struct option *)&options, OPTION_CARDINALITY(options));
+    options.slab_size.val.vuint = MY_SLAB_SIZE;
+    options.slab_mem.val.vuint = MY_SLAB_SIZE * MY_SLAB_NSLAB;
+    options.slab_item_max.val.vuint = MY_SLAB_SIZE - SLAB_HDR_SIZE;
+    options.slab_memfd.val.vbool = true;
+
+    test_teardown();
+    slab_setup(&options, &metrics);
+
+    time_update();
+    for (i = 0; i < NKEY; i++) {
+        key.len = sprintf(keystr, "key%04"PRIu32, i);
+        key.data = keystr;
+        val.len = sprintf(valstr, "val%04"PRIu32, i);
+        val.data = valstr;
+        status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+        ck_assert_int_eq(status, ITEM_OK);
+        item_insert(it, &key);
+    }
+
+    /* as a new process taking over the heap would */
+    fd = slab_heap_fd();
+    ck_assert_int_ge(fd, 0);
+    slab_teardown();
+    metric_reset((struct metric *)&metrics, METRIC_CARDINALITY(metrics));
+    slab_heap_inherit(fd);
+    slab_setup(&options, &metrics);
+
+    ck_assert_int_eq(metrics.item_linked_curr.gauge, NKEY);
+    for (i = 0; i < NKEY; i++) {
+        key.len = sprintf(keystr, "key%04"PRIu32, i);
+        key.data = keystr;
+        val.len = sprintf(valstr, "val%04"PRIu32, i);
+        it = item_get(&key);
+        ck_assert_msg(it != NULL, "key %.*s not recovered", key.len, key.data);
+        ck_assert_int_eq(it->vlen, val.len);
+        ck_assert_int_eq(cc_memcmp(item_data(it), valstr, val.len), 0);
+    }
+#undef NKEY
+#undef MY_SLAB_SIZE
+#undef MY_SLAB_NSLAB
+}
+END_TEST
+
 /*
  * test suite
  */
@@ -745,16 +1392,25 @@ slab_suite(void)
     tcase_add_test(tc_item, test_prepend_basic);
     tcase_add_test(tc_item, test_annex_sequence);
     tcase_add_test(tc_item, test_delete_basic);
+    tcase_add_test(tc_item, test_hash_grow);
     tcase_add_test(tc_item, test_update_basic);
     tcase_add_test(tc_item, test_flush_basic);
     tcase_add_test(tc_item, test_expire_basic);
     tcase_add_test(tc_item, test_expire_truncated);
+    tcase_add_test(tc_item, test_expire_scan);
+    tcase_add_test(tc_item, test_snapshot);
 
     TCase *tc_slab = tcase_create("slab api");
     suite_add_tcase(s, tc_slab);
     tcase_add_test(tc_slab, test_evict_lru_basic);
+    tcase_add_test(tc_slab, test_evict_clock);
+    tcase_add_test(tc_slab, test_admit);
+    tcase_add_test(tc_slab, test_automove);
     tcase_add_test(tc_slab, test_refcount);
+    tcase_add_test(tc_slab, test_pin);
     tcase_add_test(tc_slab, test_evict_refcount);
+    tcase_add_test(tc_slab, test_numa);
+    tcase_add_test(tc_slab, test_memfd);
 
     return s;
 }
@@ -1,3 +1,4 @@
+#include <storage/slab/hashtable.h>
 #include <storage/slab/item.h>
 #include <storage/slab/slab.h>
 
@@ -17,6 +18,7 @@
 #define SUITE_NAME "slab"
 #define DEBUG_LOG  SUITE_NAME ".log"
 #define DATAPOOL_PATH "./slab_datapool.pelikan"
+#define HASH_DATAPOOL_PATH "./slab_hash_datapool.pelikan"
 #define METRIC_STAT_FMT "STATS %s %s \n"
 #define METRIC_BUF_LEN 35
 #define UPDATED_VAL "new_val"
@@ -1262,6 +1264,168 @@ START_TEST(test_crud_multiple_keys)
 }
 END_TEST
 
+/**
+ * Tests recovery with one and several threads, and that items allocated after
+ * a restart do not overwrite the ones recovered
+ */
+START_TEST(test_recovery_nthread)
+{
+#define NKEY 1000
+#define VAL "val"
+    uint32_t nthread[] = {1, 3};
+    char buf[NKEY * 2][8];
+    struct bstring key, val;
+    item_rstatus_e status;
+    struct item *it;
+    uint32_t i;
+
+    test_teardown(1);
+    option_load_default((struct option *)&options, OPTION_CARDINALITY(options));
+    options.slab_datapool.val.vstr = DATAPOOL_PATH;
+    options.slab_recovery_nthread.val.vuint = nthread[_i];
+    slab_setup(&options, &metrics);
+
+    val = str2bstr(VAL);
+    time_update();
+    for (i = 0; i < NKEY * 2; i++) {
+        if (i == NKEY) {
+            bstring_set_cstr(&key, buf[0]);
+            ck_assert(item_pin(item_get(&key)));
+            metric_reset((struct metric *)&metrics, METRIC_CARDINALITY(metrics));
+            test_teardown(0);
+            slab_setup(&options, &metrics);
+            ck_assert_int_eq(metrics.item_linked_curr.gauge, NKEY);
+            /* the pin left at teardown is gone */
+            it = item_get(&key);
+            ck_assert_int_eq(it->refcount, 0);
+            ck_assert_int_eq(item_to_slab(it)->refcount, 0);
+        }
+        key.len = (uint32_t)cc_snprintf(buf[i], sizeof(buf[i]), "%"PRIu32, i);
+        key.data = buf[i];
+        status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+        ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+        item_insert(it, &key);
+    }
+
+    for (i = 0; i < NKEY * 2; i++) {
+        key.len = (uint32_t)strlen(buf[i]);
+        key.data = buf[i];
+        it = item_get(&key);
+        ck_assert_msg(it != NULL, "item_get could not find key %.*s", key.len, key.data);
+        ck_assert_int_eq(it->klen, key.len);
+        ck_assert_int_eq(cc_memcmp(item_key(it), key.data, key.len), 0);
+    }
+
+    test_reset(1);
+#undef NKEY
+#undef VAL
+}
+END_TEST
+
+/**
+ * Tests restarting with the hash index kept in a data pool, with the heap at
+ * the same address and at another one
+ */
+START_TEST(test_hash_datapool)
+{
+#define NKEY 1000
+#define VAL "val"
+    char buf[NKEY][8];
+    struct bstring key, val;
+    item_rstatus_e status;
+    struct item *it;
+    struct slab *s;
+    uint32_t i, nfree;
+    uint8_t id;
+
+    test_teardown(1);
+    unlink(HASH_DATAPOOL_PATH);
+    option_load_default((struct option *)&options, OPTION_CARDINALITY(options));
+    options.slab_datapool.val.vstr = DATAPOOL_PATH;
+    options.slab_hash_datapool.val.vstr = HASH_DATAPOOL_PATH;
+    slab_setup(&options, &metrics);
+
+    val = str2bstr(VAL);
+    time_update();
+    for (i = 0; i < NKEY; i++) {
+        key.len = (uint32_t)cc_snprintf(buf[i], sizeof(buf[i]), "%"PRIu32, i);
+        key.data = buf[i];
+        status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+        ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+        item_insert(it, &key);
+    }
+    for (i = 0; i < NKEY; i += 4) {
+        bstring_set_cstr(&key, buf[i]);
+        ck_assert(item_delete(&key));
+    }
+    /* pins are left behind on one item, and on another that is deleted */
+    bstring_set_cstr(&key, buf[101]);
+    ck_assert(item_pin(item_get(&key)));
+    bstring_set_cstr(&key, buf[102]);
+    ck_assert(item_pin(item_get(&key)));
+    ck_assert(item_delete(&key));
+    id = it->id;
+    nfree = slabclass[id].nfree_itemq;
+    bstring_set_cstr(&key, "reserved");
+    status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+    ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+    s = item_to_slab(it);
+    ck_assert_int_eq(s->refcount, 3); /* the reservation and the two pins */
+
+    slab_metrics_st copy = metrics;
+    if (_i == 0) {
+        test_teardown(0);
+        metric_reset((struct metric *)&metrics, METRIC_CARDINALITY(metrics));
+        slab_setup(&options, &metrics);
+    } else {
+        void *pmem_addr = test_get_pmem_mapping_addr();
+        test_teardown(0);
+        metric_reset((struct metric *)&metrics, METRIC_CARDINALITY(metrics));
+        void *addr = mmap(pmem_addr, pagesize, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        ck_assert_msg(addr == pmem_addr, "could not map at the address of the data pool");
+        slab_setup(&options, &metrics);
+        munmap(addr, pagesize);
+    }
+
+    ck_assert(hashtable_attached(hash_table));
+    ck_assert_int_eq(hash_table->nhash_item, NKEY - NKEY / 4 - 1);
+    ck_assert_int_eq(metrics.item_linked_curr.gauge, copy.item_linked_curr.gauge);
+    ck_assert_int_eq(metrics.item_keyval_byte.gauge, copy.item_keyval_byte.gauge);
+    /* the reserved and the deleted item went back to the free q */
+    ck_assert_int_eq(slabclass[id].nfree_itemq, nfree + 1);
+    ck_assert_int_eq(perslab[id].item_free.gauge, nfree + 1);
+    ck_assert_int_eq(metrics.item_curr.gauge, copy.item_curr.gauge - 2);
+    /* and no pin is left on the slab */
+    bstring_set_cstr(&key, buf[101]);
+    it = item_get(&key);
+    ck_assert_msg(it != NULL, "item_get could not find key %s", buf[101]);
+    ck_assert_int_eq(it->refcount, 0);
+    ck_assert_int_eq(item_to_slab(it)->refcount, 0);
+
+    for (i = 0; i < NKEY; i++) {
+        bstring_set_cstr(&key, buf[i]);
+        it = item_get(&key);
+        if (i % 4 == 0 || i == 102) {
+            ck_assert_msg(it == NULL, "deleted key %s found", buf[i]);
+            status = item_reserve(&it, &key, &val, val.len, 0, INT32_MAX);
+            ck_assert_msg(status == ITEM_OK, "item_reserve not OK - return status %d", status);
+            ck_assert(it->in_freeq == 0);
+            item_insert(it, &key);
+        } else {
+            ck_assert_msg(it != NULL, "item_get could not find key %s", buf[i]);
+            ck_assert_int_eq(cc_memcmp(item_key(it), buf[i], key.len), 0);
+        }
+    }
+    ck_assert_int_eq(hash_table->nhash_item, NKEY);
+
+    test_teardown(1);
+    unlink(HASH_DATAPOOL_PATH);
+    test_setup();
+#undef NKEY
+#undef VAL
+}
+END_TEST
+
 START_TEST(test_metrics_insert_basic)
 {
 #define KEY "key"
@@ -1725,6 +1889,8 @@ slab_suite(void)
     TCase *tc_multiple = tcase_create("multiple keys");
     suite_add_tcase(s, tc_multiple);
     tcase_add_loop_test(tc_multiple, test_crud_multiple_keys, 0, 3);
+    tcase_add_loop_test(tc_multiple, test_recovery_nthread, 0, 2);
+    tcase_add_loop_test(tc_multiple, test_hash_datapool, 0, 2);
 
     TCase *tc_smetrics = tcase_create("slab metrics");
     suite_add_tcase(s, tc_smetrics);